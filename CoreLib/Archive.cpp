@@ -0,0 +1,280 @@
+#include "Archive.h"
+#include "Compression.h"
+#include "LibIO.h"
+#include <algorithm>
+#include <ctype.h>
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		using namespace CoreLib::Basic;
+
+		static List<RefPtr<AssetArchive>> & GetMountedArchives()
+		{
+			static List<RefPtr<AssetArchive>> archives;
+			return archives;
+		}
+
+		static bool IsPathEqual(const char * path0, const char * path1, int length)
+		{
+#ifdef _WIN32
+			for (int i = 0; i < length; i++)
+			{
+				if (tolower((unsigned char)path0[i]) != tolower((unsigned char)path1[i]))
+					return false;
+			}
+			return true;
+#else
+			return memcmp(path0, path1, length) == 0;
+#endif
+		}
+
+		String AssetArchive::NormalizePath(const String & path)
+		{
+			List<String> dirs;
+			for (auto & dir : Path::Split(path))
+			{
+				if (dir == ".")
+					continue;
+				if (dir == ".." && dirs.Count() && dirs.Last() != "..")
+					dirs.RemoveAt(dirs.Count() - 1);
+				else
+					dirs.Add(dir);
+			}
+			StringBuilder sb;
+			if (path.StartsWith("\\\\") || path.StartsWith("//"))
+				sb << "//";
+			else if (path.StartsWith("/") || path.StartsWith("\\"))
+				sb << "/";
+			for (int i = 0; i < dirs.Count(); i++)
+			{
+				if (i)
+					sb << "/";
+				sb << dirs[i];
+			}
+			return sb.ProduceString();
+		}
+
+		uint64_t AssetArchive::GetPathHash(const String & normalizedPath)
+		{
+			// FNV-1a of the lower case path, so that the index is the same on case insensitive file systems
+			uint64_t hash = 14695981039346656037ull;
+			for (int i = 0; i < normalizedPath.Length(); i++)
+			{
+				hash ^= (uint64_t)tolower((unsigned char)normalizedPath[i]);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		AssetArchive::AssetArchive(const String & fileName, const String & pRootDirectory)
+		{
+			rootDirectory = NormalizePath(pRootDirectory);
+			file = new MemoryMappedFile(fileName);
+			auto buffer = file->GetBuffer();
+			auto size = file->GetSize();
+			AssetArchiveHeader header, expectedHeader;
+			if (size < (Int64)sizeof(header))
+				throw IOException("'" + fileName + "' is not an asset archive.");
+			memcpy(&header, buffer, sizeof(header));
+			if (memcmp(header.Identifier, expectedHeader.Identifier, sizeof(header.Identifier)) != 0)
+				throw IOException("'" + fileName + "' is not an asset archive.");
+			if (header.Version != expectedHeader.Version)
+				throw IOException("'" + fileName + "' has an unsupported archive version.");
+			Int64 pathsOffset = header.IndexOffset + (Int64)header.EntryCount * (Int64)sizeof(AssetArchiveEntry);
+			if (header.EntryCount < 0 || header.IndexOffset < (Int64)sizeof(header) ||
+				header.IndexOffset % AssetArchiveDataAlignment != 0 || pathsOffset > size)
+				throw IOException("'" + fileName + "' is corrupted.");
+			entries = (AssetArchiveEntry*)(buffer + header.IndexOffset);
+			entryCount = header.EntryCount;
+			paths = (const char*)(buffer + pathsOffset);
+			Int64 pathsSize = size - pathsOffset;
+			for (int i = 0; i < entryCount; i++)
+			{
+				auto & entry = entries[i];
+				if (entry.Offset < (Int64)sizeof(header) || entry.CompressedSize < 0 || entry.Size < 0 ||
+					entry.Offset + entry.CompressedSize > header.IndexOffset || entry.Size > 0x7FFFFFFF ||
+					entry.PathOffset < 0 || entry.PathLength < 0 || (Int64)entry.PathOffset + entry.PathLength > pathsSize ||
+					(i > 0 && entries[i - 1].PathHash > entry.PathHash))
+					throw IOException("'" + fileName + "' is corrupted.");
+			}
+		}
+
+		String AssetArchive::GetEntryPath(int id)
+		{
+			return String(paths + entries[id].PathOffset, entries[id].PathLength);
+		}
+
+		int AssetArchive::FindEntry(const String & relativePath)
+		{
+			auto hash = GetPathHash(relativePath);
+			auto entry = std::lower_bound(entries, entries + entryCount, hash, [](const AssetArchiveEntry & e, uint64_t h)
+			{
+				return e.PathHash < h;
+			});
+			for (; entry < entries + entryCount && entry->PathHash == hash; entry++)
+			{
+				if (entry->PathLength == relativePath.Length() &&
+					IsPathEqual(paths + entry->PathOffset, relativePath.Buffer(), relativePath.Length()))
+					return (int)(entry - entries);
+			}
+			return -1;
+		}
+
+		RefPtr<AssetArchiveFile> AssetArchive::OpenEntry(int id, bool privateCopy)
+		{
+			auto & entry = entries[id];
+			RefPtr<AssetArchiveFile> result = new AssetArchiveFile();
+			auto entryData = MakeArrayView(file->GetBuffer() + entry.Offset, (int)entry.CompressedSize);
+			if (entry.CompressedSize == entry.Size)
+			{
+				if (privateCopy)
+				{
+					result->decompressedData.AddRange(entryData.Buffer(), entryData.Count());
+					result->data = result->decompressedData.GetArrayView();
+				}
+				else
+					result->data = entryData;
+			}
+			else
+			{
+				result->decompressedData.SetSize((int)entry.Size);
+				DecompressBlock(entryData, result->decompressedData.GetArrayView());
+				result->data = result->decompressedData.GetArrayView();
+			}
+			return result;
+		}
+
+		void AssetArchive::Mount(RefPtr<AssetArchive> archive)
+		{
+			GetMountedArchives().Add(archive);
+		}
+
+		void AssetArchive::UnmountAll()
+		{
+			GetMountedArchives() = List<RefPtr<AssetArchive>>();
+		}
+
+		// finds the archive and entry of a file, the path is normalized only when an archive is mounted
+		static bool FindArchiveEntry(const String & fileName, AssetArchive * & archive, int & entryId)
+		{
+			auto & archives = GetMountedArchives();
+			if (archives.Count() == 0)
+				return false;
+			auto path = AssetArchive::NormalizePath(fileName);
+			for (auto & mountedArchive : archives)
+			{
+				auto & root = mountedArchive->GetRootDirectory();
+				String relativePath;
+				if (root.Length() == 0)
+					relativePath = path;
+				else if (path.Length() > root.Length() + 1 && path[root.Length()] == '/' &&
+					IsPathEqual(path.Buffer(), root.Buffer(), root.Length()))
+					relativePath = path.SubString(root.Length() + 1, path.Length() - root.Length() - 1);
+				else
+					continue;
+				entryId = mountedArchive->FindEntry(relativePath);
+				if (entryId != -1)
+				{
+					archive = mountedArchive.Ptr();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		RefPtr<AssetArchiveFile> AssetArchive::Open(const String & fileName, bool privateCopy)
+		{
+			AssetArchive * archive;
+			int entryId;
+			if (FindArchiveEntry(fileName, archive, entryId))
+				return archive->OpenEntry(entryId, privateCopy);
+			return nullptr;
+		}
+
+		bool AssetArchive::Contains(const String & fileName)
+		{
+			AssetArchive * archive;
+			int entryId;
+			return FindArchiveEntry(fileName, archive, entryId);
+		}
+
+		AssetArchiveWriter::AssetArchiveWriter(const String & fileName)
+			: writer(new FileStream(fileName, FileMode::Create))
+		{
+			// the header is rewritten with the index offset when the archive is closed
+			AssetArchiveHeader header;
+			writer.Write(header);
+			position = sizeof(header);
+		}
+
+		void AssetArchiveWriter::Pad()
+		{
+			int padding = (int)((AssetArchiveDataAlignment - position % AssetArchiveDataAlignment) % AssetArchiveDataAlignment);
+			if (padding)
+			{
+				unsigned char zeros[AssetArchiveDataAlignment] = {};
+				writer.Write(zeros, padding);
+				position += padding;
+			}
+		}
+
+		void AssetArchiveWriter::AddFile(const String & relativePath, ArrayView<unsigned char> data, bool allowCompression)
+		{
+			PendingEntry pending;
+			pending.Path = AssetArchive::NormalizePath(relativePath);
+#ifdef _WIN32
+			if (!addedPaths.Add(pending.Path.ToLower()))
+#else
+			if (!addedPaths.Add(pending.Path))
+#endif
+				throw ArgumentException("'" + relativePath + "' is already in the archive.");
+			Pad();
+			auto & entry = pending.Entry;
+			entry.PathHash = AssetArchive::GetPathHash(pending.Path);
+			entry.Offset = position;
+			entry.Size = data.Count();
+			entry.CompressedSize = data.Count();
+			entry.PathOffset = 0;
+			entry.PathLength = pending.Path.Length();
+			List<unsigned char> compressedData;
+			if (allowCompression && data.Count())
+			{
+				compressedData = CompressBlock(data);
+				if (compressedData.Count() < data.Count() - data.Count() / 8)
+				{
+					entry.CompressedSize = compressedData.Count();
+					data = compressedData.GetArrayView();
+				}
+			}
+			writer.Write(data.Buffer(), data.Count());
+			position += data.Count();
+			pendingEntries.Add(_Move(pending));
+		}
+
+		void AssetArchiveWriter::Close()
+		{
+			Pad();
+			AssetArchiveHeader header;
+			header.EntryCount = pendingEntries.Count();
+			header.IndexOffset = position;
+			std::stable_sort(pendingEntries.begin(), pendingEntries.end(), [](const PendingEntry & e0, const PendingEntry & e1)
+			{
+				return e0.Entry.PathHash < e1.Entry.PathHash;
+			});
+			int pathOffset = 0;
+			for (auto & pending : pendingEntries)
+			{
+				pending.Entry.PathOffset = pathOffset;
+				pathOffset += pending.Path.Length();
+				writer.Write(pending.Entry);
+			}
+			for (auto & pending : pendingEntries)
+				writer.Write(pending.Path.Buffer(), pending.Path.Length());
+			writer.GetStream()->Seek(SeekOrigin::Start, 0);
+			writer.Write(header);
+			writer.Close();
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef CORE_LIB_ARCHIVE_H
+#define CORE_LIB_ARCHIVE_H
+
+#include "Basic.h"
+#include "Stream.h"
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		// Asset archive (.pak): the contents of a directory tree packed into a single file. The layout is
+		//   header | entry data, each aligned to 16 bytes | index | path strings
+		// The index is sorted by a 64-bit hash of the relative path of each entry, so that a lookup is a binary
+		// search. Entries are stored as-is or as a single block of CompressBlock.
+		struct AssetArchiveHeader
+		{
+			char Identifier[8] = { 'S', 'P', 'A', 'K', 0, 0, 0, 0 };
+			int Version = 1;
+			int EntryCount = 0;
+			Int64 IndexOffset = 0;
+		};
+
+		struct AssetArchiveEntry
+		{
+			uint64_t PathHash;
+			Int64 Offset;
+			// equal to Size for entries that are stored uncompressed
+			Int64 CompressedSize;
+			Int64 Size;
+			int PathOffset;
+			int PathLength;
+		};
+
+		static const int AssetArchiveDataAlignment = 16;
+
+		// data of an archive entry. Uncompressed entries opened for reading point into the mapped archive, which
+		// stays mapped until it is unmounted and is shared by all readers of the entry.
+		class AssetArchiveFile : public CoreLib::Basic::Object
+		{
+			friend class AssetArchive;
+		private:
+			CoreLib::List<unsigned char> decompressedData;
+			CoreLib::ArrayView<unsigned char> data;
+		public:
+			CoreLib::ArrayView<unsigned char> GetData()
+			{
+				return data;
+			}
+		};
+
+		class AssetArchive : public CoreLib::Basic::Object
+		{
+		private:
+			RefPtr<MemoryMappedFile> file;
+			String rootDirectory;
+			AssetArchiveEntry * entries = nullptr;
+			int entryCount = 0;
+			const char * paths = nullptr;
+		public:
+			// maps an archive whose entries are looked up relative to rootDirectory. Throws IOException if the
+			// file is not a valid archive.
+			AssetArchive(const String & fileName, const String & rootDirectory);
+			const String & GetRootDirectory()
+			{
+				return rootDirectory;
+			}
+			int GetEntryCount()
+			{
+				return entryCount;
+			}
+			const AssetArchiveEntry & GetEntry(int id)
+			{
+				return entries[id];
+			}
+			String GetEntryPath(int id);
+			// returns the id of the entry with the given path relative to the root directory, or -1
+			int FindEntry(const String & relativePath);
+			// entries opened as a private copy never share their data, so that the caller may modify it in place
+			RefPtr<AssetArchiveFile> OpenEntry(int id, bool privateCopy = false);
+
+			// canonical form of a path used by the index: '/' separated, with "." and ".." resolved
+			static String NormalizePath(const String & path);
+			static uint64_t GetPathHash(const String & normalizedPath);
+
+			// Archives are mounted at start-up before any loading thread runs and unmounted at shutdown; the
+			// functions below read the list of mounted archives without locking.
+			static void Mount(RefPtr<AssetArchive> archive);
+			static void UnmountAll();
+			// finds a file in the mounted archives, in the order they are mounted. Returns null if no archive
+			// contains the file.
+			static RefPtr<AssetArchiveFile> Open(const String & fileName, bool privateCopy = false);
+			static bool Contains(const String & fileName);
+		};
+
+		// Writes an archive. Files are added with the path they are looked up with, relative to the root
+		// directory the archive is mounted at.
+		class AssetArchiveWriter
+		{
+		private:
+			struct PendingEntry
+			{
+				String Path;
+				AssetArchiveEntry Entry;
+			};
+			BinaryWriter writer;
+			CoreLib::List<PendingEntry> pendingEntries;
+			CoreLib::HashSet<String> addedPaths;
+			Int64 position = 0;
+			void Pad();
+		public:
+			AssetArchiveWriter(const String & fileName);
+			// entries that do not shrink by at least 1/8 when compressed are stored uncompressed
+			void AddFile(const String & relativePath, CoreLib::ArrayView<unsigned char> data, bool allowCompression = true);
+			// writes the index and closes the file
+			void Close();
+			int GetEntryCount()
+			{
+				return pendingEntries.Count();
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include "Compression.h"
+#include "Stream.h"
+#include <string.h>
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		using namespace CoreLib::Basic;
+
+		static const int MinMatchLength = 4;
+		// the last 5 bytes of a block are always literals, and no match starts in the last 12 bytes
+		static const int LastLiteralCount = 5;
+		static const int MatchStartLimit = 12;
+		static const int MaxMatchOffset = 65535;
+		static const int HashBits = 16;
+
+		static inline unsigned int Read32(const unsigned char * ptr)
+		{
+			unsigned int result;
+			memcpy(&result, ptr, sizeof(result));
+			return result;
+		}
+
+		static inline int HashSequence(unsigned int sequence)
+		{
+			return (int)((sequence * 2654435761u) >> (32 - HashBits));
+		}
+
+		static inline unsigned char * WriteLength(unsigned char * dst, int length)
+		{
+			while (length >= 255)
+			{
+				*dst++ = 255;
+				length -= 255;
+			}
+			*dst++ = (unsigned char)length;
+			return dst;
+		}
+
+		static unsigned char * WriteSequence(unsigned char * dst, const unsigned char * literals, int literalCount, int offset, int matchLength)
+		{
+			unsigned char * token = dst++;
+			if (literalCount >= 15)
+			{
+				*token = 15 << 4;
+				dst = WriteLength(dst, literalCount - 15);
+			}
+			else
+				*token = (unsigned char)(literalCount << 4);
+			memcpy(dst, literals, literalCount);
+			dst += literalCount;
+			if (matchLength == 0)
+				return dst;
+			*dst++ = (unsigned char)(offset & 0xFF);
+			*dst++ = (unsigned char)(offset >> 8);
+			int length = matchLength - MinMatchLength;
+			if (length >= 15)
+			{
+				*token |= 15;
+				dst = WriteLength(dst, length - 15);
+			}
+			else
+				*token |= (unsigned char)length;
+			return dst;
+		}
+
+		int GetMaxCompressedSize(int inputSize)
+		{
+			return inputSize + inputSize / 255 + 16;
+		}
+
+		int CompressBlock(ArrayView<unsigned char> input, unsigned char * output)
+		{
+			const unsigned char * src = input.Buffer();
+			int size = input.Count();
+			unsigned char * dst = output;
+			// an empty block is a single token without literals, and input.Buffer() may be null
+			if (size == 0)
+			{
+				*dst = 0;
+				return 1;
+			}
+			int anchor = 0;
+			if (size > MatchStartLimit)
+			{
+				List<int> hashTable;
+				hashTable.SetSize(1 << HashBits);
+				for (auto & entry : hashTable)
+					entry = -1;
+				int matchEndLimit = size - LastLiteralCount;
+				int pos = 0;
+				while (pos + MatchStartLimit <= size)
+				{
+					unsigned int sequence = Read32(src + pos);
+					int hash = HashSequence(sequence);
+					int ref = hashTable[hash];
+					hashTable[hash] = pos;
+					if (ref < 0 || pos - ref > MaxMatchOffset || Read32(src + ref) != sequence)
+					{
+						// step faster through data that does not compress
+						pos += 1 + ((pos - anchor) >> 6);
+						continue;
+					}
+					while (pos > anchor && ref > 0 && src[pos - 1] == src[ref - 1])
+					{
+						pos--;
+						ref--;
+					}
+					int length = MinMatchLength;
+					while (pos + length < matchEndLimit && src[pos + length] == src[ref + length])
+						length++;
+					dst = WriteSequence(dst, src + anchor, pos - anchor, pos - ref, length);
+					pos += length;
+					anchor = pos;
+					if (pos + MatchStartLimit <= size)
+						hashTable[HashSequence(Read32(src + pos - 2))] = pos - 2;
+				}
+			}
+			dst = WriteSequence(dst, src + anchor, size - anchor, 0, 0);
+			return (int)(dst - output);
+		}
+
+		List<unsigned char> CompressBlock(ArrayView<unsigned char> input)
+		{
+			List<unsigned char> result;
+			result.SetSize(GetMaxCompressedSize(input.Count()));
+			result.SetSize(CompressBlock(input, result.Buffer()));
+			return result;
+		}
+
+		void DecompressBlock(ArrayView<unsigned char> input, ArrayView<unsigned char> output)
+		{
+			const unsigned char * src = input.Buffer();
+			unsigned char * dst = output.Buffer();
+			int inputSize = input.Count();
+			int outputSize = output.Count();
+			// empty output may have a null buffer, so do not run the copy loop for it
+			if (outputSize == 0)
+			{
+				if (inputSize > 1 || (inputSize == 1 && src[0] != 0))
+					throw IOException("compressed block does not match the expected size.");
+				return;
+			}
+			int inPos = 0, outPos = 0;
+			// a length never exceeds the output size, checking that before adding each byte also keeps the sum
+			// from overflowing on long runs of 255
+			auto readLength = [&](int length)
+			{
+				if (length == 15)
+				{
+					unsigned char b;
+					do
+					{
+						if (inPos >= inputSize)
+							throw IOException("compressed block is truncated.");
+						b = src[inPos++];
+						if (b > outputSize - length)
+							throw IOException("compressed block is corrupted.");
+						length += b;
+					} while (b == 255);
+				}
+				return length;
+			};
+			while (true)
+			{
+				if (inPos >= inputSize)
+					throw IOException("compressed block is truncated.");
+				int token = src[inPos++];
+				int literalCount = readLength(token >> 4);
+				if (literalCount > inputSize - inPos || literalCount > outputSize - outPos)
+					throw IOException("compressed block is corrupted.");
+				memcpy(dst + outPos, src + inPos, literalCount);
+				inPos += literalCount;
+				outPos += literalCount;
+				if (inPos == inputSize)
+					break;
+				if (inputSize - inPos < 2)
+					throw IOException("compressed block is truncated.");
+				int offset = src[inPos] | (src[inPos + 1] << 8);
+				inPos += 2;
+				int matchLength = readLength(token & 15) + MinMatchLength;
+				if (offset == 0 || offset > outPos || matchLength > outputSize - outPos)
+					throw IOException("compressed block is corrupted.");
+				unsigned char * match = dst + outPos - offset;
+				if (offset >= matchLength)
+					memcpy(dst + outPos, match, matchLength);
+				else
+				{
+					for (int i = 0; i < matchLength; i++)
+						dst[outPos + i] = match[i];
+				}
+				outPos += matchLength;
+			}
+			if (outPos != outputSize)
+				throw IOException("compressed block does not match the expected size.");
+		}
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef CORE_LIB_COMPRESSION_H
+#define CORE_LIB_COMPRESSION_H
+
+#include "Basic.h"
+
+namespace CoreLib
+{
+	namespace IO
+	{
+		// Block codec in the LZ4 block format: a block is a sequence of literal runs and back references into the
+		// previous 64KB of output. Decompression is a tight copy loop, which makes the codec suitable for data that is
+		// read far more often than it is written.
+
+		// size of the output buffer needed to compress inputSize bytes in the worst case
+		int GetMaxCompressedSize(int inputSize);
+		// compresses input into output, which must hold at least GetMaxCompressedSize(input.Count()) bytes, and
+		// returns the size of the compressed block
+		int CompressBlock(CoreLib::ArrayView<unsigned char> input, unsigned char * output);
+		CoreLib::List<unsigned char> CompressBlock(CoreLib::ArrayView<unsigned char> input);
+		// decompresses a block into output, whose size must be the size of the original data. Throws IOException if
+		// the block is malformed.
+		void DecompressBlock(CoreLib::ArrayView<unsigned char> input, CoreLib::ArrayView<unsigned char> output);
+	}
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "Bitmap.h"
 #include "../Stream.h"
 #include "../LibIO.h"
+#include "../Archive.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "lodepng.h"
@@ -63,6 +64,10 @@ namespace CoreLib
 			int channel = 4;
 			if (fileName.EndsWith("pfm") || fileName.EndsWith("PFM"))
 				pixels = LoadPFM(fileName, width, height);
+			// stb_image reads from the file system, images in a mounted archive are decoded from their entry
+			else if (auto entry = IO::AssetArchive::Open(fileName))
+				pixels = (VectorMath::Vec4 *)stbi_loadf_from_memory(entry->GetData().Buffer(), entry->GetData().Count(),
+					&width, &height, &channel, 4);
 			else
 			{
 #ifdef _WIN32
@@ -83,17 +88,22 @@ namespace CoreLib
 		{
 			pixels = nullptr;
 			int channel = 0;
+			if (auto entry = IO::AssetArchive::Open(fileName))
+				pixels = stbi_load_from_memory(entry->GetData().Buffer(), entry->GetData().Count(), &width, &height, &channel, 4);
+			else
+			{
 #ifdef _WIN32
-			FILE * f;
-			_wfopen_s(&f, fileName.ToWString(), L"rb");
-            if (f)
-            {
-				pixels = stbi_load_from_file(f, &width, &height, &channel, 4);
-				fclose(f);
-            }
+				FILE * f;
+				_wfopen_s(&f, fileName.ToWString(), L"rb");
+				if (f)
+				{
+					pixels = stbi_load_from_file(f, &width, &height, &channel, 4);
+					fclose(f);
+				}
 #else
-			pixels = stbi_load(fileName.Buffer(), &width, &height, &channel, 4);
+				pixels = stbi_load(fileName.Buffer(), &width, &height, &channel, 4);
 #endif
+			}
 			isTransparent = (channel == 4);
 			if (!pixels)
 				throw IO::IOException("Cannot load image \"" + fileName + "\"");
@@ -1,5 +1,6 @@
 #include "LibIO.h"
 #include "Exception.h"
+#include "Archive.h"
 #ifndef __STDC__
 #define __STDC__ 1
 #endif
@@ -33,6 +34,8 @@ namespace CoreLib
 
 		bool File::Exists(const String & fileName)
 		{
+			if (AssetArchive::Contains(fileName))
+				return true;
 #if defined(CPP17_FILESYSTEM)
 			return filesystem::exists(filesystem::u8path(fileName.Buffer()));
 #elif defined(_WIN32)
@@ -44,6 +47,53 @@ namespace CoreLib
 #endif
 		}
 
+		bool File::Delete(const String & fileName)
+		{
+#if defined(CPP17_FILESYSTEM)
+			std::error_code err;
+			return filesystem::remove(filesystem::u8path(fileName.Buffer()), err);
+#elif defined(_WIN32)
+			return ::_wremove(((String)fileName).ToWString()) == 0;
+#else
+			return ::remove(fileName.Buffer()) == 0;
+#endif
+		}
+
+		bool File::Move(const String & fileName, const String & newFileName)
+		{
+#if defined(CPP17_FILESYSTEM)
+			std::error_code err;
+			filesystem::rename(filesystem::u8path(fileName.Buffer()), filesystem::u8path(newFileName.Buffer()), err);
+			return !err;
+#elif defined(_WIN32)
+			::_wremove(((String)newFileName).ToWString());
+			return ::_wrename(((String)fileName).ToWString(), ((String)newFileName).ToWString()) == 0;
+#else
+			return ::rename(fileName.Buffer(), newFileName.Buffer()) == 0;
+#endif
+		}
+
+		Int64 File::GetLastWriteTime(const String & fileName)
+		{
+#if defined(CPP17_FILESYSTEM)
+			std::error_code err;
+			auto time = filesystem::last_write_time(filesystem::u8path(fileName.Buffer()), err);
+			if (err)
+				throw IOException("Cannot access file '" + fileName + "'");
+			return (Int64)time.time_since_epoch().count();
+#elif defined(_WIN32)
+			struct _stat64 statVar;
+			if (::_wstat64(((String)fileName).ToWString(), &statVar) == -1)
+				throw IOException("Cannot access file '" + fileName + "'");
+			return (Int64)statVar.st_mtime;
+#else
+			struct stat statVar;
+			if (::stat(fileName.Buffer(), &statVar) != 0)
+				throw IOException("Cannot access file '" + fileName + "'");
+			return (Int64)statVar.st_mtime;
+#endif
+		}
+
 		String Path::TruncateExt(const String & path)
 		{
 			int dotPos = path.LastIndexOf('.');
@@ -297,16 +347,13 @@ namespace CoreLib
 		CoreLib::Basic::List<unsigned char> File::ReadAllBytes(const CoreLib::Basic::String & fileName)
 		{
 			RefPtr<FileStream> fs = new FileStream(fileName, FileMode::Open, FileAccess::Read, FileShare::ReadWrite);
+			fs->Seek(SeekOrigin::End, 0);
+			auto size = fs->GetPosition();
+			fs->Seek(SeekOrigin::Start, 0);
 			List<unsigned char> buffer;
-			while (!fs->IsEnd())
-			{
-				unsigned char ch;
-				int read = (int)fs->Read(&ch, 1);
-				if (read)
-					buffer.Add(ch);
-				else
-					break;
-			}
+			buffer.SetSize((int)size);
+			if (size)
+				buffer.SetSize((int)fs->Read(buffer.Buffer(), size));
 			return _Move(buffer);
 		}
 
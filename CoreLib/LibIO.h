@@ -18,6 +18,12 @@ namespace CoreLib
 			static void WriteAllText(const CoreLib::Basic::String & fileName, const CoreLib::Basic::String & text);
 			static CoreLib::Basic::List<unsigned char> ReadAllBytes(const CoreLib::Basic::String & fileName);
             static void WriteAllBytes(const CoreLib::Basic::String & fileName, void * buffer, size_t size);
+			// time of the last modification in an unspecified unit, only meaningful when compared to other files
+			static CoreLib::Int64 GetLastWriteTime(const CoreLib::Basic::String & fileName);
+			// returns false if the file does not exist or cannot be deleted
+			static bool Delete(const CoreLib::Basic::String & fileName);
+			// renames a file, replacing the destination if it exists. Returns false if the file cannot be renamed
+			static bool Move(const CoreLib::Basic::String & fileName, const CoreLib::Basic::String & newFileName);
 		};
 
 		enum class DirectoryEntryType
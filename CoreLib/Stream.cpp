@@ -1,8 +1,15 @@
 #include "Stream.h"
 #ifdef _WIN32
 #include <share.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 #include "LibIO.h"
+#include "Archive.h"
 
 namespace CoreLib
 {
@@ -19,6 +26,17 @@ namespace CoreLib
 		}
 		void FileStream::Init(const CoreLib::Basic::String & fileName, FileMode fileMode, FileAccess access, FileShare share)
 		{
+			if (fileMode == FileMode::Open && access == FileAccess::Read)
+			{
+				auto entry = AssetArchive::Open(fileName);
+				if (entry)
+				{
+					this->fileAccess = FileAccess::Read;
+					archiveStream = new MemoryStream(entry->GetData());
+					archiveFile = entry;
+					return;
+				}
+			}
 			const wchar_t * mode = L"rt";
 			const char* modeMBCS = "rt";
 			switch (fileMode)
@@ -135,6 +153,8 @@ namespace CoreLib
 		}
 		Int64 FileStream::GetPosition()
 		{
+			if (archiveStream)
+				return archiveStream->GetPosition();
 #ifdef _WIN32
 			fpos_t pos;
 			fgetpos(handle, &pos);
@@ -166,6 +186,14 @@ namespace CoreLib
 				throw NotSupportedException("Unsupported seek origin.");
 				break;
 			}
+			if (archiveStream)
+			{
+				if (origin == SeekOrigin::Current)
+					archiveStream->Seek(SeekOrigin::Start, archiveStream->GetPosition() + offset);
+				else
+					archiveStream->Seek(origin, offset);
+				return;
+			}
 #ifdef _WIN32
 			int rs = _fseeki64(handle, offset, _origin);
 #else
@@ -178,10 +206,10 @@ namespace CoreLib
 		}
 		Int64 FileStream::Read(void * buffer, Int64 length)
 		{
-			auto bytes = fread_s(buffer, (size_t)length, 1, (size_t)length, handle);
+			auto bytes = archiveStream ? (size_t)archiveStream->Read(buffer, length) : fread_s(buffer, (size_t)length, 1, (size_t)length, handle);
 			if (bytes == 0 && length > 0)
 			{
-				if (!feof(handle))
+				if (!archiveStream && !feof(handle))
 					throw IOException("FileStream read failed.");
 				else if (endReached)
 					throw EndOfStreamException("End of file is reached.");
@@ -191,6 +219,8 @@ namespace CoreLib
 		}
 		Int64 FileStream::Write(const void * buffer, Int64 length)
 		{
+			if (archiveStream)
+				throw IOException("FileStream write failed.");
 			auto bytes = (Int64)fwrite(buffer, 1, (size_t)length, handle);
 			if (bytes < length)
 			{
@@ -213,10 +243,72 @@ namespace CoreLib
 				fclose(handle);
 				handle = 0;
 			}
+			archiveStream = nullptr;
+			archiveFile = nullptr;
 		}
 		bool FileStream::IsEnd()
 		{
 			return endReached;
 		}
-	}
+	
+		MemoryMappedFile::MemoryMappedFile(const CoreLib::Basic::String & fileName)
+		{
+			// a mapped file is copy-on-write, its users may modify it in place without affecting later loads
+			auto entry = AssetArchive::Open(fileName, true);
+			if (entry)
+			{
+				buffer = entry->GetData().Buffer();
+				size = entry->GetData().Count();
+				archiveFile = entry;
+				return;
+			}
+#ifdef _WIN32
+			HANDLE file = CreateFileW(fileName.ToWString(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+				throw IOException("Cannot open file '" + fileName + "'");
+			LARGE_INTEGER fileSize;
+			HANDLE mapping = NULL;
+			if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+				mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (mapping)
+				buffer = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			if (!buffer)
+			{
+				if (mapping)
+					CloseHandle(mapping);
+				CloseHandle(file);
+				throw IOException("Cannot map file '" + fileName + "'");
+			}
+			size = fileSize.QuadPart;
+			fileHandle = file;
+			mappingHandle = mapping;
+#else
+			int file = open(fileName.Buffer(), O_RDONLY);
+			if (file == -1)
+				throw IOException("Cannot open file '" + fileName + "'");
+			struct stat fileStat;
+			void * mapping = MAP_FAILED;
+			if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+				mapping = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			// the mapping stays valid after the descriptor is closed
+			close(file);
+			if (mapping == MAP_FAILED)
+				throw IOException("Cannot map file '" + fileName + "'");
+			buffer = (unsigned char *)mapping;
+			size = fileStat.st_size;
+#endif
+		}
+		MemoryMappedFile::~MemoryMappedFile()
+		{
+			if (archiveFile)
+				return;
+#ifdef _WIN32
+			UnmapViewOfFile(buffer);
+			CloseHandle((HANDLE)mappingHandle);
+			CloseHandle((HANDLE)fileHandle);
+#else
+			munmap(buffer, (size_t)size);
+#endif
+		}
+}
 }
@@ -213,12 +213,16 @@ namespace CoreLib
 			None, ReadOnly, WriteOnly, ReadWrite
 		};
 
+		// Files opened for reading are served from the mounted asset archives (see Archive.h) before the file system.
 		class FileStream : public Stream
 		{
 		private:
-			FILE * handle;
+			FILE * handle = nullptr;
 			FileAccess fileAccess;
 			bool endReached = false;
+			// set when the file is read from an asset archive
+			RefPtr<Stream> archiveStream;
+			RefPtr<CoreLib::Basic::Object> archiveFile;
 			void Init(const CoreLib::Basic::String & fileName, FileMode fileMode, FileAccess access, FileShare share);
 		public:
 			FileStream(const CoreLib::Basic::String & fileName, FileMode fileMode = FileMode::Open);
@@ -275,17 +279,14 @@ namespace CoreLib
 			}
 			virtual Int64 Read(void * pbuffer, Int64 length)
 			{
-				Int64 i;
-				for (i = 0; i < length; i++)
-				{
-					if (ptr + i < readBuffer.Count())
-					{
-						((unsigned char*)pbuffer)[i] = readBuffer[(int)(ptr + i)];
-					}
-					else
-						break;
-				}
-				return i;
+				Int64 count = readBuffer.Count() - ptr;
+				if (count > length)
+					count = length;
+				if (count <= 0)
+					return 0;
+				memcpy(pbuffer, readBuffer.Buffer() + ptr, (size_t)count);
+				ptr += (int)count;
+				return count;
 			}
 			virtual Int64 Write(const void * pbuffer, Int64 length)
 			{
@@ -333,6 +334,34 @@ namespace CoreLib
 					return writeBuffer.Count();
 			}
 		};
+
+		// Read-only file mapped into memory. The view is copy-on-write: writes to the mapped memory are private to
+		// the process and never reach the file. Files in a mounted asset archive are served from a private copy of
+		// their archive entry instead.
+		class MemoryMappedFile : public CoreLib::Basic::Object
+		{
+		private:
+			unsigned char * buffer = nullptr;
+			Int64 size = 0;
+			RefPtr<CoreLib::Basic::Object> archiveFile;
+#ifdef _WIN32
+			void * fileHandle = nullptr;
+			void * mappingHandle = nullptr;
+#endif
+		public:
+			MemoryMappedFile(const CoreLib::Basic::String & fileName);
+			~MemoryMappedFile();
+			MemoryMappedFile(const MemoryMappedFile &) = delete;
+			MemoryMappedFile & operator = (const MemoryMappedFile &) = delete;
+			unsigned char * GetBuffer()
+			{
+				return buffer;
+			}
+			Int64 GetSize()
+			{
+				return size;
+			}
+		};
 	}
 }
 
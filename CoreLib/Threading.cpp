@@ -46,5 +46,179 @@ namespace CoreLib
 			return sysconf(_SC_NPROCESSORS_ONLN);
 		#endif
 		}
+
+		static thread_local ThreadPool * currentThreadPool = nullptr;
+		static thread_local int currentWorkerIndex = -1;
+
+		ThreadPool::ThreadPool(int threadCount)
+		{
+			if (threadCount <= 0)
+				threadCount = ParallelSystemInfo::GetProcessorCount();
+			queuedTaskCount = 0;
+			stopping = false;
+			for (int i = 0; i <= threadCount; i++)
+				queues.Add(new WorkerQueue());
+			for (int i = 0; i < threadCount; i++)
+			{
+				workers.Add(new Thread(new ThreadProc([this, i]()
+				{
+					WorkerMain(i);
+				})));
+			}
+		}
+
+		ThreadPool::~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			sleepCondition.notify_all();
+			for (auto & worker : workers)
+				worker->Join();
+		}
+
+		int ThreadPool::GetCurrentQueueIndex()
+		{
+			if (currentThreadPool == this)
+				return currentWorkerIndex;
+			return workers.Count();
+		}
+
+		void ThreadPool::Submit(TaskGroup & group, Task task)
+		{
+			group.pendingTasks++;
+			auto & queue = *queues[GetCurrentQueueIndex()];
+			queue.Lock.Lock();
+			TaskEntry entry;
+			entry.Func = _Move(task);
+			entry.Group = &group;
+			queue.Tasks.push_back(_Move(entry));
+			queue.Lock.Unlock();
+			queuedTaskCount++;
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			sleepCondition.notify_one();
+		}
+
+		bool ThreadPool::TryPopTask(int queueIndex, TaskEntry & task)
+		{
+			if (queuedTaskCount.load() == 0)
+				return false;
+			// pop the most recent task from our own queue first, it is the most likely to be in cache
+			if (queueIndex < workers.Count())
+			{
+				auto & queue = *queues[queueIndex];
+				queue.Lock.Lock();
+				if (queue.Tasks.size())
+				{
+					task = _Move(queue.Tasks.back());
+					queue.Tasks.pop_back();
+					queue.Lock.Unlock();
+					queuedTaskCount--;
+					return true;
+				}
+				queue.Lock.Unlock();
+			}
+			// otherwise steal the oldest task from another queue, starting with the external queue
+			int queueCount = queues.Count();
+			for (int i = 0; i < queueCount; i++)
+			{
+				int victim = (queueCount - 1 + queueIndex + i) % queueCount;
+				if (victim == queueIndex && queueIndex < workers.Count())
+					continue;
+				auto & queue = *queues[victim];
+				queue.Lock.Lock();
+				if (queue.Tasks.size())
+				{
+					task = _Move(queue.Tasks.front());
+					queue.Tasks.pop_front();
+					queue.Lock.Unlock();
+					queuedTaskCount--;
+					return true;
+				}
+				queue.Lock.Unlock();
+			}
+			return false;
+		}
+
+		void ThreadPool::RunTask(TaskEntry & task)
+		{
+			auto & group = *task.Group;
+			try
+			{
+				task.Func();
+			}
+			catch (...)
+			{
+				group.exceptionLock.Lock();
+				if (!group.exception)
+					group.exception = std::current_exception();
+				group.exceptionLock.Unlock();
+			}
+			task.Func = Task();
+			CompleteTask(group);
+		}
+
+		void ThreadPool::CompleteTask(TaskGroup & group)
+		{
+			// the group may be destroyed by its waiter as soon as the count reaches zero
+			if (--group.pendingTasks == 0)
+			{
+				{
+					std::lock_guard<std::mutex> lock(sleepMutex);
+				}
+				sleepCondition.notify_all();
+			}
+		}
+
+		bool ThreadPool::RunPendingTask()
+		{
+			TaskEntry task;
+			if (TryPopTask(GetCurrentQueueIndex(), task))
+			{
+				RunTask(task);
+				return true;
+			}
+			return false;
+		}
+
+		void ThreadPool::Wait(TaskGroup & group)
+		{
+			while (!group.IsCompleted())
+			{
+				if (RunPendingTask())
+					continue;
+				// sleep until a task can be helped with or the last task of the group completes
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepCondition.wait(lock, [&]() {return group.IsCompleted() || queuedTaskCount.load() != 0; });
+			}
+			if (group.exception)
+			{
+				auto exception = group.exception;
+				group.exception = nullptr;
+				std::rethrow_exception(exception);
+			}
+		}
+
+		void ThreadPool::WorkerMain(int workerIndex)
+		{
+			currentThreadPool = this;
+			currentWorkerIndex = workerIndex;
+			while (!stopping)
+			{
+				TaskEntry task;
+				if (TryPopTask(workerIndex, task))
+				{
+					RunTask(task);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepCondition.wait(lock, [this]() {return stopping || queuedTaskCount.load() != 0; });
+			}
+			currentThreadPool = nullptr;
+			currentWorkerIndex = -1;
+		}
 	}
 }
\ No newline at end of file
@@ -3,9 +3,13 @@
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <xmmintrin.h>
 #include "Basic.h"
 #include "Events.h"
+#include "Func.h"
 
 #ifndef _WIN32
 #define __stdcall
@@ -146,6 +150,100 @@ namespace CoreLib
 				return handle.unlock();
 			}
 		};
+
+		// A pool of worker threads with per-worker task queues and work stealing.
+		// Tasks submitted from a worker thread go to that worker's own queue (processed LIFO),
+		// idle workers steal the oldest tasks from other queues. Tasks are tracked with TaskGroups,
+		// and a thread waiting for a group helps executing pending tasks, so tasks may freely
+		// spawn and wait for child tasks. An exception thrown by a task is rethrown by Wait.
+		class ThreadPool : public CoreLib::Basic::Object
+		{
+		public:
+			typedef CoreLib::Basic::Func<void> Task;
+			class TaskGroup
+			{
+				friend class ThreadPool;
+			private:
+				std::atomic<int> pendingTasks;
+				// the first exception thrown by a task of the group
+				SpinLock exceptionLock;
+				std::exception_ptr exception;
+			public:
+				TaskGroup()
+				{
+					pendingTasks = 0;
+				}
+				bool IsCompleted()
+				{
+					return pendingTasks.load() == 0;
+				}
+			};
+		private:
+			struct TaskEntry
+			{
+				Task Func;
+				TaskGroup * Group = nullptr;
+			};
+			struct WorkerQueue
+			{
+				SpinLock Lock;
+				std::deque<TaskEntry> Tasks;
+			};
+			CoreLib::Basic::List<CoreLib::Basic::RefPtr<Thread>> workers;
+			// queues [0, workers.Count()) belong to the workers, the last queue receives tasks from other threads.
+			CoreLib::Basic::List<CoreLib::Basic::RefPtr<WorkerQueue>> queues;
+			std::mutex sleepMutex;
+			std::condition_variable sleepCondition;
+			std::atomic<int> queuedTaskCount;
+			std::atomic<bool> stopping;
+			int GetCurrentQueueIndex();
+			bool TryPopTask(int queueIndex, TaskEntry & task);
+			void RunTask(TaskEntry & task);
+			void CompleteTask(TaskGroup & group);
+			void WorkerMain(int workerIndex);
+		public:
+			// creates a pool with the given number of worker threads, or one per processor if threadCount <= 0.
+			ThreadPool(int threadCount = 0);
+			~ThreadPool();
+			int GetThreadCount()
+			{
+				return workers.Count();
+			}
+			// the queued task holds the only reference to the function, the reference counts of Func are not atomic.
+			void Submit(TaskGroup & group, Task task);
+			// executes a single pending task on the calling thread, returns false if no task is available.
+			bool RunPendingTask();
+			// blocks until all tasks of the group have completed, executing pending tasks in the meantime.
+			// Rethrows the first exception thrown by a task of the group once all of them have completed.
+			void Wait(TaskGroup & group);
+			// runs func(i) for i in [begin, end), split into chunks of at least grainSize iterations.
+			template<typename TFunc>
+			void ParallelFor(int begin, int end, int grainSize, const TFunc & func)
+			{
+				int count = end - begin;
+				if (count <= 0)
+					return;
+				int chunkCount = CoreLib::Basic::Math::Min(workers.Count() * 4, (count + grainSize - 1) / grainSize);
+				if (chunkCount <= 1)
+				{
+					for (int i = begin; i < end; i++)
+						func(i);
+					return;
+				}
+				TaskGroup group;
+				for (int c = 0; c < chunkCount; c++)
+				{
+					int chunkBegin = begin + (int)((long long)count * c / chunkCount);
+					int chunkEnd = begin + (int)((long long)count * (c + 1) / chunkCount);
+					Submit(group, [=, &func]()
+					{
+						for (int i = chunkBegin; i < chunkEnd; i++)
+							func(i);
+					});
+				}
+				Wait(group);
+			}
+		};
 	}
 }
 
@@ -3,6 +3,8 @@
 #include "CoreLib/CommandLineParser.h"
 #include "HardwareRenderer.h"
 #include "Engine.h"
+#include "LightmapBakeBenchmark.h"
+#include "AssetCooker.h"
 #include "CoreLib/Imaging/Bitmap.h"
 #include "CoreLib/CommandLineParser.h"
 
@@ -38,6 +40,7 @@ int __stdcall wWinMain(
 {
 	OsApplication::Init(0, nullptr);
 #endif
+	int exitCode = 0;
 	{
 		EngineInitArguments args;
 		auto & appParams = args.LaunchParams;
@@ -135,13 +138,58 @@ int __stdcall wWinMain(
 				Engine::Instance()->SetTimingMode(GameEngine::TimingMode::Fixed);
 				Engine::Instance()->SetFrameDuration(1.0f / appParams.FramesPerSecond);
 			}
-			Engine::Run();
+			if (parser.OptionExists("-bakeworker"))
+			{
+				CoreLib::RefPtr<LightmapBaker> baker = CreateLightmapBaker();
+				baker->RunWorker(RemoveQuote(parser.GetOptionValue("-bakeworker")));
+			}
+			else if (parser.OptionExists("-bakebenchmark"))
+			{
+				LightmapBakeBenchmarkArguments benchmarkArgs;
+				benchmarkArgs.LevelFileName = RemoveQuote(parser.GetOptionValue("-bakebenchmark"));
+				if (parser.OptionExists("-bakepreset"))
+					benchmarkArgs.Preset = parser.GetOptionValue("-bakepreset");
+				if (parser.OptionExists("-bakereference"))
+					benchmarkArgs.ReferenceFileName = RemoveQuote(parser.GetOptionValue("-bakereference"));
+				if (parser.OptionExists("-bakeoutput"))
+					benchmarkArgs.OutputFileName = RemoveQuote(parser.GetOptionValue("-bakeoutput"));
+				if (parser.OptionExists("-bakeminpsnr"))
+					benchmarkArgs.MinPSNR = (float)StringToDouble(parser.GetOptionValue("-bakeminpsnr"));
+				if (parser.OptionExists("-bakedistributed"))
+					benchmarkArgs.DistributedJobDirectory = RemoveQuote(parser.GetOptionValue("-bakedistributed"));
+				if (parser.OptionExists("-bakeworkers"))
+					benchmarkArgs.DistributedWorkerCount = StringToInt(parser.GetOptionValue("-bakeworkers"));
+				exitCode = RunLightmapBakeBenchmark(benchmarkArgs);
+			}
+			else if (parser.OptionExists("-cook"))
+			{
+				AssetCookerArguments cookerArgs;
+				cookerArgs.SourceDirectory = args.GameDirectory;
+				cookerArgs.OutputDirectory = RemoveQuote(parser.GetOptionValue("-cook"));
+				if (parser.OptionExists("-cookthreads"))
+					cookerArgs.ThreadCount = (int)StringToInt(parser.GetOptionValue("-cookthreads"));
+				if (parser.OptionExists("-cookrebuild"))
+					cookerArgs.Rebuild = true;
+				if (parser.OptionExists("-cooktextures"))
+				{
+					auto textureFormat = parser.GetOptionValue("-cooktextures").ToLower();
+					if (textureFormat == "bc7")
+						cookerArgs.TextureFormat = CookedTextureFormat::BC7;
+					else if (textureFormat != "bc1")
+						Engine::Print("unknown texture format '%s', textures are cooked to BC1.\n", textureFormat.Buffer());
+				}
+				exitCode = RunAssetCooker(cookerArgs);
+			}
+			else
+				Engine::Run();
 		}
 		catch (const CoreLib::Exception & e)
 		{
 			OsApplication::ShowMessage(e.Message, "Error");
+			exitCode = 1;
 		}
 		Engine::Destroy();
 	}
 	OsApplication::Dispose();
+	return exitCode;
 }
\ No newline at end of file
@@ -104,6 +104,99 @@ namespace GameEngine
 		SerializeFields(sb);
 		sb << "}\n";
 	}
+	int BinaryLevelContext::GetStringId(const CoreLib::String & str)
+	{
+		int id = -1;
+		if (!StringIds.TryGetValue(str, id))
+		{
+			id = Strings.Count();
+			Strings.Add(str);
+			StringIds[str] = id;
+		}
+		return id;
+	}
+	void Actor::ParseBinary(Level * plevel, CoreLib::IO::BinaryReader & reader, BinaryLevelContext & context, int classNameId, bool & isInvalid)
+	{
+		level = plevel;
+		auto stream = reader.GetStream();
+		auto & className = context.Strings[classNameId];
+		int propertyCount = reader.ReadInt32();
+		for (int i = 0; i < propertyCount; i++)
+		{
+			int nameId = reader.ReadInt32();
+			int blockSize = reader.ReadInt32();
+			auto blockEnd = stream->GetPosition() + blockSize;
+			auto & propertyName = context.Strings[nameId];
+			auto key = ((CoreLib::Int64)classNameId << 32) + nameId;
+			int offset = -1;
+			if (!context.PropertyOffsets.TryGetValue(key, offset))
+			{
+				if (auto prop = FindProperty(propertyName.Buffer()))
+					offset = (int)((unsigned char *)prop - (unsigned char *)this);
+				context.PropertyOffsets[key] = offset;
+			}
+			if (offset == -1)
+			{
+				Print("Actor '%s' does not have property '%s'.\n", className.Buffer(), propertyName.Buffer());
+				isInvalid = true;
+			}
+			else
+			{
+				try
+				{
+					GetProperty(offset)->ReadBinary(reader);
+				}
+				catch (CoreLib::Text::TextFormatException)
+				{
+					Print("Cannot parse property '%s'.\n", propertyName.Buffer());
+					isInvalid = true;
+				}
+			}
+			stream->Seek(CoreLib::IO::SeekOrigin::Start, blockEnd);
+		}
+		// fields without a property are kept in their text form
+		auto fields = reader.ReadString();
+		if (fields.Length())
+		{
+			CoreLib::Text::TokenReader parser(fields);
+			while (!parser.IsEnd())
+			{
+				auto fieldNameToken = parser.ReadToken();
+				try
+				{
+					if (!ParseField(fieldNameToken.Content, parser))
+					{
+						Print("Actor '%s' does not have property '%s'.\n", className.Buffer(), fieldNameToken.Content.Buffer());
+						isInvalid = true;
+						break;
+					}
+				}
+				catch (CoreLib::Text::TextFormatException)
+				{
+					Print("Cannot parse property '%s'.\n", fieldNameToken.Content.Buffer());
+					isInvalid = true;
+					break;
+				}
+			}
+		}
+	}
+	void Actor::SerializeToBinary(CoreLib::IO::BinaryWriter & writer, BinaryLevelContext & context)
+	{
+		auto propList = GetPropertyList();
+		writer.Write(propList.Count());
+		for (auto & prop : propList)
+		{
+			CoreLib::IO::BinaryWriter blockWriter(new CoreLib::IO::MemoryStream());
+			prop->WriteBinary(blockWriter);
+			auto block = (CoreLib::IO::MemoryStream *)blockWriter.GetStream();
+			writer.Write(context.GetStringId(prop->GetName()));
+			writer.Write(block->GetBufferSize());
+			writer.Write((unsigned char *)block->GetBuffer(), block->GetBufferSize());
+		}
+		CoreLib::StringBuilder fields;
+		SerializeFields(fields);
+		writer.Write(fields.ProduceString());
+	}
 	VectorMath::Vec3 Actor::GetPosition()
 	{
 		auto l = LocalTransform.GetValue();
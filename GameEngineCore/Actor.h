@@ -35,6 +35,17 @@ namespace GameEngine
 
 	class Level;
 
+	// string table of a binary level. Class and property names are stored once and referred to by index, and the
+	// offset of a property is looked up once per class and property name.
+	struct BinaryLevelContext
+	{
+		CoreLib::List<CoreLib::String> Strings;
+		CoreLib::Dictionary<CoreLib::String, int> StringIds;
+		// key is (class name id << 32) + property name id, -1 for properties the class does not have
+		CoreLib::Dictionary<CoreLib::Int64, int> PropertyOffsets;
+		int GetStringId(const CoreLib::String & str);
+	};
+
 	class Actor : public PropertyContainer
 	{
 	protected:
@@ -63,6 +74,8 @@ namespace GameEngine
 		virtual void RegisterUI(GraphicsUI::UIEntry *) {}
 		virtual void Parse(Level * plevel, CoreLib::Text::TokenReader & parser, bool & isInvalid);
 		virtual void SerializeToText(CoreLib::StringBuilder & sb);
+		virtual void ParseBinary(Level * plevel, CoreLib::IO::BinaryReader & reader, BinaryLevelContext & context, int classNameId, bool & isInvalid);
+		virtual void SerializeToBinary(CoreLib::IO::BinaryWriter & writer, BinaryLevelContext & context);
 		virtual void GetDrawables(const GetDrawablesParameter & /*params*/) {}
 		virtual CoreLib::String GetTypeName() { return "Actor"; }
 		void SetLevel(Level * plevel)
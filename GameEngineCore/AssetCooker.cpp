@@ -0,0 +1,408 @@
+#include "AssetCooker.h"
+#include "Engine.h"
+#include "Level.h"
+#include "CameraActor.h"
+#include "Mesh.h"
+#include "TextureCompressor.h"
+#include "CoreLib/LibIO.h"
+#include "CoreLib/Archive.h"
+#include "CoreLib/MD5.h"
+#include "CoreLib/PerformanceCounter.h"
+#include "CoreLib/Threading.h"
+#include "CoreLib/Graphics/TextureFile.h"
+
+using namespace CoreLib;
+using namespace CoreLib::IO;
+using namespace CoreLib::Diagnostics;
+using namespace CoreLib::Threading;
+
+namespace GameEngine
+{
+    enum class CookedAssetKind
+    {
+        Copy, Texture, Mesh, Level
+    };
+
+    // the version of a kind is increased whenever its cooked output changes, so that existing outputs are cooked again
+    static const int CookedAssetKindVersions[] = { 1, 1, 1, 1 };
+    static const char * CookCacheFileName = "cook.cache";
+    static const char * CookCacheIdentifier = "SPCOOK";
+    static const int CookCacheVersion = 2;
+
+    // the texture format is part of the version of cooked textures, so that changing it cooks them again
+    static int GetCookedAssetKindVersion(CookedAssetKind kind, const AssetCookerArguments & args)
+    {
+        int version = CookedAssetKindVersions[(int)kind];
+        if (kind == CookedAssetKind::Texture)
+            version |= (int)args.TextureFormat << 16;
+        return version;
+    }
+
+    struct CookCacheEntry
+    {
+        Int64 SourceSize = 0;
+        Int64 SourceTime = 0;
+        unsigned char SourceHash[16] = {};
+        int Kind = 0;
+        int KindVersion = 0;
+        int OptionsHash = 0;
+        String OutputPath;
+    };
+
+    struct CookedAsset
+    {
+        // paths relative to the source and output directories
+        String SourcePath, OutputPath;
+        CookedAssetKind Kind = CookedAssetKind::Copy;
+        int KindVersion = 0;
+        // options of the asset that change its output, e.g. the mip options of a texture
+        MipGenerationOptions MipOptions;
+        int OptionsHash = 0;
+        Int64 SourceSize = 0;
+        Int64 SourceTime = 0;
+        unsigned char SourceHash[16] = {};
+        bool NeedsCooking = false;
+        String Error;
+    };
+
+    static void CollectSourceFiles(const String & dir, const String & relativeDir, const String & outputDir, List<String> & files)
+    {
+        List<DirectoryEntry> entries;
+        for (auto entry : DirectoryIterator(dir))
+            entries.Add(entry);
+        entries.Sort([](const DirectoryEntry & e0, const DirectoryEntry & e1) { return e0.name < e1.name; });
+        for (auto & entry : entries)
+        {
+            auto relativePath = relativeDir.Length() ? relativeDir + "/" + entry.name : entry.name;
+            if (entry.type == DirectoryEntryType::Directory)
+            {
+                // the shader cache is rebuilt by the engine
+                if (!relativeDir.Length() && entry.name == "Cache")
+                    continue;
+                if (Path::Normalize(entry.fullPath) == outputDir)
+                    continue;
+                CollectSourceFiles(entry.fullPath, relativePath, outputDir, files);
+            }
+            else if (entry.type == DirectoryEntryType::File && Path::GetFileExt(entry.name).ToLower() != "pak")
+                files.Add(relativePath);
+        }
+    }
+
+    static bool IsImageFile(const String & ext)
+    {
+        return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" || ext == "tga";
+    }
+
+    static int GetMipOptionsHash(const MipGenerationOptions & options)
+    {
+        int hash = (int)options.Content | ((int)options.Filter << 4) | ((int)options.PreserveAlphaCoverage << 8);
+        if (options.PreserveAlphaCoverage)
+            hash ^= (int)(options.AlphaCutoff * 255.0f + 0.5f) << 16;
+        return hash;
+    }
+
+    // returns false if the file is not cooked, e.g. because another source produces the same output
+    static bool ClassifySourceFile(const String & path, HashSet<String> & sourceFiles, CookedAsset & asset)
+    {
+        auto ext = Path::GetFileExt(path).ToLower();
+        asset.SourcePath = path;
+        asset.OutputPath = path;
+        asset.Kind = CookedAssetKind::Copy;
+        if (IsImageFile(ext))
+        {
+            // the runtime prefers a .texture file next to the image
+            if (sourceFiles.Contains(Path::ReplaceExt(path, "texture")))
+                return false;
+            asset.Kind = CookedAssetKind::Texture;
+            asset.OutputPath = Path::ReplaceExt(path, "texture");
+        }
+        else if (ext == "texsettings")
+        {
+            // read by the cooker with its image, see GetImageMipOptions
+            return false;
+        }
+        else if (ext == "mesh")
+            asset.Kind = CookedAssetKind::Mesh;
+        else if (ext == "level")
+        {
+            asset.Kind = CookedAssetKind::Level;
+            asset.OutputPath = Level::GetBinaryFileName(path);
+        }
+        else if (ext == "blevel")
+        {
+            // compiled from the text level instead
+            if (sourceFiles.Contains(Path::ReplaceExt(path, "level")))
+                return false;
+        }
+        return true;
+    }
+
+    static void ComputeFileHash(const String & fileName, unsigned char hash[16])
+    {
+        auto data = File::ReadAllBytes(fileName);
+        MD5_CTX context;
+        MD5_Init(&context);
+        MD5_Update(&context, data.Buffer(), (unsigned long)data.Count());
+        MD5_Final(hash, &context);
+    }
+
+    static Int64 GetFileSize(const String & fileName)
+    {
+        FileStream stream(fileName);
+        stream.Seek(SeekOrigin::End, 0);
+        return stream.GetPosition();
+    }
+
+    // Path::CreateDir only creates the last directory of a path
+    static void CreateDirectories(const String & dir)
+    {
+        if (!dir.Length() || Path::IsDirectory(dir))
+            return;
+        CreateDirectories(Path::GetDirectoryName(dir));
+        Path::CreateDir(dir);
+    }
+
+    // returns an empty cache if the file is missing or unreadable, all assets are then cooked
+    static void LoadCookCache(const String & fileName, Dictionary<String, CookCacheEntry> & cache)
+    {
+        if (!File::Exists(fileName))
+            return;
+        try
+        {
+            BinaryReader reader(new FileStream(fileName));
+            if (reader.ReadString() != CookCacheIdentifier || reader.ReadInt32() != CookCacheVersion)
+            {
+                Engine::Print("ignoring cook cache '%s' of a different version.\n", fileName.Buffer());
+                return;
+            }
+            int count = reader.ReadInt32();
+            for (int i = 0; i < count; i++)
+            {
+                auto sourcePath = reader.ReadString();
+                CookCacheEntry entry;
+                reader.Read(entry.SourceSize);
+                reader.Read(entry.SourceTime);
+                reader.Read(entry.SourceHash, 16);
+                entry.Kind = reader.ReadInt32();
+                entry.KindVersion = reader.ReadInt32();
+                entry.OptionsHash = reader.ReadInt32();
+                entry.OutputPath = reader.ReadString();
+                cache[sourcePath] = entry;
+            }
+        }
+        catch (const IOException &)
+        {
+            Engine::Print("cannot read cook cache '%s', cooking all assets.\n", fileName.Buffer());
+            cache = Dictionary<String, CookCacheEntry>();
+        }
+    }
+
+    static void SaveCookCache(const String & fileName, List<CookedAsset> & assets)
+    {
+        int count = 0;
+        for (auto & asset : assets)
+            count += asset.Error.Length() ? 0 : 1;
+        BinaryWriter writer(new FileStream(fileName, FileMode::Create));
+        writer.Write(String(CookCacheIdentifier));
+        writer.Write(CookCacheVersion);
+        writer.Write(count);
+        for (auto & asset : assets)
+        {
+            // failed assets are left out of the cache so that the next run tries them again
+            if (asset.Error.Length())
+                continue;
+            writer.Write(asset.SourcePath);
+            writer.Write(asset.SourceSize);
+            writer.Write(asset.SourceTime);
+            writer.Write(asset.SourceHash, 16);
+            writer.Write((int)asset.Kind);
+            writer.Write(asset.KindVersion);
+            writer.Write(asset.OptionsHash);
+            writer.Write(asset.OutputPath);
+        }
+        writer.Close();
+    }
+
+    static void CookAsset(const String & sourceFile, const String & outputFile, const CookedAsset & asset, const AssetCookerArguments & args)
+    {
+        switch (asset.Kind)
+        {
+        case CookedAssetKind::Copy:
+        {
+            auto data = File::ReadAllBytes(sourceFile);
+            File::WriteAllBytes(outputFile, data.Buffer(), data.Count());
+            break;
+        }
+        case CookedAssetKind::Texture:
+        {
+            CoreLib::Graphics::TextureFile texFile;
+            if (args.TextureFormat == CookedTextureFormat::BC7)
+                TextureCompressor::CompressImageFile_BC7(texFile, sourceFile, BC7Quality::High, asset.MipOptions);
+            else
+                TextureCompressor::CompressImageFile_BC1(texFile, sourceFile, TextureCompressionQuality::High, asset.MipOptions);
+            texFile.SaveToFile(outputFile);
+            break;
+        }
+        case CookedAssetKind::Mesh:
+        {
+            Mesh mesh;
+            mesh.LoadFromFile(sourceFile);
+            mesh.SaveToFile(outputFile);
+            break;
+        }
+        case CookedAssetKind::Level:
+        {
+            Level level;
+            level.FileName = sourceFile;
+            level.LoadFromText(File::ReadAllText(sourceFile));
+            // a binary level written without the skipped actors would silently lose them
+            if (level.SkippedActorCount)
+                throw IOException(String(level.SkippedActorCount) + " actor(s) of the level could not be loaded.");
+            level.SaveToBinaryFile(outputFile);
+            break;
+        }
+        }
+    }
+
+    int RunAssetCooker(const AssetCookerArguments & args)
+    {
+        if (!args.SourceDirectory.Length() || !args.OutputDirectory.Length())
+        {
+            Engine::Print("the asset cooker needs a game directory and an output directory.\n");
+            return 1;
+        }
+        auto startTime = PerformanceCounter::Start();
+        auto sourceDir = Path::Normalize(args.SourceDirectory);
+        auto outputDir = Path::Normalize(args.OutputDirectory);
+        // sources are read from the file system, not from the archives mounted by the engine
+        AssetArchive::UnmountAll();
+
+        List<String> files;
+        CollectSourceFiles(sourceDir, "", outputDir, files);
+        HashSet<String> sourceFiles;
+        for (auto & file : files)
+            sourceFiles.Add(file);
+        List<CookedAsset> assets;
+        Dictionary<String, String> outputSources;
+        for (auto & file : files)
+        {
+            CookedAsset asset;
+            if (!ClassifySourceFile(file, sourceFiles, asset))
+                continue;
+            String otherSource;
+            if (outputSources.TryGetValue(asset.OutputPath, otherSource))
+            {
+                Engine::Print("skipping '%s', its output '%s' is cooked from '%s'.\n", file.Buffer(),
+                    asset.OutputPath.Buffer(), otherSource.Buffer());
+                continue;
+            }
+            outputSources[asset.OutputPath] = file;
+            assets.Add(_Move(asset));
+        }
+
+        Dictionary<String, CookCacheEntry> cache;
+        auto cacheFileName = Path::Combine(outputDir, CookCacheFileName);
+        LoadCookCache(cacheFileName, cache);
+
+        // hash the sources, the hash of an unmodified file is taken from the cache
+        RefPtr<ThreadPool> threadPool = new ThreadPool(args.ThreadCount);
+        threadPool->ParallelFor(0, assets.Count(), 1, [&](int i)
+        {
+            auto & asset = assets[i];
+            auto sourceFile = Path::Combine(sourceDir, asset.SourcePath);
+            try
+            {
+                asset.KindVersion = GetCookedAssetKindVersion(asset.Kind, args);
+                if (asset.Kind == CookedAssetKind::Texture)
+                {
+                    asset.MipOptions = GetImageMipOptions(sourceFile);
+                    asset.OptionsHash = GetMipOptionsHash(asset.MipOptions);
+                }
+                asset.SourceSize = GetFileSize(sourceFile);
+                asset.SourceTime = File::GetLastWriteTime(sourceFile);
+                auto entry = cache.TryGetValue(asset.SourcePath);
+                if (entry && entry->SourceSize == asset.SourceSize && entry->SourceTime == asset.SourceTime)
+                    memcpy(asset.SourceHash, entry->SourceHash, sizeof(asset.SourceHash));
+                else
+                    ComputeFileHash(sourceFile, asset.SourceHash);
+                asset.NeedsCooking = args.Rebuild || !entry ||
+                    memcmp(entry->SourceHash, asset.SourceHash, sizeof(asset.SourceHash)) != 0 ||
+                    entry->Kind != (int)asset.Kind || entry->KindVersion != asset.KindVersion || entry->OptionsHash != asset.OptionsHash ||
+                    entry->OutputPath != asset.OutputPath || !File::Exists(Path::Combine(outputDir, asset.OutputPath));
+            }
+            catch (const Exception & e)
+            {
+                asset.Error = e.Message;
+            }
+        });
+
+        // remove the outputs of deleted sources, or of sources now cooked to a different file
+        int removedCount = 0;
+        for (auto & entry : cache)
+        {
+            if (!outputSources.ContainsKey(entry.Value.OutputPath) &&
+                File::Delete(Path::Combine(outputDir, entry.Value.OutputPath)))
+                removedCount++;
+        }
+
+        List<int> cookList, levelCookList;
+        HashSet<String> outputDirs;
+        for (int i = 0; i < assets.Count(); i++)
+        {
+            if (!assets[i].NeedsCooking || assets[i].Error.Length())
+                continue;
+            // levels create actors and load resources through the engine, so they are cooked on this thread
+            if (assets[i].Kind == CookedAssetKind::Level)
+                levelCookList.Add(i);
+            else
+                cookList.Add(i);
+            outputDirs.Add(Path::GetDirectoryName(Path::Combine(outputDir, assets[i].OutputPath)));
+        }
+        CreateDirectories(outputDir);
+        for (auto & dir : outputDirs)
+            CreateDirectories(dir);
+        auto cook = [&](CookedAsset & asset)
+        {
+            try
+            {
+                CookAsset(Path::Combine(sourceDir, asset.SourcePath), Path::Combine(outputDir, asset.OutputPath), asset, args);
+            }
+            catch (const Exception & e)
+            {
+                asset.Error = e.Message;
+            }
+        };
+        threadPool->ParallelFor(0, cookList.Count(), 1, [&](int i)
+        {
+            cook(assets[cookList[i]]);
+        });
+        threadPool = nullptr;
+        for (auto id : levelCookList)
+            cook(assets[id]);
+
+        int cookedCount = 0, failedCount = 0;
+        for (auto & asset : assets)
+        {
+            if (asset.Error.Length())
+            {
+                Engine::Print("cannot cook '%s': %s\n", asset.SourcePath.Buffer(), asset.Error.Buffer());
+                failedCount++;
+            }
+            else if (asset.NeedsCooking)
+                cookedCount++;
+        }
+        try
+        {
+            SaveCookCache(cacheFileName, assets);
+        }
+        catch (const IOException &)
+        {
+            Engine::Print("cannot write cook cache '%s'.\n", cacheFileName.Buffer());
+            failedCount++;
+        }
+        Engine::Print("cooked %d of %d assets, %d up to date, %d failed, %d outputs removed, in %.2f s.\n", cookedCount,
+            assets.Count(), assets.Count() - cookedCount - failedCount, failedCount, removedCount,
+            PerformanceCounter::EndSeconds(startTime));
+        return failedCount ? 1 : 0;
+    }
+}
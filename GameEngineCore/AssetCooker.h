@@ -0,0 +1,38 @@
+#ifndef GAME_ENGINE_ASSET_COOKER_H
+#define GAME_ENGINE_ASSET_COOKER_H
+
+#include "CoreLib/Basic.h"
+
+namespace GameEngine
+{
+    enum class CookedTextureFormat
+    {
+        // 4 bits per texel, for color textures without alpha
+        BC1,
+        // 8 bits per texel with alpha, slower to cook
+        BC7
+    };
+
+    struct AssetCookerArguments
+    {
+        // game directory holding the source assets
+        CoreLib::String SourceDirectory;
+        CoreLib::String OutputDirectory;
+        // number of threads cooking assets, one per processor when <= 0
+        int ThreadCount = 0;
+        // block compression of images cooked to .texture files
+        CookedTextureFormat TextureFormat = CookedTextureFormat::BC1;
+        // cooks all assets regardless of the cache
+        bool Rebuild = false;
+    };
+
+    // Converts the assets of a game directory to the formats loaded at runtime and writes them to an output directory
+    // with the same layout: images are block compressed to .texture files with the mip options of GetImageMipOptions,
+    // meshes are rewritten in the current mesh format, text levels are compiled to .blevel files and other files are
+    // copied. The content hash, options and outputs of each asset are kept in a cache in the output directory, so that
+    // later runs only cook the assets that have changed.
+    // Returns the exit code of the cooker, 0 on success.
+    int RunAssetCooker(const AssetCookerArguments & args);
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "CoreLib/Basic.h"
 #include "CoreLib/Graphics/BBox.h"
+#include "CoreLib/Threading.h"
 #include "Ray.h"
 
 namespace GameEngine
@@ -134,9 +135,9 @@ namespace GameEngine
         VectorMath::Vec3 Center;
     };
 
-    inline float SurfaceArea(CoreLib::Graphics::BBox & box)
+    inline float SurfaceArea(const CoreLib::Graphics::BBox & box)
     {
-        return ((box.xMax - box.xMin)*(box.yMax - box.yMin) + (box.xMax - box.xMin)*(box.zMax - box.zMax) + (box.yMax - box.yMin)*(box.zMax - box.zMin))*2.0f;
+        return ((box.xMax - box.xMin)*(box.yMax - box.yMin) + (box.xMax - box.xMin)*(box.zMax - box.zMin) + (box.yMax - box.yMin)*(box.zMax - box.zMin))*2.0f;
     }
 
     struct BucketInfo
@@ -483,6 +484,294 @@ namespace GameEngine
         tree.Root = ConstructBvhNode<T, CostEvaluator>(tree, elements, elementCount, tree.ElementListSize, tree.NodeCount, eval, 0);
     }
 
+    // Build node of ParallelBvhBuilder. Nodes are allocated from a preallocated arena, and refer to
+    // their elements as a range of the build data array, which is partitioned in place.
+    struct BvhNode_Arena
+    {
+        CoreLib::Graphics::BBox Bounds;
+        int Axis;
+        int ElementStart, ElementCount;
+        int Children[2];
+    };
+
+    // Binned SAH BVH builder that splits subtrees into parallel tasks, and bins, computes bounds and
+    // partitions elements in parallel for the large nodes near the root.
+    // The result is flattened into the same layout produced by Bvh::FromBuild.
+    template<typename T, typename CostEvaluator>
+    class ParallelBvhBuilder
+    {
+    private:
+        static const int ParallelChunkSize = 1 << 14;
+        static const int ParallelSubtreeThreshold = 1 << 12;
+        static const int MaxDepth = 128;
+        CoreLib::Threading::ThreadPool & pool;
+        CostEvaluator & eval;
+        BuildData<T> * elements = nullptr;
+        CoreLib::List<BuildData<T>> partitionBuffer;
+        CoreLib::List<BvhNode_Arena> nodes;
+        std::atomic<int> nodeCount;
+
+        int GetChunkCount(int count)
+        {
+            return (count + ParallelChunkSize - 1) / ParallelChunkSize;
+        }
+        static inline int GetBucket(const BuildData<T> & element, const CoreLib::Graphics::BBox & centroidBounds, int dim)
+        {
+            int b = (int)(nBuckets * ((element.Center[dim] - centroidBounds.Min[dim]) / (centroidBounds.Max[dim] - centroidBounds.Min[dim])));
+            if (b == nBuckets) b = nBuckets - 1;
+            return b;
+        }
+        void ComputeBounds(int start, int count, CoreLib::Graphics::BBox & bbox, CoreLib::Graphics::BBox & centroidBounds)
+        {
+            bbox.Init();
+            centroidBounds.Init();
+            if (count < ParallelChunkSize * 2)
+            {
+                for (int i = start; i < start + count; i++)
+                {
+                    centroidBounds.Union(elements[i].Center);
+                    bbox.Union(elements[i].Bounds);
+                }
+                return;
+            }
+            int chunkCount = GetChunkCount(count);
+            CoreLib::List<CoreLib::Graphics::BBox> chunkBounds, chunkCentroidBounds;
+            chunkBounds.SetSize(chunkCount);
+            chunkCentroidBounds.SetSize(chunkCount);
+            pool.ParallelFor(0, chunkCount, 1, [&](int c)
+            {
+                chunkBounds[c].Init();
+                chunkCentroidBounds[c].Init();
+                int end = CoreLib::Math::Min(start + count, start + (c + 1) * ParallelChunkSize);
+                for (int i = start + c * ParallelChunkSize; i < end; i++)
+                {
+                    chunkCentroidBounds[c].Union(elements[i].Center);
+                    chunkBounds[c].Union(elements[i].Bounds);
+                }
+            });
+            for (int c = 0; c < chunkCount; c++)
+            {
+                bbox.Union(chunkBounds[c]);
+                centroidBounds.Union(chunkCentroidBounds[c]);
+            }
+        }
+        void ComputeBuckets(int start, int count, const CoreLib::Graphics::BBox & centroidBounds, int dim, BucketInfo * buckets)
+        {
+            if (count < ParallelChunkSize * 2)
+            {
+                for (int i = start; i < start + count; i++)
+                {
+                    int b = GetBucket(elements[i], centroidBounds, dim);
+                    buckets[b].count++;
+                    buckets[b].bounds.Union(elements[i].Bounds);
+                }
+                return;
+            }
+            int chunkCount = GetChunkCount(count);
+            CoreLib::List<BucketInfo> chunkBuckets;
+            chunkBuckets.SetSize(chunkCount * nBuckets);
+            pool.ParallelFor(0, chunkCount, 1, [&](int c)
+            {
+                auto localBuckets = chunkBuckets.Buffer() + c * nBuckets;
+                int end = CoreLib::Math::Min(start + count, start + (c + 1) * ParallelChunkSize);
+                for (int i = start + c * ParallelChunkSize; i < end; i++)
+                {
+                    int b = GetBucket(elements[i], centroidBounds, dim);
+                    localBuckets[b].count++;
+                    localBuckets[b].bounds.Union(elements[i].Bounds);
+                }
+            });
+            for (int c = 0; c < chunkCount; c++)
+            {
+                for (int b = 0; b < nBuckets; b++)
+                {
+                    buckets[b].count += chunkBuckets[c * nBuckets + b].count;
+                    buckets[b].bounds.Union(chunkBuckets[c * nBuckets + b].bounds);
+                }
+            }
+        }
+        // partitions the range so that elements in buckets [0, splitBucket] come first, returns the size of the first half.
+        int Partition(int start, int count, const CoreLib::Graphics::BBox & centroidBounds, int dim, int splitBucket)
+        {
+            if (count < ParallelChunkSize * 2)
+            {
+                auto pmid = std::partition(elements + start, elements + start + count, [&](const BuildData<T> & p)
+                {
+                    return GetBucket(p, centroidBounds, dim) <= splitBucket;
+                });
+                return (int)(pmid - (elements + start));
+            }
+            // count elements on the left side per chunk, then scatter into the partition buffer and copy back
+            int chunkCount = GetChunkCount(count);
+            CoreLib::List<int> leftCounts, leftOffsets, rightOffsets;
+            leftCounts.SetSize(chunkCount);
+            leftOffsets.SetSize(chunkCount);
+            rightOffsets.SetSize(chunkCount);
+            pool.ParallelFor(0, chunkCount, 1, [&](int c)
+            {
+                int leftCount = 0;
+                int end = CoreLib::Math::Min(start + count, start + (c + 1) * ParallelChunkSize);
+                for (int i = start + c * ParallelChunkSize; i < end; i++)
+                    if (GetBucket(elements[i], centroidBounds, dim) <= splitBucket)
+                        leftCount++;
+                leftCounts[c] = leftCount;
+            });
+            int totalLeft = 0;
+            for (int c = 0; c < chunkCount; c++)
+            {
+                leftOffsets[c] = totalLeft;
+                totalLeft += leftCounts[c];
+            }
+            int rightOffset = totalLeft;
+            for (int c = 0; c < chunkCount; c++)
+            {
+                rightOffsets[c] = rightOffset;
+                int chunkSize = CoreLib::Math::Min(count - c * ParallelChunkSize, ParallelChunkSize);
+                rightOffset += chunkSize - leftCounts[c];
+            }
+            pool.ParallelFor(0, chunkCount, 1, [&](int c)
+            {
+                int leftPtr = start + leftOffsets[c];
+                int rightPtr = start + rightOffsets[c];
+                int end = CoreLib::Math::Min(start + count, start + (c + 1) * ParallelChunkSize);
+                for (int i = start + c * ParallelChunkSize; i < end; i++)
+                {
+                    if (GetBucket(elements[i], centroidBounds, dim) <= splitBucket)
+                        partitionBuffer[leftPtr++] = elements[i];
+                    else
+                        partitionBuffer[rightPtr++] = elements[i];
+                }
+            });
+            pool.ParallelFor(0, chunkCount, 1, [&](int c)
+            {
+                int chunkStart = start + c * ParallelChunkSize;
+                int chunkSize = CoreLib::Math::Min(count - c * ParallelChunkSize, ParallelChunkSize);
+                memcpy(elements + chunkStart, partitionBuffer.Buffer() + chunkStart, chunkSize * sizeof(BuildData<T>));
+            });
+            return totalLeft;
+        }
+        void BuildNode(int nodeId, int start, int count, int depth)
+        {
+            auto & node = nodes[nodeId];
+            node.Axis = 0;
+            node.ElementStart = start;
+            node.ElementCount = count;
+            node.Children[0] = node.Children[1] = -1;
+            CoreLib::Graphics::BBox bbox, centroidBounds;
+            ComputeBounds(start, count, bbox, centroidBounds);
+            node.Bounds = bbox;
+            if (count == 1 || depth >= MaxDepth)
+                return;
+            int dim = centroidBounds.MaxDimension();
+            if (centroidBounds.Min[dim] == centroidBounds.Max[dim])
+                return;
+
+            BucketInfo buckets[nBuckets];
+            ComputeBuckets(start, count, centroidBounds, dim, buckets);
+            CoreLib::Graphics::BBox bounds1[nBuckets - 1];
+            bounds1[nBuckets - 2] = buckets[nBuckets - 1].bounds;
+            for (int i = nBuckets - 3; i >= 0; i--)
+            {
+                bounds1[i].Init();
+                bounds1[i].Union(buckets[i + 1].bounds);
+                bounds1[i].Union(bounds1[i + 1]);
+            }
+            CoreLib::Graphics::BBox b0;
+            b0.Init();
+            int count0 = 0;
+            float minCost = FLT_MAX;
+            int minCostSplit = 0;
+            float totalArea = SurfaceArea(bbox);
+            for (int i = 0; i < nBuckets - 1; i++)
+            {
+                b0.Union(buckets[i].bounds);
+                count0 += buckets[i].count;
+                float cost = eval.EvalCost(count0, SurfaceArea(b0), count - count0, SurfaceArea(bounds1[i]), totalArea);
+                if (cost < minCost)
+                {
+                    minCost = cost;
+                    minCostSplit = i;
+                }
+            }
+            if (count <= CostEvaluator::ElementsPerNode && minCost >= count)
+                return;
+
+            int leftCount = Partition(start, count, centroidBounds, dim, minCostSplit);
+            int leftChild = nodeCount.fetch_add(2);
+            int rightChild = leftChild + 1;
+            node.Axis = dim;
+            node.Children[0] = leftChild;
+            node.Children[1] = rightChild;
+            if (count > ParallelSubtreeThreshold)
+            {
+                CoreLib::Threading::ThreadPool::TaskGroup group;
+                pool.Submit(group, [=]()
+                {
+                    BuildNode(leftChild, start, leftCount, depth + 1);
+                });
+                BuildNode(rightChild, start + leftCount, count - leftCount, depth + 1);
+                pool.Wait(group);
+            }
+            else
+            {
+                BuildNode(leftChild, start, leftCount, depth + 1);
+                BuildNode(rightChild, start + leftCount, count - leftCount, depth + 1);
+            }
+        }
+        int FlattenNodes(Bvh<T> & tree, int nodeId)
+        {
+            auto & node = nodes[nodeId];
+            int id = tree.Nodes.Count();
+            BvhNode n;
+            n.Axis = node.Axis;
+            n.Bounds = node.Bounds;
+            n.SkipBBoxTest = 0;
+            n.ElementCount = node.Children[0] == -1 ? node.ElementCount : 0;
+            tree.Nodes.Add(n);
+            if (node.Children[0] != -1)
+            {
+                FlattenNodes(tree, node.Children[0]);
+                tree.Nodes[id].ChildOffset = FlattenNodes(tree, node.Children[1]) - id;
+            }
+            else
+            {
+                tree.Nodes[id].ElementId = tree.Elements.Count();
+                for (int i = node.ElementStart; i < node.ElementStart + node.ElementCount; i++)
+                    tree.Elements.Add(*elements[i].Element);
+            }
+            return id;
+        }
+    public:
+        ParallelBvhBuilder(CoreLib::Threading::ThreadPool & threadPool, CostEvaluator & costEvaluator)
+            : pool(threadPool), eval(costEvaluator)
+        {}
+        void Build(Bvh<T> & tree, BuildData<T> * buildElements, int elementCount)
+        {
+            tree.Nodes.Clear();
+            tree.Elements.Clear();
+            if (elementCount == 0)
+                return;
+            elements = buildElements;
+            // a binary tree with non-empty leaves has at most 2n-1 nodes
+            nodes.SetSize(elementCount * 2 - 1);
+            partitionBuffer.SetSize(elementCount >= ParallelChunkSize * 2 ? elementCount : 0);
+            nodeCount = 1;
+            BuildNode(0, 0, elementCount, 0);
+            partitionBuffer = CoreLib::List<BuildData<T>>();
+            tree.Nodes.Reserve(nodeCount.load());
+            tree.Elements.Reserve(elementCount);
+            FlattenNodes(tree, 0);
+            nodes = CoreLib::List<BvhNode_Arena>();
+        }
+    };
+
+    template<typename T, typename CostEvaluator>
+    void ConstructBvhParallel(Bvh<T> & tree, BuildData<T>* elements, int elementCount, CostEvaluator & eval, CoreLib::Threading::ThreadPool & pool)
+    {
+        ParallelBvhBuilder<T, CostEvaluator> builder(pool, eval);
+        builder.Build(tree, elements, elementCount);
+    }
+
     template<typename T, typename Tracer, typename THit, bool pred>
     bool TraverseBvh(const Tracer & tracer, THit& rs, Bvh<T> & tree, const Ray & ray, VectorMath::Vec3 rcpDir)
     {
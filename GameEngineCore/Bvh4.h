@@ -0,0 +1,387 @@
+#ifndef GAME_ENGINE_BVH4_H
+#define GAME_ENGINE_BVH4_H
+
+#include "Bvh.h"
+
+namespace GameEngine
+{
+    // A 4-wide BVH node. Bounds of the four children are stored in SoA layout (BoundsMin[axis][child])
+    // so that a ray can be tested against all children with a single set of SSE instructions.
+    class Bvh4Node
+    {
+    public:
+        float BoundsMin[3][4];
+        float BoundsMax[3][4];
+        // index of the child node for inner children, or index of the first element block for leaf children
+        int Children[4];
+        // number of element blocks of a leaf child, 0 for an inner child and -1 for an unused slot
+        int BlockCount[4];
+        void Init()
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                for (int j = 0; j < 3; j++)
+                {
+                    BoundsMin[j][i] = FLT_MAX;
+                    BoundsMax[j][i] = -FLT_MAX;
+                }
+                Children[i] = 0;
+                BlockCount[i] = -1;
+            }
+        }
+        void SetChildBounds(int child, const CoreLib::Graphics::BBox & bounds)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                BoundsMin[j][child] = bounds.Min[j];
+                BoundsMax[j][child] = bounds.Max[j];
+            }
+        }
+    };
+
+    // A 4-wide BVH (QBVH) collapsed from a binary Bvh<T>.
+    // Leaf elements are converted into blocks of type TBlock by a user supplied block builder, which
+    // allows the leaf data to be stored in a SIMD friendly layout.
+    template<typename TBlock>
+    class Bvh4
+    {
+    private:
+        // element range covered by each subtree of the binary BVH being collapsed
+        CoreLib::List<int> subtreeFirstElement, subtreeElementCount;
+        template<typename T, typename TBlockBuilder>
+        int CollapseNode(Bvh<T> & bvh, int binaryNodeId, TBlockBuilder & blockBuilder)
+        {
+            // a subtree that fits in a single element block becomes a leaf.
+            auto isLeaf = [&](int id)
+            {
+                return bvh.Nodes[id].GetIsLeaf() || subtreeElementCount[id] <= TBlockBuilder::ElementsPerBlock;
+            };
+            // open up the binary subtree until we have gathered (at most) four children,
+            // always expanding the inner node with the largest surface area first.
+            int candidates[4];
+            int candidateCount = 0;
+            auto & binaryNode = bvh.Nodes[binaryNodeId];
+            if (isLeaf(binaryNodeId))
+                candidates[candidateCount++] = binaryNodeId;
+            else
+            {
+                candidates[candidateCount++] = binaryNodeId + 1;
+                candidates[candidateCount++] = binaryNodeId + binaryNode.ChildOffset;
+            }
+            while (candidateCount < 4)
+            {
+                int bestCandidate = -1;
+                float bestArea = -1.0f;
+                for (int i = 0; i < candidateCount; i++)
+                {
+                    if (isLeaf(candidates[i]))
+                        continue;
+                    float area = SurfaceArea(bvh.Nodes[candidates[i]].Bounds);
+                    if (area > bestArea)
+                    {
+                        bestArea = area;
+                        bestCandidate = i;
+                    }
+                }
+                if (bestCandidate == -1)
+                    break;
+                int expandedNodeId = candidates[bestCandidate];
+                candidates[bestCandidate] = expandedNodeId + 1;
+                candidates[candidateCount++] = expandedNodeId + bvh.Nodes[expandedNodeId].ChildOffset;
+            }
+
+            int nodeId = Nodes.Count();
+            Bvh4Node node;
+            node.Init();
+            Nodes.Add(node);
+            for (int i = 0; i < candidateCount; i++)
+            {
+                int childId = candidates[i];
+                Nodes[nodeId].SetChildBounds(i, bvh.Nodes[childId].Bounds);
+                if (isLeaf(childId))
+                {
+                    int firstBlock = Blocks.Count();
+                    blockBuilder.BuildBlocks(Blocks, bvh.Elements.Buffer() + subtreeFirstElement[childId], subtreeElementCount[childId]);
+                    Nodes[nodeId].Children[i] = firstBlock;
+                    Nodes[nodeId].BlockCount[i] = Blocks.Count() - firstBlock;
+                }
+                else
+                {
+                    int childNodeId = CollapseNode(bvh, childId, blockBuilder);
+                    Nodes[nodeId].Children[i] = childNodeId;
+                    Nodes[nodeId].BlockCount[i] = 0;
+                }
+            }
+            return nodeId;
+        }
+    public:
+        CoreLib::List<Bvh4Node> Nodes;
+        CoreLib::List<TBlock> Blocks;
+        // Collapses a flattened binary BVH. TBlockBuilder must define ElementsPerBlock and
+        // `void BuildBlocks(List<TBlock> & blocks, T * elements, int count)`.
+        template<typename T, typename TBlockBuilder>
+        void FromBvh(Bvh<T> & bvh, TBlockBuilder & blockBuilder)
+        {
+            Nodes.Clear();
+            Blocks.Clear();
+            if (bvh.Nodes.Count() == 0)
+            {
+                // an empty tree still has a root node without any children, so traversal needs no special case.
+                Bvh4Node root;
+                root.Init();
+                Nodes.Add(root);
+                return;
+            }
+            // children always follow their parent in the flattened layout, so a reverse sweep
+            // computes the element range of every subtree.
+            subtreeFirstElement.SetSize(bvh.Nodes.Count());
+            subtreeElementCount.SetSize(bvh.Nodes.Count());
+            for (int i = bvh.Nodes.Count() - 1; i >= 0; i--)
+            {
+                auto & node = bvh.Nodes[i];
+                if (node.GetIsLeaf())
+                {
+                    subtreeFirstElement[i] = node.ElementId;
+                    subtreeElementCount[i] = node.GetElementCount();
+                }
+                else
+                {
+                    subtreeFirstElement[i] = subtreeFirstElement[i + 1];
+                    subtreeElementCount[i] = subtreeElementCount[i + 1] + subtreeElementCount[i + node.ChildOffset];
+                }
+            }
+            Nodes.Reserve(bvh.Nodes.Count() / 2 + 1);
+            CollapseNode(bvh, 0, blockBuilder);
+            subtreeFirstElement = CoreLib::List<int>();
+            subtreeElementCount = CoreLib::List<int>();
+            Nodes.Compress();
+            Blocks.Compress();
+        }
+    };
+
+    inline __m128 SafeRcp4(const VectorMath::Vec3 & dir, int axis)
+    {
+        float d = dir[axis];
+        if (d > -1e-20f && d < 1e-20f)
+            return _mm_set1_ps(d < 0.0f ? -1e30f : 1e30f);
+        return _mm_set1_ps(1.0f / d);
+    }
+
+    // Traverses a Bvh4 with a single ray. `tracer.Trace(block, tMax)` is invoked for every leaf block whose
+    // bounds are hit by the ray, and should return true and shrink tMax if it finds a closer intersection.
+    // When pred is true, the traversal terminates at the first intersection found (any-hit query).
+    template<typename TBlock, typename Tracer, bool pred>
+    bool TraverseBvh4(Tracer & tracer, const Bvh4<TBlock> & tree, const Ray & ray)
+    {
+        struct StackEntry
+        {
+            int Index;
+            int BlockCount;
+            float T;
+        };
+        const int stackSize = 512;
+        StackEntry stack[stackSize];
+        int stackPtr = 0;
+        bool hit = false;
+        float tMax = ray.tMax;
+
+        __m128 origin[3], rcpDir[3], originTimesRcpDir[3];
+        int nearOffset[3];
+        for (int i = 0; i < 3; i++)
+        {
+            origin[i] = _mm_set1_ps(ray.Origin[i]);
+            rcpDir[i] = SafeRcp4(ray.Dir, i);
+            originTimesRcpDir[i] = _mm_mul_ps(origin[i], rcpDir[i]);
+            // for negative ray directions the entry plane of a slab is the max plane
+            nearOffset[i] = ray.Dir[i] < 0.0f ? 1 : 0;
+        }
+        const __m128 zero = _mm_setzero_ps();
+        // slightly enlarge the exit distance to stay conservative under floating point rounding
+        const __m128 robustScale = _mm_set1_ps(1.0f + 2e-6f);
+
+        stack[stackPtr++] = StackEntry{ 0, 0, 0.0f };
+        while (stackPtr)
+        {
+            auto entry = stack[--stackPtr];
+            if (entry.T > tMax)
+                continue;
+            if (entry.BlockCount > 0)
+            {
+                for (int i = 0; i < entry.BlockCount; i++)
+                {
+                    if (tracer.Trace(tree.Blocks[entry.Index + i], tMax))
+                    {
+                        hit = true;
+                        if (pred)
+                            return true;
+                    }
+                }
+                continue;
+            }
+            auto & node = tree.Nodes[entry.Index];
+            const float * planes[2] = { &node.BoundsMin[0][0], &node.BoundsMax[0][0] };
+            __m128 tNear = zero;
+            __m128 tFar = _mm_set1_ps(tMax);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                __m128 nearPlane = _mm_loadu_ps(planes[nearOffset[axis]] + axis * 4);
+                __m128 farPlane = _mm_loadu_ps(planes[1 - nearOffset[axis]] + axis * 4);
+                __m128 t0 = _mm_sub_ps(_mm_mul_ps(nearPlane, rcpDir[axis]), originTimesRcpDir[axis]);
+                __m128 t1 = _mm_sub_ps(_mm_mul_ps(farPlane, rcpDir[axis]), originTimesRcpDir[axis]);
+                tNear = _mm_max_ps(tNear, t0);
+                tFar = _mm_min_ps(tFar, _mm_mul_ps(t1, robustScale));
+            }
+            int hitMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+            if (!hitMask)
+                continue;
+            alignas(16) float tNearValues[4];
+            _mm_store_ps(tNearValues, tNear);
+            // push the hit children so that the nearest one is on top of the stack
+            StackEntry hitChildren[4];
+            int hitCount = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if ((hitMask & (1 << i)) && node.BlockCount[i] >= 0)
+                {
+                    StackEntry child{ node.Children[i], node.BlockCount[i], tNearValues[i] };
+                    int j = hitCount++;
+                    while (j > 0 && hitChildren[j - 1].T < child.T)
+                    {
+                        hitChildren[j] = hitChildren[j - 1];
+                        j--;
+                    }
+                    hitChildren[j] = child;
+                }
+            }
+            if (stackPtr + hitCount > stackSize)
+                throw "stack overflow";
+            for (int i = 0; i < hitCount; i++)
+                stack[stackPtr++] = hitChildren[i];
+        }
+        return hit;
+    }
+
+    const int MaxBvh4PacketSize = 32;
+
+    // Traverses a Bvh4 with a packet of up to MaxBvh4PacketSize coherent rays. Each node is fetched once for the
+    // packet and only tested against the rays that reached it, so rays of a sorted stream share most of their node
+    // visits. `tracers[i].Trace(block, tMax)` is invoked for every leaf block whose bounds are hit by ray i, see
+    // TraverseBvh4. Returns the mask of the rays that hit.
+    template<typename TBlock, typename Tracer>
+    unsigned int TraversePacketBvh4(Tracer * tracers, const Bvh4<TBlock> & tree, const Ray * rays, int rayCount)
+    {
+        struct StackEntry
+        {
+            int Index;
+            int BlockCount;
+            unsigned int RayMask;
+        };
+        const int stackSize = 512;
+        StackEntry stack[stackSize];
+        int stackPtr = 0;
+        unsigned int hitRays = 0;
+        if (rayCount > MaxBvh4PacketSize)
+            throw "packet too large";
+
+        float tMax[MaxBvh4PacketSize];
+        __m128 rcpDir[MaxBvh4PacketSize][3], originTimesRcpDir[MaxBvh4PacketSize][3];
+        int nearOffset[MaxBvh4PacketSize][3];
+        for (int r = 0; r < rayCount; r++)
+        {
+            tMax[r] = rays[r].tMax;
+            for (int i = 0; i < 3; i++)
+            {
+                rcpDir[r][i] = SafeRcp4(rays[r].Dir, i);
+                originTimesRcpDir[r][i] = _mm_mul_ps(_mm_set1_ps(rays[r].Origin[i]), rcpDir[r][i]);
+                nearOffset[r][i] = rays[r].Dir[i] < 0.0f ? 1 : 0;
+            }
+        }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 robustScale = _mm_set1_ps(1.0f + 2e-6f);
+
+        unsigned int allRays = rayCount == 32 ? 0xFFFFFFFFu : (1u << rayCount) - 1;
+        stack[stackPtr++] = StackEntry{ 0, 0, allRays };
+        while (stackPtr)
+        {
+            auto entry = stack[--stackPtr];
+            if (entry.BlockCount > 0)
+            {
+                for (int r = 0; r < rayCount; r++)
+                {
+                    if (!(entry.RayMask & (1u << r)))
+                        continue;
+                    for (int i = 0; i < entry.BlockCount; i++)
+                    {
+                        if (tracers[r].Trace(tree.Blocks[entry.Index + i], tMax[r]))
+                            hitRays |= 1u << r;
+                    }
+                }
+                continue;
+            }
+            auto & node = tree.Nodes[entry.Index];
+            __m128 planes[2][3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                planes[0][axis] = _mm_loadu_ps(node.BoundsMin[axis]);
+                planes[1][axis] = _mm_loadu_ps(node.BoundsMax[axis]);
+            }
+            // rays that hit each child, and the nearest entry distance of any of them
+            unsigned int childRays[4] = {};
+            alignas(16) float childT[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+            for (int r = 0; r < rayCount; r++)
+            {
+                if (!(entry.RayMask & (1u << r)))
+                    continue;
+                __m128 tNear = zero;
+                __m128 tFar = _mm_set1_ps(tMax[r]);
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    __m128 t0 = _mm_sub_ps(_mm_mul_ps(planes[nearOffset[r][axis]][axis], rcpDir[r][axis]), originTimesRcpDir[r][axis]);
+                    __m128 t1 = _mm_sub_ps(_mm_mul_ps(planes[1 - nearOffset[r][axis]][axis], rcpDir[r][axis]), originTimesRcpDir[r][axis]);
+                    tNear = _mm_max_ps(tNear, t0);
+                    tFar = _mm_min_ps(tFar, _mm_mul_ps(t1, robustScale));
+                }
+                int hitMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+                if (!hitMask)
+                    continue;
+                alignas(16) float tNearValues[4];
+                _mm_store_ps(tNearValues, tNear);
+                for (int i = 0; i < 4; i++)
+                {
+                    if (hitMask & (1 << i))
+                    {
+                        childRays[i] |= 1u << r;
+                        childT[i] = CoreLib::Math::Min(childT[i], tNearValues[i]);
+                    }
+                }
+            }
+            // push the hit children so that the nearest one is on top of the stack
+            StackEntry hitChildren[4];
+            float hitChildT[4];
+            int hitCount = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (childRays[i] && node.BlockCount[i] >= 0)
+                {
+                    StackEntry child{ node.Children[i], node.BlockCount[i], childRays[i] };
+                    int j = hitCount++;
+                    while (j > 0 && hitChildT[j - 1] < childT[i])
+                    {
+                        hitChildren[j] = hitChildren[j - 1];
+                        hitChildT[j] = hitChildT[j - 1];
+                        j--;
+                    }
+                    hitChildren[j] = child;
+                    hitChildT[j] = childT[i];
+                }
+            }
+            if (stackPtr + hitCount > stackSize)
+                throw "stack overflow";
+            for (int i = 0; i < hitCount; i++)
+                stack[stackPtr++] = hitChildren[i];
+        }
+        return hitRays;
+    }
+}
+
+#endif
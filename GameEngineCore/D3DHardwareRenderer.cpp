@@ -3613,6 +3613,11 @@ public:
         return RendererState::Get().deviceName;
     }
 
+    virtual bool HasDevice() override
+    {
+        return true;
+    }
+
     virtual bool IsImageSpaceYAxisInverted() override
     {
         return false;
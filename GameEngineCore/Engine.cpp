@@ -3,6 +3,7 @@
 #include "CameraActor.h"
 #include "FreeRoamCameraController.h"
 #include "CoreLib/LibIO.h"
+#include "CoreLib/Archive.h"
 #include "CoreLib/Tokenizer.h"
 #include "EngineLimits.h"
 #include "CoreLib/Imaging/Bitmap.h"
@@ -29,6 +30,36 @@ namespace GameEngine
 
 	void RegisterEngineActorClasses(Engine *);
 
+	// mounts the asset archives (*.pak) in a directory, their entries are looked up relative to the directory
+	static void MountAssetArchives(const String & dir)
+	{
+		List<String> archiveFiles;
+		try
+		{
+			for (auto entry : DirectoryIterator(dir))
+			{
+				if (entry.type == DirectoryEntryType::File && Path::GetFileExt(entry.name).ToLower() == "pak")
+					archiveFiles.Add(entry.fullPath);
+			}
+		}
+		catch (...)
+		{
+			return;
+		}
+		archiveFiles.Sort();
+		for (auto & archiveFile : archiveFiles)
+		{
+			try
+			{
+				AssetArchive::Mount(new AssetArchive(archiveFile, dir));
+			}
+			catch (const IOException & e)
+			{
+				Engine::Print("cannot mount asset archive '%S': %S\n", archiveFile.ToWString(), e.Message.ToWString());
+			}
+		}
+	}
+
     String RemoveQuote(String str)
     {
         if (str.Length() >= 2 && str.StartsWith("\""))
@@ -143,6 +174,9 @@ namespace GameEngine
 			
             gameDir = Path::Normalize(args.GameDirectory);
             engineDir = Path::Normalize(args.EngineDirectory);
+            MountAssetArchives(gameDir);
+            if (engineDir != gameDir)
+                MountAssetArchives(engineDir);
             Path::CreateDir(Path::Combine(gameDir, "Cache"));
             Path::CreateDir(Path::Combine(gameDir, "Cache/Shaders"));
             Path::CreateDir(Path::Combine(gameDir, "Settings"));
@@ -279,6 +313,7 @@ namespace GameEngine
         debugGraphics = nullptr;
 		renderer = nullptr;
         shaderCompiler = nullptr;
+        AssetArchive::UnmountAll();
 	}
 
 	void Engine::SaveGraphicsSettings()
@@ -597,6 +632,9 @@ namespace GameEngine
 		try
 		{
 			auto actualFileName = FindFile(fileName, ResourceType::Level);
+			// cooked games may ship the binary level only
+			if (!actualFileName.Length())
+				actualFileName = FindFile(Level::GetBinaryFileName(fileName), ResourceType::Level);
 			level = new GameEngine::Level(actualFileName);
 			inDataTransfer = true;
 			renderer->InitializeLevel(level.Ptr());
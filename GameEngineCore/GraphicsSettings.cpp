@@ -20,6 +20,10 @@ namespace GameEngine
 				ShadowMapArraySize = StringToInt(settingsValue);
 			else if (settingsName == "ShadowMapResolution")
 				ShadowMapResolution = StringToInt(settingsValue);
+			else if (settingsName == "TextureStreamingBudget")
+				TextureStreamingBudget = StringToInt(settingsValue);
+			else if (settingsName == "AsyncShaderCompilation")
+				AsyncShaderCompilation = StringToInt(settingsValue) != 0;
 		}
 	}
 	void GraphicsSettings::SaveToFile(CoreLib::String fileName)
@@ -27,6 +31,8 @@ namespace GameEngine
 		StringBuilder sb;
 		sb << "ShadowMapArraySize = \"" << ShadowMapArraySize << "\"\n";
 		sb << "ShadowMapResolution = \"" << ShadowMapResolution << "\"\n";
+		sb << "TextureStreamingBudget = \"" << TextureStreamingBudget << "\"\n";
+		sb << "AsyncShaderCompilation = \"" << (AsyncShaderCompilation ? 1 : 0) << "\"\n";
 		File::WriteAllText(fileName, sb.ProduceString());
 	}
 }
@@ -11,6 +11,10 @@ namespace GameEngine
 		int ShadowMapArraySize = 8;
 		int ShadowMapResolution = 1024;
 		bool UsePipelineCache = true;
+		// compiles the shaders of new pipelines in the background, skipping their draws until they are ready
+		bool AsyncShaderCompilation = true;
+		// memory in MB for the mip levels of streamed textures
+		int TextureStreamingBudget = 1024;
 		void LoadFromFile(CoreLib::String fileName);
 		void SaveToFile(CoreLib::String fileName);
 	};
@@ -919,6 +919,8 @@ namespace GameEngine
 		virtual int StorageBufferAlignment() = 0;
         virtual WindowSurface * CreateSurface(WindowHandle windowHandle, int width, int height) = 0;
 		virtual CoreLib::String GetRendererName() = 0;
+		// false for renderers that do not execute the submitted work on a device, such as the dummy renderer of headless runs
+		virtual bool HasDevice() = 0;
         virtual bool IsImageSpaceYAxisInverted() = 0;
 	};
 
@@ -1,6 +1,7 @@
 #include "Engine.h"
 #include "Level.h"
 #include "CoreLib/LibIO.h"
+#include "CoreLib/Archive.h"
 #include "CoreLib/Tokenizer.h"
 #include "MeshBuilder.h"
 #include "CameraActor.h"
@@ -56,8 +57,28 @@ namespace GameEngine
 
     Level::Level(const CoreLib::String & fileName)
     {
-        FileName = fileName;
-        LoadFromText(File::ReadAllText(fileName));
+        // the binary level is used unless the text has been edited since it was compiled. Archived files have
+        // no write time, a cooked binary level is always used when either file is archived.
+        auto binaryFileName = GetBinaryFileName(fileName);
+        bool useBinary = binaryFileName == fileName;
+        FileName = useBinary ? Path::ReplaceExt(fileName, "level") : fileName;
+        if (!useBinary && File::Exists(binaryFileName))
+        {
+            useBinary = !File::Exists(fileName) || AssetArchive::Contains(binaryFileName) || AssetArchive::Contains(fileName) ||
+                File::GetLastWriteTime(binaryFileName) >= File::GetLastWriteTime(fileName);
+        }
+        if (useBinary)
+        {
+            auto data = File::ReadAllBytes(binaryFileName);
+            BinaryReader reader(new MemoryStream(data.GetArrayView()));
+            LoadFromBinary(reader);
+        }
+        else
+            LoadFromText(File::ReadAllText(fileName));
+    }
+    CoreLib::String Level::GetBinaryFileName(const CoreLib::String & fileName)
+    {
+        return Path::ReplaceExt(fileName, "blevel");
     }
     void Level::LoadFromText(CoreLib::String text)
     {
@@ -121,6 +142,7 @@ namespace GameEngine
                 }
                 else
                     Print("Error parsing object at line %d, ignoring the object.\n", pos.Line);
+                SkippedActorCount++;
                 errorRecover();
             }
             else
@@ -138,6 +160,7 @@ namespace GameEngine
                             Print("error: an actor named '%S' already exists, ignoring second definition at line %d.\n",
                                 actor->Name.GetValue().ToWString(), pos.Line);
                         }
+                        SkippedActorCount++;
                         errorRecover();
                     }
                     else
@@ -150,13 +173,117 @@ namespace GameEngine
                 catch (Exception e)
                 {
                     Print("OnLoad() error: an actor named '%S' failed to load, message: '%S'.\n", actor->Name.GetValue().ToWString(), e.Message.ToWString());
+                    SkippedActorCount++;
                     errorRecover();
                 }
             }
         }
         Print("Num materials: %d\n", Materials.Count());
     }
+    void Level::LoadFromBinary(BinaryReader & reader)
+    {
+        auto stream = reader.GetStream();
+        BinaryLevelHeader header, expectedHeader;
+        reader.Read(header);
+        if (memcmp(header.Identifier, expectedHeader.Identifier, sizeof(header.Identifier)) != 0)
+            throw IOException("invalid binary level file.");
+        if (header.Version != expectedHeader.Version)
+            throw IOException("unsupported binary level version " + String(header.Version) + ".");
+        BinaryLevelContext context;
+        context.Strings.SetSize(header.StringCount);
+        for (auto & str : context.Strings)
+            reader.Read(str);
+        if (header.LightmapFileNameId != -1)
+            LightmapFileName = context.Strings[header.LightmapFileNameId];
+        for (int i = 0; i < header.HiddenSectionCount; i++)
+            HiddenSections.Add(reader.ReadString());
+        for (int i = 0; i < header.ActorCount; i++)
+        {
+            int classNameId = reader.ReadInt32();
+            int blockSize = reader.ReadInt32();
+            auto blockEnd = stream->GetPosition() + blockSize;
+            auto & actorClass = context.Strings[classNameId];
+            ObjPtr<Actor> actor = Engine::Instance()->CreateActor(actorClass);
+            bool isInvalid = false;
+            if (!actor)
+            {
+                Print("Unknown actor class '%S', ignoring the object.\n", actorClass.ToWString());
+                SkippedActorCount++;
+            }
+            else
+            {
+                actor->ParseBinary(this, reader, context, classNameId, isInvalid);
+                if (isInvalid)
+                {
+                    Print("Error loading actor %d of class '%S', ignoring the object.\n", i, actorClass.ToWString());
+                    SkippedActorCount++;
+                }
+                else if (Actors.ContainsKey(actor->Name.GetValue()))
+                {
+                    Print("error: an actor named '%S' already exists, ignoring second definition.\n",
+                        actor->Name.GetValue().ToWString());
+                    SkippedActorCount++;
+                }
+                else
+                {
+                    try
+                    {
+                        RegisterActor(actor.Ptr());
+                        if (actor->GetEngineType() == EngineActorType::Camera)
+                            CurrentCamera = actor.As<CameraActor>();
+                    }
+                    catch (Exception e)
+                    {
+                        Print("OnLoad() error: an actor named '%S' failed to load, message: '%S'.\n", actor->Name.GetValue().ToWString(), e.Message.ToWString());
+                        SkippedActorCount++;
+                    }
+                }
+            }
+            stream->Seek(SeekOrigin::Start, blockEnd);
+        }
+        Print("Num materials: %d\n", Materials.Count());
+    }
     void Level::SaveToFile(CoreLib::String fileName)
+    {
+        File::WriteAllText(fileName, SaveToText());
+        SaveToBinaryFile(GetBinaryFileName(fileName));
+        FileName = fileName;
+    }
+    void Level::SaveToBinary(BinaryWriter & writer)
+    {
+        // actors are written first so that the string table is complete when the header is written
+        BinaryLevelContext context;
+        BinaryWriter actorWriter(new MemoryStream());
+        auto actorData = (MemoryStream *)actorWriter.GetStream();
+        for (auto & actor : Actors)
+        {
+            BinaryWriter blockWriter(new MemoryStream());
+            auto block = (MemoryStream *)blockWriter.GetStream();
+            actor.Value->SerializeToBinary(blockWriter, context);
+            actorWriter.Write(context.GetStringId(actor.Value->GetTypeName()));
+            actorWriter.Write(block->GetBufferSize());
+            actorWriter.Write((unsigned char *)block->GetBuffer(), block->GetBufferSize());
+        }
+        BinaryLevelHeader header;
+        if (LightmapFileName.Length())
+            header.LightmapFileNameId = context.GetStringId(LightmapFileName);
+        header.StringCount = context.Strings.Count();
+        header.ActorCount = Actors.Count();
+        header.HiddenSectionCount = HiddenSections.Count();
+        writer.Write(header);
+        for (auto & str : context.Strings)
+            writer.Write(str);
+        for (auto & sect : HiddenSections)
+            writer.Write(sect);
+        writer.Write((unsigned char *)actorData->GetBuffer(), actorData->GetBufferSize());
+    }
+    void Level::SaveToBinaryFile(const CoreLib::String & fileName)
+    {
+        BinaryWriter writer(new FileStream(fileName, FileMode::Create));
+        SaveToBinary(writer);
+        writer.Close();
+    }
+    CoreLib::String Level::SaveToText()
     {
         StringBuilder sb;
         if (LightmapFileName.Length())
@@ -165,8 +292,7 @@ namespace GameEngine
             actor.Value->SerializeToText(sb);
         for (auto & sect : HiddenSections)
             sb << "hidden " << sect << "\n";
-        File::WriteAllText(fileName, IndentText(sb.ProduceString()));
-        FileName = fileName;
+        return IndentText(sb.ProduceString());
     }
     Level::~Level()
     {
@@ -13,6 +13,20 @@ namespace GameEngine
     class Actor;
     class CameraActor;
 
+    struct BinaryLevelHeader
+    {
+        char Identifier[6] = { 'L', 'E', 'V', 'L', '|', 'B' };
+        int Version = 1;
+        int StringCount = 0;
+        int ActorCount = 0;
+        int HiddenSectionCount = 0;
+        // index into the string table, -1 if the level has no lightmaps
+        int LightmapFileNameId = -1;
+    };
+
+    // A level is stored as text for editing and compiled to a binary form that loads without tokenizing. The
+    // binary form starts with BinaryLevelHeader, followed by the string table, the hidden sections and one block per
+    // actor: class name id, block size, and per property its name id, size and value.
     class Level : public CoreLib::Object
     {
     private:
@@ -30,8 +44,17 @@ namespace GameEngine
         CoreLib::ObjPtr<CameraActor> CurrentCamera;
         CoreLib::String FileName;
         CoreLib::String LightmapFileName;
+        // number of actors left out by the loads because they could not be parsed, created or loaded
+        int SkippedActorCount = 0;
         void LoadFromText(CoreLib::String text);
+        void LoadFromBinary(CoreLib::IO::BinaryReader & reader);
+        // saves the text form of the level and its binary form next to it
         void SaveToFile(CoreLib::String fileName);
+        CoreLib::String SaveToText();
+        void SaveToBinary(CoreLib::IO::BinaryWriter & writer);
+        void SaveToBinaryFile(const CoreLib::String & fileName);
+        // name of the binary level compiled from a text level
+        static CoreLib::String GetBinaryFileName(const CoreLib::String & fileName);
         Level(const CoreLib::String & fileName);
         Level() = default;
         ~Level();
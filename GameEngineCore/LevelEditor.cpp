@@ -193,7 +193,8 @@ namespace GameEngine
             Engine::Instance()->GetRenderer()->UpdateLightmap(lightmapSet);
             return true;
         }
-        void BakeLightmaps()
+        // an incremental bake only rebakes the lightmaps affected by changes since the bake saved in the .lightmap file
+        void BakeLightmaps(bool resume = false, bool incremental = false)
         {
             statusPanel->SetText("Baking lightmaps...");
             if (lightmapBaker)
@@ -235,6 +236,28 @@ namespace GameEngine
             }
 
             LightmapBakingSettings settings;
+            settings.CheckpointFileName = Path::ReplaceExt(level->FileName, "lightmapcheckpoint");
+            settings.ResumeFromCheckpoint = resume;
+            auto lightmapFileName = Path::ReplaceExt(level->FileName, "lightmap");
+            if (incremental && File::Exists(lightmapFileName))
+            {
+                LightmapSet previousLightmaps;
+                bool isLoaded = false;
+                try
+                {
+                    previousLightmaps.LoadFromFile(level, lightmapFileName);
+                    isLoaded = true;
+                }
+                catch (const Exception & e)
+                {
+                    Engine::Print("cannot load previous lightmaps '%s' (%s), baking all lightmaps.\n", lightmapFileName.Buffer(), e.Message.Buffer());
+                }
+                if (isLoaded)
+                {
+                    lightmapBaker->StartIncremental(settings, level, previousLightmaps);
+                    return;
+                }
+            }
             lightmapBaker->Start(settings, level);
         }
         void InitUI()
@@ -311,6 +334,12 @@ namespace GameEngine
             auto mnLighting = new MenuItem(mainMenu, "&Lighting");
             auto mnPrebakeLighting = new MenuItem(mnLighting, "&Bake Lightmaps");
             mnPrebakeLighting->OnClick.Bind(this, &LevelEditorImpl::mnBakeLightmaps_Clicked);
+            auto mnBakeChangedLightmaps = new MenuItem(mnLighting, "Bake C&hanged Lightmaps");
+            mnBakeChangedLightmaps->OnClick.Bind(this, &LevelEditorImpl::mnBakeChangedLightmaps_Clicked);
+            auto mnResumeBaking = new MenuItem(mnLighting, "&Resume Baking");
+            mnResumeBaking->OnClick.Bind(this, &LevelEditorImpl::mnResumeBaking_Clicked);
+            auto mnFinishBaking = new MenuItem(mnLighting, "&Finish Baking");
+            mnFinishBaking->OnClick.Bind(this, &LevelEditorImpl::mnFinishBaking_Clicked);
             auto mnCancelBaking = new MenuItem(mnLighting, "&Cancel Baking");
             mnCancelBaking->OnClick.Bind(this, &LevelEditorImpl::mnCancelBaking_Clicked);
             auto mnExportLightmap = new MenuItem(mnLighting, "Ex&port Lightmap...");
@@ -678,6 +707,11 @@ namespace GameEngine
             if (lightmapBaker)
                 lightmapBaker->Cancel();
         }
+        void mnFinishBaking_Clicked(UI_Base*)
+        {
+            if (lightmapBaker && lightmapBaker->IsRunning())
+                lightmapBaker->Stop();
+        }
         void mnDebugView_Clicked(UI_Base* sender)
         {
             Engine::Instance()->GetRenderer()->SetDebugView(((GraphicsUI::MenuItem*)sender)->GetText());
@@ -746,6 +780,14 @@ namespace GameEngine
         void mnBakeLightmaps_Clicked(UI_Base*)
         {
             BakeLightmaps();
+        }
+        void mnBakeChangedLightmaps_Clicked(UI_Base*)
+        {
+            BakeLightmaps(false, true);
+        }
+        void mnResumeBaking_Clicked(UI_Base*)
+        {
+            BakeLightmaps(true);
         }
 		void UIEntry_MouseMove(UI_Base *, UIMouseEventArgs & e)
 		{
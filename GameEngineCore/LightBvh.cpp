@@ -0,0 +1,166 @@
+#include "LightBvh.h"
+#include "StaticScene.h"
+#include <algorithm>
+
+using namespace CoreLib;
+using namespace VectorMath;
+
+namespace GameEngine
+{
+    // smallest cone containing both cones, after "Importance Sampling of Many Lights with Adaptive Tree Splitting"
+    static void UnionCones(LightBvhNode & result, const LightBvhNode & a, const LightBvhNode & b)
+    {
+        if (b.ThetaO > a.ThetaO)
+        {
+            UnionCones(result, b, a);
+            return;
+        }
+        float cosThetaD = Math::Clamp(Vec3::Dot(a.Axis, b.Axis), -1.0f, 1.0f);
+        float thetaD = acosf(cosThetaD);
+        result.ThetaE = Math::Max(a.ThetaE, b.ThetaE);
+        if (Math::Min(thetaD + b.ThetaO, Math::Pi) <= a.ThetaO)
+        {
+            result.Axis = a.Axis;
+            result.ThetaO = a.ThetaO;
+            return;
+        }
+        float thetaO = (a.ThetaO + thetaD + b.ThetaO) * 0.5f;
+        if (thetaO >= Math::Pi)
+        {
+            result.Axis = a.Axis;
+            result.ThetaO = Math::Pi;
+            return;
+        }
+        // rotate the axis of a towards the axis of b
+        float thetaR = thetaO - a.ThetaO;
+        auto ortho = b.Axis - a.Axis * cosThetaD;
+        float orthoLength = ortho.Length();
+        result.Axis = a.Axis;
+        if (orthoLength > 1e-6f)
+            result.Axis = (a.Axis * cosf(thetaR) + ortho * (sinf(thetaR) / orthoLength)).Normalize();
+        result.ThetaO = thetaO;
+    }
+
+    void LightBvh::Build(const List<StaticLight> & lights)
+    {
+        Nodes.Clear();
+        List<int> lightIds;
+        for (int i = 0; i < lights.Count(); i++)
+        {
+            if (lights[i].Type != StaticLightType::Directional)
+                lightIds.Add(i);
+        }
+        lightCount = lightIds.Count();
+        if (lightCount == 0)
+            return;
+        Nodes.Reserve(lightCount * 2 - 1);
+        Nodes.SetSize(1);
+        BuildNode(lights, lightIds, 0, 0, lightIds.Count());
+    }
+
+    void LightBvh::BuildNode(const List<StaticLight> & lights, List<int> & lightIds, int nodeId, int begin, int end)
+    {
+        if (end - begin == 1)
+        {
+            auto & light = lights[lightIds[begin]];
+            auto & node = Nodes[nodeId];
+            node.BoundsMin = node.BoundsMax = light.Position;
+            if (light.Type == StaticLightType::Spot)
+            {
+                node.Axis = light.Direction;
+                node.ThetaO = 0.0f;
+                node.ThetaE = Math::Min(light.SpotFadingEndAngle, Math::Pi);
+            }
+            else
+            {
+                node.Axis = Vec3::Create(0.0f, 1.0f, 0.0f);
+                node.ThetaO = Math::Pi;
+                node.ThetaE = 0.0f;
+            }
+            node.Power = Math::Max(0.0f, light.Intensity.x * 0.2126f + light.Intensity.y * 0.7152f + light.Intensity.z * 0.0722f);
+            node.MaxRadius = light.Radius;
+            node.Child = -1;
+            node.LightId = lightIds[begin];
+            return;
+        }
+        // split at the median of the light positions along the longest axis of their bounds
+        Vec3 boundsMin = lights[lightIds[begin]].Position;
+        Vec3 boundsMax = boundsMin;
+        for (int i = begin + 1; i < end; i++)
+        {
+            boundsMin = Vec3::Create(Math::Min(boundsMin.x, lights[lightIds[i]].Position.x), Math::Min(boundsMin.y, lights[lightIds[i]].Position.y),
+                Math::Min(boundsMin.z, lights[lightIds[i]].Position.z));
+            boundsMax = Vec3::Create(Math::Max(boundsMax.x, lights[lightIds[i]].Position.x), Math::Max(boundsMax.y, lights[lightIds[i]].Position.y),
+                Math::Max(boundsMax.z, lights[lightIds[i]].Position.z));
+        }
+        auto extent = boundsMax - boundsMin;
+        int axis = 0;
+        if (extent.y > extent[axis])
+            axis = 1;
+        if (extent.z > extent[axis])
+            axis = 2;
+        int mid = (begin + end) / 2;
+        std::nth_element(lightIds.Buffer() + begin, lightIds.Buffer() + mid, lightIds.Buffer() + end, [&](int a, int b)
+        {
+            return lights[a].Position[axis] < lights[b].Position[axis];
+        });
+        int child = Nodes.Count();
+        Nodes.SetSize(child + 2);
+        BuildNode(lights, lightIds, child, begin, mid);
+        BuildNode(lights, lightIds, child + 1, mid, end);
+
+        LightBvhNode node;
+        auto & left = Nodes[child];
+        auto & right = Nodes[child + 1];
+        node.BoundsMin = boundsMin;
+        node.BoundsMax = boundsMax;
+        UnionCones(node, left, right);
+        node.Power = left.Power + right.Power;
+        node.MaxRadius = (left.MaxRadius == 0.0f || right.MaxRadius == 0.0f) ? 0.0f : Math::Max(left.MaxRadius, right.MaxRadius);
+        node.Child = child;
+        node.LightId = -1;
+        Nodes[nodeId] = node;
+    }
+
+    float LightBvh::GetImportance(const LightBvhNode & node, Vec3 position, Vec3 normal) const
+    {
+        // the lighting model of the baker has no distance falloff except for the range of a light
+        float falloff = 1.0f;
+        if (node.MaxRadius > 0.0f)
+        {
+            Vec3 closestPoint = Vec3::Create(Math::Clamp(position.x, node.BoundsMin.x, node.BoundsMax.x),
+                Math::Clamp(position.y, node.BoundsMin.y, node.BoundsMax.y), Math::Clamp(position.z, node.BoundsMin.z, node.BoundsMax.z));
+            float boundsDist = (closestPoint - position).Length();
+            if (boundsDist >= node.MaxRadius)
+                return 0.0f;
+            falloff = 1.0f - sqrtf(boundsDist / node.MaxRadius);
+        }
+        auto center = (node.BoundsMin + node.BoundsMax) * 0.5f;
+        float halfDiagonal = (node.BoundsMax - node.BoundsMin).Length() * 0.5f;
+        auto toCenter = center - position;
+        float dist = toCenter.Length();
+        // the bounds may be in any direction when the point is inside their bounding sphere
+        if (dist <= halfDiagonal || dist == 0.0f)
+            return node.Power * falloff;
+        auto dir = toCenter * (1.0f / dist);
+        float sinThetaU = halfDiagonal / dist;
+        float cosThetaU = sqrtf(Math::Max(0.0f, 1.0f - sinThetaU * sinThetaU));
+        // largest cosine between the normal and a direction towards the bounds
+        float cosThetaI = Math::Clamp(Vec3::Dot(normal, dir), -1.0f, 1.0f);
+        float cosThetaIBound = 1.0f;
+        if (cosThetaI < cosThetaU)
+        {
+            float sinThetaI = sqrtf(Math::Max(0.0f, 1.0f - cosThetaI * cosThetaI));
+            cosThetaIBound = cosThetaI * cosThetaU + sinThetaI * sinThetaU;
+        }
+        if (cosThetaIBound <= 0.0f)
+            return 0.0f;
+        // the point must be within the emission cone of at least one light. Spot lights compare their direction
+        // with the direction from the surface to the light.
+        float theta = acosf(Math::Clamp(Vec3::Dot(node.Axis, dir), -1.0f, 1.0f));
+        float thetaU = asinf(Math::Min(sinThetaU, 1.0f));
+        if (theta - node.ThetaO - thetaU > node.ThetaE)
+            return 0.0f;
+        return node.Power * falloff * cosThetaIBound;
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef GAME_ENGINE_LIGHT_BVH_H
+#define GAME_ENGINE_LIGHT_BVH_H
+
+#include "CoreLib/Basic.h"
+#include "CoreLib/VectorMath.h"
+#include "CoreLib/LibMath.h"
+
+namespace GameEngine
+{
+    struct StaticLight;
+
+    struct LightBvhNode
+    {
+        // bounds of the light positions below the node
+        VectorMath::Vec3 BoundsMin, BoundsMax;
+        // cone of the light axes: a light axis deviates at most ThetaO from Axis, and a light only reaches
+        // directions within ThetaE of its axis. Angles are in radians.
+        VectorMath::Vec3 Axis;
+        float ThetaO, ThetaE;
+        float Power;
+        // largest radius of the lights below the node, 0 if one of them has an unlimited range
+        float MaxRadius;
+        // first of the two children of an interior node, -1 for a leaf
+        int Child;
+        // index of the light of a leaf into the light list passed to Build
+        int LightId;
+    };
+
+    // Bounding volume hierarchy over point and spot lights with power and orientation bounds per node, used to
+    // importance sample the lights of scenes with too many of them to evaluate every light for every texel.
+    class LightBvh
+    {
+    private:
+        int lightCount = 0;
+        void BuildNode(const CoreLib::List<StaticLight> & lights, CoreLib::List<int> & lightIds, int nodeId, int begin, int end);
+    public:
+        CoreLib::List<LightBvhNode> Nodes;
+        // builds the hierarchy over the point and spot lights of the list, directional lights are skipped
+        void Build(const CoreLib::List<StaticLight> & lights);
+        int GetLightCount() const
+        {
+            return lightCount;
+        }
+        // conservative estimate of the lighting that the lights of a node contribute to a surface point. Never 0 if one
+        // of the lights can light the point.
+        float GetImportance(const LightBvhNode & node, VectorMath::Vec3 position, VectorMath::Vec3 normal) const;
+        // Selects at most maxLightCount lights for a surface point and calls f(lightId, weight) for each of them.
+        // The most important nodes are split until the limit is reached; lights that end up alone in a node are
+        // evaluated exactly with weight 1, and one light is sampled from every other node proportionally to importance
+        // and weighted by the inverse of its probability, so that the weighted sum is an unbiased estimate.
+        template<typename LightFunc>
+        void SampleLights(CoreLib::Basic::Random & random, VectorMath::Vec3 position, VectorMath::Vec3 normal, int maxLightCount, const LightFunc & f) const
+        {
+            if (Nodes.Count() == 0)
+                return;
+            struct CutNode
+            {
+                int NodeId;
+                float Importance;
+            };
+            const int MaxCutSize = 64;
+            CutNode cut[MaxCutSize];
+            int cutSize = 0;
+            maxLightCount = CoreLib::Math::Clamp(maxLightCount, 1, MaxCutSize);
+            float rootImportance = GetImportance(Nodes[0], position, normal);
+            if (rootImportance > 0.0f)
+                cut[cutSize++] = CutNode{ 0, rootImportance };
+            while (true)
+            {
+                int splitId = -1;
+                for (int i = 0; i < cutSize; i++)
+                {
+                    if (Nodes[cut[i].NodeId].Child != -1 && (splitId == -1 || cut[i].Importance > cut[splitId].Importance))
+                        splitId = i;
+                }
+                if (splitId == -1 || cutSize == maxLightCount)
+                    break;
+                int child = Nodes[cut[splitId].NodeId].Child;
+                cut[splitId] = cut[--cutSize];
+                for (int c = 0; c < 2; c++)
+                {
+                    float importance = GetImportance(Nodes[child + c], position, normal);
+                    if (importance > 0.0f)
+                        cut[cutSize++] = CutNode{ child + c, importance };
+                }
+            }
+            for (int i = 0; i < cutSize; i++)
+            {
+                int nodeId = cut[i].NodeId;
+                float probability = 1.0f;
+                while (Nodes[nodeId].Child != -1)
+                {
+                    int child = Nodes[nodeId].Child;
+                    float importance0 = GetImportance(Nodes[child], position, normal);
+                    float importance1 = GetImportance(Nodes[child + 1], position, normal);
+                    if (importance0 + importance1 <= 0.0f)
+                        break;
+                    float probability0 = importance0 / (importance0 + importance1);
+                    if (random.NextFloat() < probability0)
+                    {
+                        nodeId = child;
+                        probability *= probability0;
+                    }
+                    else
+                    {
+                        nodeId = child + 1;
+                        probability *= 1.0f - probability0;
+                    }
+                }
+                if (Nodes[nodeId].Child == -1)
+                    f(Nodes[nodeId].LightId, 1.0f / probability);
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include "LightmapBakeBenchmark.h"
+#include "Engine.h"
+#include "Level.h"
+#include "CoreLib/LibIO.h"
+#include <math.h>
+
+using namespace CoreLib;
+using namespace VectorMath;
+
+namespace GameEngine
+{
+    bool GetLightmapBakingPreset(const String & name, LightmapBakingSettings & settings)
+    {
+        settings = LightmapBakingSettings();
+        settings.UseCpuCompression = true;
+        if (name == "preview")
+        {
+            settings.ResolutionScale = 0.5f;
+            settings.IndirectLightingBounces = 2;
+            settings.SampleCount = 8;
+            settings.FinalGatherSampleCount = 32;
+            settings.CompressionQuality = BC6HQuality::Fast;
+        }
+        else if (name == "default")
+        {
+        }
+        else if (name == "production")
+        {
+            settings.ResolutionScale = 2.0f;
+            settings.MaxResolution = 2048;
+            settings.SampleCount = 32;
+            settings.FinalGatherSampleCount = 512;
+            settings.CompressionQuality = BC6HQuality::High;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    LightmapComparisonResult CompareLightmapSets(LightmapSet & result, LightmapSet & reference)
+    {
+        LightmapComparisonResult comparison;
+        double squaredErrorSum = 0.0;
+        float peak = 0.0f;
+        for (auto & actorMap : result.ActorLightmapIds)
+        {
+            int referenceMapId = -1;
+            if (!reference.ActorLightmapIds.TryGetValue(actorMap.Key, referenceMapId))
+            {
+                comparison.MismatchedMapCount++;
+                continue;
+            }
+            auto & map = result.Lightmaps[actorMap.Value];
+            auto & referenceMap = reference.Lightmaps[referenceMapId];
+            if (map.Width != referenceMap.Width || map.Height != referenceMap.Height)
+            {
+                comparison.MismatchedMapCount++;
+                continue;
+            }
+            for (int y = 0; y < map.Height; y++)
+            {
+                for (int x = 0; x < map.Width; x++)
+                {
+                    auto value = map.GetPixel(x, y).xyz();
+                    auto referenceValue = referenceMap.GetPixel(x, y).xyz();
+                    for (int c = 0; c < 3; c++)
+                    {
+                        double diff = value[c] - referenceValue[c];
+                        squaredErrorSum += diff * diff;
+                        peak = Math::Max(peak, referenceValue[c]);
+                    }
+                }
+            }
+            comparison.TexelCount += map.Width * map.Height;
+            comparison.ComparedMapCount++;
+        }
+        for (auto & actorMap : reference.ActorLightmapIds)
+        {
+            if (!result.ActorLightmapIds.ContainsKey(actorMap.Key))
+                comparison.MismatchedMapCount++;
+        }
+        if (comparison.TexelCount)
+        {
+            comparison.RMSE = sqrt(squaredErrorSum / (comparison.TexelCount * 3));
+            comparison.PSNR = comparison.RMSE > 0.0 ? 20.0 * log10(Math::Max(peak, 1e-6f) / comparison.RMSE) : INFINITY;
+        }
+        return comparison;
+    }
+
+    int RunLightmapBakeBenchmark(const LightmapBakeBenchmarkArguments & args)
+    {
+        LightmapBakingSettings settings;
+        if (!GetLightmapBakingPreset(args.Preset, settings))
+        {
+            Engine::Print("unknown lightmap baking preset '%s'\n", args.Preset.Buffer());
+            return 1;
+        }
+        Engine::Instance()->LoadLevel(args.LevelFileName);
+        auto level = Engine::Instance()->GetLevel();
+        if (!level)
+            return 1;
+
+        RefPtr<LightmapBaker> baker = CreateLightmapBaker();
+        Engine::Print("baking '%s' with preset '%s'...\n", args.LevelFileName.Buffer(), args.Preset.Buffer());
+        baker->Start(settings, level);
+        baker->Wait();
+        if (baker->IsCancelled())
+        {
+            Engine::Print("baking failed.\n");
+            return 1;
+        }
+        auto stats = baker->GetStatistics();
+        float traceTime = stats.BiasTime + stats.DirectLightingTime + stats.IndirectLightingTime;
+        Engine::Print("lightmaps:          %d\n", baker->GetLightmapSet().Lightmaps.Count());
+        Engine::Print("G-buffer:           %.3f s\n", stats.GBufferTime);
+        Engine::Print("scene build:        %.3f s (overlaps G-buffer)\n", stats.SceneBuildTime);
+        Engine::Print("G-buffer bias:      %.3f s\n", stats.BiasTime);
+        Engine::Print("direct lighting:    %.3f s\n", stats.DirectLightingTime);
+        Engine::Print("indirect lighting:  %.3f s\n", stats.IndirectLightingTime);
+        Engine::Print("compression:        %.3f s\n", stats.CompressionTime);
+        Engine::Print("total:              %.3f s\n", stats.TotalTime);
+        Engine::Print("rays:               %lld (%.2f Mrays/s)\n", (long long)stats.RayCount,
+            traceTime > 0.0f ? stats.RayCount / (traceTime * 1e6) : 0.0);
+
+        if (args.OutputFileName.Length())
+        {
+            baker->GetLightmapSet().SaveToFile(level, args.OutputFileName);
+            Engine::Print("lightmaps saved to '%s'.\n", args.OutputFileName.Buffer());
+        }
+        if (args.DistributedJobDirectory.Length())
+        {
+            auto distributedSettings = settings;
+            distributedSettings.DistributedJobDirectory = args.DistributedJobDirectory;
+            distributedSettings.LocalWorkerCount = args.DistributedWorkerCount;
+            RefPtr<LightmapBaker> distributedBaker = CreateLightmapBaker();
+            Engine::Print("baking '%s' with %d workers in '%s'...\n", args.LevelFileName.Buffer(), args.DistributedWorkerCount,
+                args.DistributedJobDirectory.Buffer());
+            distributedBaker->Start(distributedSettings, level);
+            distributedBaker->Wait();
+            if (distributedBaker->IsCancelled())
+            {
+                Engine::Print("distributed baking failed.\n");
+                return 1;
+            }
+            // tiles keep their random seeds, so distributing a bake must not change a single texel
+            auto comparison = CompareLightmapSets(distributedBaker->GetLightmapSet(), baker->GetLightmapSet());
+            Engine::Print("distributed RMSE:   %.6f\n", comparison.RMSE);
+            if (comparison.MismatchedMapCount || comparison.RMSE != 0.0)
+            {
+                Engine::Print("the distributed bake differs from the local bake.\n");
+                return 1;
+            }
+        }
+        if (args.ReferenceFileName.Length())
+        {
+            LightmapSet reference;
+            try
+            {
+                reference.LoadFromFile(level, args.ReferenceFileName);
+            }
+            catch (const IO::IOException &)
+            {
+                Engine::Print("cannot load reference lightmaps '%s'.\n", args.ReferenceFileName.Buffer());
+                return 1;
+            }
+            auto comparison = CompareLightmapSets(baker->GetLightmapSet(), reference);
+            Engine::Print("compared lightmaps: %d (%d mismatched)\n", comparison.ComparedMapCount, comparison.MismatchedMapCount);
+            Engine::Print("RMSE:               %.6f\n", comparison.RMSE);
+            Engine::Print("PSNR:               %.2f dB\n", comparison.PSNR);
+            if (comparison.MismatchedMapCount)
+            {
+                Engine::Print("the reference lightmaps do not match the level.\n");
+                return 1;
+            }
+            if (comparison.PSNR < args.MinPSNR)
+            {
+                Engine::Print("PSNR is below the threshold of %.2f dB.\n", args.MinPSNR);
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
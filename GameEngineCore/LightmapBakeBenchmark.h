@@ -0,0 +1,48 @@
+#ifndef GAME_ENGINE_LIGHTMAP_BAKE_BENCHMARK_H
+#define GAME_ENGINE_LIGHTMAP_BAKE_BENCHMARK_H
+
+#include "LightmapBaker.h"
+
+namespace GameEngine
+{
+    struct LightmapBakeBenchmarkArguments
+    {
+        CoreLib::String LevelFileName;
+        // one of the presets of GetLightmapBakingPreset
+        CoreLib::String Preset = "default";
+        // lightmap set the result is compared against, no comparison is made when empty
+        CoreLib::String ReferenceFileName;
+        // the baked lightmap set is saved to this file when not empty, e.g. to update the reference
+        CoreLib::String OutputFileName;
+        // the benchmark fails if the PSNR against the reference is lower than this
+        float MinPSNR = 0.0f;
+        // when not empty, the level is baked a second time distributed across DistributedWorkerCount local worker
+        // processes sharing this directory, and the benchmark fails unless both bakes give the same lightmaps
+        CoreLib::String DistributedJobDirectory;
+        int DistributedWorkerCount = 2;
+    };
+
+    struct LightmapComparisonResult
+    {
+        int ComparedMapCount = 0;
+        // lightmaps missing in either set or having a different resolution
+        int MismatchedMapCount = 0;
+        int64_t TexelCount = 0;
+        double RMSE = 0.0;
+        // relative to the brightest channel of the reference, infinite for identical lightmaps
+        double PSNR = 0.0;
+    };
+
+    // fills settings with a named preset: "preview", "default" or "production". Returns false for unknown names.
+    // The presets compress on the CPU so that the results do not depend on the GPU.
+    bool GetLightmapBakingPreset(const CoreLib::String & name, LightmapBakingSettings & settings);
+
+    // compares the lightmaps of two sets baked for the same level, matched by actor
+    LightmapComparisonResult CompareLightmapSets(LightmapSet & result, LightmapSet & reference);
+
+    // bakes a level with a preset, prints the time spent in each phase, the ray throughput and the difference
+    // to the reference lightmaps. Returns the exit code of the benchmark, 0 on success.
+    int RunLightmapBakeBenchmark(const LightmapBakeBenchmarkArguments & args);
+}
+
+#endif
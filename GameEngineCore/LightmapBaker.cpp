@@ -1,30 +1,99 @@
 #include "LightmapBaker.h"
 #include "ObjectSpaceGBufferRenderer.h"
+#include "ObjectSpaceGBufferRasterizer.h"
+#include "RadianceCache.h"
 #include "StaticSceneRenderer.h"
 #include "ObjectSpaceMapSet.h"
 #include "Level.h"
 #include "StaticMeshActor.h"
+#include "LightActor.h"
+#include "PointLightActor.h"
+#include "DirectionalLightActor.h"
+#include "AmbientLightActor.h"
 #include "CoreLib/VectorMath.h"
 #include "Engine.h"
 #include "CameraActor.h"
 #include "CoreLib/Threading.h"
 #include "LightmapUVGeneration.h"
 #include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <chrono>
+#include <thread>
 
 namespace GameEngine
 {
     using namespace CoreLib;
-    static thread_local int pixelCounter = 0;
-    static thread_local bool threadCancelled = false;
-    static thread_local unsigned int threadRandomSeed = 0;
+    using namespace CoreLib::IO;
+
+    // 64-bit FNV-1a hash of baking inputs
+    class BakingInputHasher
+    {
+    private:
+        uint64_t value = 14695981039346656037ull;
+    public:
+        void Add(const void * data, size_t size)
+        {
+            auto bytes = (const unsigned char *)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                value ^= bytes[i];
+                value *= 1099511628211ull;
+            }
+        }
+        template<typename T>
+        void Add(const T & val)
+        {
+            Add(&val, sizeof(T));
+        }
+        void Add(const String & str)
+        {
+            Add(str.Buffer(), str.Length());
+        }
+        uint64_t GetValue()
+        {
+            return value;
+        }
+    };
+
+    const int LightmapCheckpointFileVersion = 2;
+    struct LightmapCheckpointFileHeader
+    {
+        char Identifier[4] = {'G', 'L', 'M', 'C'};
+        int Version = LightmapCheckpointFileVersion;
+        unsigned int SettingsHash[2] = {};
+        unsigned int InputHash[2] = {};
+        int MapCount = 0;
+        int CompletedBounces = 0;
+        int FinalGatherSampleCount = 0;
+        int Reserved[9] = {};
+    };
+
+    const int LightmapDistributedFileVersion = 2;
+    // header of the session and pass files of a distributed bake
+    struct LightmapDistributedFileHeader
+    {
+        char Identifier[4] = {'G', 'L', 'M', 'D'};
+        int Version = LightmapDistributedFileVersion;
+        int SessionId = 0;
+        int MapCount = 0;
+    };
+
+    // rays traced by the current thread since its count was last added to the baker statistics
+    static thread_local int64_t threadRayCount = 0;
+    // set on a thread while it gathers the lighting at a hit that the radiance cache does not cover
+    static thread_local bool isGatheringCacheMiss = false;
+    // voxels searched around a radiance cache miss for cells to interpolate
+    static const int RadianceCacheSearchRadius = 2;
+
     class LightmapBakerImpl : public LightmapBaker
     {
     public:
         LightmapBakingSettings settings;
         LightmapSet lightmaps, lightmapsReturn;
-        ComputeKernel* lightmapComrpessionKernel;
-        int totalBlocks;
-        std::atomic<int> completedBlocks;
+        ComputeKernel* lightmapComrpessionKernel = nullptr;
+        bool isGpuCompressionUnavailable = false;
+        CoreLib::Threading::ThreadPool threadPool;
     private:
         struct RawMapSet
         {
@@ -42,6 +111,24 @@ namespace GameEngine
             }
         };
         List<RawMapSet> maps;
+        RadianceCache radianceCache;
+        // incremental baking: maps that are not dirty keep the lightmap at previousMapIds[i] of previousLightmaps
+        bool isIncremental = false;
+        LightmapSet previousLightmaps;
+        List<bool> mapDirty;
+        List<int> previousMapIds;
+        List<RawObjectSpaceMap> reusedLightmaps;
+        // progressive baking state: number of finished indirect bounces, and for the final gather the
+        // sample-weighted sum of all finished passes together with the number of samples per texel in it.
+        int completedBounces = 0;
+        int finalGatherSampleCount = 0;
+        List<RawObjectSpaceMap> finalGatherAccumulators;
+        bool isFinalGather = false;
+        bool hasCheckpointState = false;
+        CoreLib::Diagnostics::TimePoint lastCheckpointTime;
+        LightmapBakerStatistics statistics;
+        std::atomic<int64_t> tracedRayCount{0};
+        CoreLib::Diagnostics::TimePoint bakeStartTime, phaseStartTime;
         Level* level = nullptr;
         RefPtr<StaticScene> staticScene;
         void AllocLightmaps()
@@ -69,6 +156,194 @@ namespace GameEngine
                 maps[i].Init(mapResolutions[i], mapResolutions[i]);
             lightmaps.Lightmaps.SetSize(mapResolutions.Count());
         }
+        uint64_t ComputeSettingsHash()
+        {
+            BakingInputHasher hasher;
+            hasher.Add(settings.ResolutionScale);
+            hasher.Add(settings.MinResolution);
+            hasher.Add(settings.MaxResolution);
+            hasher.Add(settings.IndirectLightingBounces);
+            hasher.Add(settings.SampleCount);
+            hasher.Add(settings.FinalGatherSampleCount);
+            hasher.Add(settings.FinalGatherAdaptiveSampleThreshold);
+            hasher.Add(settings.Epsilon);
+            hasher.Add(settings.ShadowBias);
+            hasher.Add(settings.IndirectLightingWorldGranularity);
+            hasher.Add(settings.DenoiseIndirectLighting);
+            hasher.Add(settings.Denoiser.Iterations);
+            hasher.Add(settings.Denoiser.ColorSigma);
+            hasher.Add(settings.Denoiser.PositionSigma);
+            hasher.Add(settings.RadianceCacheCellSize);
+            hasher.Add(settings.RadianceCacheSampleCount);
+            hasher.Add(settings.DirectLightingShadowRayCount);
+            return hasher.GetValue();
+        }
+        // records a hash of the transform, mesh and material of every static mesh actor and of the parameters
+        // of every light, together with the region each of them influences.
+        void ComputeInputRecords()
+        {
+            lightmaps.SettingsHash = ComputeSettingsHash();
+            for (auto & actor : level->Actors)
+            {
+                LightmapInputRecord record;
+                BakingInputHasher hasher;
+                hasher.Add(actor.Value->LocalTransform.GetValue());
+                hasher.Add(actor.Value->CastShadow.GetValue());
+                if (auto smActor = actor.Value.As<StaticMeshActor>())
+                {
+                    hasher.Add(smActor->IncludeInBaking.GetValue());
+                    if (auto mesh = smActor->GetMesh())
+                    {
+                        hasher.Add(mesh->GetVertexBuffer(), (size_t)mesh->GetVertexCount() * mesh->GetVertexSize());
+                        hasher.Add(mesh->Indices.Buffer(), mesh->Indices.Count() * sizeof(int));
+                    }
+                    if (smActor->MaterialInstance)
+                    {
+                        StringBuilder materialSB;
+                        smActor->MaterialInstance->Serialize(materialSB);
+                        hasher.Add(materialSB.ProduceString());
+                    }
+                    record.Bounds = smActor->Bounds;
+                }
+                else if (auto light = actor.Value.As<LightActor>())
+                {
+                    hasher.Add(light->lightType);
+                    hasher.Add(light->Mobility.GetValue());
+                    hasher.Add(light->EnableShadows.GetValue());
+                    hasher.Add(light->Radius.GetValue());
+                    if (auto pointLight = actor.Value.As<PointLightActor>())
+                    {
+                        hasher.Add(pointLight->IsSpotLight.GetValue());
+                        hasher.Add(pointLight->Color.GetValue());
+                        hasher.Add(pointLight->SpotLightStartAngle.GetValue());
+                        hasher.Add(pointLight->SpotLightEndAngle.GetValue());
+                    }
+                    else if (auto dirLight = actor.Value.As<DirectionalLightActor>())
+                        hasher.Add(dirLight->Color.GetValue());
+                    else if (auto ambientLight = actor.Value.As<AmbientLightActor>())
+                        hasher.Add(ambientLight->Ambient.GetValue());
+                    // only point and spot lights have a finite range, every other light affects all lightmaps
+                    float radius = light->Radius.GetValue();
+                    if (light->lightType == LightType::Point && radius > 0.0f)
+                    {
+                        auto center = light->GetPosition();
+                        record.Bounds.Min = center - VectorMath::Vec3::Create(radius);
+                        record.Bounds.Max = center + VectorMath::Vec3::Create(radius);
+                    }
+                    else
+                    {
+                        record.Bounds.Min = VectorMath::Vec3::Create(-FLT_MAX);
+                        record.Bounds.Max = VectorMath::Vec3::Create(FLT_MAX);
+                    }
+                }
+                else
+                    continue;
+                record.Hash = hasher.GetValue();
+                lightmaps.InputRecords[actor.Value->Name.GetValue()] = record;
+            }
+        }
+        // Compares the input records with those of the previous bake. A lightmap is rebaked when its actor is new,
+        // its resolution changed, or it lies within the influence radius of an added, removed or changed actor or light.
+        void FindDirtyLightmaps()
+        {
+            mapDirty.SetSize(maps.Count());
+            previousMapIds.SetSize(maps.Count());
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                mapDirty[i] = true;
+                previousMapIds[i] = -1;
+            }
+            if (!isIncremental || previousLightmaps.SettingsHash != lightmaps.SettingsHash)
+                return;
+            List<CoreLib::Graphics::BBox> changedRegions;
+            for (auto & record : lightmaps.InputRecords)
+            {
+                auto previousRecord = previousLightmaps.InputRecords.TryGetValue(record.Key);
+                if (!previousRecord || previousRecord->Hash != record.Value.Hash)
+                {
+                    changedRegions.Add(record.Value.Bounds);
+                    if (previousRecord)
+                        changedRegions.Add(previousRecord->Bounds);
+                }
+            }
+            for (auto & record : previousLightmaps.InputRecords)
+            {
+                if (!lightmaps.InputRecords.ContainsKey(record.Key))
+                    changedRegions.Add(record.Value.Bounds);
+            }
+            float radius = settings.IncrementalInfluenceRadius;
+            for (auto & actorMap : lightmaps.ActorLightmapIds)
+            {
+                int mapId = actorMap.Value;
+                int previousMapId = -1;
+                if (!previousLightmaps.ActorLightmapIds.TryGetValue(actorMap.Key, previousMapId) ||
+                    previousMapId < 0 || previousMapId >= previousLightmaps.Lightmaps.Count())
+                    continue;
+                auto & previousMap = previousLightmaps.Lightmaps[previousMapId];
+                if (previousMap.Width != maps[mapId].diffuseMap.Width || previousMap.Height != maps[mapId].diffuseMap.Height)
+                    continue;
+                previousMapIds[mapId] = previousMapId;
+                bool affected = false;
+                if (radius <= 0.0f)
+                    affected = changedRegions.Count() != 0;
+                else
+                {
+                    auto bounds = actorMap.Key->Bounds;
+                    bounds.Min -= VectorMath::Vec3::Create(radius);
+                    bounds.Max += VectorMath::Vec3::Create(radius);
+                    for (auto & region : changedRegions)
+                    {
+                        if (bounds.Intersects(region))
+                        {
+                            affected = true;
+                            break;
+                        }
+                    }
+                }
+                mapDirty[mapId] = affected;
+            }
+        }
+        int GetDirtyLightmapCount()
+        {
+            int count = 0;
+            for (auto dirty : mapDirty)
+                if (dirty)
+                    count++;
+            return count;
+        }
+        // The lighting of reused lightmaps is still needed by the final gather of dirty ones, so the previous result
+        // is decompressed into their direct lighting map (with zero indirect lighting) and kept for compositing.
+        void InitReusedLightmaps()
+        {
+            reusedLightmaps.SetSize(maps.Count());
+            threadPool.ParallelFor(0, maps.Count(), 1, [&](int i)
+            {
+                if (mapDirty[i])
+                    return;
+                auto & previousMap = previousLightmaps.Lightmaps[previousMapIds[i]];
+                auto & reusedMap = reusedLightmaps[i];
+                if (previousMap.GetDataType() == RawObjectSpaceMap::DataType::BC6H)
+                    previousMap.DecompressBC6H(reusedMap);
+                else
+                {
+                    reusedMap.Init(RawObjectSpaceMap::DataType::RGB32F, previousMap.Width, previousMap.Height);
+                    for (int y = 0; y < previousMap.Height; y++)
+                        for (int x = 0; x < previousMap.Width; x++)
+                            reusedMap.SetPixel(x, y, previousMap.GetPixel(x, y));
+                }
+                for (int y = 0; y < reusedMap.Height; y++)
+                    for (int x = 0; x < reusedMap.Width; x++)
+                        maps[i].lightMap.SetPixel(x, y, VectorMath::Vec4::Create(reusedMap.GetPixel(x, y).xyz(), 1.0f));
+            });
+        }
+        void ReuseLightmaps()
+        {
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                if (!mapDirty[i])
+                    lightmaps.Lightmaps[i] = previousLightmaps.Lightmaps[previousMapIds[i]];
+            }
+        }
         template<typename TResult, typename TSource, typename TSelectFunc>
         void ReadAndDownSample(Texture2D* texture, TResult* dstBuffer, TSource srcZero, int w, int h, int superSample, const TSelectFunc & select)
         {
@@ -97,14 +372,79 @@ namespace GameEngine
                 }
 
         }
+        void RasterizeLightmapGBuffers(int superSampleFactor)
+        {
+            List<StaticMeshActor*> actors;
+            List<int> actorMapIds;
+            for (auto actor : level->Actors)
+            {
+                auto mapId = lightmaps.ActorLightmapIds.TryGetValue(actor.Value.Ptr());
+                if (!mapId) continue;
+                if (auto smActor = actor.Value.As<StaticMeshActor>())
+                {
+                    actors.Add(smActor.Ptr());
+                    actorMapIds.Add(*mapId);
+                }
+            }
+            // the diffuse of every material is loaded once, textures are shared by many actors
+            Dictionary<Material*, int> materialIds;
+            List<Material*> materials;
+            List<int> actorMaterialIds;
+            for (auto actor : actors)
+            {
+                int materialId = -1;
+                if (!materialIds.TryGetValue(actor->MaterialInstance, materialId))
+                {
+                    materialId = materials.Count();
+                    materialIds[actor->MaterialInstance] = materialId;
+                    materials.Add(actor->MaterialInstance);
+                }
+                actorMaterialIds.Add(materialId);
+            }
+            List<MaterialDiffuse> materialDiffuses;
+            materialDiffuses.SetSize(materials.Count());
+            threadPool.ParallelFor(0, materials.Count(), 1, [&](int i)
+            {
+                LoadMaterialDiffuse(materialDiffuses[i], materials[i]);
+            });
+            std::atomic<int> progress;
+            progress = 0;
+            CoreLib::Threading::ThreadPool::TaskGroup taskGroup;
+            for (int i = 0; i < actors.Count(); i++)
+            {
+                threadPool.Submit(taskGroup, [&, i]()
+                {
+                    if (isCancelled)
+                        return;
+                    auto actor = actors[i];
+                    auto & map = maps[actorMapIds[i]];
+                    ObjectSpaceGBuffer gbuffer;
+                    gbuffer.DiffuseMap = &map.diffuseMap;
+                    gbuffer.PositionMap = &map.positionMap;
+                    gbuffer.NormalMap = &map.normalMap;
+                    gbuffer.ValidPixels = &map.validPixels;
+                    RasterizeObjectSpaceGBuffer(gbuffer, actor->GetMesh(), actor->LocalTransform.GetValue(),
+                        materialDiffuses[actorMaterialIds[i]], superSampleFactor);
+                    ProgressChanged(LightmapBakerProgressChangedEventArgs(progress.fetch_add(1) + 1, actors.Count()));
+                });
+            }
+            threadPool.Wait(taskGroup);
+        }
+
         void BakeLightmapGBuffers()
         {
             const int SuperSampleFactor = 1;
             HardwareRenderer* hwRenderer = Engine::Instance()->GetRenderer()->GetHardwareRenderer();
+            StatusChanged("Baking G-Buffers...");
+            if (settings.UseSoftwareGBufferRasterizer || !hwRenderer->HasDevice())
+            {
+                // rasterized directly into the G-buffer maps, no render targets and readback needed
+                RasterizeLightmapGBuffers(SuperSampleFactor);
+                return;
+            }
             RefPtr<ObjectSpaceGBufferRenderer> renderer = CreateObjectSpaceGBufferRenderer();
             renderer->Init(Engine::Instance()->GetRenderer()->GetHardwareRenderer(), Engine::Instance()->GetRenderer()->GetRendererService(), "LightmapGBufferGen.slang");
             int progress = 0;
-            StatusChanged("Baking G-Buffers...");
             ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
             for (auto actor : level->Actors)
             {
@@ -170,8 +510,15 @@ namespace GameEngine
             return a * (1.0f - t) + b * t;
         }
 
+        void FlushRayCount()
+        {
+            tracedRayCount.fetch_add(threadRayCount, std::memory_order_relaxed);
+            threadRayCount = 0;
+        }
+
         VectorMath::Vec3 TraceShadowRay(Ray & shadowRay)
         {
+            threadRayCount++;
             auto inter = staticScene->TraceRay(shadowRay);
             if (inter.IsHit)
             {
@@ -204,67 +551,88 @@ namespace GameEngine
             return VectorMath::Vec3::Create(1.0f, 1.0f, 1.0f);
         }
 
-        VectorMath::Vec3 ComputeDirectLighting(VectorMath::Vec3 pos, VectorMath::Vec3 normal, VectorMath::Vec3 & dynamicDirectLighting)
+        VectorMath::Vec3 ComputeLightContribution(const StaticLight & light, VectorMath::Vec3 pos, VectorMath::Vec3 normal)
         {
-            VectorMath::Vec3 result;
-            result.SetZero();
-            dynamicDirectLighting.SetZero();
-            for (auto & light : staticScene->lights)
+            VectorMath::Vec3 lighting;
+            lighting.SetZero();
+            auto l = light.Position - pos;
+            auto dist = l.Length();
+            float actualDecay = 1.0f;
+            if (light.Radius != 0.0f)
             {
-                VectorMath::Vec3 lighting;
-                auto l = light.Position - pos;
-                auto dist = l.Length();
-                float actualDecay = 1.0f;
-                if (light.Radius != 0.0f)
-                {
-                    actualDecay = Lerp(1.0, 0.0f, sqrt(dist / light.Radius));
-                    if (dist > light.Radius)
-                        continue;
-                }
-                switch (light.Type)
-                {
-                case StaticLightType::Directional:
+                actualDecay = Lerp(1.0, 0.0f, sqrt(dist / light.Radius));
+                if (dist > light.Radius)
+                    return lighting;
+            }
+            switch (light.Type)
+            {
+            case StaticLightType::Directional:
+            {
+                l = light.Direction;
+                auto nDotL = VectorMath::Vec3::Dot(normal, l);
+                Ray shadowRay;
+                shadowRay.tMax = FLT_MAX;
+                shadowRay.Origin = pos;
+                shadowRay.Dir = l;
+                auto shadowFactor = light.EnableShadows ? TraceShadowRay(shadowRay) : VectorMath::Vec3::Create(1.0f);
+                shadowFactor *= actualDecay;
+                lighting = light.Intensity * shadowFactor * Math::Max(0.0f, nDotL);
+                break;
+            }
+            case StaticLightType::Point:
+            case StaticLightType::Spot:
+            {
+                if (dist < light.Radius || light.Radius == 0.0f)
                 {
-                    l = light.Direction;
+                    auto invDist = 1.0f / dist;
+                    l *= invDist;
                     auto nDotL = VectorMath::Vec3::Dot(normal, l);
+                    
+                    if (light.Type == StaticLightType::Spot)
+                    {
+                        float ang = acos(VectorMath::Vec3::Dot(l, light.Direction));
+                        actualDecay *= Lerp(1.0, 0.0, Math::Clamp((ang - light.SpotFadingStartAngle) / (light.SpotFadingEndAngle - light.SpotFadingStartAngle), 0.0f, 1.0f));
+                    }
                     Ray shadowRay;
-                    shadowRay.tMax = FLT_MAX;
+                    shadowRay.tMax = dist;
                     shadowRay.Origin = pos;
                     shadowRay.Dir = l;
-                    auto p1 = shadowRay.Origin + shadowRay.Dir * 1000.0f;
                     auto shadowFactor = light.EnableShadows ? TraceShadowRay(shadowRay) : VectorMath::Vec3::Create(1.0f);
-                    shadowFactor *= actualDecay;
-                    lighting = light.Intensity * shadowFactor * Math::Max(0.0f, nDotL);
-                    break;
-                }
-                case StaticLightType::Point:
-                case StaticLightType::Spot:
-                {
-                    if (dist < light.Radius || light.Radius == 0.0f)
-                    {
-                        auto invDist = 1.0f / dist;
-                        l *= invDist;
-                        auto nDotL = VectorMath::Vec3::Dot(normal, l);
-                        
-                        if (light.Type == StaticLightType::Spot)
-                        {
-                            float ang = acos(VectorMath::Vec3::Dot(l, light.Direction));
-                            actualDecay *= Lerp(1.0, 0.0, Math::Clamp((ang - light.SpotFadingStartAngle) / (light.SpotFadingEndAngle - light.SpotFadingStartAngle), 0.0f, 1.0f));
-                        }
-                        Ray shadowRay;
-                        shadowRay.tMax = dist;
-                        shadowRay.Origin = pos;
-                        shadowRay.Dir = l;
-                        auto shadowFactor = light.EnableShadows ? TraceShadowRay(shadowRay) : VectorMath::Vec3::Create(1.0f);
-                        lighting = light.Intensity * actualDecay * shadowFactor * Math::Max(0.0f, nDotL);
-                    }
-                    break;
-                }
+                    lighting = light.Intensity * actualDecay * shadowFactor * Math::Max(0.0f, nDotL);
                 }
+                break;
+            }
+            }
+            return lighting;
+        }
+
+        VectorMath::Vec3 ComputeDirectLighting(Random & random, VectorMath::Vec3 pos, VectorMath::Vec3 normal, VectorMath::Vec3 & dynamicDirectLighting)
+        {
+            VectorMath::Vec3 result;
+            result.SetZero();
+            dynamicDirectLighting.SetZero();
+            auto & lightBvh = staticScene->lightBvh;
+            bool sampleLights = settings.DirectLightingShadowRayCount > 0 && lightBvh.GetLightCount() > settings.DirectLightingShadowRayCount;
+            for (auto & light : staticScene->lights)
+            {
+                if (sampleLights && light.Type != StaticLightType::Directional)
+                    continue;
+                auto lighting = ComputeLightContribution(light, pos, normal);
                 result += lighting;
                 if (!light.IncludeDirectLighting)
                     dynamicDirectLighting += lighting;
             }
+            if (sampleLights)
+            {
+                lightBvh.SampleLights(random, pos, normal, settings.DirectLightingShadowRayCount, [&](int lightId, float weight)
+                {
+                    auto & light = staticScene->lights[lightId];
+                    auto lighting = ComputeLightContribution(light, pos, normal) * weight;
+                    result += lighting;
+                    if (!light.IncludeDirectLighting)
+                        dynamicDirectLighting += lighting;
+                });
+            }
             return result;
         }
 
@@ -277,8 +645,38 @@ namespace GameEngine
             return VectorMath::Vec3::Create(x, r1, z);
         }
 
+        // Indirect lighting of the previous bounce at a ray hit. The indirect lightmaps of dirty maps do not hold the
+        // bounces computed on the radiance cache, so a hit on them is looked up in the cache. A hit in a voxel without
+        // samples interpolates the cells around it, and if there are none, the bounce is gathered at the hit.
+        VectorMath::Vec3 GetIndirectLightingAtHit(const Ray & ray, const StaticSceneTracingResult & inter)
+        {
+            if (!radianceCache.IsEmpty() && mapDirty[inter.MapId])
+            {
+                auto hitPos = ray.Origin + ray.Dir * inter.T;
+                int cellId = radianceCache.FindCell(hitPos, inter.Normal);
+                if (cellId != -1)
+                    return radianceCache.Cells[cellId].Irradiance;
+                VectorMath::Vec3 irradiance;
+                if (radianceCache.Interpolate(hitPos, inter.Normal, RadianceCacheSearchRadius, irradiance))
+                    return irradiance;
+                if (!isGatheringCacheMiss)
+                {
+                    // the hits of the gather use the cache, with no further gathers on a miss
+                    isGatheringCacheMiss = true;
+                    Random random(GetTileSeed(FloatAsInt(hitPos.x) ^ FloatAsInt(hitPos.y), FloatAsInt(hitPos.z)));
+                    bool isInvalidRegion = false;
+                    irradiance = ComputeIndirectLighting(random, hitPos + inter.Normal * settings.ShadowBias, inter.Normal,
+                        settings.RadianceCacheSampleCount, 0.0f, isInvalidRegion);
+                    isGatheringCacheMiss = false;
+                    return irradiance;
+                }
+            }
+            return maps[inter.MapId].indirectLightmap.Sample(inter.UV).xyz();
+        }
+
         VectorMath::Vec3 TraceSampleRay(Ray& ray, float minValidDist, bool& isInvalid, int recurseLevel = 0)
         {
+            threadRayCount++;
             auto inter = staticScene->TraceRay(ray);
             if (inter.IsHit)
             {
@@ -288,7 +686,7 @@ namespace GameEngine
                     if (VectorMath::Vec3::Dot(inter.Normal, ray.Dir) < 0.0f)
                     {
                         auto directDiffuse = maps[inter.MapId].lightMap.Sample(inter.UV).xyz();
-                        auto indirectDiffuse = maps[inter.MapId].indirectLightmap.Sample(inter.UV).xyz();
+                        auto indirectDiffuse = GetIndirectLightingAtHit(ray, inter);
                         auto totalDiffuseLight = directDiffuse + indirectDiffuse;
                         return totalDiffuseLight * surfaceAlbedo.xyz();
                     }
@@ -346,6 +744,71 @@ namespace GameEngine
             return result;
         }
 
+        struct LightmapTile
+        {
+            int MapId;
+            int X0, Y0, X1, Y1;
+        };
+        static const int LightmapTileSize = 64;
+        static unsigned int GetTileSeed(unsigned int pass, unsigned int tileIndex)
+        {
+            unsigned int h = pass * 0x9E3779B9u ^ (tileIndex + 0x7F4A7C15u) * 0x85EBCA6Bu;
+            h ^= h >> 16;
+            h *= 0x7FEB352Du;
+            h ^= h >> 15;
+            h *= 0x846CA68Bu;
+            h ^= h >> 16;
+            return h;
+        }
+        // splits all dirty lightmaps into uniform tiles
+        void GetLightmapTiles(List<LightmapTile> & tiles)
+        {
+            tiles.Clear();
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                if (!mapDirty[i])
+                    continue;
+                int w = maps[i].diffuseMap.Width;
+                int h = maps[i].diffuseMap.Height;
+                for (int y = 0; y < h; y += LightmapTileSize)
+                    for (int x = 0; x < w; x += LightmapTileSize)
+                        tiles.Add(LightmapTile{ i, x, y, Math::Min(x + LightmapTileSize, w), Math::Min(y + LightmapTileSize, h) });
+            }
+        }
+        // Runs tileFunc(tile, random) for tiles [tileBegin, tileEnd) on the thread pool.
+        // Workers steal tiles from each other, so a large lightmap no longer serializes the bake. The random
+        // generator of a tile is seeded from the pass and tile index only, so results do not depend on scheduling.
+        // Progress is reported per completed tile; once the bake is cancelled, remaining tiles are skipped.
+        template<typename TileFunc>
+        void ForEachLightmapTile(unsigned int pass, const List<LightmapTile> & tiles, int tileBegin, int tileEnd, const TileFunc & tileFunc)
+        {
+            std::atomic<int> completedTiles;
+            completedTiles = tileBegin;
+            int tileCount = tiles.Count();
+            CoreLib::Threading::ThreadPool::TaskGroup taskGroup;
+            for (int i = tileBegin; i < tileEnd; i++)
+            {
+                threadPool.Submit(taskGroup, [&, i]()
+                {
+                    if (isCancelled)
+                        return;
+                    Random random(GetTileSeed(pass, i));
+                    tileFunc(tiles[i], random);
+                    FlushRayCount();
+                    if (!isCancelled)
+                        ProgressChanged(LightmapBakerProgressChangedEventArgs(completedTiles.fetch_add(1) + 1, tileCount));
+                });
+            }
+            threadPool.Wait(taskGroup);
+        }
+        template<typename TileFunc>
+        void ForEachLightmapTile(unsigned int pass, const TileFunc & tileFunc)
+        {
+            List<LightmapTile> tiles;
+            GetLightmapTiles(tiles);
+            ForEachLightmapTile(pass, tiles, 0, tiles.Count(), tileFunc);
+        }
+
         void BiasGBufferPositions()
         {
             VectorMath::Vec3 tangentDirs[] =
@@ -355,97 +818,82 @@ namespace GameEngine
                 VectorMath::Vec3::Create(0.0f, 0.0f, 1.0f),
                 VectorMath::Vec3::Create(0.0f, 0.0f, -1.0f)
             };
-            int completedMaps = 0;
-            for (auto & map : maps)
+            ForEachLightmapTile(0, [&](const LightmapTile & tile, Random &)
             {
-                int imageSize = map.diffuseMap.Width * map.diffuseMap.Height;
-                if (isCancelled) return;
-                #pragma omp parallel for
-                for (int pixelIdx = 0; pixelIdx < imageSize; pixelIdx++)
+                auto & map = maps[tile.MapId];
+                for (int y = tile.Y0; y < tile.Y1; y++)
                 {
-                    int x = pixelIdx % map.diffuseMap.Width;
-                    int y = pixelIdx / map.diffuseMap.Width;
-                    auto diffuse = map.diffuseMap.GetPixel(x, y);
-                    // compute lighting only for lightmap pixels that represent valid surface regions
-                    if (diffuse.x > 1e-6f || diffuse.y > 1e-6f || diffuse.z > 1e-6f)
+                    if (isCancelled) return;
+                    for (int x = tile.X0; x < tile.X1; x++)
                     {
-                        auto posPixel = map.positionMap.GetPixel(x, y);
-                        auto pos = posPixel.xyz();
-                        auto bias = posPixel.w * 0.8f;
-                        auto normal = map.normalMap.GetPixel(x, y).xyz().Normalize();
-                        // shoot random rays and find if the ray hits the back of some nearby face,
-                        // if so, shift pos to the front of that face to avoid shadow leaking
-                        VectorMath::Vec3 tangent, binormal;
-                        VectorMath::GetOrthoVec(tangent, normal);
-                        binormal = VectorMath::Vec3::Cross(normal, tangent);
-                        auto biasedPos = pos + normal * settings.ShadowBias;
-                        float minT = FLT_MAX;
-                        for (auto tangentDir : tangentDirs)
+                        auto diffuse = map.diffuseMap.GetPixel(x, y);
+                        // compute lighting only for lightmap pixels that represent valid surface regions
+                        if (diffuse.x > 1e-6f || diffuse.y > 1e-6f || diffuse.z > 1e-6f)
                         {
-                            auto testDir = tangent * tangentDir.x + normal * tangentDir.y + binormal * tangentDir.z;
-                            Ray testRay;
-                            testRay.Origin = biasedPos;
-                            testRay.Dir = testDir;
-                            testRay.tMax = bias;
-                            auto inter = staticScene->TraceRay(testRay);
-                            if (inter.IsHit && VectorMath::Vec3::Dot(inter.Normal, testDir) > 0.0f)
+                            auto posPixel = map.positionMap.GetPixel(x, y);
+                            auto pos = posPixel.xyz();
+                            auto bias = posPixel.w * 0.8f;
+                            auto normal = map.normalMap.GetPixel(x, y).xyz().Normalize();
+                            // shoot random rays and find if the ray hits the back of some nearby face,
+                            // if so, shift pos to the front of that face to avoid shadow leaking
+                            VectorMath::Vec3 tangent, binormal;
+                            VectorMath::GetOrthoVec(tangent, normal);
+                            binormal = VectorMath::Vec3::Cross(normal, tangent);
+                            auto biasedPos = pos + normal * settings.ShadowBias;
+                            float minT = FLT_MAX;
+                            for (auto tangentDir : tangentDirs)
                             {
-                                if (inter.T < minT)
+                                auto testDir = tangent * tangentDir.x + normal * tangentDir.y + binormal * tangentDir.z;
+                                Ray testRay;
+                                testRay.Origin = biasedPos;
+                                testRay.Dir = testDir;
+                                testRay.tMax = bias;
+                                threadRayCount++;
+                                auto inter = staticScene->TraceRay(testRay);
+                                if (inter.IsHit && VectorMath::Vec3::Dot(inter.Normal, testDir) > 0.0f)
                                 {
-                                    minT = inter.T;
-                                    biasedPos = testRay.Origin + testRay.Dir * inter.T + inter.Normal * (bias);
+                                    if (inter.T < minT)
+                                    {
+                                        minT = inter.T;
+                                        biasedPos = testRay.Origin + testRay.Dir * inter.T + inter.Normal * (bias);
+                                    }
                                 }
                             }
+                            map.positionMap.SetPixel(x, y, VectorMath::Vec4::Create(biasedPos, posPixel.w));
                         }
-                        map.positionMap.SetPixel(x, y, VectorMath::Vec4::Create(biasedPos, posPixel.w));
                     }
                 }
-
-                completedMaps++;
-                ProgressChanged(LightmapBakerProgressChangedEventArgs(completedMaps, maps.Count()));
-            }
+            });
         }
 
         void ComputeLightmaps_Direct()
         {
-            int completedMaps = 0;
-            for (auto & map : maps)
+            ForEachLightmapTile(0, [&](const LightmapTile & tile, Random & random)
             {
-                if (isCancelled) return;
-                int imageSize = map.diffuseMap.Width * map.diffuseMap.Height;
-                #pragma omp parallel for
-                for (int pixelIdx = 0; pixelIdx < imageSize; pixelIdx++)
+                auto & map = maps[tile.MapId];
+                for (int y = tile.Y0; y < tile.Y1; y++)
                 {
-                    if (map.validPixels.Contains(pixelIdx))
+                    if (isCancelled) return;
+                    for (int x = tile.X0; x < tile.X1; x++)
                     {
-                        pixelCounter++;
-                        if (threadCancelled || (pixelCounter & 15) == 0)
-                        {
-                            threadCancelled = isCancelled;
-                        }
-                        if (threadCancelled) continue;
-                        int x = pixelIdx % map.diffuseMap.Width;
-                        int y = pixelIdx / map.diffuseMap.Width;
-                        
+                        if (!map.validPixels.Contains(y * map.diffuseMap.Width + x))
+                            continue;
                         VectorMath::Vec4 lighting;
                         lighting.SetZero();
                         VectorMath::Vec3 dynamicDirectLighting;
-                        auto diffuse = map.diffuseMap.GetPixel(x, y);
                         auto posPixel = map.positionMap.GetPixel(x, y);
                         auto pos = posPixel.xyz();
                         auto normal = map.normalMap.GetPixel(x, y).xyz().Normalize();
-                        
-                        lighting = VectorMath::Vec4::Create(ComputeDirectLighting(pos, normal, dynamicDirectLighting), 1.0f);
+
+                        lighting = VectorMath::Vec4::Create(ComputeDirectLighting(random, pos, normal, dynamicDirectLighting), 1.0f);
                         map.lightMap.SetPixel(x, y, lighting);
                         map.dynamicDirectLighting.SetPixel(x, y, VectorMath::Vec4::Create(dynamicDirectLighting, 1.0f));
                     }
                 }
-                completedMaps++;
-                ProgressChanged(LightmapBakerProgressChangedEventArgs(completedMaps, maps.Count()));
-            }
+            });
         }
         static const int MaxLightmapBlockSize = 16;
-        void ComputeIndirectLightmapBlock(RawMapSet& map, RawObjectSpaceMap& resultMap, int sampleCount, int x0, int y0, int blockSize,
+        void ComputeIndirectLightmapBlock(Random & random, RawMapSet& map, RawObjectSpaceMap& resultMap, int sampleCount, int x0, int y0, int blockSize,
             VectorMath::Vec4* result, VectorMath::Vec3* normals, VectorMath::Vec3* positions, bool* valid, bool * computed)
         {
             int x1 = x0 + blockSize - 1;
@@ -454,23 +902,21 @@ namespace GameEngine
             {
                 if (computed[i]) continue;
                 valid[i] = false;
-                int x = (i & 1) ? x0 : x1;
-                int y = (i & 2) ? y0 : y1;
+                int x = (i & 1) ? x1 : x0;
+                int y = (i & 2) ? y1 : y0;
                 int pixelIdx = y * map.diffuseMap.Width + x;
                 if (map.validPixels.Contains(pixelIdx))
                 {
                     valid[i] = true;
-                    pixelCounter++;
                     VectorMath::Vec4 lighting;
                     lighting.SetZero();
                     auto posPixel = map.positionMap.GetPixel(x, y);
                     auto pos = posPixel.xyz();
                     auto normal = map.normalMap.GetPixel(x, y).xyz().Normalize();
-                    Random threadRandom(threadRandomSeed);
                     bool isInvalidRegion = false;
                     positions[i] = pos;
                     normals[i] = normal;
-                    lighting = VectorMath::Vec4::Create(ComputeIndirectLighting(threadRandom, pos, normal, sampleCount, posPixel.w*2.0f, isInvalidRegion), 1.0f);
+                    lighting = VectorMath::Vec4::Create(ComputeIndirectLighting(random, pos, normal, sampleCount, posPixel.w*2.0f, isInvalidRegion), 1.0f);
                     if (sampleCount >= settings.SampleCount && isInvalidRegion)
                     {
                         map.validPixels.Remove(pixelIdx);
@@ -478,21 +924,12 @@ namespace GameEngine
                     }
                     resultMap.SetPixel(x, y, lighting);
                     result[i] = lighting;
-                    threadRandomSeed = threadRandom.GetSeed();
                 }
             }
             if (blockSize > 2)
             {
                 // do we need to refine?
-                bool shouldRefine = (!valid[0] || !valid[1] || !valid[2] || !valid[3]);
-                shouldRefine = shouldRefine || (positions[3] - positions[0]).Length() > settings.IndirectLightingWorldGranularity;
-                if (sampleCount == settings.FinalGatherSampleCount)
-                {
-                    shouldRefine = shouldRefine || (result[1] - result[0]).Length() > 0.1f || (result[2] - result[0]).Length() > 0.1f ||
-                        (result[3] - result[0]).Length() > settings.FinalGatherAdaptiveSampleThreshold;
-                }
-                
-                if (shouldRefine)
+                if (ShouldRefineLightmapBlock(sampleCount, result, positions, valid))
                 {
                     VectorMath::Vec4 nResult[4];
                     VectorMath::Vec3 nPositions[4];
@@ -508,121 +945,1261 @@ namespace GameEngine
                         nComputed[j] = true; 
                         int nx0 = x0 + ((j & 1) ? (blockSize >> 1) : 0);
                         int ny0 = y0 + ((j & 2) ? (blockSize >> 1) : 0);
-                        ComputeIndirectLightmapBlock(map, resultMap, sampleCount, nx0, ny0, blockSize >> 1, nResult, nNormals, nPositions, nValid, nComputed);
+                        ComputeIndirectLightmapBlock(random, map, resultMap, sampleCount, nx0, ny0, blockSize >> 1, nResult, nNormals, nPositions, nValid, nComputed);
                     }
                 }
                 else
-                {
-                    float invBlockSize = 1.0f / (blockSize - 1);
-                    VectorMath::Vec4 first[MaxLightmapBlockSize];
-                    VectorMath::Vec4 last[MaxLightmapBlockSize];
-                    first[0] = result[0];
-                    first[blockSize - 1] = result[1];
-                    last[0] = result[2];
-                    last[blockSize - 1] = result[3];
-                    // fill first row and last row
-                    for (int j = 1; j < blockSize - 1; j++)
-                    {
-                        float t = j * invBlockSize;
-                        float invT = 1.0f - t;
-                        first[j] = result[0] * invT + result[1] * t;
-                        resultMap.SetPixel(x0 + j, y0, first[j]);
-                        last[j] = result[2] * invT + result[3] * t;
-                        resultMap.SetPixel(x0 + j, y1, last[j]);
-                    }
-                    // fill all columns
-                    for (int j = 0; j < blockSize; j++)
-                    {
-                        auto a = first[j];
-                        auto b = last[j];
-                        for (int k = 1; k < blockSize - 1; k++)
-                        {
-                            float t = k * invBlockSize;
-                            float invT = 1.0f - t;
-                            resultMap.SetPixel(x0 + j, y0 + k, a*invT + b * t);
-                        }
-                    }
-                }
+                    InterpolateLightmapBlock(resultMap, x0, y0, blockSize, result);
             }
         }
 
-        void ComputeLightmaps_Indirect(int sampleCount)
+        // fills a block by bilinear interpolation of the lighting at its four corners,
+        // corner i is at ((i & 1) ? x1 : x0, (i & 2) ? y1 : y0).
+        void InterpolateLightmapBlock(RawObjectSpaceMap & resultMap, int x0, int y0, int blockSize, VectorMath::Vec4 * result)
         {
-            static int iteration = 0;
-            iteration++;
-            totalBlocks = 0;
-            for (auto & map : maps)
+            int y1 = y0 + blockSize - 1;
+            float invBlockSize = 1.0f / (blockSize - 1);
+            VectorMath::Vec4 first[MaxLightmapBlockSize];
+            VectorMath::Vec4 last[MaxLightmapBlockSize];
+            first[0] = result[0];
+            first[blockSize - 1] = result[1];
+            last[0] = result[2];
+            last[blockSize - 1] = result[3];
+            // fill first row and last row
+            for (int j = 1; j < blockSize - 1; j++)
             {
-                int horizontalBlockCount = (map.diffuseMap.Width + MaxLightmapBlockSize - 1) / MaxLightmapBlockSize;
-                int blockCount = horizontalBlockCount * (map.diffuseMap.Height + MaxLightmapBlockSize - 1) / MaxLightmapBlockSize;
-                totalBlocks += blockCount;
+                float t = j * invBlockSize;
+                float invT = 1.0f - t;
+                first[j] = result[0] * invT + result[1] * t;
+                resultMap.SetPixel(x0 + j, y0, first[j]);
+                last[j] = result[2] * invT + result[3] * t;
+                resultMap.SetPixel(x0 + j, y1, last[j]);
             }
-            completedBlocks = 0;
-            for (auto & map : maps)
+            // fill all columns
+            for (int j = 0; j < blockSize; j++)
             {
-                if (isCancelled) return;
-                int horizontalBlockCount = (map.diffuseMap.Width + MaxLightmapBlockSize - 1) / MaxLightmapBlockSize;
-                int blockCount = horizontalBlockCount * (map.diffuseMap.Height + MaxLightmapBlockSize - 1) / MaxLightmapBlockSize;
-                auto resultMap = map.indirectLightmap;
-                #pragma omp parallel for
-                for (int blockIdx = 0; blockIdx < blockCount; blockIdx++)
+                auto a = first[j];
+                auto b = last[j];
+                for (int k = 1; k < blockSize - 1; k++)
                 {
-                    if (threadCancelled || (pixelCounter & 15) == 0)
-                    {
-                        threadCancelled = isCancelled;
-                    }
-                    if (threadCancelled) continue;
-
-                    int x0 = (blockIdx % horizontalBlockCount) * MaxLightmapBlockSize;
-                    int y0 = (blockIdx / horizontalBlockCount) * MaxLightmapBlockSize;
-                    VectorMath::Vec3 positions[4], normals[4];
-                    VectorMath::Vec4 results[4];
-                    bool valid[4];
-                    bool computed[4] = { false, false ,false, false };
-                    ComputeIndirectLightmapBlock(map, resultMap, sampleCount, x0, y0, MaxLightmapBlockSize,
-                        results, normals, positions, valid, computed);
-                    auto progress = completedBlocks.fetch_add(1);
-                    if ((progress & 7) == 0)
-                        ProgressChanged(LightmapBakerProgressChangedEventArgs(progress + 1, totalBlocks));
+                    float t = k * invBlockSize;
+                    float invT = 1.0f - t;
+                    resultMap.SetPixel(x0 + j, y0 + k, a*invT + b * t);
                 }
-                map.indirectLightmap = _Move(resultMap);
             }
         }
 
-        RawObjectSpaceMap blurTempMap;
-        Dictionary<int, List<float>> blurKernels;
-        ArrayView<float> GetBlurKernel(int radius)
+        bool ShouldRefineLightmapBlock(int sampleCount, VectorMath::Vec4 * result, VectorMath::Vec3 * positions, bool * valid)
         {
-            int size = radius + 1;
-            if (auto rs = blurKernels.TryGetValue(size))
-                return rs->GetArrayView();
-            List<float> kernel;
-            kernel.SetSize(size);
-            float sigma = 0.6f;
-            float invTwoSigmaSquare = 1.0f / (2.0f * sigma * sigma);
-            for (int i = 0; i < size; i++)
+            bool shouldRefine = (!valid[0] || !valid[1] || !valid[2] || !valid[3]);
+            shouldRefine = shouldRefine || (positions[3] - positions[0]).Length() > settings.IndirectLightingWorldGranularity;
+            if (isFinalGather)
             {
-                float dist = i / (float)radius;
-                float weight = exp(-dist * dist * invTwoSigmaSquare);
-                kernel[i] = weight;
+                shouldRefine = shouldRefine || (result[1] - result[0]).Length() > 0.1f || (result[2] - result[0]).Length() > 0.1f ||
+                    (result[3] - result[0]).Length() > settings.FinalGatherAdaptiveSampleThreshold;
             }
-            blurKernels[size] = kernel;
-            return blurKernels[size]().GetArrayView();
+            return shouldRefine;
         }
-        void BlurLightmap(IntSet& validPixels, int blurRadius, RawObjectSpaceMap & lightmap)
+
+        // a texel whose indirect lighting is computed by a gather ray stream
+        struct GatherTexel
         {
-            blurTempMap.Init(lightmap.GetDataType(), lightmap.Width, lightmap.Height);
-            ArrayView<float> kernel = GetBlurKernel(blurRadius);
-            #pragma omp parallel for
-            for (int y = 0; y < lightmap.Height; y++)
+            int PixelIndex;
+            VectorMath::Vec3 Position, Normal;
+            float MinValidDistance;
+            VectorMath::Vec3 Radiance;
+            bool IsInvalidRegion;
+        };
+        struct GatherRayInfo
+        {
+            int Texel;
+            int Depth;
+            VectorMath::Vec3 Throughput;
+        };
+        static unsigned int ExpandMortonBits(unsigned int v)
+        {
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        }
+        // sorts a ray stream by direction octant, then by the morton code of the ray origin
+        void SortRayStream(List<Ray> & rays, List<GatherRayInfo> & rayInfos)
+        {
+            VectorMath::Vec3 originMin = VectorMath::Vec3::Create(FLT_MAX), originMax = VectorMath::Vec3::Create(-FLT_MAX);
+            for (auto & ray : rays)
             {
-                for (int x = 0; x < lightmap.Width; x++)
+                for (int k = 0; k < 3; k++)
                 {
-                    if (validPixels.Contains(y*lightmap.Width + x))
+                    originMin[k] = Math::Min(originMin[k], ray.Origin[k]);
+                    originMax[k] = Math::Max(originMax[k], ray.Origin[k]);
+                }
+            }
+            VectorMath::Vec3 quantizeScale;
+            for (int k = 0; k < 3; k++)
+                quantizeScale[k] = originMax[k] > originMin[k] ? 1023.0f / (originMax[k] - originMin[k]) : 0.0f;
+            List<uint64_t> keys;
+            keys.SetSize(rays.Count());
+            for (int i = 0; i < rays.Count(); i++)
+            {
+                auto & ray = rays[i];
+                unsigned int octant = (ray.Dir.x < 0.0f ? 1 : 0) | (ray.Dir.y < 0.0f ? 2 : 0) | (ray.Dir.z < 0.0f ? 4 : 0);
+                unsigned int morton = 0;
+                for (int k = 0; k < 3; k++)
+                    morton |= ExpandMortonBits((unsigned int)((ray.Origin[k] - originMin[k]) * quantizeScale[k])) << k;
+                keys[i] = ((uint64_t)octant << 62) | ((uint64_t)morton << 32) | (uint64_t)i;
+            }
+            std::sort(keys.begin(), keys.end());
+            List<Ray> sortedRays;
+            List<GatherRayInfo> sortedInfos;
+            sortedRays.SetSize(rays.Count());
+            sortedInfos.SetSize(rays.Count());
+            for (int i = 0; i < keys.Count(); i++)
+            {
+                int src = (int)(keys[i] & 0xFFFFFFFF);
+                sortedRays[i] = rays[src];
+                sortedInfos[i] = rayInfos[src];
+            }
+            rays = _Move(sortedRays);
+            rayInfos = _Move(sortedInfos);
+        }
+
+        // Computes the indirect lighting of a batch of texels: all hemisphere samples are generated into a
+        // ray stream, which is sorted and traced against the static scene as a whole. Hits are shaded in a
+        // separate pass, and rays passing through translucent surfaces are continued in the next stream.
+        void TraceGatherRayStream(Random & random, List<GatherTexel> & texels, int sampleCount)
+        {
+            List<Ray> rays, nextRays;
+            List<GatherRayInfo> rayInfos, nextRayInfos;
+            List<StaticSceneTracingResult> hits;
+            rays.Reserve(texels.Count() * sampleCount);
+            rayInfos.Reserve(texels.Count() * sampleCount);
+            for (int t = 0; t < texels.Count(); t++)
+            {
+                auto & texel = texels[t];
+                VectorMath::Vec3 tangent;
+                VectorMath::GetOrthoVec(tangent, texel.Normal);
+                auto binormal = VectorMath::Vec3::Cross(tangent, texel.Normal);
+                for (int i = 0; i < sampleCount; i++)
+                {
+                    float r1 = random.NextFloat();
+                    float r2 = random.NextFloat();
+                    Ray ray;
+                    ray.Origin = texel.Position;
+                    auto tanDir = UniformSampleHemisphere(r1, r2);
+                    ray.Dir = tangent * tanDir.x + texel.Normal * tanDir.y + binormal * tanDir.z;
+                    ray.tMax = FLT_MAX;
+                    rays.Add(ray);
+                    GatherRayInfo info;
+                    info.Texel = t;
+                    info.Depth = 0;
+                    info.Throughput = VectorMath::Vec3::Create(r1);
+                    rayInfos.Add(info);
+                }
+            }
+            while (rays.Count())
+            {
+                SortRayStream(rays, rayInfos);
+                hits.SetSize(rays.Count());
+                threadRayCount += rays.Count();
+                staticScene->TraceRays(rays.GetArrayView(), hits.GetArrayView());
+                nextRays.Clear();
+                nextRayInfos.Clear();
+                for (int i = 0; i < rays.Count(); i++)
+                {
+                    auto & ray = rays[i];
+                    auto & info = rayInfos[i];
+                    auto & texel = texels[info.Texel];
+                    auto & inter = hits[i];
+                    if (!inter.IsHit)
                     {
-                        VectorMath::Vec3 value;
-                        float sumWeight = kernel[0];
-                        value = lightmap.GetPixel(x, y).xyz();
+                        if (ray.Dir.y > 0.0f)
+                            texel.Radiance += staticScene->ambientColor * info.Throughput;
+                        continue;
+                    }
+                    auto surfaceAlbedo = maps[inter.MapId].diffuseMap.Sample(inter.UV);
+                    if (surfaceAlbedo.w == 1.0f)
+                    {
+                        if (VectorMath::Vec3::Dot(inter.Normal, ray.Dir) < 0.0f)
+                        {
+                            auto directDiffuse = maps[inter.MapId].lightMap.Sample(inter.UV).xyz();
+                            auto indirectDiffuse = GetIndirectLightingAtHit(ray, inter);
+                            texel.Radiance += (directDiffuse + indirectDiffuse) * surfaceAlbedo.xyz() * info.Throughput;
+                        }
+                        else if (info.Depth == 0 && inter.T < texel.MinValidDistance)
+                            texel.IsInvalidRegion = true;
+                    }
+                    else if (info.Depth <= settings.SampleCount)
+                    {
+                        Ray newRay;
+                        newRay.Origin = ray.Origin + ray.Dir * (inter.T + settings.ShadowBias);
+                        newRay.Dir = ray.Dir;
+                        newRay.tMax = ray.tMax - (inter.T + settings.ShadowBias);
+                        nextRays.Add(newRay);
+                        GatherRayInfo newInfo;
+                        newInfo.Texel = info.Texel;
+                        newInfo.Depth = info.Depth + 1;
+                        newInfo.Throughput = info.Throughput * surfaceAlbedo.xyz() * surfaceAlbedo.w;
+                        nextRayInfos.Add(newInfo);
+                    }
+                }
+                Swap(rays, nextRays);
+                Swap(rayInfos, nextRayInfos);
+            }
+            for (auto & texel : texels)
+                texel.Radiance *= 2.0f / (float)sampleCount;
+        }
+
+        // Streamed version of ComputeIndirectLightmapBlock for a tile of blocks. Blocks are refined breadth first,
+        // and all corner texels of one refinement level are gathered with a single ray stream.
+        void ComputeIndirectLightmapTileStreamed(Random & random, RawMapSet & map, RawObjectSpaceMap & resultMap, int sampleCount, const LightmapTile & tile)
+        {
+            int tileX0 = tile.X0;
+            int tileY0 = tile.Y0;
+            struct Block
+            {
+                int X0, Y0, Size;
+            };
+            struct CornerState
+            {
+                VectorMath::Vec4 Lighting;
+                VectorMath::Vec3 Position;
+                bool Computed = false;
+                bool Valid = false;
+            };
+            int tileW = tile.X1 - tile.X0;
+            int tileH = tile.Y1 - tile.Y0;
+            List<CornerState> corners;
+            corners.SetSize(tileW * tileH);
+            List<Block> blocks, nextBlocks;
+            for (int y = 0; y < tileH; y += MaxLightmapBlockSize)
+                for (int x = 0; x < tileW; x += MaxLightmapBlockSize)
+                    blocks.Add(Block{ tileX0 + x, tileY0 + y, MaxLightmapBlockSize });
+            List<GatherTexel> texels;
+            while (blocks.Count())
+            {
+                if (isCancelled)
+                    return;
+                texels.Clear();
+                for (auto & block : blocks)
+                {
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int x = (i & 1) ? block.X0 + block.Size - 1 : block.X0;
+                        int y = (i & 2) ? block.Y0 + block.Size - 1 : block.Y0;
+                        auto & corner = corners[(y - tileY0) * tileW + x - tileX0];
+                        if (corner.Computed)
+                            continue;
+                        corner.Computed = true;
+                        int pixelIdx = y * map.diffuseMap.Width + x;
+                        if (!map.validPixels.Contains(pixelIdx))
+                            continue;
+                        auto posPixel = map.positionMap.GetPixel(x, y);
+                        GatherTexel texel;
+                        texel.PixelIndex = pixelIdx;
+                        texel.Position = posPixel.xyz();
+                        texel.Normal = map.normalMap.GetPixel(x, y).xyz().Normalize();
+                        texel.MinValidDistance = posPixel.w * 2.0f;
+                        texel.Radiance.SetZero();
+                        texel.IsInvalidRegion = false;
+                        texels.Add(texel);
+                    }
+                }
+                TraceGatherRayStream(random, texels, sampleCount);
+                for (auto & texel : texels)
+                {
+                    int x = texel.PixelIndex % map.diffuseMap.Width;
+                    int y = texel.PixelIndex / map.diffuseMap.Width;
+                    auto & corner = corners[(y - tileY0) * tileW + x - tileX0];
+                    corner.Lighting = VectorMath::Vec4::Create(texel.Radiance, 1.0f);
+                    corner.Position = texel.Position;
+                    corner.Valid = true;
+                    if (sampleCount >= settings.SampleCount && texel.IsInvalidRegion)
+                    {
+                        map.validPixels.Remove(texel.PixelIndex);
+                        corner.Valid = false;
+                    }
+                    resultMap.SetPixel(x, y, corner.Lighting);
+                }
+                nextBlocks.Clear();
+                for (auto & block : blocks)
+                {
+                    if (block.Size <= 2)
+                        continue;
+                    VectorMath::Vec4 result[4];
+                    VectorMath::Vec3 positions[4];
+                    bool valid[4];
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int x = (i & 1) ? block.X0 + block.Size - 1 : block.X0;
+                        int y = (i & 2) ? block.Y0 + block.Size - 1 : block.Y0;
+                        auto & corner = corners[(y - tileY0) * tileW + x - tileX0];
+                        result[i] = corner.Lighting;
+                        positions[i] = corner.Position;
+                        valid[i] = corner.Valid;
+                    }
+                    if (ShouldRefineLightmapBlock(sampleCount, result, positions, valid))
+                    {
+                        int halfSize = block.Size >> 1;
+                        for (int j = 0; j < 4; j++)
+                            nextBlocks.Add(Block{ block.X0 + ((j & 1) ? halfSize : 0), block.Y0 + ((j & 2) ? halfSize : 0), halfSize });
+                    }
+                    else
+                        InterpolateLightmapBlock(resultMap, block.X0, block.Y0, block.Size, result);
+                }
+                Swap(blocks, nextBlocks);
+            }
+        }
+
+        void TraceIndirectLightingTile(const LightmapTile & tile, Random & random, int sampleCount, List<RawObjectSpaceMap> & resultMaps)
+        {
+            auto & map = maps[tile.MapId];
+            auto & resultMap = resultMaps[tile.MapId];
+            if (settings.UseRayStreams)
+                ComputeIndirectLightmapTileStreamed(random, map, resultMap, sampleCount, tile);
+            else
+            {
+                for (int y0 = tile.Y0; y0 < tile.Y1; y0 += MaxLightmapBlockSize)
+                    for (int x0 = tile.X0; x0 < tile.X1; x0 += MaxLightmapBlockSize)
+                    {
+                        if (isCancelled) return;
+                        VectorMath::Vec3 positions[4], normals[4];
+                        VectorMath::Vec4 results[4];
+                        bool valid[4];
+                        bool computed[4] = { false, false ,false, false };
+                        ComputeIndirectLightmapBlock(random, map, resultMap, sampleCount, x0, y0, MaxLightmapBlockSize,
+                            results, normals, positions, valid, computed);
+                    }
+            }
+        }
+
+        // Traces one bounce of indirect lighting into resultMaps. The indirect lighting of the previous bounce
+        // is read from the maps while tracing, so results go to separate maps.
+        void TraceIndirectLighting(unsigned int seedPass, int sampleCount, List<RawObjectSpaceMap> & resultMaps)
+        {
+            resultMaps.SetSize(maps.Count());
+            for (int i = 0; i < maps.Count(); i++)
+                resultMaps[i] = maps[i].indirectLightmap;
+            if (settings.DistributedJobDirectory.Length())
+            {
+                TraceIndirectLightingDistributed(seedPass, sampleCount, resultMaps);
+                return;
+            }
+            ForEachLightmapTile(seedPass, [&](const LightmapTile & tile, Random & random)
+            {
+                TraceIndirectLightingTile(tile, random, sampleCount, resultMaps);
+            });
+        }
+
+        void ComputeLightmaps_Indirect(int pass, int sampleCount)
+        {
+            List<RawObjectSpaceMap> resultMaps;
+            TraceIndirectLighting(pass + 1, sampleCount, resultMaps);
+            // a cancelled bounce is incomplete, keep the previous one for the checkpoint
+            if (isCancelled)
+                return;
+            for (int i = 0; i < maps.Count(); i++)
+                maps[i].indirectLightmap = _Move(resultMaps[i]);
+        }
+
+        void AddRadianceCacheSamples()
+        {
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                if (!mapDirty[i])
+                    continue;
+                auto & map = maps[i];
+                for (int y = 0; y < map.diffuseMap.Height; y++)
+                    for (int x = 0; x < map.diffuseMap.Width; x++)
+                    {
+                        if (map.validPixels.Contains(y * map.diffuseMap.Width + x))
+                            radianceCache.AddSample(map.positionMap.GetPixel(x, y).xyz(), map.normalMap.GetPixel(x, y).xyz().Normalize());
+                    }
+            }
+            radianceCache.Finalize();
+        }
+        // Fills the radiance cache with the surface samples of the dirty lightmaps and computes the given number of
+        // indirect bounces on the cache voxels. A bounce gathers the lighting of the previous one at the ray hits,
+        // so the final gather of the lightmaps then picks up all bounces with a single cache lookup per hit.
+        void ComputeRadianceCache(int bounces)
+        {
+            StatusChanged("Building radiance cache...");
+            int texelCount = 0;
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                if (mapDirty[i])
+                    texelCount += maps[i].diffuseMap.Width * maps[i].diffuseMap.Height;
+            }
+            radianceCache.Init(settings.RadianceCacheCellSize, texelCount / 16);
+            AddRadianceCacheSamples();
+            List<VectorMath::Vec3> irradiance;
+            irradiance.SetSize(radianceCache.Cells.Count());
+            for (int bounce = 0; bounce < bounces; bounce++)
+            {
+                StringBuilder statusTextSB;
+                statusTextSB << "Computing radiance cache, pass " << bounce + 1 << "/" << bounces << "...";
+                StatusChanged(statusTextSB.ProduceString());
+                ProgressChanged(LightmapBakerProgressChangedEventArgs(bounce, bounces));
+                threadPool.ParallelFor(0, radianceCache.Cells.Count(), 64, [&](int i)
+                {
+                    if (isCancelled)
+                        return;
+                    auto & cell = radianceCache.Cells[i];
+                    Random random(GetTileSeed(bounce + 1, i));
+                    bool isInvalidRegion = false;
+                    irradiance[i] = ComputeIndirectLighting(random, cell.Position + cell.Normal * settings.ShadowBias, cell.Normal,
+                        settings.RadianceCacheSampleCount, 0.0f, isInvalidRegion);
+                    FlushRayCount();
+                });
+                if (isCancelled)
+                    return;
+                for (int i = 0; i < irradiance.Count(); i++)
+                    radianceCache.Cells[i].Irradiance = irradiance[i];
+            }
+        }
+
+        // Accumulates the final gather in passes of FinalGatherPassSampleCount samples, compositing the average
+        // of all passes so far after each of them. The lighting of the previous bounce stays in the maps as the
+        // gather source until all samples are taken or the bake is stopped.
+        void ComputeLightmaps_FinalGather(int pass)
+        {
+            isFinalGather = true;
+            if (finalGatherSampleCount == 0)
+            {
+                finalGatherAccumulators.SetSize(maps.Count());
+                for (int i = 0; i < maps.Count(); i++)
+                    finalGatherAccumulators[i].Init(RawObjectSpaceMap::DataType::RGB32F, maps[i].indirectLightmap.Width, maps[i].indirectLightmap.Height);
+            }
+            List<RawObjectSpaceMap> sourceMaps;
+            sourceMaps.SetSize(maps.Count());
+            for (int i = 0; i < maps.Count(); i++)
+                sourceMaps[i] = maps[i].indirectLightmap;
+            bool hasResult = false;
+            while (finalGatherSampleCount < settings.FinalGatherSampleCount && !isStopRequested)
+            {
+                int passSampleCount = Math::Min(Math::Max(settings.FinalGatherPassSampleCount, 1), settings.FinalGatherSampleCount - finalGatherSampleCount);
+                StringBuilder statusTextSB;
+                statusTextSB << "Computing final gather, " << finalGatherSampleCount + passSampleCount << "/" << settings.FinalGatherSampleCount << " samples...";
+                StatusChanged(statusTextSB.ProduceString());
+                ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
+                List<RawObjectSpaceMap> resultMaps;
+                // every pass uses its own random sequence so that passes are independent estimates
+                TraceIndirectLighting(pass + 1 + finalGatherSampleCount, passSampleCount, resultMaps);
+                if (isCancelled)
+                    break;
+                for (int i = 0; i < maps.Count(); i++)
+                {
+                    auto & accumulator = finalGatherAccumulators[i];
+                    auto & resultMap = resultMaps[i];
+                    threadPool.ParallelFor(0, accumulator.Height, 4, [&](int y)
+                    {
+                        for (int x = 0; x < accumulator.Width; x++)
+                            accumulator.SetPixel(x, y, accumulator.GetPixel(x, y) + resultMap.GetPixel(x, y) * (float)passSampleCount);
+                    });
+                }
+                finalGatherSampleCount += passSampleCount;
+                SetFinalGatherResult();
+                CompositeLightmaps();
+                hasResult = true;
+                if (isCancelled)
+                    break;
+                IterationCompleted();
+                for (int i = 0; i < maps.Count(); i++)
+                    maps[i].indirectLightmap = sourceMaps[i];
+                SaveCheckpointIfDue();
+            }
+            if (isCancelled)
+            {
+                // leave the gather source in place for the checkpoint
+                for (int i = 0; i < maps.Count(); i++)
+                    maps[i].indirectLightmap = _Move(sourceMaps[i]);
+            }
+            else if (!hasResult && finalGatherSampleCount > 0)
+            {
+                // resumed from a checkpoint that already holds the complete final gather
+                SetFinalGatherResult();
+                CompositeLightmaps();
+                IterationCompleted();
+            }
+            else if (hasResult)
+                SetFinalGatherResult();
+            isFinalGather = false;
+        }
+        void SetFinalGatherResult()
+        {
+            float invSampleCount = 1.0f / finalGatherSampleCount;
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                auto & accumulator = finalGatherAccumulators[i];
+                auto & indirectMap = maps[i].indirectLightmap;
+                threadPool.ParallelFor(0, accumulator.Height, 4, [&](int y)
+                {
+                    for (int x = 0; x < accumulator.Width; x++)
+                        indirectMap.SetPixel(x, y, accumulator.GetPixel(x, y) * invSampleCount);
+                });
+            }
+        }
+
+        uint64_t ComputeInputHash()
+        {
+            // combine per-actor hashes independently of the actor order
+            uint64_t result = 0;
+            for (auto & record : lightmaps.InputRecords)
+            {
+                BakingInputHasher hasher;
+                hasher.Add(record.Key);
+                hasher.Add(record.Value.Hash);
+                result += hasher.GetValue();
+            }
+            return result;
+        }
+        void SaveCheckpointIfDue()
+        {
+            if (settings.CheckpointFileName.Length() == 0)
+                return;
+            if (CoreLib::Diagnostics::PerformanceCounter::EndSeconds(lastCheckpointTime) < settings.CheckpointInterval)
+                return;
+            SaveCheckpoint();
+        }
+        // Saves the state after the last finished bounce or final gather pass. Direct lighting is not saved since
+        // it is cheap to recompute. The file is written under a temporary name first so that a crash while saving
+        // does not destroy the previous checkpoint.
+        void SaveCheckpoint()
+        {
+            if (settings.CheckpointFileName.Length() == 0 || !hasCheckpointState)
+                return;
+            StatusChanged("Saving checkpoint...");
+            auto tempFileName = settings.CheckpointFileName + ".tmp";
+            try
+            {
+                LightmapCheckpointFileHeader header;
+                auto settingsHash = lightmaps.SettingsHash;
+                auto inputHash = ComputeInputHash();
+                header.SettingsHash[0] = (unsigned int)settingsHash;
+                header.SettingsHash[1] = (unsigned int)(settingsHash >> 32);
+                header.InputHash[0] = (unsigned int)inputHash;
+                header.InputHash[1] = (unsigned int)(inputHash >> 32);
+                header.MapCount = maps.Count();
+                header.CompletedBounces = completedBounces;
+                header.FinalGatherSampleCount = finalGatherSampleCount;
+                {
+                    BinaryWriter writer(new FileStream(tempFileName, FileMode::Create));
+                    writer.Write(header);
+                    for (int i = 0; i < maps.Count(); i++)
+                    {
+                        auto & map = maps[i];
+                        writer.Write((int)mapDirty[i]);
+                        writer.Write(map.diffuseMap.Width);
+                        writer.Write(map.diffuseMap.Height);
+                        writer.Write(map.validPixels.Size() >> 5);
+                        writer.Write(map.validPixels.GetBuffer(), map.validPixels.Size() >> 5);
+                        map.indirectLightmap.SaveToStream(writer);
+                        if (finalGatherSampleCount > 0)
+                            finalGatherAccumulators[i].SaveToStream(writer);
+                    }
+                    // the cache holds the bounces skipped in the lightmaps once it is complete, its cells are rebuilt
+                    // from the G-buffers when the checkpoint is loaded
+                    bool isCacheComplete = completedBounces >= settings.IndirectLightingBounces - 1;
+                    writer.Write(isCacheComplete ? radianceCache.Cells.Count() : 0);
+                    if (isCacheComplete)
+                    {
+                        for (auto & cell : radianceCache.Cells)
+                            writer.Write(cell.Irradiance);
+                    }
+                }
+                if (!File::Move(tempFileName, settings.CheckpointFileName))
+                    throw IOException("Cannot rename " + tempFileName);
+            }
+            catch (const IOException &)
+            {
+                Engine::Print("Lightmap baker: failed to save checkpoint '%S'.\n", settings.CheckpointFileName.ToWString());
+            }
+            lastCheckpointTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+        }
+        // Restores the indirect lighting state from the checkpoint file. Returns false if there is no checkpoint
+        // or it was saved for different settings, actors or lightmap layout.
+        bool LoadCheckpoint()
+        {
+            if (settings.CheckpointFileName.Length() == 0 || !File::Exists(settings.CheckpointFileName))
+                return false;
+            try
+            {
+                BinaryReader reader(new FileStream(settings.CheckpointFileName, FileMode::Open));
+                LightmapCheckpointFileHeader header;
+                reader.Read(header);
+                if (strncmp(header.Identifier, "GLMC", 4) != 0 || header.Version != LightmapCheckpointFileVersion)
+                    return false;
+                auto settingsHash = header.SettingsHash[0] + ((uint64_t)header.SettingsHash[1] << 32);
+                auto inputHash = header.InputHash[0] + ((uint64_t)header.InputHash[1] << 32);
+                if (settingsHash != lightmaps.SettingsHash || inputHash != ComputeInputHash() || header.MapCount != maps.Count()
+                    || header.CompletedBounces > settings.IndirectLightingBounces || header.FinalGatherSampleCount > settings.FinalGatherSampleCount)
+                    return false;
+                List<IntSet> validPixels;
+                List<RawObjectSpaceMap> indirectMaps, accumulators;
+                validPixels.SetSize(maps.Count());
+                indirectMaps.SetSize(maps.Count());
+                accumulators.SetSize(maps.Count());
+                for (int i = 0; i < maps.Count(); i++)
+                {
+                    auto & map = maps[i];
+                    int dirty = reader.ReadInt32();
+                    int width = reader.ReadInt32();
+                    int height = reader.ReadInt32();
+                    int validPixelWords = reader.ReadInt32();
+                    if ((dirty != 0) != mapDirty[i] || width != map.diffuseMap.Width || height != map.diffuseMap.Height
+                        || validPixelWords != (map.validPixels.Size() >> 5))
+                        return false;
+                    validPixels[i].SetMax(width * height);
+                    reader.Read(validPixels[i].GetBuffer(), validPixelWords);
+                    indirectMaps[i].LoadFromStream(reader);
+                    if (header.FinalGatherSampleCount > 0)
+                        accumulators[i].LoadFromStream(reader);
+                }
+                // a cache cell holds at least one valid texel
+                int cacheCellCount = reader.ReadInt32();
+                int texelCount = 0;
+                for (auto & validPixelSet : validPixels)
+                    texelCount += validPixelSet.Size();
+                if (cacheCellCount < 0 || cacheCellCount > texelCount)
+                    return false;
+                List<VectorMath::Vec3> cacheIrradiance;
+                cacheIrradiance.SetSize(cacheCellCount);
+                reader.Read(cacheIrradiance.Buffer(), cacheIrradiance.Count());
+                for (int i = 0; i < maps.Count(); i++)
+                    maps[i].validPixels = _Move(validPixels[i]);
+                if (cacheCellCount > 0)
+                {
+                    radianceCache.Init(settings.RadianceCacheCellSize, cacheCellCount);
+                    AddRadianceCacheSamples();
+                    if (radianceCache.Cells.Count() != cacheCellCount)
+                    {
+                        radianceCache = RadianceCache();
+                        return false;
+                    }
+                    for (int i = 0; i < cacheCellCount; i++)
+                        radianceCache.Cells[i].Irradiance = cacheIrradiance[i];
+                }
+                for (int i = 0; i < maps.Count(); i++)
+                    maps[i].indirectLightmap = _Move(indirectMaps[i]);
+                completedBounces = header.CompletedBounces;
+                finalGatherSampleCount = header.FinalGatherSampleCount;
+                if (finalGatherSampleCount > 0)
+                    finalGatherAccumulators = _Move(accumulators);
+                return true;
+            }
+            catch (const IOException &)
+            {
+                return false;
+            }
+        }
+
+        // Distributed baking: the baker and any number of worker processes share a job directory. At the first
+        // indirect lighting pass the baker writes a session file with the settings, the level and the G-buffers.
+        // Every pass then writes a pass file with the gather source of the pass and an empty job file per range of
+        // tiles. The baker and the workers claim a job by renaming its file, which succeeds for exactly one of them,
+        // and workers return the traced tiles in result files. Tiles keep the random seeds of a local bake, so
+        // distributing a bake does not change its result.
+        static const int TilesPerDistributedJob = 16;
+        // While a session runs, the baker rewrites a heartbeat file every DistributedHeartbeatInterval seconds.
+        // Workers leave the bake once the heartbeat has not changed for DistributedHeartbeatTimeout seconds, e.g.
+        // because the baker has crashed.
+        static const int DistributedHeartbeatInterval = 2;
+        static const int DistributedHeartbeatTimeout = 60;
+        CoreLib::Threading::Thread heartbeatThread;
+        std::atomic<bool> isHeartbeatStopped{true};
+        bool isWorker = false;
+        bool isDistributedSessionStarted = false;
+        int distributedSessionId = 0;
+        int distributedPassCount = 0;
+        String GetDistributedFileName(const String & name)
+        {
+            return Path::Combine(settings.DistributedJobDirectory, name);
+        }
+        String GetDistributedPassFileName(int passId)
+        {
+            return GetDistributedFileName(String("pass") + String(passId));
+        }
+        String GetDistributedJobFileName(int passId, int jobId, const char * suffix)
+        {
+            StringBuilder sb;
+            sb << "pass" << passId << ".job" << jobId << suffix;
+            return GetDistributedFileName(sb.ProduceString());
+        }
+        // writes under a temporary name first, so that other processes never see a partially written file
+        template<typename WriteFunc>
+        static void WriteFileAtomic(const String & fileName, const WriteFunc & writeFunc)
+        {
+            auto tempFileName = fileName + ".tmp";
+            {
+                BinaryWriter writer(new FileStream(tempFileName, FileMode::Create));
+                writeFunc(writer);
+            }
+            if (!File::Move(tempFileName, fileName))
+                throw IOException("Cannot rename " + tempFileName);
+        }
+        static void SleepWhileWaiting()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        // removes the files of previous sessions, keeping the done marker if requested
+        void ClearDistributedFiles(bool keepDoneFile)
+        {
+            List<String> fileNames;
+            for (auto entry : DirectoryIterator(settings.DistributedJobDirectory))
+            {
+                if (entry.type != DirectoryEntryType::File)
+                    continue;
+                if (entry.name.StartsWith("pass") || entry.name.StartsWith("session") || entry.name.StartsWith("current") ||
+                    entry.name.StartsWith("heartbeat") || (!keepDoneFile && entry.name.StartsWith("done")))
+                    fileNames.Add(entry.fullPath);
+            }
+            for (auto & fileName : fileNames)
+                File::Delete(fileName);
+        }
+        // reads the session and pass ids stored in the current pass pointer or the done marker, or the session id and
+        // the beat count of the heartbeat
+        bool ReadDistributedIds(const String & fileName, int & sessionId, int & passId)
+        {
+            try
+            {
+                if (!File::Exists(fileName))
+                    return false;
+                BinaryReader reader(new FileStream(fileName, FileMode::Open));
+                sessionId = reader.ReadInt32();
+                passId = reader.ReadInt32();
+                return true;
+            }
+            catch (const IOException &)
+            {
+                return false;
+            }
+        }
+        // every setting that lightmap allocation and tracing read, so that workers trace exactly like the baker
+        void WriteDistributedSettings(BinaryWriter & writer)
+        {
+            writer.Write(settings.ResolutionScale);
+            writer.Write(settings.MinResolution);
+            writer.Write(settings.MaxResolution);
+            writer.Write(settings.IndirectLightingBounces);
+            writer.Write(settings.SampleCount);
+            writer.Write(settings.FinalGatherSampleCount);
+            writer.Write(settings.FinalGatherPassSampleCount);
+            writer.Write(settings.FinalGatherAdaptiveSampleThreshold);
+            writer.Write(settings.Epsilon);
+            writer.Write(settings.ShadowBias);
+            writer.Write(settings.IndirectLightingWorldGranularity);
+            writer.Write((int)settings.UseRayStreams);
+            writer.Write(settings.RadianceCacheCellSize);
+            writer.Write(settings.RadianceCacheSampleCount);
+            writer.Write(settings.DirectLightingShadowRayCount);
+        }
+        void ReadDistributedSettings(BinaryReader & reader)
+        {
+            settings.ResolutionScale = reader.ReadFloat();
+            settings.MinResolution = reader.ReadInt32();
+            settings.MaxResolution = reader.ReadInt32();
+            settings.IndirectLightingBounces = reader.ReadInt32();
+            settings.SampleCount = reader.ReadInt32();
+            settings.FinalGatherSampleCount = reader.ReadInt32();
+            settings.FinalGatherPassSampleCount = reader.ReadInt32();
+            settings.FinalGatherAdaptiveSampleThreshold = reader.ReadFloat();
+            settings.Epsilon = reader.ReadFloat();
+            settings.ShadowBias = reader.ReadFloat();
+            settings.IndirectLightingWorldGranularity = reader.ReadFloat();
+            settings.UseRayStreams = reader.ReadInt32() != 0;
+            settings.RadianceCacheCellSize = reader.ReadFloat();
+            settings.RadianceCacheSampleCount = reader.ReadInt32();
+            settings.DirectLightingShadowRayCount = reader.ReadInt32();
+        }
+        // hash of the meshes of the baked actors, including their lightmap UVs. Workers use the meshes as they are
+        // and only join a bake whose meshes match theirs.
+        uint64_t ComputeBakedMeshHash()
+        {
+            BakingInputHasher hasher;
+            for (auto & actor : level->Actors)
+            {
+                auto smActor = actor.Value.As<StaticMeshActor>();
+                if (!smActor || !smActor->IncludeInBaking.GetValue() || !smActor->GetMesh())
+                    continue;
+                auto mesh = smActor->GetMesh();
+                hasher.Add(mesh->GetMinimumLightmapResolution());
+                hasher.Add(mesh->GetVertexBuffer(), (size_t)mesh->GetVertexCount() * mesh->GetVertexSize());
+                hasher.Add(mesh->Indices.Buffer(), mesh->Indices.Count() * sizeof(int));
+            }
+            return hasher.GetValue();
+        }
+        String GetWorkerCommandLine()
+        {
+            auto quote = [](const String & arg)
+            {
+                return arg.StartsWith("\"") ? arg : "\"" + arg + "\"";
+            };
+            auto & parser = OsApplication::GetCommandLineParser();
+            StringBuilder sb;
+            sb << quote(parser.GetFileName()) << " -no_renderer -headless";
+            if (parser.OptionExists("-dir"))
+                sb << " -dir " << quote(parser.GetOptionValue("-dir"));
+            if (parser.OptionExists("-enginedir"))
+                sb << " -enginedir " << quote(parser.GetOptionValue("-enginedir"));
+            sb << " -bakeworker " << quote(settings.DistributedJobDirectory);
+            return sb.ProduceString();
+        }
+        void StartHeartbeat()
+        {
+            isHeartbeatStopped = false;
+            heartbeatThread.Start(new CoreLib::Threading::ThreadProc([this]()
+            {
+                int beat = 0;
+                while (!isHeartbeatStopped)
+                {
+                    try
+                    {
+                        WriteFileAtomic(GetDistributedFileName("heartbeat"), [&](BinaryWriter & writer)
+                        {
+                            writer.Write(distributedSessionId);
+                            writer.Write(beat);
+                        });
+                        beat++;
+                    }
+                    catch (const IOException &)
+                    {
+                        // a worker may be reading the file, the next beat is written after the interval
+                    }
+                    for (int i = 0; i < DistributedHeartbeatInterval * 20 && !isHeartbeatStopped; i++)
+                        SleepWhileWaiting();
+                }
+            }));
+        }
+        void StopHeartbeat()
+        {
+            isHeartbeatStopped = true;
+            heartbeatThread.Join();
+        }
+        void StartDistributedSession()
+        {
+            StatusChanged("Starting distributed bake...");
+            Path::CreateDir(settings.DistributedJobDirectory);
+            ClearDistributedFiles(false);
+            distributedSessionId = (int)(std::chrono::system_clock::now().time_since_epoch().count() & 0x7FFFFFFF);
+            distributedPassCount = 0;
+            isDistributedSessionStarted = true;
+            WriteFileAtomic(GetDistributedFileName("session"), [&](BinaryWriter & writer)
+            {
+                LightmapDistributedFileHeader header;
+                header.SessionId = distributedSessionId;
+                header.MapCount = maps.Count();
+                writer.Write(header);
+                WriteDistributedSettings(writer);
+                writer.Write(level->SaveToText());
+                writer.Write(ComputeBakedMeshHash());
+                for (int i = 0; i < maps.Count(); i++)
+                {
+                    auto & map = maps[i];
+                    writer.Write((int)mapDirty[i]);
+                    writer.Write(map.diffuseMap.Width);
+                    writer.Write(map.diffuseMap.Height);
+                    writer.Write(map.validPixels.GetBuffer(), map.validPixels.Size() >> 5);
+                    map.diffuseMap.SaveToStream(writer);
+                    map.lightMap.SaveToStream(writer);
+                    if (mapDirty[i])
+                    {
+                        map.positionMap.SaveToStream(writer);
+                        map.normalMap.SaveToStream(writer);
+                    }
+                    else
+                        map.indirectLightmap.SaveToStream(writer);
+                }
+                // workers rebuild the cache cells from the G-buffers and only receive the lighting of the cells
+                writer.Write(radianceCache.Cells.Count());
+                for (auto & cell : radianceCache.Cells)
+                    writer.Write(cell.Irradiance);
+            });
+            StartHeartbeat();
+            if (settings.LocalWorkerCount > 0)
+            {
+                auto commandLine = GetWorkerCommandLine();
+                for (int i = 0; i < settings.LocalWorkerCount; i++)
+                {
+                    if (!OsApplication::StartProcess(commandLine))
+                        Engine::Print("Lightmap baker: failed to start worker process '%S'.\n", commandLine.ToWString());
+                }
+            }
+        }
+        void EndDistributedSession()
+        {
+            if (!isDistributedSessionStarted)
+                return;
+            isDistributedSessionStarted = false;
+            StopHeartbeat();
+            try
+            {
+                WriteFileAtomic(GetDistributedFileName("done"), [&](BinaryWriter & writer)
+                {
+                    writer.Write(distributedSessionId);
+                    writer.Write(distributedPassCount);
+                });
+                ClearDistributedFiles(true);
+            }
+            catch (const IOException &)
+            {
+                Engine::Print("Lightmap baker: failed to end distributed session in '%S'.\n", settings.DistributedJobDirectory.ToWString());
+            }
+        }
+        bool ClaimDistributedJob(int passId, int jobId)
+        {
+            auto jobFileName = GetDistributedJobFileName(passId, jobId, "");
+            auto takenFileName = GetDistributedJobFileName(passId, jobId, ".taken");
+            return File::Move(jobFileName, takenFileName);
+        }
+        void GetDistributedJobTileRange(int tileCount, int jobId, int & tileBegin, int & tileEnd)
+        {
+            tileBegin = jobId * TilesPerDistributedJob;
+            tileEnd = Math::Min(tileBegin + TilesPerDistributedJob, tileCount);
+        }
+        // traces the tiles of a job in parallel. Callers run several jobs at a time from tasks of the thread pool and
+        // report the progress per job.
+        void RunDistributedJob(unsigned int seedPass, int sampleCount, const List<LightmapTile> & tiles, int jobId, List<RawObjectSpaceMap> & resultMaps)
+        {
+            int tileBegin, tileEnd;
+            GetDistributedJobTileRange(tiles.Count(), jobId, tileBegin, tileEnd);
+            threadPool.ParallelFor(tileBegin, tileEnd, 1, [&](int i)
+            {
+                if (isCancelled)
+                    return;
+                Random random(GetTileSeed(seedPass, i));
+                TraceIndirectLightingTile(tiles[i], random, sampleCount, resultMaps);
+                FlushRayCount();
+            });
+        }
+        // a job result holds the traced lighting and the valid flag of every texel of the tiles of the job
+        void WriteDistributedJobResult(BinaryWriter & writer, const List<LightmapTile> & tiles, int jobId, List<RawObjectSpaceMap> & resultMaps)
+        {
+            int tileBegin, tileEnd;
+            GetDistributedJobTileRange(tiles.Count(), jobId, tileBegin, tileEnd);
+            List<VectorMath::Vec3> lighting;
+            List<unsigned char> valid;
+            for (int i = tileBegin; i < tileEnd; i++)
+            {
+                auto & tile = tiles[i];
+                auto & map = maps[tile.MapId];
+                for (int y = tile.Y0; y < tile.Y1; y++)
+                    for (int x = tile.X0; x < tile.X1; x++)
+                    {
+                        lighting.Add(resultMaps[tile.MapId].GetPixel(x, y).xyz());
+                        valid.Add(map.validPixels.Contains(y * map.diffuseMap.Width + x) ? 1 : 0);
+                    }
+            }
+            writer.Write(distributedSessionId);
+            writer.Write(jobId);
+            writer.Write(lighting);
+            writer.Write(valid);
+        }
+        bool ReadDistributedJobResult(const String & fileName, const List<LightmapTile> & tiles, int jobId, List<RawObjectSpaceMap> & resultMaps)
+        {
+            List<VectorMath::Vec3> lighting;
+            List<unsigned char> valid;
+            try
+            {
+                BinaryReader reader(new FileStream(fileName, FileMode::Open));
+                if (reader.ReadInt32() != distributedSessionId || reader.ReadInt32() != jobId)
+                    return false;
+                reader.Read(lighting);
+                reader.Read(valid);
+            }
+            catch (const IOException &)
+            {
+                return false;
+            }
+            int tileBegin, tileEnd;
+            GetDistributedJobTileRange(tiles.Count(), jobId, tileBegin, tileEnd);
+            int texelCount = 0;
+            for (int i = tileBegin; i < tileEnd; i++)
+                texelCount += (tiles[i].X1 - tiles[i].X0) * (tiles[i].Y1 - tiles[i].Y0);
+            if (lighting.Count() != texelCount || valid.Count() != texelCount)
+                return false;
+            int texel = 0;
+            for (int i = tileBegin; i < tileEnd; i++)
+            {
+                auto & tile = tiles[i];
+                auto & map = maps[tile.MapId];
+                for (int y = tile.Y0; y < tile.Y1; y++)
+                    for (int x = tile.X0; x < tile.X1; x++)
+                    {
+                        resultMaps[tile.MapId].SetPixel(x, y, VectorMath::Vec4::Create(lighting[texel], 1.0f));
+                        if (!valid[texel])
+                            map.validPixels.Remove(y * map.diffuseMap.Width + x);
+                        texel++;
+                    }
+            }
+            return true;
+        }
+        // Distributed counterpart of the tile loop of TraceIndirectLighting. The baker works on jobs itself until all
+        // jobs are claimed, then merges the results of the workers. Jobs that a worker does not finish within
+        // DistributedJobTimeout are traced locally, and any I/O failure falls back to a local bake.
+        void TraceIndirectLightingDistributed(unsigned int seedPass, int sampleCount, List<RawObjectSpaceMap> & resultMaps)
+        {
+            List<LightmapTile> tiles;
+            GetLightmapTiles(tiles);
+            int jobCount = (tiles.Count() + TilesPerDistributedJob - 1) / TilesPerDistributedJob;
+            List<bool> jobDone;
+            jobDone.SetSize(jobCount);
+            for (auto & done : jobDone)
+                done = false;
+            int passId = -1;
+            try
+            {
+                if (!isDistributedSessionStarted)
+                    StartDistributedSession();
+                passId = distributedPassCount++;
+                for (int j = 0; j < jobCount; j++)
+                    File::WriteAllText(GetDistributedJobFileName(passId, j, ""), "");
+                WriteFileAtomic(GetDistributedPassFileName(passId), [&](BinaryWriter & writer)
+                {
+                    LightmapDistributedFileHeader header;
+                    header.SessionId = distributedSessionId;
+                    header.MapCount = maps.Count();
+                    writer.Write(header);
+                    writer.Write(seedPass);
+                    writer.Write(sampleCount);
+                    writer.Write((int)isFinalGather);
+                    writer.Write(tiles.Count());
+                    writer.Write(jobCount);
+                    for (int i = 0; i < maps.Count(); i++)
+                    {
+                        if (!mapDirty[i])
+                            continue;
+                        writer.Write(maps[i].validPixels.GetBuffer(), maps[i].validPixels.Size() >> 5);
+                        maps[i].indirectLightmap.SaveToStream(writer);
+                    }
+                });
+                WriteFileAtomic(GetDistributedFileName("current"), [&](BinaryWriter & writer)
+                {
+                    writer.Write(distributedSessionId);
+                    writer.Write(passId);
+                });
+                // the baker claims jobs from tasks of its thread pool, so that it traces as many jobs at a time as it
+                // has threads while the workers claim the others
+                std::atomic<int> localDoneCount;
+                localDoneCount = 0;
+                CoreLib::Threading::ThreadPool::TaskGroup localJobs;
+                for (int j = 0; j < jobCount; j++)
+                {
+                    threadPool.Submit(localJobs, [&, j]()
+                    {
+                        if (isCancelled || !ClaimDistributedJob(passId, j))
+                            return;
+                        RunDistributedJob(seedPass, sampleCount, tiles, j, resultMaps);
+                        jobDone[j] = true;
+                        if (!isCancelled)
+                            ProgressChanged(LightmapBakerProgressChangedEventArgs(localDoneCount.fetch_add(1) + 1, jobCount));
+                    });
+                }
+                threadPool.Wait(localJobs);
+                auto waitStart = CoreLib::Diagnostics::PerformanceCounter::Start();
+                while (!isCancelled)
+                {
+                    bool isTimedOut = CoreLib::Diagnostics::PerformanceCounter::EndSeconds(waitStart) > settings.DistributedJobTimeout;
+                    int doneCount = 0;
+                    for (int j = 0; j < jobCount && !isCancelled; j++)
+                    {
+                        if (!jobDone[j])
+                        {
+                            auto resultFileName = GetDistributedJobFileName(passId, j, ".result");
+                            if (File::Exists(resultFileName) && ReadDistributedJobResult(resultFileName, tiles, j, resultMaps))
+                                jobDone[j] = true;
+                            else if (isTimedOut)
+                            {
+                                Engine::Print("Lightmap baker: distributed job %d of pass %d timed out, tracing it locally.\n", j, passId);
+                                RunDistributedJob(seedPass, sampleCount, tiles, j, resultMaps);
+                                jobDone[j] = true;
+                            }
+                        }
+                        if (jobDone[j])
+                            doneCount++;
+                    }
+                    ProgressChanged(LightmapBakerProgressChangedEventArgs(doneCount, jobCount));
+                    if (doneCount == jobCount)
+                        break;
+                    SleepWhileWaiting();
+                }
+                File::Delete(GetDistributedPassFileName(passId));
+                for (int j = 0; j < jobCount; j++)
+                {
+                    File::Delete(GetDistributedJobFileName(passId, j, ".taken"));
+                    File::Delete(GetDistributedJobFileName(passId, j, ".result"));
+                }
+            }
+            catch (const IOException &)
+            {
+                Engine::Print("Lightmap baker: distributed bake in '%S' failed, continuing locally.\n", settings.DistributedJobDirectory.ToWString());
+                EndDistributedSession();
+                settings.DistributedJobDirectory = String();
+                for (int j = 0; j < jobCount && !isCancelled; j++)
+                {
+                    if (!jobDone[j])
+                        RunDistributedJob(seedPass, sampleCount, tiles, j, resultMaps);
+                }
+            }
+        }
+        // loads the state of a session written by StartDistributedSession
+        bool JoinDistributedSession(int sessionId)
+        {
+            BinaryReader reader(new FileStream(GetDistributedFileName("session"), FileMode::Open));
+            LightmapDistributedFileHeader header;
+            reader.Read(header);
+            if (strncmp(header.Identifier, "GLMD", 4) != 0 || header.Version != LightmapDistributedFileVersion || header.SessionId != sessionId)
+                return false;
+            ReadDistributedSettings(reader);
+            StatusChanged("Loading level...");
+            Engine::Instance()->LoadLevelFromText(reader.ReadString());
+            level = Engine::Instance()->GetLevel();
+            lightmaps = LightmapSet();
+            maps.Clear();
+            radianceCache = RadianceCache();
+            // the baker has generated any missing lightmap UVs before the session started, a worker never changes
+            // the shared meshes
+            uint64_t meshHash;
+            reader.Read(meshHash);
+            for (auto & actor : level->Actors)
+            {
+                auto smActor = actor.Value.As<StaticMeshActor>();
+                if (smActor && smActor->IncludeInBaking.GetValue() && smActor->GetMesh() &&
+                    smActor->GetMesh()->GetMinimumLightmapResolution() <= 0)
+                    return false;
+            }
+            if (ComputeBakedMeshHash() != meshHash)
+                return false;
+            AllocLightmaps();
+            if (header.MapCount != maps.Count())
+                return false;
+            mapDirty.SetSize(maps.Count());
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                auto & map = maps[i];
+                mapDirty[i] = reader.ReadInt32() != 0;
+                int width = reader.ReadInt32();
+                int height = reader.ReadInt32();
+                if (width != map.diffuseMap.Width || height != map.diffuseMap.Height)
+                    return false;
+                reader.Read(map.validPixels.GetBuffer(), map.validPixels.Size() >> 5);
+                map.diffuseMap.LoadFromStream(reader);
+                map.lightMap.LoadFromStream(reader);
+                if (mapDirty[i])
+                {
+                    map.positionMap.LoadFromStream(reader);
+                    map.normalMap.LoadFromStream(reader);
+                }
+                else
+                    map.indirectLightmap.LoadFromStream(reader);
+            }
+            int cacheCellCount = reader.ReadInt32();
+            if (cacheCellCount > 0)
+            {
+                radianceCache.Init(settings.RadianceCacheCellSize, cacheCellCount);
+                AddRadianceCacheSamples();
+                if (radianceCache.Cells.Count() != cacheCellCount)
+                    return false;
+                for (auto & cell : radianceCache.Cells)
+                    reader.Read(cell.Irradiance);
+            }
+            StatusChanged("Building BVH...");
+            staticScene = BuildStaticScene(level, threadPool);
+            distributedSessionId = sessionId;
+            return true;
+        }
+        // traces all jobs of a pass that are still unclaimed
+        void RunDistributedPass(int passId)
+        {
+            BinaryReader reader(new FileStream(GetDistributedPassFileName(passId), FileMode::Open));
+            LightmapDistributedFileHeader header;
+            reader.Read(header);
+            if (header.SessionId != distributedSessionId || header.MapCount != maps.Count())
+                return;
+            unsigned int seedPass;
+            reader.Read(seedPass);
+            int sampleCount = reader.ReadInt32();
+            isFinalGather = reader.ReadInt32() != 0;
+            int tileCount = reader.ReadInt32();
+            int jobCount = reader.ReadInt32();
+            List<LightmapTile> tiles;
+            GetLightmapTiles(tiles);
+            if (tiles.Count() != tileCount)
+                return;
+            for (int i = 0; i < maps.Count(); i++)
+            {
+                if (!mapDirty[i])
+                    continue;
+                reader.Read(maps[i].validPixels.GetBuffer(), maps[i].validPixels.Size() >> 5);
+                maps[i].indirectLightmap.LoadFromStream(reader);
+            }
+            // close the file early so that the baker can delete it once the pass is done
+            reader.GetStream()->Close();
+            List<RawObjectSpaceMap> resultMaps;
+            resultMaps.SetSize(maps.Count());
+            for (int i = 0; i < maps.Count(); i++)
+                resultMaps[i] = maps[i].indirectLightmap;
+            std::atomic<int> doneCount;
+            doneCount = 0;
+            CoreLib::Threading::ThreadPool::TaskGroup jobs;
+            for (int j = 0; j < jobCount; j++)
+            {
+                threadPool.Submit(jobs, [&, j]()
+                {
+                    if (!ClaimDistributedJob(passId, j))
+                        return;
+                    RunDistributedJob(seedPass, sampleCount, tiles, j, resultMaps);
+                    try
+                    {
+                        WriteFileAtomic(GetDistributedJobFileName(passId, j, ".result"), [&](BinaryWriter & writer)
+                        {
+                            WriteDistributedJobResult(writer, tiles, j, resultMaps);
+                        });
+                    }
+                    catch (const IOException &)
+                    {
+                        // the baker traces the job itself once it times out
+                        Engine::Print("Lightmap baker: failed to write the result of job %d of pass %d.\n", j, passId);
+                    }
+                    ProgressChanged(LightmapBakerProgressChangedEventArgs(doneCount.fetch_add(1) + 1, jobCount));
+                });
+            }
+            threadPool.Wait(jobs);
+        }
+
+        RawObjectSpaceMap blurTempMap;
+        Dictionary<int, List<float>> blurKernels;
+        ArrayView<float> GetBlurKernel(int radius)
+        {
+            int size = radius + 1;
+            if (auto rs = blurKernels.TryGetValue(size))
+                return rs->GetArrayView();
+            List<float> kernel;
+            kernel.SetSize(size);
+            float sigma = 0.6f;
+            float invTwoSigmaSquare = 1.0f / (2.0f * sigma * sigma);
+            for (int i = 0; i < size; i++)
+            {
+                float dist = i / (float)radius;
+                float weight = exp(-dist * dist * invTwoSigmaSquare);
+                kernel[i] = weight;
+            }
+            blurKernels[size] = kernel;
+            return blurKernels[size]().GetArrayView();
+        }
+        void BlurLightmap(IntSet& validPixels, int blurRadius, RawObjectSpaceMap & lightmap)
+        {
+            blurTempMap.Init(lightmap.GetDataType(), lightmap.Width, lightmap.Height);
+            ArrayView<float> kernel = GetBlurKernel(blurRadius);
+            threadPool.ParallelFor(0, lightmap.Height, 4, [&](int y)
+            {
+                for (int x = 0; x < lightmap.Width; x++)
+                {
+                    if (validPixels.Contains(y*lightmap.Width + x))
+                    {
+                        VectorMath::Vec3 value;
+                        float sumWeight = kernel[0];
+                        value = lightmap.GetPixel(x, y).xyz();
                         for (int ix = x - 1; ix >= Math::Max(0, x - blurRadius); ix--)
                         {
                             if (validPixels.Contains(y*lightmap.Width + ix))
@@ -649,10 +2226,9 @@ namespace GameEngine
                         blurTempMap.SetPixel(x, y, VectorMath::Vec4::Create(value, 1.0f));
                     }
                 }
-            }
+            });
 
-            #pragma omp parallel for
-            for (int y = 0; y < lightmap.Height; y++)
+            threadPool.ParallelFor(0, lightmap.Height, 4, [&](int y)
             {
                 for (int x = 0; x < lightmap.Width; x++)
                 {
@@ -687,7 +2263,7 @@ namespace GameEngine
                         lightmap.SetPixel(x, y, VectorMath::Vec4::Create(value, 1.0f));
                     }
                 }
-            }
+            });
         }
 
         void CompositeLightmaps()
@@ -696,27 +2272,37 @@ namespace GameEngine
             for (int i = 0; i < maps.Count(); i++)
             {
                 auto & lm = lightmaps.Lightmaps[i];
+                if (!mapDirty[i])
+                {
+                    lm = reusedLightmaps[i];
+                    continue;
+                }
                 lm.Init(RawObjectSpaceMap::DataType::RGB32F, maps[i].lightMap.Width, maps[i].lightMap.Height);
                 int indirectBlurRadius = Math::Clamp(maps[i].indirectLightmap.Width / 50, 1, 40);
 
                 // get direct lighting
-                #pragma omp parallel for
-                for (int y = 0; y < lm.Height; y++)
+                threadPool.ParallelFor(0, lm.Height, 4, [&](int y)
+                {
                     for (int x = 0; x < lm.Width; x++)
                         lm.SetPixel(x, y, maps[i].lightMap.GetPixel(x, y) - maps[i].dynamicDirectLighting.GetPixel(x, y));
+                });
 
                 // blur direct lighting in final lightmap
                 BlurLightmap(maps[i].validPixels, 2, lm);
                 // composite indirect lighting
-                BlurLightmap(maps[i].validPixels, indirectBlurRadius, maps[i].indirectLightmap);
-                #pragma omp parallel for
-                for (int y = 0; y < lm.Height; y++)
+                if (settings.DenoiseIndirectLighting)
+                    DenoiseLightmap(threadPool, maps[i].indirectLightmap, maps[i].positionMap, maps[i].normalMap, maps[i].validPixels, settings.Denoiser);
+                else
+                    BlurLightmap(maps[i].validPixels, indirectBlurRadius, maps[i].indirectLightmap);
+                threadPool.ParallelFor(0, lm.Height, 4, [&](int y)
+                {
                     for (int x = 0; x < lm.Width; x++)
                         lm.SetPixel(x, y, lm.GetPixel(x, y) + maps[i].indirectLightmap.GetPixel(x, y));
+                });
 
                 // dilate
-                #pragma omp parallel for
-                for (int y = 0; y < lm.Height; y++)
+                threadPool.ParallelFor(0, lm.Height, 4, [&](int y)
+                {
                     for (int x = 0; x < lm.Width; x++)
                     {
                         if (!maps[i].validPixels.Contains(y * lm.Width + x) 
@@ -737,6 +2323,7 @@ namespace GameEngine
                         outContinue:;
                         }
                     }
+                });
                 
             }
         }
@@ -754,42 +2341,89 @@ namespace GameEngine
                 }
             }
             auto list = From(referencedMeshes).ToList();
-            #pragma omp parallel for
-            for (int i = 0; i < list.Count(); i++)
+            threadPool.ParallelFor(0, list.Count(), 1, [&](int i)
             {
                 if (isCancelled)
-                    continue;
+                    return;
                 auto kv = list[i];
                 if (kv.Value->GetMinimumLightmapResolution() <= 0)
                 {
                     StatusChanged(String("Generating unique uv for '") + kv.Key + "'...");
                     Mesh meshOut;
-                    GenerateLightmapUV(&meshOut, kv.Value, settings.MaxResolution, 1 + Math::Log2Ceil(settings.MaxResolution) - Math::Log2Ceil(settings.MinResolution));
+                    GenerateLightmapUV(&meshOut, kv.Value, settings.MaxResolution, 1 + Math::Log2Ceil(settings.MaxResolution) - Math::Log2Ceil(settings.MinResolution),
+                        &threadPool);
                     meshOut.SetMinimumLightmapResolution(settings.MinResolution);
                     auto fullFileName = Engine::Instance()->FindFile(kv.Key, ResourceType::Mesh);
+                    // releases the mapping of the source mesh file before it is replaced
+                    *kv.Value = _Move(meshOut);
                     try
                     {
                         if (fullFileName.Length())
-                            meshOut.SaveToFile(fullFileName);
+                            kv.Value->SaveToFile(fullFileName);
                     }
                     catch (const CoreLib::IO::IOException&)
                     {
                         StatusChanged(String("Failed to save mesh to '") + fullFileName + "'.");
                     }
-                    *kv.Value = _Move(meshOut);
                     MeshChanged(kv.Value);
                 }
-            }
+            });
         }
         
+        void CompressLightmapsOnCpu()
+        {
+            List<unsigned char> compressed;
+            for (int i = 0; i < lightmaps.Lightmaps.Count(); i++)
+            {
+                if (!mapDirty[i])
+                    continue;
+                auto & lm = lightmaps.Lightmaps[i];
+                compressed.SetSize(lm.Width * lm.Height);
+                threadPool.ParallelFor(0, (lm.Height + 3) / 4, 1, [&](int blockY)
+                {
+                    TextureCompressor::CompressBC6H_BlockRow(compressed.Buffer(), (float*)lm.GetBuffer(), lm.Width, lm.Height, blockY,
+                        settings.CompressionQuality);
+                });
+                lm.Init(RawObjectSpaceMap::DataType::BC6H, lm.Width, lm.Height);
+                memcpy(lm.GetBuffer(), compressed.Buffer(), compressed.Count());
+                if (isCancelled)
+                    return;
+            }
+        }
         void CompressLightmaps()
         {
+            ReuseLightmaps();
+            // the kernel is only compiled when the GPU path is taken, baking without a GPU has none
+            if (!settings.UseCpuCompression && !lightmapComrpessionKernel && !isGpuCompressionUnavailable)
+            {
+                if (!Engine::Instance()->GetRenderer()->GetHardwareRenderer()->HasDevice())
+                    isGpuCompressionUnavailable = true;
+                else
+                {
+                    try
+                    {
+                        lightmapComrpessionKernel = Engine::GetComputeTaskManager()->LoadKernel("BC6Compression.slang", "cs_main");
+                    }
+                    catch (const Exception &)
+                    {
+                        isGpuCompressionUnavailable = true;
+                    }
+                }
+            }
+            if (settings.UseCpuCompression || !lightmapComrpessionKernel)
+            {
+                CompressLightmapsOnCpu();
+                return;
+            }
             auto computeTaskManager = Engine::GetComputeTaskManager();
             auto hw = Engine::Instance()->GetRenderer()->GetHardwareRenderer();
             RefPtr<Fence> fence = hw->CreateFence();
             fence->Reset();
-            for (auto & lm : lightmaps.Lightmaps)
+            for (int i = 0; i < lightmaps.Lightmaps.Count(); i++)
             {
+                if (!mapDirty[i])
+                    continue;
+                auto & lm = lightmaps.Lightmaps[i];
                 int inputBufferSize = (int)lm.Width * lm.Height * sizeof(float) * 3;
                 int outputBufferSize = lm.Width * lm.Height;
                 auto inputBufferStructInfo = BufferStructureInfo(sizeof(float), inputBufferSize / sizeof(float));
@@ -816,10 +2450,17 @@ namespace GameEngine
         }
     public:
         std::atomic<bool> isCancelled;
+        std::atomic<bool> isStopRequested;
         std::atomic<bool> started;
         CoreLib::Threading::Thread computeThread;
         void StatusChanged(String status)
         {
+            // a worker process runs without a UI and reports its status on the console
+            if (isWorker)
+            {
+                Engine::Print("Lightmap baker worker: %S\n", status.ToWString());
+                return;
+            }
             Engine::Instance()->GetMainWindow()->InvokeAsync([=]()
             {
                 OnStatusChanged(status);
@@ -827,6 +2468,8 @@ namespace GameEngine
         }
         void MeshChanged(Mesh* mesh)
         {
+            if (isWorker)
+                return;
             Engine::Instance()->GetMainWindow()->InvokeAsync([=]()
             {
                 OnMeshChanged(mesh);
@@ -834,6 +2477,8 @@ namespace GameEngine
         }
         void ProgressChanged(LightmapBakerProgressChangedEventArgs e)
         {
+            if (isWorker)
+                return;
             Engine::Instance()->GetMainWindow()->InvokeAsync([=]()
             {
                 OnProgressChanged(e);
@@ -859,8 +2504,16 @@ namespace GameEngine
                 });
             }
         }
+        // returns the seconds since the last call and starts timing the next phase
+        float EndPhase()
+        {
+            float seconds = CoreLib::Diagnostics::PerformanceCounter::EndSeconds(phaseStartTime);
+            phaseStartTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+            return seconds;
+        }
         void ComputeThreadMain()
         {
+            bakeStartTime = CoreLib::Diagnostics::PerformanceCounter::Start();
             HardwareRenderer* hwRenderer = Engine::Instance()->GetRenderer()->GetHardwareRenderer();
             hwRenderer->ThreadInit(1);
 
@@ -870,59 +2523,125 @@ namespace GameEngine
             if (isCancelled) goto computeThreadEnd;
 
             AllocLightmaps();
+            ComputeInputRecords();
+            FindDirtyLightmaps();
             if (isCancelled) goto computeThreadEnd;
-            #pragma omp parallel sections
+            if (isIncremental)
+            {
+                int dirtyCount = GetDirtyLightmapCount();
+                if (dirtyCount == 0)
+                {
+                    StatusChanged("Lightmaps are up to date.");
+                    ReuseLightmaps();
+                    goto computeThreadEnd;
+                }
+                StringBuilder statusTextSB;
+                statusTextSB << "Rebaking " << dirtyCount << " of " << maps.Count() << " lightmaps...";
+                StatusChanged(statusTextSB.ProduceString());
+            }
             {
-                #pragma omp section
+                // build the static scene on the thread pool while this thread renders the G-buffers
+                CoreLib::Threading::ThreadPool::TaskGroup buildSceneTask;
+                threadPool.Submit(buildSceneTask, [this]()
                 {
                     StatusChanged("Building BVH...");
                     ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
 
-                    staticScene = BuildStaticScene(level);
-                }
-                #pragma omp section
-                {
-                    Engine::Instance()->GetRenderer()->GetHardwareRenderer()->ThreadInit(1);
-                    StatusChanged("Initializing lightmaps...");
-                    BakeLightmapGBuffers();                    
-                }
+                    auto buildStartTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+                    staticScene = BuildStaticScene(level, threadPool);
+                    statistics.SceneBuildTime = CoreLib::Diagnostics::PerformanceCounter::EndSeconds(buildStartTime);
+                });
+                StatusChanged("Initializing lightmaps...");
+                EndPhase();
+                BakeLightmapGBuffers();
+                InitReusedLightmaps();
+                statistics.GBufferTime = EndPhase();
+                threadPool.Wait(buildSceneTask);
+                EndPhase();
             }
-            
+
+
             if (isCancelled) goto computeThreadEnd;
 
             StatusChanged("Refining G-Buffer...");
             BiasGBufferPositions();
+            statistics.BiasTime = EndPhase();
 
             if (isCancelled) goto computeThreadEnd;
 
             StatusChanged("Computing direct lighting...");
             ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
             ComputeLightmaps_Direct();
-            CompositeLightmaps();
+            statistics.DirectLightingTime = EndPhase();
             if (isCancelled) goto computeThreadEnd;
-            IterationCompleted();
+            hasCheckpointState = true;
+            lastCheckpointTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+            if (settings.ResumeFromCheckpoint)
+            {
+                if (LoadCheckpoint())
+                {
+                    StringBuilder statusTextSB;
+                    statusTextSB << "Resuming from checkpoint after " << completedBounces << " bounces";
+                    if (finalGatherSampleCount > 0)
+                        statusTextSB << " and " << finalGatherSampleCount << " final gather samples";
+                    statusTextSB << ".";
+                    StatusChanged(statusTextSB.ProduceString());
+                }
+                else
+                    StatusChanged("No matching checkpoint found, baking from scratch.");
+            }
+            if (finalGatherSampleCount == 0)
+            {
+                CompositeLightmaps();
+                if (isCancelled) goto computeThreadEnd;
+                IterationCompleted();
+            }
 
-            for (int i = 0; i < settings.IndirectLightingBounces; i++)
+            // a resumed bake restores the cache from the checkpoint
+            if (settings.RadianceCacheCellSize > 0.0f && settings.IndirectLightingBounces > 1 && !isStopRequested &&
+                radianceCache.IsEmpty())
+            {
+                ComputeRadianceCache(settings.IndirectLightingBounces - 1);
+                if (isCancelled) goto computeThreadEnd;
+                completedBounces = settings.IndirectLightingBounces - 1;
+            }
+            for (int i = completedBounces; i < settings.IndirectLightingBounces && !isStopRequested; i++)
             {
-                StringBuilder statusTextSB;
-                statusTextSB << "Computing indirect lighting, pass " << i + 1 << "/" << settings.IndirectLightingBounces;
                 if (i == settings.IndirectLightingBounces - 1)
-                    statusTextSB << "(final gather)";
-                statusTextSB << "...";
+                {
+                    ComputeLightmaps_FinalGather(i);
+                    if (isCancelled) goto computeThreadEnd;
+                    break;
+                }
+                StringBuilder statusTextSB;
+                statusTextSB << "Computing indirect lighting, pass " << i + 1 << "/" << settings.IndirectLightingBounces << "...";
                 auto statusText = statusTextSB.ToString();
                 StatusChanged(statusText);
                 ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
-                ComputeLightmaps_Indirect(i == settings.IndirectLightingBounces-1 ? settings.FinalGatherSampleCount : Math::Min((i + 1) * 2, settings.SampleCount));
+                ComputeLightmaps_Indirect(i, Math::Min((i + 1) * 2, settings.SampleCount));
+                if (isCancelled) goto computeThreadEnd;
                 CompositeLightmaps();
                 if (isCancelled) goto computeThreadEnd;
+                completedBounces = i + 1;
                 IterationCompleted();
+                SaveCheckpointIfDue();
             }
 
+            statistics.IndirectLightingTime = EndPhase();
             StatusChanged("Compressing lightmaps...");
             CompressLightmaps();
+            statistics.CompressionTime = EndPhase();
         computeThreadEnd:;
+            EndDistributedSession();
+            statistics.TotalTime = CoreLib::Diagnostics::PerformanceCounter::EndSeconds(bakeStartTime);
+            statistics.RayCount = tracedRayCount.load();
+            if (isCancelled)
+                SaveCheckpoint();
             if (!isCancelled)
             {
+                // a later bake with the same settings must not resume from the finished one
+                if (settings.CheckpointFileName.Length())
+                    File::Delete(settings.CheckpointFileName);
                 StatusChanged("Baking completed.");
                 ProgressChanged(LightmapBakerProgressChangedEventArgs(0, 100));
             }
@@ -935,19 +2654,113 @@ namespace GameEngine
             started = false;
         }
         virtual void Start(const LightmapBakingSettings & pSettings, Level* pLevel) override
+        {
+            isIncremental = false;
+            previousLightmaps = LightmapSet();
+            StartBaking(pSettings, pLevel);
+        }
+        virtual void StartIncremental(const LightmapBakingSettings & pSettings, Level* pLevel, const LightmapSet & pPreviousLightmaps) override
+        {
+            isIncremental = true;
+            previousLightmaps = pPreviousLightmaps;
+            StartBaking(pSettings, pLevel);
+        }
+        void StartBaking(const LightmapBakingSettings & pSettings, Level* pLevel)
         {
             settings = pSettings;
             level = pLevel;
             lightmaps = LightmapSet();
             maps.Clear();
+            radianceCache = RadianceCache();
+            completedBounces = 0;
+            finalGatherSampleCount = 0;
+            finalGatherAccumulators.Clear();
+            hasCheckpointState = false;
+            isDistributedSessionStarted = false;
+            distributedPassCount = 0;
+            statistics = LightmapBakerStatistics();
+            tracedRayCount = 0;
             started = true;
             isCancelled = false;
+            isStopRequested = false;
 
             computeThread.Start(new CoreLib::Threading::ThreadProc([this]()
             {
                 ComputeThreadMain();
             }));
         }
+        virtual void RunWorker(const String & jobDirectory) override
+        {
+            isWorker = true;
+            isCancelled = false;
+            isStopRequested = false;
+            settings = LightmapBakingSettings();
+            settings.DistributedJobDirectory = jobDirectory;
+            StatusChanged("Waiting for a distributed bake in '" + jobDirectory + "'...");
+            String status = "Distributed bake completed.";
+            int sessionId = -1;
+            int nextPassId = 0;
+            // the last heartbeat seen, a worker waits for a bake to start until it has seen one
+            int heartbeatSessionId = -1, heartbeat = -1;
+            auto heartbeatTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+            while (true)
+            {
+                int currentSessionId, passId;
+                if (sessionId != -1 && ReadDistributedIds(GetDistributedFileName("done"), currentSessionId, passId) &&
+                    currentSessionId == sessionId)
+                    break;
+                int beatSessionId, beat;
+                if (ReadDistributedIds(GetDistributedFileName("heartbeat"), beatSessionId, beat) &&
+                    (beatSessionId != heartbeatSessionId || beat != heartbeat))
+                {
+                    heartbeatSessionId = beatSessionId;
+                    heartbeat = beat;
+                    heartbeatTime = CoreLib::Diagnostics::PerformanceCounter::Start();
+                }
+                else if (heartbeatSessionId != -1 &&
+                    CoreLib::Diagnostics::PerformanceCounter::EndSeconds(heartbeatTime) > DistributedHeartbeatTimeout)
+                {
+                    status = "The baker stopped responding, leaving the distributed bake.";
+                    break;
+                }
+                if (ReadDistributedIds(GetDistributedFileName("current"), currentSessionId, passId))
+                {
+                    try
+                    {
+                        if (currentSessionId != sessionId)
+                        {
+                            if (!JoinDistributedSession(currentSessionId))
+                            {
+                                status = "The bake does not match the level or the meshes loaded by this worker.";
+                                break;
+                            }
+                            sessionId = currentSessionId;
+                            nextPassId = 0;
+                        }
+                        if (passId >= nextPassId)
+                        {
+                            StringBuilder statusTextSB;
+                            statusTextSB << "Tracing pass " << passId << "...";
+                            StatusChanged(statusTextSB.ProduceString());
+                            nextPassId = passId + 1;
+                            RunDistributedPass(passId);
+                            continue;
+                        }
+                    }
+                    catch (const IOException &)
+                    {
+                        // the baker has already finished and removed the pass
+                    }
+                }
+                SleepWhileWaiting();
+            }
+            StatusChanged(status);
+            isWorker = false;
+        }
+        virtual LightmapBakerStatistics GetStatistics() override
+        {
+            return statistics;
+        }
         virtual bool IsRunning() override
         {
             return started;
@@ -969,11 +2782,14 @@ namespace GameEngine
             isCancelled = true;
             Wait();
         }
+        virtual void Stop() override
+        {
+            isStopRequested = true;
+        }
         LightmapBakerImpl()
         {
-            auto computeTaskManager = Engine::GetComputeTaskManager();
-            lightmapComrpessionKernel = computeTaskManager->LoadKernel("BC6Compression.slang", "cs_main");
             isCancelled = false;
+            isStopRequested = false;
             started = false;
         }
     };
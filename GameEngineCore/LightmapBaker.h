@@ -4,6 +4,8 @@
 #include "CoreLib/Basic.h"
 #include "CoreLib/Events.h"
 #include "LightmapSet.h"
+#include "LightmapDenoiser.h"
+#include "TextureCompressor.h"
 
 namespace GameEngine
 {
@@ -22,6 +24,47 @@ namespace GameEngine
         float Epsilon = 1e-5f;
         float ShadowBias = 1e-2f;
         float IndirectLightingWorldGranularity = 30.0f;
+        // trace gather rays of a tile as sorted ray streams and shade them in a separate pass
+        bool UseRayStreams = true;
+        // for incremental bakes, changed actors and lights only affect lightmaps within this distance of them.
+        // 0 means unlimited, in which case any change rebakes all lightmaps since indirect lighting is global.
+        float IncrementalInfluenceRadius = 0.0f;
+        // the final gather is accumulated progressively in passes of this many samples per texel,
+        // and the preview is updated after every pass.
+        int FinalGatherPassSampleCount = 16;
+        // file that the partial bake state is periodically saved to, checkpointing is disabled when empty.
+        CoreLib::String CheckpointFileName;
+        // minimum time in seconds between two checkpoints
+        float CheckpointInterval = 120.0f;
+        // continue from the checkpoint in CheckpointFileName if it was saved for the same level and settings.
+        bool ResumeFromCheckpoint = false;
+        // filter indirect lighting with the edge-aware denoiser instead of a plain blur
+        bool DenoiseIndirectLighting = true;
+        LightmapDenoiserSettings Denoiser;
+        // compress lightmaps to BC6H with the CPU encoder instead of a GPU compute kernel
+        bool UseCpuCompression = false;
+        BC6HQuality CompressionQuality = BC6HQuality::Normal;
+        // rasterize the lightmap G-buffers on the CPU instead of the hardware renderer.
+        // always done when the hardware renderer has no device, e.g. the dummy renderer on build servers without a GPU.
+        bool UseSoftwareGBufferRasterizer = false;
+        // edge length of the world space voxels of the radiance cache, 0 disables the cache. With the cache, all bounces
+        // but the final gather are computed on the cache voxels and the final gather looks them up at its ray hits.
+        // larger voxels bake faster at the cost of blurrier multi-bounce lighting.
+        float RadianceCacheCellSize = 0.0f;
+        // rays traced per voxel and bounce
+        int RadianceCacheSampleCount = 64;
+        // shadow rays per texel for the direct lighting of point and spot lights. With more lights than this, the most
+        // significant lights of a texel are evaluated exactly and the others are importance sampled from a light BVH.
+        // 0 evaluates every light.
+        int DirectLightingShadowRayCount = 0;
+        // directory shared with worker processes, see LightmapBaker::RunWorker. Indirect lighting passes are split into jobs
+        // of lightmap tiles that the baker and the workers claim through files in this directory. Empty bakes locally.
+        CoreLib::String DistributedJobDirectory;
+        // worker processes started on this machine for a distributed bake. Workers on other machines are started with
+        // "-bakeworker <directory>", where the directory refers to the same shared folder.
+        int LocalWorkerCount = 0;
+        // seconds to wait for the result of a job claimed by a worker before tracing it locally
+        float DistributedJobTimeout = 600.0f;
     };
     struct LightmapBakerProgressChangedEventArgs
     {
@@ -34,6 +77,21 @@ namespace GameEngine
             ProgressValue = progress;
         }
     };
+    // wall clock time in seconds spent in each phase of the last bake, and the number of rays it traced
+    struct LightmapBakerStatistics
+    {
+        float GBufferTime = 0.0f;
+        // building the static scene overlaps with rendering the G-buffers
+        float SceneBuildTime = 0.0f;
+        float BiasTime = 0.0f;
+        float DirectLightingTime = 0.0f;
+        // radiance cache, indirect bounces, final gather and compositing
+        float IndirectLightingTime = 0.0f;
+        float CompressionTime = 0.0f;
+        float TotalTime = 0.0f;
+        // rays traced on this machine, including shadow rays and G-buffer refinement rays
+        int64_t RayCount = 0;
+    };
     class LightmapBaker : public CoreLib::RefObject
     {
     public:
@@ -43,11 +101,21 @@ namespace GameEngine
         CoreLib::Event<bool /*isCancelled*/> OnCompleted;
         CoreLib::Event<Mesh*> OnMeshChanged;
         virtual void Start(const LightmapBakingSettings & settings, Level* pLevel) = 0;
+        // bakes only the lightmaps affected by actors and lights that changed since previousLightmaps was baked,
+        // and reuses all other lightmaps of previousLightmaps.
+        virtual void StartIncremental(const LightmapBakingSettings & settings, Level* pLevel, const LightmapSet & previousLightmaps) = 0;
         virtual bool IsRunning() = 0;
         virtual bool IsCancelled() = 0;
         virtual LightmapSet& GetLightmapSet() = 0;
         virtual void Wait() = 0;
         virtual void Cancel() = 0;
+        // finishes the bake after the current pass, using the samples accumulated so far.
+        virtual void Stop() = 0;
+        // runs this process as a worker of distributed bakes in jobDirectory until the bake it joined is done, or the
+        // baker has stopped responding. Loads the level of the bake into the engine and blocks the calling thread.
+        virtual void RunWorker(const CoreLib::String & jobDirectory) = 0;
+        // valid after the bake has completed
+        virtual LightmapBakerStatistics GetStatistics() = 0;
     };
     LightmapBaker* CreateLightmapBaker();
 }
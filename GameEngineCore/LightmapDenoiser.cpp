@@ -0,0 +1,252 @@
+#include "LightmapDenoiser.h"
+#include <smmintrin.h>
+
+using namespace CoreLib;
+using namespace VectorMath;
+
+namespace GameEngine
+{
+    // B3 spline kernel of the a-trous transform
+    static const float AtrousKernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    // exp(x) for x <= 0 as (1 + x/256)^256, which is accurate enough for filter weights
+    inline float DenoiserExp(float x)
+    {
+        float v = Math::Max(1.0f + x * (1.0f / 256.0f), 0.0f);
+        for (int i = 0; i < 8; i++)
+            v *= v;
+        return v;
+    }
+    inline __m128 DenoiserExp4(__m128 x)
+    {
+        __m128 v = _mm_max_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x, _mm_set1_ps(1.0f / 256.0f))), _mm_setzero_ps());
+        for (int i = 0; i < 8; i++)
+            v = _mm_mul_ps(v, v);
+        return v;
+    }
+    // normal weight max(0, dot(n0, n1))^32
+    inline float DenoiserNormalWeight(float d)
+    {
+        float v = Math::Max(d, 0.0f);
+        for (int i = 0; i < 5; i++)
+            v *= v;
+        return v;
+    }
+    inline __m128 DenoiserNormalWeight4(__m128 d)
+    {
+        __m128 v = _mm_max_ps(d, _mm_setzero_ps());
+        for (int i = 0; i < 5; i++)
+            v = _mm_mul_ps(v, v);
+        return v;
+    }
+
+    // planar copy of the filter inputs, so that four neighboring texels can be loaded with one instruction
+    struct DenoiserGuide
+    {
+        int Width, Height;
+        List<float> PosX, PosY, PosZ, NormalX, NormalY, NormalZ;
+        // 1 for valid texels and 0 otherwise
+        List<float> Mask;
+        // 1 / (PositionSigma * texel footprint)^2
+        List<float> PositionScale;
+    };
+    struct DenoiserImage
+    {
+        List<float> R, G, B, Luminance;
+        void SetSize(int size)
+        {
+            R.SetSize(size);
+            G.SetSize(size);
+            B.SetSize(size);
+            Luminance.SetSize(size);
+        }
+    };
+
+    static void DenoiseTexel(const DenoiserGuide & guide, DenoiserImage & src, DenoiserImage & dst, int y, int x, int step, float colorScale)
+    {
+        int w = guide.Width;
+        int p = y * w + x;
+        if (guide.Mask[p] == 0.0f)
+        {
+            dst.R[p] = src.R[p];
+            dst.G[p] = src.G[p];
+            dst.B[p] = src.B[p];
+            return;
+        }
+        float lum = src.Luminance[p];
+        float invColorVariance = colorScale / (lum * lum + 1e-4f);
+        float positionScale = guide.PositionScale[p] / (float)(step * step);
+        float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f, sumW = 0.0f;
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            int sy = y + dy * step;
+            if (sy < 0 || sy >= guide.Height)
+                continue;
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                int sx = x + dx * step;
+                if (sx < 0 || sx >= w)
+                    continue;
+                int q = sy * w + sx;
+                float px = guide.PosX[q] - guide.PosX[p];
+                float py = guide.PosY[q] - guide.PosY[p];
+                float pz = guide.PosZ[q] - guide.PosZ[p];
+                float dl = src.Luminance[q] - lum;
+                float nDot = guide.NormalX[q] * guide.NormalX[p] + guide.NormalY[q] * guide.NormalY[p] + guide.NormalZ[q] * guide.NormalZ[p];
+                float weight = AtrousKernel[dx < 0 ? -dx : dx] * AtrousKernel[dy < 0 ? -dy : dy] * guide.Mask[q] *
+                    DenoiserExp(-(px * px + py * py + pz * pz) * positionScale - dl * dl * invColorVariance) * DenoiserNormalWeight(nDot);
+                sumR += src.R[q] * weight;
+                sumG += src.G[q] * weight;
+                sumB += src.B[q] * weight;
+                sumW += weight;
+            }
+        }
+        float invSumW = 1.0f / Math::Max(sumW, 1e-20f);
+        dst.R[p] = sumR * invSumW;
+        dst.G[p] = sumG * invSumW;
+        dst.B[p] = sumB * invSumW;
+    }
+
+    // filters texels [x, x + 4) of row y, all horizontal taps must be inside the row
+    static void DenoiseTexels4(const DenoiserGuide & guide, DenoiserImage & src, DenoiserImage & dst, int y, int x, int step, float colorScale)
+    {
+        int w = guide.Width;
+        int p = y * w + x;
+        __m128 mask = _mm_loadu_ps(guide.Mask.Buffer() + p);
+        __m128 centerR = _mm_loadu_ps(src.R.Buffer() + p);
+        __m128 centerG = _mm_loadu_ps(src.G.Buffer() + p);
+        __m128 centerB = _mm_loadu_ps(src.B.Buffer() + p);
+        if (_mm_movemask_ps(_mm_cmpneq_ps(mask, _mm_setzero_ps())) == 0)
+        {
+            _mm_storeu_ps(dst.R.Buffer() + p, centerR);
+            _mm_storeu_ps(dst.G.Buffer() + p, centerG);
+            _mm_storeu_ps(dst.B.Buffer() + p, centerB);
+            return;
+        }
+        __m128 lum = _mm_loadu_ps(src.Luminance.Buffer() + p);
+        __m128 invColorVariance = _mm_div_ps(_mm_set1_ps(colorScale), _mm_add_ps(_mm_mul_ps(lum, lum), _mm_set1_ps(1e-4f)));
+        __m128 positionScale = _mm_mul_ps(_mm_loadu_ps(guide.PositionScale.Buffer() + p), _mm_set1_ps(1.0f / (float)(step * step)));
+        __m128 posX = _mm_loadu_ps(guide.PosX.Buffer() + p);
+        __m128 posY = _mm_loadu_ps(guide.PosY.Buffer() + p);
+        __m128 posZ = _mm_loadu_ps(guide.PosZ.Buffer() + p);
+        __m128 normalX = _mm_loadu_ps(guide.NormalX.Buffer() + p);
+        __m128 normalY = _mm_loadu_ps(guide.NormalY.Buffer() + p);
+        __m128 normalZ = _mm_loadu_ps(guide.NormalZ.Buffer() + p);
+        __m128 sumR = _mm_setzero_ps(), sumG = _mm_setzero_ps(), sumB = _mm_setzero_ps(), sumW = _mm_setzero_ps();
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            int sy = y + dy * step;
+            if (sy < 0 || sy >= guide.Height)
+                continue;
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                int q = sy * w + x + dx * step;
+                __m128 px = _mm_sub_ps(_mm_loadu_ps(guide.PosX.Buffer() + q), posX);
+                __m128 py = _mm_sub_ps(_mm_loadu_ps(guide.PosY.Buffer() + q), posY);
+                __m128 pz = _mm_sub_ps(_mm_loadu_ps(guide.PosZ.Buffer() + q), posZ);
+                __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+                __m128 dl = _mm_sub_ps(_mm_loadu_ps(src.Luminance.Buffer() + q), lum);
+                __m128 exponent = _mm_add_ps(_mm_mul_ps(dist2, positionScale), _mm_mul_ps(_mm_mul_ps(dl, dl), invColorVariance));
+                __m128 nDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(guide.NormalX.Buffer() + q), normalX),
+                    _mm_mul_ps(_mm_loadu_ps(guide.NormalY.Buffer() + q), normalY)), _mm_mul_ps(_mm_loadu_ps(guide.NormalZ.Buffer() + q), normalZ));
+                __m128 weight = _mm_mul_ps(_mm_set1_ps(AtrousKernel[dx < 0 ? -dx : dx] * AtrousKernel[dy < 0 ? -dy : dy]), _mm_loadu_ps(guide.Mask.Buffer() + q));
+                weight = _mm_mul_ps(weight, _mm_mul_ps(DenoiserExp4(_mm_sub_ps(_mm_setzero_ps(), exponent)), DenoiserNormalWeight4(nDot)));
+                sumR = _mm_add_ps(sumR, _mm_mul_ps(_mm_loadu_ps(src.R.Buffer() + q), weight));
+                sumG = _mm_add_ps(sumG, _mm_mul_ps(_mm_loadu_ps(src.G.Buffer() + q), weight));
+                sumB = _mm_add_ps(sumB, _mm_mul_ps(_mm_loadu_ps(src.B.Buffer() + q), weight));
+                sumW = _mm_add_ps(sumW, weight);
+            }
+        }
+        __m128 invSumW = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(sumW, _mm_set1_ps(1e-20f)));
+        // invalid texels keep their value
+        __m128 validMask = _mm_cmpneq_ps(mask, _mm_setzero_ps());
+        _mm_storeu_ps(dst.R.Buffer() + p, _mm_blendv_ps(centerR, _mm_mul_ps(sumR, invSumW), validMask));
+        _mm_storeu_ps(dst.G.Buffer() + p, _mm_blendv_ps(centerG, _mm_mul_ps(sumG, invSumW), validMask));
+        _mm_storeu_ps(dst.B.Buffer() + p, _mm_blendv_ps(centerB, _mm_mul_ps(sumB, invSumW), validMask));
+    }
+
+    void DenoiseLightmap(CoreLib::Threading::ThreadPool & threadPool, RawObjectSpaceMap & lightmap, RawObjectSpaceMap & positionMap,
+        RawObjectSpaceMap & normalMap, CoreLib::IntSet & validPixels, const LightmapDenoiserSettings & settings)
+    {
+        int w = lightmap.Width;
+        int h = lightmap.Height;
+        int size = w * h;
+        if (size == 0 || settings.Iterations <= 0)
+            return;
+        DenoiserGuide guide;
+        guide.Width = w;
+        guide.Height = h;
+        guide.PosX.SetSize(size);
+        guide.PosY.SetSize(size);
+        guide.PosZ.SetSize(size);
+        guide.NormalX.SetSize(size);
+        guide.NormalY.SetSize(size);
+        guide.NormalZ.SetSize(size);
+        guide.Mask.SetSize(size);
+        guide.PositionScale.SetSize(size);
+        DenoiserImage images[2];
+        images[0].SetSize(size);
+        images[1].SetSize(size);
+        threadPool.ParallelFor(0, h, 4, [&](int y)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int p = y * w + x;
+                auto pos = positionMap.GetPixel(x, y);
+                auto normal = normalMap.GetPixel(x, y).xyz();
+                auto lighting = lightmap.GetPixel(x, y);
+                guide.PosX[p] = pos.x;
+                guide.PosY[p] = pos.y;
+                guide.PosZ[p] = pos.z;
+                float normalLength = normal.Length();
+                if (normalLength > 0.0f)
+                    normal *= 1.0f / normalLength;
+                guide.NormalX[p] = normal.x;
+                guide.NormalY[p] = normal.y;
+                guide.NormalZ[p] = normal.z;
+                guide.Mask[p] = validPixels.Contains(p) ? 1.0f : 0.0f;
+                float footprint = Math::Max(pos.w, 1e-4f) * settings.PositionSigma;
+                guide.PositionScale[p] = 1.0f / (footprint * footprint);
+                images[0].R[p] = lighting.x;
+                images[0].G[p] = lighting.y;
+                images[0].B[p] = lighting.z;
+            }
+        });
+        float colorScale = 1.0f / (settings.ColorSigma * settings.ColorSigma);
+        int src = 0;
+        for (int iteration = 0; iteration < settings.Iterations; iteration++)
+        {
+            int step = 1 << iteration;
+            auto & srcImage = images[src];
+            auto & dstImage = images[1 - src];
+            threadPool.ParallelFor(0, size, 4096, [&](int p)
+            {
+                srcImage.Luminance[p] = srcImage.R[p] * 0.2126f + srcImage.G[p] * 0.7152f + srcImage.B[p] * 0.0722f;
+            });
+            // texels whose horizontal taps are all inside the row are filtered four at a time
+            int simdBegin = Math::Min(2 * step, w);
+            int simdEnd = Math::Max(w - 2 * step, simdBegin);
+            threadPool.ParallelFor(0, h, 4, [&](int y)
+            {
+                int x = 0;
+                for (; x < simdBegin; x++)
+                    DenoiseTexel(guide, srcImage, dstImage, y, x, step, colorScale);
+                for (; x + 4 <= simdEnd; x += 4)
+                    DenoiseTexels4(guide, srcImage, dstImage, y, x, step, colorScale);
+                for (; x < w; x++)
+                    DenoiseTexel(guide, srcImage, dstImage, y, x, step, colorScale);
+            });
+            src = 1 - src;
+        }
+        auto & result = images[src];
+        threadPool.ParallelFor(0, h, 4, [&](int y)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int p = y * w + x;
+                if (guide.Mask[p] != 0.0f)
+                    lightmap.SetPixel(x, y, Vec4::Create(result.R[p], result.G[p], result.B[p], 1.0f));
+            }
+        });
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef GAME_ENGINE_LIGHTMAP_DENOISER_H
+#define GAME_ENGINE_LIGHTMAP_DENOISER_H
+
+#include "ObjectSpaceMapSet.h"
+#include "CoreLib/IntSet.h"
+#include "CoreLib/Threading.h"
+
+namespace GameEngine
+{
+    struct LightmapDenoiserSettings
+    {
+        // number of a-trous iterations, the filter footprint doubles with every iteration
+        int Iterations = 4;
+        // relative luminance difference at which the weight of a texel falls to 1/e
+        float ColorSigma = 0.5f;
+        // world space distance, in texel footprints, at which the weight of a texel falls to 1/e
+        float PositionSigma = 1.5f;
+    };
+
+    // Edge-aware a-trous wavelet filter for baked lighting. Filter weights are guided by the world position
+    // (w = texel footprint) and normal G-buffers of the lightmap, so lighting does not leak across geometric
+    // edges or lightmap chart boundaries. Only texels in validPixels are read and written.
+    void DenoiseLightmap(CoreLib::Threading::ThreadPool & threadPool, RawObjectSpaceMap & lightmap, RawObjectSpaceMap & positionMap,
+        RawObjectSpaceMap & normalMap, CoreLib::IntSet & validPixels, const LightmapDenoiserSettings & settings);
+}
+
+#endif
@@ -13,7 +13,7 @@ namespace GameEngine
         Simple
     };
     const int LightmapSetFileVersionMajor = 0;
-    const int LightmapSetFileVersionMinor = 1;
+    const int LightmapSetFileVersionMinor = 2;
     const int LightmapSetFileVersion = (LightmapSetFileVersionMajor << 16) + LightmapSetFileVersionMinor;
     struct LightmapSetFileHeader
     {
@@ -22,7 +22,9 @@ namespace GameEngine
         int LightmapCount = 0;
         int ActorIndexCount = 0;
         LightmapType Type;
-        int Reserved[16] = {};
+        int InputRecordCount = 0;
+        unsigned int SettingsHash[2] = {};
+        int Reserved[13] = {};
     };
 
     void LightmapSet::SaveToFile(Level * /*level*/, CoreLib::String fileName)
@@ -30,6 +32,9 @@ namespace GameEngine
         LightmapSetFileHeader header;
         header.LightmapCount = Lightmaps.Count();
         header.ActorIndexCount = ActorLightmapIds.Count();
+        header.InputRecordCount = InputRecords.Count();
+        header.SettingsHash[0] = (unsigned int)SettingsHash;
+        header.SettingsHash[1] = (unsigned int)(SettingsHash >> 32);
         BinaryWriter writer(new FileStream(fileName, FileMode::Create));
         writer.Write(header);
         for (auto & element : ActorLightmapIds)
@@ -41,6 +46,11 @@ namespace GameEngine
         {
             Lightmaps[i].SaveToStream(writer);
         }
+        for (auto & record : InputRecords)
+        {
+            writer.Write(record.Key);
+            writer.Write(record.Value);
+        }
     }
 
     void LightmapSet::LoadFromFile(Level * level, CoreLib::String fileName)
@@ -48,12 +58,15 @@ namespace GameEngine
         BinaryReader reader(new FileStream(fileName, FileMode::Open));
         LightmapSetFileHeader header;
         reader.Read(header);
-        if (strncmp(header.Identifier, "GLMS", 4) != 0)
+        if (strncmp(header.Identifier, "GLMS", 4) != 0 || header.ActorIndexCount < 0 || header.LightmapCount < 0 ||
+            header.InputRecordCount < 0)
             throw IO::IOException("Invalid lightmap file.");
         for (int i = 0; i < header.ActorIndexCount; i++)
         {
             auto actorName = reader.ReadString();
             auto lightmapId = reader.ReadInt32();
+            if (lightmapId < 0 || lightmapId >= header.LightmapCount)
+                throw IO::IOException("Invalid lightmap file.");
             auto actor = level->FindActor(actorName);
             if (actor)
             {
@@ -70,6 +83,18 @@ namespace GameEngine
         {
             Lightmaps[i].LoadFromStream(reader);
         }
+        // input records were added in version 0.2, older files are always rebaked completely
+        if (header.Version >= ((0 << 16) + 2))
+        {
+            SettingsHash = header.SettingsHash[0] + ((uint64_t)header.SettingsHash[1] << 32);
+            for (int i = 0; i < header.InputRecordCount; i++)
+            {
+                auto actorName = reader.ReadString();
+                LightmapInputRecord record;
+                reader.Read(record);
+                InputRecords[actorName] = record;
+            }
+        }
     }
 
 }
\ No newline at end of file
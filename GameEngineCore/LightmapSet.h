@@ -3,16 +3,27 @@
 
 #include "CoreLib/Basic.h"
 #include "ObjectSpaceMapSet.h"
+#include "CoreLib/Graphics/BBox.h"
 
 namespace GameEngine
 {
     class Actor;
     class Level;
 
+    // hash of the baking inputs of an actor or light and the region it influenced, used by incremental baking.
+    struct LightmapInputRecord
+    {
+        uint64_t Hash = 0;
+        CoreLib::Graphics::BBox Bounds;
+    };
+
     struct LightmapSet
     {
         CoreLib::List<RawObjectSpaceMap> Lightmaps;
         CoreLib::Dictionary<Actor*, int> ActorLightmapIds;
+        // input records of the actors and lights of the level, keyed by actor name
+        CoreLib::Dictionary<CoreLib::String, LightmapInputRecord> InputRecords;
+        uint64_t SettingsHash = 0;
        
         void SaveToFile(Level* level, CoreLib::String fileName);
         void LoadFromFile(Level* level, CoreLib::String fileName);
@@ -304,111 +304,233 @@ namespace GameEngine
             }
         }
 
-        static const int CoarseReductionFactor = 4;
-        struct HierarchicalBitmap
+        // chart rasterized at a given size and dilated by the padding, one bit per texel in rows of 64 bit words
+        struct ChartBitmap : public RefObject
         {
-            Canvas FineBitmap;
-            Canvas CoarseBitmap;
-            void BuildCoarseBitmap()
+            int width, height, wordsPerRow;
+            List<uint64_t> bits;
+            // first and one past the last covered row of each column, bottom is height for empty columns
+            List<int> columnBottom, columnTop;
+        };
+
+        // occupied texels of a texture during packing in rows of 64 bit words. Per column, the horizon is one past the
+        // highest covered row and firstFree is the lowest row that is not covered.
+        static const int HoleSearchStep = 4;
+        struct PackingTexture
+        {
+            int size, wordsPerRow;
+            List<uint64_t> bits;
+            List<int> horizon, firstFree;
+            void Init(int textureSize)
             {
-                CoarseBitmap.Init((FineBitmap.width + CoarseReductionFactor - 1) / CoarseReductionFactor,
-                    (FineBitmap.height + CoarseReductionFactor - 1) / CoarseReductionFactor);
-                for (int i = 0; i < CoarseBitmap.height; i++)
+                size = textureSize;
+                wordsPerRow = (textureSize + 63) >> 6;
+                bits.SetSize(wordsPerRow * textureSize);
+                for (auto & w : bits)
+                    w = 0;
+                horizon.SetSize(textureSize);
+                firstFree.SetSize(textureSize);
+                for (int i = 0; i < textureSize; i++)
+                    horizon[i] = firstFree[i] = 0;
+            }
+            bool Get(int x, int y)
+            {
+                return (bits[y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+            }
+            // the chart placed at column x does not overlap placed charts at rows >= restingRow, where it rests on the horizon,
+            // and must overlap them at rows < lowestRow, where the bottom texel of a column is covered.
+            void GetPlacementRows(ChartBitmap & chart, int x, int & lowestRow, int & restingRow)
+            {
+                lowestRow = restingRow = 0;
+                for (int c = 0; c < chart.width; c++)
                 {
-                    int y0 = i * CoarseReductionFactor;
-                    int y1 = Math::Min(FineBitmap.height, y0 + CoarseReductionFactor);
-                    for (int j = 0; j < CoarseBitmap.width; j++)
+                    if (chart.columnBottom[c] < chart.height)
                     {
-                        int x0 = j * CoarseReductionFactor;
-                        int x1 = Math::Min(FineBitmap.width, x0 + CoarseReductionFactor);
-                        for (int y = y0; y < y1; y++)
-                            for (int x = x0; x < x1; x++)
-                                if (FineBitmap.Get(x, y))
-                                {
-                                    CoarseBitmap.Set(j, i);
-                                    goto nextJ;
-                                }
-                    nextJ:;
+                        lowestRow = Math::Max(lowestRow, firstFree[x + c] - chart.columnBottom[c]);
+                        restingRow = Math::Max(restingRow, horizon[x + c] - chart.columnBottom[c]);
                     }
                 }
             }
-            void Set(int x, int y)
+            // tests 64 texels at a time, the chart rows are shifted to the bit offset of x
+            bool HasOverlap(ChartBitmap & chart, int x, int y)
             {
-                FineBitmap.Set(x, y);
-                CoarseBitmap.Set(x / CoarseReductionFactor, y / CoarseReductionFactor);
-            }
-        };
-
-        void WriteChartBitmask(HierarchicalBitmap & texture, HierarchicalBitmap & chartBitmap, int x, int y)
-        {
-            for (int i = 0; i < chartBitmap.FineBitmap.height; i++)
-                for (int j = 0; j < chartBitmap.FineBitmap.width; j++)
+                int shift = x & 63;
+                int wordOffset = x >> 6;
+                int textureWords = wordsPerRow - wordOffset;
+                for (int i = 0; i < chart.height; i++)
                 {
-                    if (chartBitmap.FineBitmap.Get(j, i))
+                    const uint64_t * chartRow = chart.bits.Buffer() + i * chart.wordsPerRow;
+                    const uint64_t * textureRow = bits.Buffer() + (y + i) * wordsPerRow + wordOffset;
+                    for (int w = 0; w < chart.wordsPerRow; w++)
                     {
-                        texture.Set(j + x, i + y);
+                        if ((chartRow[w] << shift) & textureRow[w])
+                            return true;
+                        if (shift && w + 1 < textureWords && (chartRow[w] >> (64 - shift)) & textureRow[w + 1])
+                            return true;
                     }
                 }
-        }
-        void DilateBitmap(Canvas & rs, Canvas& inBmp, int pixels)
-        {
-            Canvas tmp;
-            rs.Init(inBmp.width + pixels * 2, inBmp.height + pixels * 2);
-            for (int i = 0; i < inBmp.height; i++)
-                for (int j = 0; j < inBmp.width; j++)
-                    if (inBmp.Get(j, i))
-                        rs.Set(j + pixels, i + pixels);
-            tmp.Init(rs.width, rs.height);
-            for (auto i = 0; i < tmp.height; i++)
-                for (auto j = 0; j < tmp.width; j++)
+                return false;
+            }
+            // finds the lowest position of the chart, returns false if it does not fit below the top of the texture.
+            // Positions on the horizon need no overlap test, only holes below it are searched with overlap tests.
+            bool FindPlacement(ChartBitmap & chart, int & bestX, int & bestY)
+            {
+                bestX = -1;
+                bestY = size - chart.height + 1;
+                for (int x = 0; x + chart.width <= size && bestY > 0; x++)
                 {
-                    for (auto k = -pixels; k <= pixels; k++)
-                        if (j + k >= 0 && j + k < tmp.width && rs.Get(j + k, i))
+                    int lowestRow, restingRow;
+                    GetPlacementRows(chart, x, lowestRow, restingRow);
+                    if (restingRow < bestY)
+                    {
+                        bestX = x;
+                        bestY = restingRow;
+                    }
+                    if (x % HoleSearchStep)
+                        continue;
+                    for (int y = lowestRow; y < Math::Min(restingRow, bestY); y += HoleSearchStep)
+                    {
+                        if (!HasOverlap(chart, x, y))
                         {
-                            tmp.Set(j, i);
+                            bestX = x;
+                            bestY = y;
                             break;
                         }
+                    }
                 }
-            for (auto i = 0; i < tmp.height; i++)
-                for (auto j = 0; j < tmp.width; j++)
+                return bestX != -1;
+            }
+            void Add(ChartBitmap & chart, int x, int y)
+            {
+                int shift = x & 63;
+                int wordOffset = x >> 6;
+                int textureWords = wordsPerRow - wordOffset;
+                for (int i = 0; i < chart.height; i++)
                 {
-                    for (auto k = -pixels; k <= pixels; k++)
-                        if (i + k >= 0 && i + k < tmp.height && tmp.Get(j, i + k))
-                        {
-                            rs.Set(j, i);
-                            break;
-                        }
+                    const uint64_t * chartRow = chart.bits.Buffer() + i * chart.wordsPerRow;
+                    uint64_t * textureRow = bits.Buffer() + (y + i) * wordsPerRow + wordOffset;
+                    for (int w = 0; w < chart.wordsPerRow; w++)
+                    {
+                        textureRow[w] |= chartRow[w] << shift;
+                        if (shift && w + 1 < textureWords)
+                            textureRow[w + 1] |= chartRow[w] >> (64 - shift);
+                    }
                 }
-        }
+                for (int c = 0; c < chart.width; c++)
+                {
+                    if (chart.columnBottom[c] < chart.height)
+                    {
+                        horizon[x + c] = Math::Max(horizon[x + c], y + chart.columnTop[c]);
+                        int & free = firstFree[x + c];
+                        while (free < size && Get(x + c, free))
+                            free++;
+                    }
+                }
+            }
+        };
 
-        bool ChartHasOverlap(HierarchicalBitmap& texture, HierarchicalBitmap& chartBmp, int x, int y)
+        // rasterizations of every chart keyed by their size, shared by all scales tried during packing
+        List<Dictionary<int, RefPtr<ChartBitmap>>> chartBitmapCache;
+        CoreLib::Threading::SpinLock chartBitmapCacheLock;
+
+        RefPtr<ChartBitmap> BuildChartBitmap(Chart & chart, int width, int height, int paddingPixels)
         {
-            int cx = x / CoarseReductionFactor;
-            int cy = y / CoarseReductionFactor;
-            for (int i = 0; i < chartBmp.CoarseBitmap.height; i++)
-                for (int j = 0; j < chartBmp.CoarseBitmap.width; j++)
+            Canvas bmp;
+            bmp.Init(width, height);
+            RasterizeChart(bmp, chart);
+            RefPtr<ChartBitmap> result = new ChartBitmap();
+            result->width = width + paddingPixels * 2;
+            result->height = height + paddingPixels * 2;
+            int wordsPerRow = (result->width + 63) >> 6;
+            result->wordsPerRow = wordsPerRow;
+            List<uint64_t> rows;
+            rows.SetSize(result->height * wordsPerRow);
+            for (auto & w : rows)
+                w = 0;
+            for (int i = 0; i < height; i++)
+                for (int j = 0; j < width; j++)
+                    if (bmp.Get(j, i))
+                    {
+                        int x = j + paddingPixels;
+                        rows[(i + paddingPixels) * wordsPerRow + (x >> 6)] |= 1ull << (x & 63);
+                    }
+            // dilate rows one texel per step, carrying bits across word boundaries
+            for (int i = 0; i < result->height; i++)
+            {
+                uint64_t * row = rows.Buffer() + i * wordsPerRow;
+                for (int k = 0; k < paddingPixels; k++)
                 {
-                    if (chartBmp.CoarseBitmap.Get(j, i) && 
-                        texture.CoarseBitmap.Get(j + cx, i + cy))
+                    uint64_t carryLeft = 0;
+                    for (int w = 0; w < wordsPerRow; w++)
                     {
-                        int fiEnd = Math::Min(chartBmp.FineBitmap.height, (i + 1) * CoarseReductionFactor);
-                        int fjEnd = Math::Min(chartBmp.FineBitmap.width, (j + 1) * CoarseReductionFactor);
-
-                        for (int fi = i * CoarseReductionFactor; fi < fiEnd; fi++)
-                            for (int fj = j * CoarseReductionFactor; fj < fjEnd; fj++)
-                                if (chartBmp.FineBitmap.Get(fj, fi) && texture.FineBitmap.Get(fj + x, fi + y))
-                                    return true;
+                        uint64_t word = row[w];
+                        uint64_t next = w + 1 < wordsPerRow ? row[w + 1] : 0;
+                        row[w] = word | (word << 1) | carryLeft | (word >> 1) | (next << 63);
+                        carryLeft = word >> 63;
                     }
                 }
-            return false;
+            }
+            // then dilate columns by combining the rows within the padding distance
+            result->bits.SetSize(rows.Count());
+            for (int i = 0; i < result->height; i++)
+            {
+                int i0 = Math::Max(0, i - paddingPixels);
+                int i1 = Math::Min(result->height - 1, i + paddingPixels);
+                for (int w = 0; w < wordsPerRow; w++)
+                {
+                    uint64_t word = 0;
+                    for (int k = i0; k <= i1; k++)
+                        word |= rows[k * wordsPerRow + w];
+                    result->bits[i * wordsPerRow + w] = word;
+                }
+            }
+            result->columnBottom.SetSize(result->width);
+            result->columnTop.SetSize(result->width);
+            for (int c = 0; c < result->width; c++)
+            {
+                result->columnBottom[c] = result->height;
+                result->columnTop[c] = 0;
+            }
+            for (int i = 0; i < result->height; i++)
+            {
+                for (int w = 0; w < wordsPerRow; w++)
+                {
+                    uint64_t word = result->bits[i * wordsPerRow + w];
+                    for (int b = 0; word; b++, word >>= 1)
+                    {
+                        if (word & 1)
+                        {
+                            int c = (w << 6) + b;
+                            result->columnBottom[c] = Math::Min(result->columnBottom[c], i);
+                            result->columnTop[c] = i + 1;
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        RefPtr<ChartBitmap> GetChartBitmap(int chartId, int width, int height, int paddingPixels)
+        {
+            int key = (width << 16) | height;
+            RefPtr<ChartBitmap> result;
+            chartBitmapCacheLock.Lock();
+            chartBitmapCache[chartId].TryGetValue(key, result);
+            chartBitmapCacheLock.Unlock();
+            if (result)
+                return result;
+            result = BuildChartBitmap(charts[chartId], width, height, paddingPixels);
+            chartBitmapCacheLock.Lock();
+            chartBitmapCache[chartId][key] = result;
+            chartBitmapCacheLock.Unlock();
+            return result;
         }
+
         bool TryPackCharts(int textureSize, float scale, int paddingPixels, List<ChartPlacement> & chartPositions)
         {
             chartPositions.SetSize(charts.Count());
-            // first, rasterize all charts
-            List<HierarchicalBitmap> chartBitmaps;
-            chartBitmaps.SetSize(charts.Count());
-
+            PackingTexture texture;
+            texture.Init(textureSize);
             for (int i = 0; i < charts.Count(); i++)
             {
                 auto & chart = charts[i];
@@ -416,49 +538,53 @@ namespace GameEngine
                     return false;
                 int chartBitmapWidth = Math::Max(1, (int)(chart.size.x * textureSize * scale));
                 int chartBitmapHeight = Math::Max(1, (int)(chart.size.y * textureSize * scale));
-                Canvas bmp;
-                bmp.Init(chartBitmapWidth, chartBitmapHeight);
-                RasterizeChart(bmp, chart);
-                DilateBitmap(chartBitmaps[i].FineBitmap, bmp, paddingPixels);
-                chartBitmaps[i].BuildCoarseBitmap();
+                auto chartBitmap = GetChartBitmap(i, chartBitmapWidth, chartBitmapHeight, paddingPixels);
+                int x, y;
+                if (!texture.FindPlacement(*chartBitmap, x, y))
+                    return false;
+                texture.Add(*chartBitmap, x, y);
+                chartPositions[i].position = Vec2::Create((float)(x + paddingPixels), (float)(y + paddingPixels));
+                chartPositions[i].size = Vec2::Create((float)chartBitmapWidth, (float)chartBitmapHeight);
             }
-            
-            // try all placements
-            HierarchicalBitmap texture;
-            texture.FineBitmap.Init(textureSize, textureSize);
-            texture.CoarseBitmap.Init(textureSize / CoarseReductionFactor, textureSize / CoarseReductionFactor);
+            return true;
+        }
 
-            for (int i = 0; i < charts.Count(); i++)
+        // scales tried at once in every round of the scale search. Fixed, so that the result does not depend on the thread count.
+        static const int ScaleSearchWidth = 4;
+        CoreLib::Threading::ThreadPool * threadPool = nullptr;
+
+        int TryPackChartsAtScales(int textureSize, const float * scales, int paddingPixels, List<ChartPlacement> & chartPositions)
+        {
+            bool succeeded[ScaleSearchWidth];
+            List<ChartPlacement> placements[ScaleSearchWidth];
+            auto tryScale = [&](int i)
             {
-                bool placed = false;
-                for (int x = 0; x < textureSize - chartBitmaps[i].FineBitmap.width; x += 4)
-                {
-                    for (int y = 0; y < textureSize - chartBitmaps[i].FineBitmap.height; y += 4)
-                    {
-                        // try placing chart at (x,y)
-                        if (!ChartHasOverlap(texture, chartBitmaps[i], x, y))
-                        {
-                            WriteChartBitmask(texture, chartBitmaps[i], x, y);
-                            placed = true;
-                            chartPositions[i].position = Vec2::Create((float)(x + paddingPixels), (float)(y + paddingPixels));
-                            chartPositions[i].size = Vec2::Create((float)(chartBitmaps[i].FineBitmap.width - paddingPixels * 2), (float)(chartBitmaps[i].FineBitmap.height - paddingPixels * 2));
-                            break;
-                        }
-                    }
-                    if (placed)
-                        break;
-                }
-                if (!placed)
+                succeeded[i] = TryPackCharts(textureSize, scales[i], paddingPixels, placements[i]);
+            };
+            if (threadPool)
+                threadPool->ParallelFor(0, ScaleSearchWidth, 1, tryScale);
+            else
+            {
+                for (int i = 0; i < ScaleSearchWidth; i++)
+                    tryScale(i);
+            }
+            // scales are in descending order, return the index of the largest one that fits
+            for (int i = 0; i < ScaleSearchWidth; i++)
+            {
+                if (succeeded[i])
                 {
-                    return false;
+                    chartPositions = _Move(placements[i]);
+                    return i;
                 }
             }
-            return true;
+            return -1;
         }
 
         bool PackCharts2(int textureSize, int paddingPixels, float & scale)
         {
             charts.Sort([](Chart& c1, Chart& c2) { return c1.surfaceArea > c2.surfaceArea; });
+            chartBitmapCache.Clear();
+            chartBitmapCache.SetSize(charts.Count());
 
             List<ChartPlacement> chartPositions;
             // sort charts by size
@@ -471,35 +597,46 @@ namespace GameEngine
                 if (c.size.y > 1.0f)
                     scale = Math::Min(scale, 1.0f / c.size.y);
             }
+            // halve the scale until the charts fit
             float failScale = scale, succScale = 0.0f;
+            float scales[ScaleSearchWidth];
             while (scale > 1e-5f)
             {
-                List<ChartPlacement> tmpChartPositions;
-                if (TryPackCharts(textureSize, scale, paddingPixels, tmpChartPositions))
+                for (int i = 0; i < ScaleSearchWidth; i++)
+                    scales[i] = scale * (1.0f / (1 << i));
+                int fit = TryPackChartsAtScales(textureSize, scales, paddingPixels, chartPositions);
+                if (fit == 0)
+                {
+                    succScale = failScale = scale;
+                    break;
+                }
+                if (fit > 0)
                 {
-                    succScale = scale;
-                    chartPositions = tmpChartPositions;
+                    succScale = scales[fit];
+                    failScale = scales[fit - 1];
                     break;
                 }
-                failScale = scale;
-                scale = scale * 0.5f;
+                failScale = scales[ScaleSearchWidth - 1];
+                scale = failScale * 0.5f;
             }
-            // find best scale
-            if (scale < 1e-5)
+            if (scale <= 1e-5f)
                 return false;
-            for (int iter = 0; iter < 5;  iter++)
+            // then narrow down the largest scale that fits
+            for (int iter = 0; iter < 3 && succScale < failScale; iter++)
             {
+                float step = (failScale - succScale) / (ScaleSearchWidth + 1);
+                for (int i = 0; i < ScaleSearchWidth; i++)
+                    scales[i] = failScale - step * (i + 1);
                 List<ChartPlacement> tmpChartPositions;
-                float midScale = (succScale + failScale) * 0.5f;
-                bool succ = TryPackCharts(textureSize, midScale, paddingPixels, tmpChartPositions);
-                if (succ)
+                int fit = TryPackChartsAtScales(textureSize, scales, paddingPixels, tmpChartPositions);
+                if (fit != -1)
                 {
-                    succScale = midScale;
-                    chartPositions = tmpChartPositions;
+                    chartPositions = _Move(tmpChartPositions);
+                    succScale = scales[fit];
                 }
-                else
-                    failScale = midScale;
+                failScale = fit > 0 ? scales[fit - 1] : (fit == 0 ? failScale : scales[ScaleSearchWidth - 1]);
             }
+            chartBitmapCache.Clear();
             if (chartPositions.Count())
             {
                 for (int i = 0; i < chartPositions.Count(); i++)
@@ -601,9 +738,10 @@ namespace GameEngine
         }
     };
 
-    bool GenerateLightmapUV(Mesh* meshOut, Mesh* meshIn, int textureSize, int paddingPixels)
+    bool GenerateLightmapUV(Mesh* meshOut, Mesh* meshIn, int textureSize, int paddingPixels, CoreLib::Threading::ThreadPool * threadPool)
     {
         LightmapUVGenerationContext ctx;
+        ctx.threadPool = threadPool;
         return ctx.GenerateUniqueUV(meshIn, meshOut, textureSize, paddingPixels);
     }
 }
\ No newline at end of file
@@ -1,10 +1,19 @@
 #ifndef GAME_ENGINE_LIGHTMAP_UV_GENERATION
 #define GAME_ENGINE_LIGHTMAP_UV_GENERATION
 
+namespace CoreLib
+{
+    namespace Threading
+    {
+        class ThreadPool;
+    }
+}
+
 namespace GameEngine
 {
     class Mesh;
-    bool GenerateLightmapUV(Mesh* meshOut, Mesh* meshIn, int textureSize, int paddingPixels);
+    // packing tries several scales at once on threadPool when one is given
+    bool GenerateLightmapUV(Mesh* meshOut, Mesh* meshIn, int textureSize, int paddingPixels, CoreLib::Threading::ThreadPool * threadPool = nullptr);
 }
 
 #endif
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include <future>
 #include <sys/timerfd.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <spawn.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
@@ -340,6 +342,22 @@ namespace GameEngine
 #endif
         appContext.Free();
     }
+    bool OsApplication::StartProcess(const CoreLib::String & commandLine)
+    {
+        // posix_spawn instead of fork, which is unsafe in a multithreaded process. The shell starts the process in the
+        // background and exits, so that the process is reparented to init and never becomes a zombie of this one.
+        CoreLib::String shellCommand = commandLine + " &";
+        char shellName[] = "sh";
+        char shellOption[] = "-c";
+        char * argv[] = { shellName, shellOption, (char*)shellCommand.Buffer(), nullptr };
+        pid_t pid;
+        if (posix_spawn(&pid, "/bin/sh", nullptr, nullptr, argv, environ) != 0)
+            return false;
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
     void OsApplication::DebugPrint(const char* buffer)
     {
 #ifdef _DEBUG
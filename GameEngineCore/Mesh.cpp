@@ -3,6 +3,7 @@
 #include "Skeleton.h"
 #include "Engine.h"
 #include "ShaderCompiler.h"
+#include <climits>
 
 using namespace CoreLib::Basic;
 using namespace CoreLib::IO;
@@ -13,9 +14,14 @@ namespace GameEngine
 	int Mesh::uid = 0;
 	void Mesh::LoadFromFile(const CoreLib::Basic::String & pfileName)
 	{
-		RefPtr<FileStream> stream = new FileStream(pfileName);
-		LoadFromStream(stream.Ptr());
-		stream->Close();
+		RefPtr<MemoryMappedFile> file = new MemoryMappedFile(pfileName);
+		// mesh data and memory streams are addressed with 32-bit sizes
+		if (file->GetSize() > INT_MAX)
+			throw IOException("mesh file '" + pfileName + "' is larger than 2GB.");
+		RefPtr<MemoryStream> stream = new MemoryStream(file->GetBuffer(), (int)file->GetSize());
+		LoadFromStream(stream.Ptr(), file->GetBuffer(), file->GetSize());
+		if (vertexData.IsMapped() || Indices.IsMapped())
+			mappedFile = file;
 		this->fileName = pfileName;
 	}
 
@@ -58,8 +64,30 @@ namespace GameEngine
         }
     }
 
+    static void AlignStream(Stream * stream, CoreLib::Int64 start, bool write)
+    {
+        CoreLib::Int64 offset = stream->GetPosition() - start;
+        int padding = (int)((MeshFileDataAlignment - offset % MeshFileDataAlignment) % MeshFileDataAlignment);
+        if (write)
+        {
+            unsigned char zeros[MeshFileDataAlignment] = {};
+            stream->Write(zeros, padding);
+        }
+        else
+            stream->Seek(SeekOrigin::Start, stream->GetPosition() + padding);
+    }
+
 	void Mesh::LoadFromStream(Stream * stream)
 	{
+		LoadFromStream(stream, nullptr, 0);
+	}
+
+	void Mesh::LoadFromStream(Stream * stream, unsigned char * mappedBase, CoreLib::Int64 mappedSize)
+	{
+		vertexData.Clear();
+		Indices.Clear();
+		mappedFile = nullptr;
+		CoreLib::Int64 start = stream->GetPosition();
 		auto reader = BinaryReader(stream);
 		MeshHeader header;
 		reader.Read(header);
@@ -68,8 +96,9 @@ namespace GameEngine
         minLightmapResolution = header.MinLightmapResolution;
         if (!CheckMeshIdentifier(header.MeshFileIdentifier))
 		{
-			stream->Seek(SeekOrigin::Start, 0);
+			stream->Seek(SeekOrigin::Start, start);
 			header = MeshHeader();
+			header.MeshFileVersion = 1;
 		}
 		int typeId = reader.ReadInt32();
 		vertexFormat = MeshVertexFormat(typeId);
@@ -77,10 +106,37 @@ namespace GameEngine
 	    
 		int indexCount = reader.ReadInt32();
 		reader.Read(&Bounds, 1);
-		AllocVertexBuffer(vertCount);
-		Indices.SetSize(indexCount);
-		reader.Read((char*)GetVertexBuffer(), vertCount * vertexFormat.GetVertexSize());
-		reader.Read(Indices.Buffer(), indexCount);
+		if (vertCount < 0 || indexCount < 0 || (CoreLib::Int64)vertCount * vertexFormat.GetVertexSize() > INT_MAX)
+			throw IOException("invalid mesh file.");
+		int vertexDataSize = vertCount * vertexFormat.GetVertexSize();
+		if (header.MeshFileVersion >= 2)
+			AlignStream(stream, start, false);
+		if (header.MeshFileVersion >= 2 && mappedBase)
+		{
+			if (stream->GetPosition() + vertexDataSize > mappedSize)
+				throw IOException("mesh file is truncated.");
+			vertexData.SetMapped(mappedBase + stream->GetPosition(), vertexDataSize);
+			stream->Seek(SeekOrigin::Start, stream->GetPosition() + vertexDataSize);
+		}
+		else
+		{
+			AllocVertexBuffer(vertCount);
+			reader.Read((char*)GetVertexBuffer(), vertexDataSize);
+		}
+		if (header.MeshFileVersion >= 2)
+			AlignStream(stream, start, false);
+		if (header.MeshFileVersion >= 2 && mappedBase)
+		{
+			if (stream->GetPosition() + indexCount * (CoreLib::Int64)sizeof(int) > mappedSize)
+				throw IOException("mesh file is truncated.");
+			Indices.SetMapped((int*)(mappedBase + stream->GetPosition()), indexCount);
+			stream->Seek(SeekOrigin::Start, stream->GetPosition() + indexCount * (CoreLib::Int64)sizeof(int));
+		}
+		else
+		{
+			Indices.SetSize(indexCount);
+			reader.Read(Indices.Buffer(), indexCount);
+		}
 		ElementRanges.SetSize(header.ElementCount);
 		reader.Read(ElementRanges.Buffer(), ElementRanges.Count());
 		if (ElementRanges.Count() == 0)
@@ -129,6 +185,7 @@ namespace GameEngine
 
 	void Mesh::SaveToStream(Stream * stream)
 	{
+		CoreLib::Int64 start = stream->GetPosition();
 		auto writer = BinaryWriter(stream);
 		MeshHeader header;
 		header.ElementCount = ElementRanges.Count();
@@ -141,7 +198,9 @@ namespace GameEngine
 		writer.Write(vertCount);
 		writer.Write(Indices.Count());
 		writer.Write(&Bounds, 1);
+		AlignStream(stream, start, true);
 		writer.Write((char*)GetVertexBuffer(), vertCount * GetVertexSize());
+		AlignStream(stream, start, true);
 		writer.Write(Indices.Buffer(), Indices.Count());
 		writer.Write(ElementRanges.Buffer(), ElementRanges.Count());
         if (header.HasBlendShapes)
@@ -165,9 +224,25 @@ namespace GameEngine
 
 	void Mesh::SaveToFile(const CoreLib::String & pfileName)
 	{
-		RefPtr<FileStream> stream = new FileStream(pfileName, FileMode::Create);
-		SaveToStream(stream.Ptr());
-		stream->Close();
+		// The file may be the one this mesh or another mesh is mapped from, truncating it would invalidate the
+		// mapped data, so the mesh is written to a temporary file that then replaces it.
+		auto tempFileName = pfileName + ".tmp";
+		{
+			RefPtr<FileStream> stream = new FileStream(tempFileName, FileMode::Create);
+			SaveToStream(stream.Ptr());
+			stream->Close();
+		}
+		if (mappedFile)
+		{
+			vertexData.MakeResident();
+			Indices.MakeResident();
+			mappedFile = nullptr;
+		}
+		if (!File::Move(tempFileName, pfileName))
+		{
+			File::Delete(tempFileName);
+			throw IOException("cannot replace mesh file '" + pfileName + "'.");
+		}
 		fileName = pfileName;
 	}
 
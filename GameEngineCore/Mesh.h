@@ -79,7 +79,10 @@ namespace GameEngine
 
 	class Skeleton;
 
-	const int CurrentMeshFileVersion = 1;
+	// version 2 aligns the vertex and index data to MeshFileDataAlignment bytes so that they can be used in place
+	// when the file is memory mapped
+	const int CurrentMeshFileVersion = 2;
+	const int MeshFileDataAlignment = 16;
 
 	struct MeshHeader
 	{
@@ -134,6 +137,154 @@ namespace GameEngine
         return packedQ[0] + (packedQ[1] << 8) + (packedQ[2] << 16) + (packedQ[3] << 24);
     }
 
+	// Mesh data that is either owned by the mesh or refers to a copy-on-write view of a memory mapped mesh file.
+	// Elements of a mapped buffer can be modified in place; operations that change the size move the data to the heap.
+	// Copies of a buffer always own their data.
+	template<typename T>
+	class MeshDataBuffer
+	{
+	private:
+		CoreLib::List<T> list;
+		T * mapped = nullptr;
+		int mappedCount = 0;
+	public:
+		// copies mapped data to the heap, after which the mapping can be released
+		void MakeResident()
+		{
+			if (mapped)
+			{
+				list.Clear();
+				list.AddRange(mapped, mappedCount);
+				mapped = nullptr;
+				mappedCount = 0;
+			}
+		}
+		MeshDataBuffer() = default;
+		MeshDataBuffer(const MeshDataBuffer & other)
+		{
+			*this = other;
+		}
+		MeshDataBuffer(MeshDataBuffer && other)
+		{
+			*this = CoreLib::Basic::_Move(other);
+		}
+		MeshDataBuffer & operator = (const MeshDataBuffer & other)
+		{
+			if (this != &other)
+			{
+				list.Clear();
+				list.AddRange(other.Buffer(), other.Count());
+				mapped = nullptr;
+				mappedCount = 0;
+			}
+			return *this;
+		}
+		MeshDataBuffer & operator = (MeshDataBuffer && other)
+		{
+			list = CoreLib::Basic::_Move(other.list);
+			mapped = other.mapped;
+			mappedCount = other.mappedCount;
+			other.mapped = nullptr;
+			other.mappedCount = 0;
+			return *this;
+		}
+		MeshDataBuffer & operator = (const CoreLib::List<T> & other)
+		{
+			list = other;
+			mapped = nullptr;
+			mappedCount = 0;
+			return *this;
+		}
+		MeshDataBuffer & operator = (CoreLib::List<T> && other)
+		{
+			list = CoreLib::Basic::_Move(other);
+			mapped = nullptr;
+			mappedCount = 0;
+			return *this;
+		}
+		// refers to memory that the owner of the buffer keeps mapped for the lifetime of the buffer
+		void SetMapped(T * data, int count)
+		{
+			list = CoreLib::List<T>();
+			mapped = data;
+			mappedCount = count;
+		}
+		bool IsMapped() const
+		{
+			return mapped != nullptr;
+		}
+		int Count() const
+		{
+			return mapped ? mappedCount : list.Count();
+		}
+		T * Buffer() const
+		{
+			return mapped ? mapped : list.Buffer();
+		}
+		T & operator [](int id) const
+		{
+			assert(id >= 0 && id < Count());
+			return Buffer()[id];
+		}
+		T * begin() const
+		{
+			return Buffer();
+		}
+		T * end() const
+		{
+			return Buffer() + Count();
+		}
+		CoreLib::ArrayView<T> GetArrayView() const
+		{
+			return CoreLib::ArrayView<T>(Buffer(), Count());
+		}
+		bool Contains(const T & val) const
+		{
+			for (auto & v : *this)
+				if (v == val)
+					return true;
+			return false;
+		}
+		int Capacity() const
+		{
+			return mapped ? mappedCount : list.Capacity();
+		}
+		void Reserve(int size)
+		{
+			MakeResident();
+			list.Reserve(size);
+		}
+		void SetSize(int size)
+		{
+			MakeResident();
+			list.SetSize(size);
+		}
+		void Clear()
+		{
+			mapped = nullptr;
+			mappedCount = 0;
+			list.Clear();
+		}
+		void Add(const T & val)
+		{
+			MakeResident();
+			list.Add(val);
+		}
+		void AddRange(const T * vals, int n)
+		{
+			MakeResident();
+			list.AddRange(vals, n);
+		}
+		void AddRange(const CoreLib::List<T> & vals)
+		{
+			AddRange(vals.Buffer(), vals.Count());
+		}
+		void AddRange(const MeshDataBuffer & vals)
+		{
+			AddRange(vals.Buffer(), vals.Count());
+		}
+	};
+
 	class Mesh : public CoreLib::Object 
 	{
 	private:
@@ -142,12 +293,15 @@ namespace GameEngine
         PrimitiveType primitiveType = PrimitiveType::Triangles;
         int minLightmapResolution = 0;
         float surfaceArea = 0.0f;
-		CoreLib::Basic::List<unsigned char> vertexData;
+		MeshDataBuffer<unsigned char> vertexData;
 		int vertCount = 0;
 		CoreLib::String fileName;
+		// keeps the vertex and index data of a mesh loaded with LoadFromFile alive
+		CoreLib::RefPtr<CoreLib::IO::MemoryMappedFile> mappedFile;
+		void LoadFromStream(CoreLib::IO::Stream * stream, unsigned char * mappedBase, CoreLib::Int64 mappedSize);
 	public:
 		CoreLib::Graphics::BBox Bounds;
-		CoreLib::Basic::List<int> Indices;
+		MeshDataBuffer<int> Indices;
 		CoreLib::Basic::List<MeshElementRange> ElementRanges;
         CoreLib::Basic::List<CoreLib::Basic::List<BlendShapeChannel>> ElementBlendShapeChannels;
         CoreLib::Basic::List<BlendShapeVertex> BlendShapeVertices;
@@ -281,6 +435,7 @@ namespace GameEngine
 		void SaveToStream(CoreLib::IO::Stream * stream);
 		void SaveToFile(const CoreLib::String & fileName);
 		void LoadFromStream(CoreLib::IO::Stream * stream);
+		// maps the file into memory; the vertex and index data of version 2 files are used in place
 		void LoadFromFile(const CoreLib::String & fileName);
 		void FromSkeleton(Skeleton * skeleton, float width);
         void UpdateBounds();
@@ -0,0 +1,393 @@
+#include "MipGenerator.h"
+#include "CoreLib/LibIO.h"
+#include "CoreLib/Tokenizer.h"
+#include "CoreLib/Threading.h"
+#include <float.h>
+#include <math.h>
+#include <smmintrin.h>
+
+namespace GameEngine
+{
+    using namespace CoreLib;
+    using namespace CoreLib::IO;
+    using namespace CoreLib::Text;
+
+    // support of the Kaiser and Lanczos kernels in destination texels
+    static const float MipFilterRadius = 3.0f;
+    static const float KaiserAlpha = 4.0f;
+
+    static float Sinc(float x)
+    {
+        if (fabs(x) < 1e-5f)
+            return 1.0f;
+        x *= Math::Pi;
+        return sinf(x) / x;
+    }
+
+    // modified Bessel function of the first kind of order 0
+    static float BesselI0(float x)
+    {
+        float sum = 1.0f, term = 1.0f, halfX2 = x * x * 0.25f;
+        for (int k = 1; k < 32 && term > sum * 1e-8f; k++)
+        {
+            term *= halfX2 / (float)(k * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    // x is the distance from the destination texel center in destination texels
+    static float EvaluateMipFilter(MipFilter filter, float x)
+    {
+        x = fabs(x);
+        switch (filter)
+        {
+        case MipFilter::Box:
+            // texels on the boundary, e.g. the middle texel when halving an odd size, are split between both boxes
+            if (x < 0.5f - 1e-4f)
+                return 1.0f;
+            return x < 0.5f + 1e-4f ? 0.5f : 0.0f;
+        case MipFilter::Kaiser:
+        {
+            if (x >= MipFilterRadius)
+                return 0.0f;
+            float t = x / MipFilterRadius;
+            return Sinc(x) * BesselI0(KaiserAlpha * sqrtf(1.0f - t * t)) / BesselI0(KaiserAlpha);
+        }
+        default:
+            return x < MipFilterRadius ? Sinc(x) * Sinc(x / MipFilterRadius) : 0.0f;
+        }
+    }
+
+    // source texels and normalized weights of each destination texel along one dimension, edges are clamped
+    struct MipFilterTaps
+    {
+        int Stride = 0;
+        List<int> Counts;
+        List<int> Indices;
+        List<float> Weights;
+        void Build(MipFilter filter, int srcSize, int dstSize)
+        {
+            float scale = srcSize / (float)dstSize;
+            float radius = (filter == MipFilter::Box ? 0.5f : MipFilterRadius) * scale;
+            Stride = (int)(radius * 2.0f) + 3;
+            Counts.SetSize(dstSize);
+            Indices.SetSize(dstSize * Stride);
+            Weights.SetSize(dstSize * Stride);
+            for (int i = 0; i < dstSize; i++)
+            {
+                float center = (i + 0.5f) * scale;
+                int first = (int)ceilf(center - radius - 0.5f) - 1;
+                int count = 0;
+                float sum = 0.0f;
+                for (int k = 0; k < Stride; k++)
+                {
+                    float weight = EvaluateMipFilter(filter, (first + k + 0.5f - center) / scale);
+                    if (weight == 0.0f)
+                        continue;
+                    Indices[i * Stride + count] = Math::Clamp(first + k, 0, srcSize - 1);
+                    Weights[i * Stride + count] = weight;
+                    sum += weight;
+                    count++;
+                }
+                for (int k = 0; k < count; k++)
+                    Weights[i * Stride + k] /= sum;
+                Counts[i] = count;
+            }
+        }
+    };
+
+    static float SRGBToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    struct MipConversionTables
+    {
+        // first level channel values to the values filtered
+        float Color[256];
+        float Alpha[256];
+    };
+
+    // Linear to sRGB conversion. Codes holds the sRGB code at the start of each interval of sqrt(linear), the intervals
+    // are small enough to contain at most one of the linear values half way between consecutive codes, in Thresholds.
+    struct SRGBEncodingTable
+    {
+        static const int Size = 4096;
+        unsigned char Codes[Size];
+        float Thresholds[256];
+        SRGBEncodingTable()
+        {
+            for (int i = 0; i < 255; i++)
+                Thresholds[i] = SRGBToLinear((i + 0.5f) / 255.0f);
+            Thresholds[255] = FLT_MAX;
+            for (int i = 0; i < Size; i++)
+            {
+                float t = i / (float)(Size - 1);
+                int code = 0;
+                while (t * t >= Thresholds[code])
+                    code++;
+                Codes[i] = (unsigned char)code;
+            }
+        }
+    };
+
+    Threading::ThreadPool & GetTextureProcessingThreads()
+    {
+        static Threading::ThreadPool threadPool;
+        return threadPool;
+    }
+
+    static const SRGBEncodingTable & GetSRGBEncodingTable()
+    {
+        static SRGBEncodingTable table;
+        return table;
+    }
+
+    // Filters a level from the previous one in floating point. The first level is read from its 8-bit texels, src is null then.
+    static void FilterMipLevel(float * dst, int dstWidth, int dstHeight, const float * src, const unsigned char * src8,
+        int srcWidth, int srcHeight, const MipConversionTables & tables, MipFilter filter)
+    {
+        MipFilterTaps tapsX, tapsY;
+        tapsX.Build(filter, srcWidth, dstWidth);
+        tapsY.Build(filter, srcHeight, dstHeight);
+        // rows are filtered in batches, each batch reuses a buffer for a source row filtered vertically
+        const int rowBatchSize = 4;
+        GetTextureProcessingThreads().ParallelFor(0, (dstHeight + rowBatchSize - 1) / rowBatchSize, 1, [&](int batch)
+        {
+            List<float> rowBuffer;
+            rowBuffer.SetSize(srcWidth * 4);
+            auto row = rowBuffer.Buffer();
+            int batchEnd = Math::Min(dstHeight, (batch + 1) * rowBatchSize);
+            for (int y = batch * rowBatchSize; y < batchEnd; y++)
+            {
+                for (int x = 0; x < srcWidth; x++)
+                    _mm_storeu_ps(row + x * 4, _mm_setzero_ps());
+                for (int k = 0; k < tapsY.Counts[y]; k++)
+                {
+                    int sy = tapsY.Indices[y * tapsY.Stride + k];
+                    __m128 weight = _mm_set1_ps(tapsY.Weights[y * tapsY.Stride + k]);
+                    if (src8)
+                    {
+                        auto srcRow = src8 + (size_t)sy * srcWidth * 4;
+                        for (int x = 0; x < srcWidth; x++)
+                        {
+                            auto texel = srcRow + x * 4;
+                            __m128 value = _mm_set_ps(tables.Alpha[texel[3]], tables.Color[texel[2]], tables.Color[texel[1]], tables.Color[texel[0]]);
+                            _mm_storeu_ps(row + x * 4, _mm_add_ps(_mm_loadu_ps(row + x * 4), _mm_mul_ps(value, weight)));
+                        }
+                    }
+                    else
+                    {
+                        auto srcRow = src + (size_t)sy * srcWidth * 4;
+                        for (int x = 0; x < srcWidth; x++)
+                            _mm_storeu_ps(row + x * 4, _mm_add_ps(_mm_loadu_ps(row + x * 4), _mm_mul_ps(_mm_loadu_ps(srcRow + x * 4), weight)));
+                    }
+                }
+                auto dstRow = dst + (size_t)y * dstWidth * 4;
+                for (int x = 0; x < dstWidth; x++)
+                {
+                    __m128 sum = _mm_setzero_ps();
+                    auto indices = tapsX.Indices.Buffer() + x * tapsX.Stride;
+                    auto weights = tapsX.Weights.Buffer() + x * tapsX.Stride;
+                    for (int k = 0; k < tapsX.Counts[x]; k++)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + indices[k] * 4), _mm_set1_ps(weights[k])));
+                    _mm_storeu_ps(dstRow + x * 4, sum);
+                }
+            }
+        });
+    }
+
+    // Converts a filtered row back to 8 bits, renormalizing normals and scaling alpha by alphaScale.
+    static void StoreMipRow(unsigned char * dst, const float * src, int width, MipContent content, float alphaScale)
+    {
+        auto & srgbTable = GetSRGBEncodingTable();
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 scale = _mm_set_ps(255.0f * alphaScale, 255.0f, 255.0f, 255.0f);
+        __m128 maxValue = _mm_set1_ps(255.0f);
+        for (int x = 0; x < width; x++)
+        {
+            __m128 value = _mm_loadu_ps(src + x * 4);
+            if (content == MipContent::NormalMap)
+            {
+                __m128 length = _mm_sqrt_ps(_mm_max_ps(_mm_dp_ps(value, value, 0x7F), _mm_set1_ps(1e-20f)));
+                __m128 normal = _mm_add_ps(_mm_mul_ps(_mm_div_ps(value, length), half), half);
+                value = _mm_blend_ps(normal, value, 8);
+            }
+            __m128 quantized = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(value, scale), half), _mm_setzero_ps()), maxValue);
+            __m128i packed = _mm_cvttps_epi32(quantized);
+            packed = _mm_packus_epi16(_mm_packus_epi32(packed, packed), packed);
+            int texel = _mm_cvtsi128_si32(packed);
+            memcpy(dst + x * 4, &texel, 4);
+            if (content == MipContent::Color)
+            {
+                alignas(16) float linear[4];
+                alignas(16) int intervals[4];
+                __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), one);
+                _mm_store_ps(linear, clamped);
+                _mm_store_si128((__m128i*)intervals, _mm_cvttps_epi32(_mm_mul_ps(_mm_sqrt_ps(clamped), _mm_set1_ps(SRGBEncodingTable::Size - 1.0f))));
+                for (int c = 0; c < 3; c++)
+                {
+                    int code = srgbTable.Codes[intervals[c]];
+                    dst[x * 4 + c] = (unsigned char)(linear[c] >= srgbTable.Thresholds[code] ? code + 1 : code);
+                }
+            }
+        }
+    }
+
+    // fraction of the texels of a filtered level with alpha above threshold
+    static float ComputeAlphaCoverage(const float * pixels, int count, float threshold)
+    {
+        int covered = 0;
+        for (int i = 0; i < count; i++)
+            covered += pixels[i * 4 + 3] > threshold ? 1 : 0;
+        return covered / (float)count;
+    }
+
+    // Finds the alpha threshold at which a level has the coverage of the first level. Scaling alpha by cutoff / threshold
+    // moves that threshold to the cutoff.
+    static float FindAlphaCoverageScale(const float * pixels, int count, float cutoff, float targetCoverage)
+    {
+        float low = 0.0f, high = 1.0f, threshold = cutoff;
+        for (int i = 0; i < 16; i++)
+        {
+            threshold = (low + high) * 0.5f;
+            if (ComputeAlphaCoverage(pixels, count, threshold) > targetCoverage)
+                low = threshold;
+            else
+                high = threshold;
+        }
+        return threshold > 0.0f ? cutoff / threshold : 1.0f;
+    }
+
+    void GenerateMipChain(MipChain & result, ArrayView<unsigned char> rgbaPixels, int width, int height,
+        const MipGenerationOptions & options)
+    {
+        result.Levels.Clear();
+        int size = 0;
+        for (int w = width, h = height; ; w = Math::Max(1, w / 2), h = Math::Max(1, h / 2))
+        {
+            result.Levels.Add(MipLevelDesc{ w, h, size });
+            size += w * h * 4;
+            if (w == 1 && h == 1)
+                break;
+        }
+        result.Pixels.SetSize(size);
+        memcpy(result.Pixels.Buffer(), rgbaPixels.Buffer(), width * height * 4);
+        int levelCount = result.Levels.Count();
+        if (levelCount == 1)
+            return;
+
+        MipConversionTables tables;
+        for (int i = 0; i < 256; i++)
+        {
+            float value = i / 255.0f;
+            if (options.Content == MipContent::Color)
+                tables.Color[i] = SRGBToLinear(value);
+            else if (options.Content == MipContent::NormalMap)
+                tables.Color[i] = value * 2.0f - 1.0f;
+            else
+                tables.Color[i] = value;
+            tables.Alpha[i] = value;
+        }
+
+        // the levels after the first in floating point, each level is filtered from the previous one
+        // so that all levels keep the precision of the filter
+        int firstLevelSize = width * height * 4;
+        List<float> filteredPixels;
+        filteredPixels.SetSize(size - firstLevelSize);
+        auto getFilteredLevel = [&](int level) { return filteredPixels.Buffer() + result.Levels[level].Offset - firstLevelSize; };
+        for (int i = 1; i < levelCount; i++)
+        {
+            auto & level = result.Levels[i];
+            auto & prevLevel = result.Levels[i - 1];
+            FilterMipLevel(getFilteredLevel(i), level.Width, level.Height, i == 1 ? nullptr : getFilteredLevel(i - 1),
+                i == 1 ? rgbaPixels.Buffer() : nullptr, prevLevel.Width, prevLevel.Height, tables, options.Filter);
+        }
+
+        List<float> alphaScales;
+        alphaScales.SetSize(levelCount);
+        for (int i = 0; i < levelCount; i++)
+            alphaScales[i] = 1.0f;
+        if (options.PreserveAlphaCoverage)
+        {
+            int covered = 0;
+            for (int i = 0; i < width * height; i++)
+                covered += rgbaPixels[i * 4 + 3] > options.AlphaCutoff * 255.0f ? 1 : 0;
+            float coverage = covered / (float)(width * height);
+            GetTextureProcessingThreads().ParallelFor(1, levelCount, 1, [&](int i)
+            {
+                alphaScales[i] = FindAlphaCoverageScale(getFilteredLevel(i), result.Levels[i].Width * result.Levels[i].Height,
+                    options.AlphaCutoff, coverage);
+            });
+        }
+
+        // the rows of all levels are converted in one loop, the coarse levels alone are too small to keep all threads busy
+        struct LevelRow
+        {
+            int Level, Y;
+        };
+        List<LevelRow> rows;
+        for (int i = 1; i < levelCount; i++)
+        {
+            for (int y = 0; y < result.Levels[i].Height; y++)
+                rows.Add(LevelRow{ i, y });
+        }
+        GetTextureProcessingThreads().ParallelFor(0, rows.Count(), 16, [&](int r)
+        {
+            auto & level = result.Levels[rows[r].Level];
+            size_t rowOffset = (size_t)rows[r].Y * level.Width * 4;
+            StoreMipRow(result.GetLevelPixels(rows[r].Level) + rowOffset, getFilteredLevel(rows[r].Level) + rowOffset, level.Width,
+                options.Content, alphaScales[rows[r].Level]);
+        });
+    }
+
+    String GetImageMipSettingsFileName(const String & imageFileName)
+    {
+        return Path::ReplaceExt(imageFileName, "texsettings");
+    }
+
+    MipGenerationOptions GetImageMipOptions(const String & imageFileName)
+    {
+        MipGenerationOptions options;
+        auto name = Path::GetFileNameWithoutEXT(imageFileName).ToLower();
+        if (name.EndsWith("_n") || name.EndsWith("_nrm") || name.EndsWith("_normal"))
+            options.Content = MipContent::NormalMap;
+        else if (name.EndsWith("_cutout"))
+            options.PreserveAlphaCoverage = true;
+        auto settingsFileName = GetImageMipSettingsFileName(imageFileName);
+        if (!File::Exists(settingsFileName))
+            return options;
+        TokenReader parser(File::ReadAllText(settingsFileName));
+        while (!parser.IsEnd())
+        {
+            auto settingsName = parser.ReadWord();
+            parser.Read("=");
+            auto settingsValue = parser.ReadStringLiteral();
+            if (settingsName == "Content")
+            {
+                if (settingsValue == "NormalMap")
+                    options.Content = MipContent::NormalMap;
+                else if (settingsValue == "Linear")
+                    options.Content = MipContent::Linear;
+                else
+                    options.Content = MipContent::Color;
+            }
+            else if (settingsName == "Filter")
+            {
+                if (settingsValue == "Box")
+                    options.Filter = MipFilter::Box;
+                else if (settingsValue == "Lanczos")
+                    options.Filter = MipFilter::Lanczos;
+                else
+                    options.Filter = MipFilter::Kaiser;
+            }
+            else if (settingsName == "PreserveAlphaCoverage")
+                options.PreserveAlphaCoverage = StringToInt(settingsValue) != 0;
+            else if (settingsName == "AlphaCutoff")
+                options.AlphaCutoff = StringToFloat(settingsValue);
+        }
+        return options;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef GAME_ENGINE_MIP_GENERATOR_H
+#define GAME_ENGINE_MIP_GENERATOR_H
+
+#include "CoreLib/Basic.h"
+
+namespace CoreLib
+{
+    namespace Threading
+    {
+        class ThreadPool;
+    }
+}
+
+namespace GameEngine
+{
+    enum class MipFilter
+    {
+        // average of the source texels covered by a destination texel, the cheapest
+        Box,
+        // Kaiser windowed sinc, sharper than box with little ringing
+        Kaiser,
+        // Lanczos 3, the sharpest, may ring at hard edges
+        Lanczos
+    };
+
+    enum class MipContent
+    {
+        // sRGB encoded RGB, filtered in linear space, with linear alpha
+        Color,
+        // linear data in all channels
+        Linear,
+        // normals encoded as n * 0.5 + 0.5 in RGB, renormalized in every level
+        NormalMap
+    };
+
+    struct MipGenerationOptions
+    {
+        MipContent Content = MipContent::Color;
+        MipFilter Filter = MipFilter::Kaiser;
+        // scales the alpha of each level so that the fraction of texels with alpha above AlphaCutoff stays
+        // the same as in the top level, which keeps alpha tested textures from thinning out in the distance
+        bool PreserveAlphaCoverage = false;
+        float AlphaCutoff = 0.5f;
+        MipGenerationOptions() = default;
+        MipGenerationOptions(MipContent content, MipFilter filter = MipFilter::Kaiser)
+            : Content(content), Filter(filter)
+        {}
+    };
+
+    // Mip options of an image file. Normal maps are recognized by a name ending with _n, _nrm or _normal, and alpha
+    // tested textures by a name ending with _cutout. A .texsettings file next to the image overrides this, with lines
+    // of the form Content = "NormalMap" (Color, Linear), Filter = "Box" (Kaiser, Lanczos), PreserveAlphaCoverage = "1"
+    // and AlphaCutoff = "0.5".
+    MipGenerationOptions GetImageMipOptions(const CoreLib::String & imageFileName);
+    CoreLib::String GetImageMipSettingsFileName(const CoreLib::String & imageFileName);
+
+    struct MipLevelDesc
+    {
+        int Width, Height;
+        // offset of the level in MipChain::Pixels
+        int Offset;
+    };
+
+    // RGBA8 levels of a texture down to 1x1, finest first, stored in a single buffer
+    class MipChain
+    {
+    public:
+        CoreLib::List<unsigned char> Pixels;
+        CoreLib::List<MipLevelDesc> Levels;
+        unsigned char * GetLevelPixels(int level)
+        {
+            return Pixels.Buffer() + Levels[level].Offset;
+        }
+    };
+
+    // threads shared by mip generation and texture compression, created on first use
+    CoreLib::Threading::ThreadPool & GetTextureProcessingThreads();
+
+    // Generates the mip chain of an RGBA8 image, the first level is a copy of the image. Each level is filtered in
+    // floating point from the previous one with its rows processed in parallel, then all levels are converted back
+    // to 8 bits in a single parallel loop. The loops run on GetTextureProcessingThreads().
+    void GenerateMipChain(MipChain & result, CoreLib::ArrayView<unsigned char> rgbaPixels, int width, int height,
+        const MipGenerationOptions & options);
+}
+
+#endif
@@ -186,6 +186,8 @@ namespace GameEngine
         static void Init(int argc, const char** argv);
         static void Dispose();
         static void DebugPrint(const char * buffer);
+        // launches a process from a command line without waiting for it, returns false if it cannot be started.
+        static bool StartProcess(const CoreLib::String & commandLine);
         static CoreLib::Text::CommandLineParser& GetCommandLineParser()
         {
             return commandlineParser;
@@ -0,0 +1,239 @@
+#include "ObjectSpaceGBufferRasterizer.h"
+#include "Rasterizer.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Engine.h"
+#include "TextureCompressor.h"
+#include "CoreLib/Tokenizer.h"
+#include <float.h>
+
+using namespace CoreLib;
+using namespace CoreLib::IO;
+using namespace VectorMath;
+
+namespace GameEngine
+{
+    VectorMath::Vec4 MaterialDiffuse::Sample(VectorMath::Vec2 uv) const
+    {
+        if (!Texture.Count())
+            return Color;
+        int x = Math::Clamp((int)((uv.x - floor(uv.x)) * TextureWidth), 0, TextureWidth - 1);
+        int y = Math::Clamp((int)((uv.y - floor(uv.y)) * TextureHeight), 0, TextureHeight - 1);
+        return Color * UnpackRGBA8(Texture[y * TextureWidth + x]);
+    }
+
+    // the tokens of the expression assigned to the albedo of the material pattern, e.g. of
+    // "rs.albedo = albedoMap.Sample(viewParams.textureSampler, vertUV).xyz;"
+    static bool FindAlbedoExpression(List<Text::Token> & result, const String & shaderSource)
+    {
+        auto tokens = Text::TokenizeText(shaderSource);
+        for (int i = 0; i + 1 < tokens.Count(); i++)
+        {
+            if (tokens[i].Type == Text::TokenType::Identifier && tokens[i].Content == "albedo" &&
+                tokens[i + 1].Type == Text::TokenType::OpAssign)
+            {
+                for (int j = i + 2; j < tokens.Count() && tokens[j].Type != Text::TokenType::Semicolon; j++)
+                    result.Add(tokens[j]);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // looks the texture up the way SceneResource::LoadTexture does
+    static void LoadDiffuseTexture(MaterialDiffuse & result, const String & textureName, int maxTextureSize)
+    {
+        auto fileName = Engine::Instance()->FindFile(Path::ReplaceExt(textureName, "texture"), ResourceType::Texture);
+        if (!fileName.Length())
+            fileName = Engine::Instance()->FindFile(textureName, ResourceType::Texture);
+        if (!fileName.Length())
+        {
+            Print("cannot load texture '%S'\n", textureName.ToWString());
+            return;
+        }
+        try
+        {
+            if (fileName.ToLower().EndsWith(".texture"))
+            {
+                CoreLib::Graphics::TextureFile file(fileName);
+                int level = 0;
+                while (level + 1 < file.GetMipLevels() && Math::Max(file.GetWidth(), file.GetHeight()) >> level > maxTextureSize)
+                    level++;
+                TextureCompressor::DecompressRGBA(result.Texture, file, level);
+                result.TextureWidth = Math::Max(1, file.GetWidth() >> level);
+                result.TextureHeight = Math::Max(1, file.GetHeight() >> level);
+            }
+            else
+                TextureCompressor::LoadImageFile_RGBA(result.Texture, result.TextureWidth, result.TextureHeight, fileName);
+        }
+        catch (const Exception &)
+        {
+            Print("cannot load texture '%S' for lightmap baking\n", fileName.ToWString());
+            result.Texture.Clear();
+        }
+    }
+
+    void LoadMaterialDiffuse(MaterialDiffuse & result, Material * material, int maxTextureSize)
+    {
+        result = MaterialDiffuse();
+        if (!material)
+            return;
+        List<Text::Token> expression;
+        auto shaderFileName = Engine::Instance()->FindFile(material->ShaderFile, ResourceType::Shader);
+        try
+        {
+            if (!shaderFileName.Length() || !FindAlbedoExpression(expression, File::ReadAllText(shaderFileName)))
+                return;
+        }
+        catch (const Exception &)
+        {
+            Print("cannot read shader '%S' for lightmap baking\n", material->ShaderFile.ToWString());
+            return;
+        }
+        // color variables modulate the first texture variable, e.g. "albedoMap.Sample(...).xyz * tint"
+        bool hasVariable = false;
+        Vec4 color = Vec4::Create(1.0f, 1.0f, 1.0f, 1.0f);
+        String textureName;
+        List<float> literals;
+        for (auto & token : expression)
+        {
+            if (token.Type == Text::TokenType::IntLiterial || token.Type == Text::TokenType::DoubleLiterial)
+                literals.Add((float)StringToDouble(token.Content));
+            if (token.Type != Text::TokenType::Identifier)
+                continue;
+            auto var = material->Variables.TryGetValue(token.Content);
+            if (!var)
+                continue;
+            hasVariable = true;
+            if (var->VarType == DynamicVariableType::Vec3)
+                color *= Vec4::Create(var->Vec3Value, 1.0f);
+            else if (var->VarType == DynamicVariableType::Vec4)
+                color *= Vec4::Create(var->Vec4Value.xyz(), 1.0f);
+            else if (var->VarType == DynamicVariableType::Texture && !textureName.Length())
+                textureName = var->StringValue;
+        }
+        if (!hasVariable)
+        {
+            // a constant albedo, e.g. "float3(0.9, 0.9, 0.9)"
+            if (literals.Count() == 3)
+                result.Color = Vec4::Create(literals[0], literals[1], literals[2], 1.0f);
+            else if (literals.Count() == 1)
+                result.Color = Vec4::Create(literals[0], literals[0], literals[0], 1.0f);
+            return;
+        }
+        result.Color = color;
+        if (textureName.Length())
+            LoadDiffuseTexture(result, textureName, maxTextureSize);
+    }
+
+    // distance of a barycentric coordinate to the triangle, used as depth so that texels covered by
+    // the dilated border of a triangle never overwrite texels covered by the interior of another one.
+    static float GetOutsideDistance(float b0, float b1, float b2)
+    {
+        float distance = 0.0f;
+        float b[3] = { b0, b1, b2 };
+        for (int i = 0; i < 3; i++)
+        {
+            if (b[i] < 0.0f)
+                distance -= b[i];
+            else if (b[i] > 1.0f)
+                distance += b[i] - 1.0f;
+        }
+        return Math::Min(distance, 1.0f);
+    }
+
+    void RasterizeObjectSpaceGBuffer(ObjectSpaceGBuffer & gbuffer, Mesh * mesh, const VectorMath::Matrix4 & localTransform,
+        const MaterialDiffuse & diffuse, int superSampleFactor)
+    {
+        int width = gbuffer.DiffuseMap->Width;
+        int height = gbuffer.DiffuseMap->Height;
+        int sampleWidth = width * superSampleFactor;
+        int sampleHeight = height * superSampleFactor;
+        int uvChannelId = mesh->GetVertexFormat().GetUVChannelCount() - 1;
+        bool hasTangent = mesh->GetVertexFormat().HasTangent();
+
+        // transform vertices to world space once, normals are transformed through the tangent frame like StaticMeshTransform does
+        List<Vec3> worldPositions, worldNormals;
+        worldPositions.SetSize(mesh->GetVertexCount());
+        worldNormals.SetSize(mesh->GetVertexCount());
+        for (int i = 0; i < mesh->GetVertexCount(); i++)
+        {
+            worldPositions[i] = localTransform.Transform(Vec4::Create(mesh->GetVertexPosition(i), 1.0f)).xyz();
+            if (hasTangent)
+            {
+                auto tangentFrame = mesh->GetVertexTangentFrame(i);
+                auto tangent = tangentFrame.Transform(Vec3::Create(1.0f, 0.0f, 0.0f));
+                auto normal = tangentFrame.Transform(Vec3::Create(0.0f, 1.0f, 0.0f));
+                auto binormal = Vec3::Cross(tangent, normal);
+                auto worldTangent = localTransform.TransformNormal(tangent).Normalize();
+                auto worldBinormal = localTransform.TransformNormal(binormal).Normalize();
+                worldNormals[i] = Vec3::Cross(worldBinormal, worldTangent);
+            }
+        }
+
+        List<float> depthBuffer;
+        depthBuffer.SetSize(width * height);
+        for (auto & depth : depthBuffer)
+            depth = FLT_MAX;
+        for (int f = 0; f < mesh->Indices.Count() / 3; f++)
+        {
+            int vertIds[3];
+            Vec2 uvs[3], textureUVs[3];
+            Vec3 positions[3], normals[3];
+            for (int j = 0; j < 3; j++)
+            {
+                vertIds[j] = mesh->Indices[f * 3 + j];
+                uvs[j] = mesh->GetVertexUV(vertIds[j], uvChannelId);
+                textureUVs[j] = mesh->GetVertexUV(vertIds[j], 0);
+                positions[j] = worldPositions[vertIds[j]];
+                normals[j] = worldNormals[vertIds[j]];
+            }
+            if (!hasTangent)
+            {
+                auto faceNormal = Vec3::Cross(positions[1] - positions[0], positions[2] - positions[0]).Normalize();
+                normals[0] = normals[1] = normals[2] = faceNormal;
+            }
+            // barycentric coordinates are computed in the texel space of the supersampled G-buffer
+            Vec2 t0 = Vec2::Create(uvs[0].x * sampleWidth, uvs[0].y * sampleHeight);
+            Vec2 d1 = Vec2::Create(uvs[1].x * sampleWidth, uvs[1].y * sampleHeight) - t0;
+            Vec2 d2 = Vec2::Create(uvs[2].x * sampleWidth, uvs[2].y * sampleHeight) - t0;
+            float det = d1.x * d2.y - d1.y * d2.x;
+            if (fabs(det) < 1e-8f)
+                continue;
+            float invDet = 1.0f / det;
+
+            // world space change of position per lightmap texel, the equivalent of fwidth(worldPos) in the shader
+            auto e1 = positions[1] - positions[0];
+            auto e2 = positions[2] - positions[0];
+            auto dPdx = (e1 * d2.y - e2 * d1.y) * (invDet * superSampleFactor);
+            auto dPdy = (e2 * d1.x - e1 * d2.x) * (invDet * superSampleFactor);
+            float footprint = 0.0f;
+            for (int c = 0; c < 3; c++)
+                footprint = Math::Max(footprint, fabs(dPdx[c]) + fabs(dPdy[c]));
+
+            ProjectedTriangle tri;
+            Rasterizer::SetupTriangle(tri, uvs[0], uvs[1], uvs[2], sampleWidth, sampleHeight);
+            Rasterizer::ForEachPixel(tri, sampleWidth, sampleHeight, [&](int sx, int sy)
+            {
+                float qx = sx + 0.5f - t0.x;
+                float qy = sy + 0.5f - t0.y;
+                float b1 = (qx * d2.y - qy * d2.x) * invDet;
+                float b2 = (d1.x * qy - d1.y * qx) * invDet;
+                float b0 = 1.0f - b1 - b2;
+                float depth = GetOutsideDistance(b0, b1, b2);
+                int x = sx / superSampleFactor;
+                int y = sy / superSampleFactor;
+                int texelId = y * width + x;
+                if (depth >= depthBuffer[texelId])
+                    return;
+                depthBuffer[texelId] = depth;
+                auto position = positions[0] * b0 + positions[1] * b1 + positions[2] * b2;
+                auto normal = (normals[0] * b0 + normals[1] * b1 + normals[2] * b2).Normalize();
+                gbuffer.DiffuseMap->SetPixel(x, y, diffuse.Sample(textureUVs[0] * b0 + textureUVs[1] * b1 + textureUVs[2] * b2));
+                gbuffer.PositionMap->SetPixel(x, y, Vec4::Create(position, footprint));
+                gbuffer.NormalMap->SetPixel(x, y, Vec4::Create(normal, 0.0f));
+                gbuffer.ValidPixels->Add(texelId);
+            });
+        }
+    }
+}
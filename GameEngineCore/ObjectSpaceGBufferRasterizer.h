@@ -0,0 +1,45 @@
+#ifndef GAME_ENGINE_OBJECT_SPACE_GBUFFER_RASTERIZER_H
+#define GAME_ENGINE_OBJECT_SPACE_GBUFFER_RASTERIZER_H
+
+#include "ObjectSpaceMapSet.h"
+#include "CoreLib/IntSet.h"
+
+namespace GameEngine
+{
+    class Mesh;
+    class Material;
+
+    struct ObjectSpaceGBuffer
+    {
+        RawObjectSpaceMap * DiffuseMap;
+        // xyz = world position, w = world space footprint of a texel
+        RawObjectSpaceMap * PositionMap;
+        RawObjectSpaceMap * NormalMap;
+        CoreLib::IntSet * ValidPixels;
+    };
+
+    // Diffuse of a material sampled on the CPU: a constant color, modulated by an RGBA8 albedo texture when the material
+    // has one. Texels are stored in the bottom-up row order of texture files and sampled with repeat addressing.
+    struct MaterialDiffuse
+    {
+        // same albedo as DefaultMaterial.slang
+        VectorMath::Vec4 Color = VectorMath::Vec4::Create(0.9f, 0.9f, 0.9f, 1.0f);
+        CoreLib::List<unsigned int> Texture;
+        int TextureWidth = 0, TextureHeight = 0;
+        VectorMath::Vec4 Sample(VectorMath::Vec2 uv) const;
+    };
+
+    // Finds the material variables the albedo of the material pattern is assigned from in the material's shader, and
+    // loads the albedo texture at the first mip level no larger than maxTextureSize. Materials whose albedo does not
+    // come from their variables keep the default albedo, or the constant of a float3 literal.
+    void LoadMaterialDiffuse(MaterialDiffuse & result, Material * material, int maxTextureSize = 256);
+
+    // Software counterpart of LightmapGBufferGen.slang: rasterizes a mesh in its lightmap UV space and writes the
+    // diffuse, world position and world normal of every covered texel into the G-buffer, whose maps must be of equal size.
+    // Each texel is sampled at superSampleFactor^2 positions and takes the attributes of the sample closest to a triangle.
+    // The diffuse texture is sampled with the first UV channel, like the material shaders do.
+    void RasterizeObjectSpaceGBuffer(ObjectSpaceGBuffer & gbuffer, Mesh * mesh, const VectorMath::Matrix4 & localTransform,
+        const MaterialDiffuse & diffuse, int superSampleFactor = 1);
+}
+
+#endif
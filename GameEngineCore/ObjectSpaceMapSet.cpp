@@ -2,6 +2,7 @@
 #include "CoreLib/Basic.h"
 #include "CoreLib/VectorMath.h"
 #include "CoreLib/Imaging/Bitmap.h"
+#include "TextureCompressor.h"
 
 using namespace CoreLib;
 
@@ -90,8 +91,33 @@ namespace GameEngine
         Width = w;
         Height = h;
     }
+    void RawObjectSpaceMap::DecompressBC6H(RawObjectSpaceMap & result)
+    {
+        result.Init(DataType::RGB32F, Width, Height);
+        // 4x4 blocks of 16 bytes in row major order
+        int blocksPerRow = (Width + 3) / 4;
+        int blockRows = (Height + 3) / 4;
+        for (int blockY = 0; blockY < blockRows; blockY++)
+        {
+            for (int blockX = 0; blockX < blocksPerRow; blockX++)
+            {
+                VectorMath::Vec3 texels[16];
+                TextureCompressor::DecompressBC6H_Block(data.Buffer() + (blockY * blocksPerRow + blockX) * 16, texels);
+                for (int ki = 0; ki < 4 && blockY * 4 + ki < Height; ki++)
+                    for (int kj = 0; kj < 4 && blockX * 4 + kj < Width; kj++)
+                        result.SetPixel(blockX * 4 + kj, blockY * 4 + ki, VectorMath::Vec4::Create(texels[ki * 4 + kj], 1.0f));
+            }
+        }
+    }
     void RawObjectSpaceMap::DebugSaveAsImage(String fileName)
     {
+        if (dataType == DataType::BC6H)
+        {
+            RawObjectSpaceMap decompressed;
+            DecompressBC6H(decompressed);
+            decompressed.DebugSaveAsImage(fileName);
+            return;
+        }
         CoreLib::Imaging::BitmapF bmp = CoreLib::Imaging::BitmapF(Width, Height);
         auto pixels = bmp.GetPixels();
         for (int i = 0; i < Width * Height; i++)
@@ -24,6 +24,9 @@ namespace GameEngine
         void SetPixel(int x, int y, VectorMath::Vec4 value);
         void * GetBuffer() { return data.Buffer(); }
         void Init(DataType type, int w, int h);
+        // decodes a BC6H map into an RGB32F map of the same size, every block is decoded once. GetPixel does not
+        // read BC6H maps.
+        void DecompressBC6H(RawObjectSpaceMap & result);
         void DebugSaveAsImage(CoreLib::String fileName);
         void LoadFromStream(CoreLib::IO::BinaryReader& reader);
         void SaveToStream(CoreLib::IO::BinaryWriter& writer);
@@ -11,6 +11,190 @@ using namespace CoreLib::IO;
 
 namespace GameEngine
 {
+	static const char * PipelineManifestIdentifier = "SPPIPE";
+	static const int PipelineManifestVersion = 2;
+
+	String PipelineRecord::GetKey() const
+	{
+		StringBuilder sb;
+		sb << FragmentShaderFile << "/" << FragmentShaderFunction;
+		for (int i = 0; i < ModuleFiles.Count(); i++)
+			sb << "|" << ModuleFiles[i] << "/" << ModuleTypes[i];
+		sb << "|" << VertexFormat << "|" << (int)PrimType << "|" << (int)Culling;
+		return sb.ProduceString();
+	}
+
+	static PipelineRecord ReadPipelineRecord(BinaryReader & reader)
+	{
+		PipelineRecord record;
+		record.FragmentShaderFile = reader.ReadString();
+		record.FragmentShaderFunction = reader.ReadString();
+		int moduleCount = reader.ReadInt32();
+		for (int j = 0; j < moduleCount; j++)
+		{
+			record.ModuleFiles.Add(reader.ReadString());
+			record.ModuleTypes.Add(reader.ReadString());
+		}
+		record.VertexFormat = reader.ReadInt32();
+		record.PrimType = (PrimitiveType)reader.ReadInt32();
+		record.Culling = (CullMode)reader.ReadInt32();
+		return record;
+	}
+
+	static void WritePipelineRecord(BinaryWriter & writer, const PipelineRecord & record)
+	{
+		writer.Write(record.FragmentShaderFile);
+		writer.Write(record.FragmentShaderFunction);
+		writer.Write(record.ModuleFiles.Count());
+		for (int i = 0; i < record.ModuleFiles.Count(); i++)
+		{
+			writer.Write(record.ModuleFiles[i]);
+			writer.Write(record.ModuleTypes[i]);
+		}
+		writer.Write(record.VertexFormat);
+		writer.Write((int)record.PrimType);
+		writer.Write((int)record.Culling);
+	}
+
+	void PipelineManifest::LoadFromFile(const String & fileName)
+	{
+		records = EnumerableDictionary<String, PipelineRecord>();
+		levels = EnumerableDictionary<String, LevelRecords>();
+		currentLevel = nullptr;
+		levelVersion++;
+		modified = false;
+		if (!File::Exists(fileName))
+			return;
+		try
+		{
+			BinaryReader reader(new FileStream(fileName));
+			if (reader.ReadString() != PipelineManifestIdentifier || reader.ReadInt32() != PipelineManifestVersion)
+			{
+				Print("ignoring pipeline manifest '%s' of a different version.\n", fileName.Buffer());
+				return;
+			}
+			int count = reader.ReadInt32();
+			List<String> keys;
+			for (int i = 0; i < count; i++)
+			{
+				auto record = ReadPipelineRecord(reader);
+				keys.Add(record.GetKey());
+				records[keys.Last()] = record;
+			}
+			int levelCount = reader.ReadInt32();
+			for (int i = 0; i < levelCount; i++)
+			{
+				auto levelName = reader.ReadString();
+				LevelRecords level;
+				level.SessionCount = reader.ReadInt32();
+				int usedCount = reader.ReadInt32();
+				for (int j = 0; j < usedCount; j++)
+				{
+					int recordIndex = reader.ReadInt32();
+					int lastUsedSession = reader.ReadInt32();
+					if (recordIndex < 0 || recordIndex >= keys.Count())
+						throw IOException("invalid pipeline record index.");
+					level.LastUsedSessions[keys[recordIndex]] = lastUsedSession;
+				}
+				levels[levelName] = _Move(level);
+			}
+		}
+		catch (const IOException &)
+		{
+			Print("cannot read pipeline manifest '%s'.\n", fileName.Buffer());
+			records = EnumerableDictionary<String, PipelineRecord>();
+			levels = EnumerableDictionary<String, LevelRecords>();
+		}
+	}
+
+	void PipelineManifest::SaveToFile(const String & fileName)
+	{
+		// records no longer used by any level are not saved
+		EnumerableDictionary<String, int> recordIndices;
+		for (auto & level : levels)
+			for (auto & used : level.Value.LastUsedSessions)
+				if (!recordIndices.ContainsKey(used.Key))
+					recordIndices[used.Key] = recordIndices.Count();
+		BinaryWriter writer(new FileStream(fileName, FileMode::Create));
+		writer.Write(String(PipelineManifestIdentifier));
+		writer.Write(PipelineManifestVersion);
+		writer.Write(recordIndices.Count());
+		for (auto & entry : recordIndices)
+			WritePipelineRecord(writer, *records.TryGetValue(entry.Key));
+		writer.Write(levels.Count());
+		for (auto & level : levels)
+		{
+			writer.Write(level.Key);
+			writer.Write(level.Value.SessionCount);
+			writer.Write(level.Value.LastUsedSessions.Count());
+			for (auto & used : level.Value.LastUsedSessions)
+			{
+				writer.Write(*recordIndices.TryGetValue(used.Key));
+				writer.Write(used.Value);
+			}
+		}
+		writer.Close();
+		modified = false;
+	}
+
+	void PipelineManifest::SetLevel(const String & levelName)
+	{
+		if (!levels.ContainsKey(levelName))
+			levels[levelName] = LevelRecords();
+		currentLevel = levels.TryGetValue(levelName);
+		currentLevel->SessionCount++;
+		levelVersion++;
+		modified = true;
+		List<String> unusedKeys;
+		for (auto & used : currentLevel->LastUsedSessions)
+		{
+			if (currentLevel->SessionCount - used.Value > MaxUnusedSessions)
+				unusedKeys.Add(used.Key);
+		}
+		for (auto & key : unusedKeys)
+			currentLevel->LastUsedSessions.Remove(key);
+	}
+
+	void PipelineManifest::Add(const PipelineRecord & record)
+	{
+		if (!currentLevel)
+			return;
+		auto key = record.GetKey();
+		if (!records.ContainsKey(key))
+			records[key] = record;
+		auto lastUsedSession = currentLevel->LastUsedSessions.TryGetValue(key);
+		if (!lastUsedSession || *lastUsedSession != currentLevel->SessionCount)
+		{
+			currentLevel->LastUsedSessions[key] = currentLevel->SessionCount;
+			modified = true;
+		}
+	}
+
+	void PipelineManifest::Remove(const PipelineRecord & record)
+	{
+		auto key = record.GetKey();
+		if (records.ContainsKey(key))
+		{
+			records.Remove(key);
+			for (auto & level : levels)
+				level.Value.LastUsedSessions.Remove(key);
+			modified = true;
+		}
+	}
+
+	List<PipelineRecord> PipelineManifest::GetRecords()
+	{
+		List<PipelineRecord> result;
+		if (!currentLevel)
+			return result;
+		for (auto & used : currentLevel->LastUsedSessions)
+		{
+			if (auto record = records.TryGetValue(used.Key))
+				result.Add(*record);
+		}
+		return result;
+	}
+
 	VertexFormat PipelineContext::LoadVertexFormat(MeshVertexFormat vertFormat)
 	{
 		VertexFormat rs;
@@ -59,12 +243,7 @@ namespace GameEngine
 		shaderKeyChanged = false;
 		lastVtxId = vtxId;
         lastPrimType = primType;
-		shaderKeyBuilder.Clear();
-		shaderKeyBuilder.Append(fragmentShaderEntryPoint->Id);
-		shaderKeyBuilder.FlipLeadingByte(vtxId);
-		for (int i = 0; i < modulePtr; i++)
-			shaderKeyBuilder.Append(modules[i]->ModuleId);
-        shaderKeyBuilder.Append((unsigned int)primType);
+		BuildShaderKey(vtxId, primType);
 		/*
 		if (shaderKeyBuilder.Key == lastKey)
 		{
@@ -74,46 +253,110 @@ namespace GameEngine
 		{
 			//lastKey = shaderKeyBuilder.Key;
 			lastPipeline = pipeline->Ptr();
-			return pipeline->Ptr();
+			if (manifest && lastPipeline->recordedLevelVersion != manifest->GetLevelVersion())
+				RecordPipelineUse(lastPipeline);
+			return lastPipeline;
 		}
 		//lastKey = shaderKeyBuilder.Key;
-		lastPipeline = CreatePipeline(vertFormat, primType);
+		RefPtr<ShaderCompilationRequest> compilation;
+		if (!pendingCompilations.TryGetValue(shaderKeyBuilder.Key, compilation))
+		{
+			compilation = CompileShaders(vertFormat);
+			if (!asyncShaderCompilation)
+				Engine::GetShaderCompiler()->WaitForCompilation(compilation.Ptr());
+		}
+		if (!compilation->Completed)
+		{
+			pendingCompilations[shaderKeyBuilder.Key] = compilation;
+			// look the pipeline up again on the next call
+			shaderKeyChanged = true;
+			lastPipeline = nullptr;
+			return nullptr;
+		}
+		pendingCompilations.Remove(shaderKeyBuilder.Key);
+		if (!compilation->Succeeded)
+			Print("Error compiling shader.\n%s\n", compilation->Result.Diagnostics.Buffer());
+		lastPipeline = CreatePipeline(vertFormat, primType, compilation->Result);
+		if (manifest)
+			RecordPipelineUse(lastPipeline);
 		return lastPipeline;
 	}
 
-	PipelineClass * PipelineContext::CreatePipeline(MeshVertexFormat * vertFormat, PrimitiveType primType)
+	void PipelineContext::RecordPipelineUse(PipelineClass * pipeline)
 	{
-		RefPtr<PipelineBuilder> pipelineBuilder = hwRenderer->CreatePipelineBuilder();
+		if (warmingUp)
+			return;
+		manifest->Add(pipeline->record);
+		pipeline->recordedLevelVersion = manifest->GetLevelVersion();
+	}
 
-		pipelineBuilder->FixedFunctionStates = fixedFunctionStates;
-        pipelineBuilder->FixedFunctionStates.PrimitiveTopology = primType;
+	bool PipelineContext::WarmUpPipeline(const PipelineRecord & record, bool & pending)
+	{
+		pending = false;
+		const int maxModules = sizeof(modules) / sizeof(ModuleInstance*);
+		int moduleCount = record.ModuleFiles.Count();
+		if (moduleCount > maxModules)
+			return false;
+		ModuleInstance recordModules[maxModules];
+		for (int i = 0; i < moduleCount; i++)
+		{
+			auto typeSymbol = Engine::GetShaderCompiler()->LoadTypeSymbol(record.ModuleFiles[i], record.ModuleTypes[i]);
+			if (!typeSymbol)
+				return false;
+			recordModules[i].Init(typeSymbol);
+		}
+		modulePtr = 0;
+		for (int i = 0; i < moduleCount; i++)
+			PushModuleInstance(&recordModules[i]);
+		SetCullMode(record.Culling);
+		MeshVertexFormat vertexFormat(record.VertexFormat);
+		warmingUp = true;
+		pending = GetPipeline(&vertexFormat, record.PrimType) == nullptr;
+		warmingUp = false;
+		// the modules of the record go out of scope
+		for (int i = 0; i < moduleCount; i++)
+			modules[i] = nullptr;
+		modulePtr = 0;
+		shaderKeyChanged = true;
+		return true;
+	}
 
-		// Set vertex layout
-		pipelineBuilder->SetVertexLayout(LoadVertexFormat(*vertFormat));
+	void PipelineContext::WaitForPendingCompilations()
+	{
+		for (auto & compilation : pendingCompilations)
+			Engine::GetShaderCompiler()->WaitForCompilation(compilation.Value.Ptr());
+	}
 
-		// Compile shaders
+	RefPtr<ShaderCompilationRequest> PipelineContext::CompileShaders(MeshVertexFormat * vertFormat)
+	{
         ShaderCompilationEnvironment env;
         for (int i = 0; i < modulePtr; i++)
         {
             env.SpecializationTypes.Add(modules[i]->typeSymbol);
         }
         env.SpecializationTypes.Add(vertFormat->GetTypeSymbol());
-        struct CompilationTask
-        {
-            ShaderEntryPoint * entryPoint;
-            ShaderType shaderType;
-        };
-        RefPtr<PipelineClass> pipelineClass = new PipelineClass();
-        static int pipelineClassId = 0;
-        pipelineClassId++;
-        pipelineClass->Id = pipelineClassId;
         Array<ShaderEntryPoint*, 2> entryPoints;
         entryPoints.SetSize(2);
         entryPoints[0] = vertexShaderEntryPoint;
         entryPoints[1] = fragmentShaderEntryPoint;
+        return Engine::GetShaderCompiler()->CompileShaderAsync(entryPoints.GetArrayView(), &env);
+	}
+
+	PipelineClass * PipelineContext::CreatePipeline(MeshVertexFormat * vertFormat, PrimitiveType primType, ShaderCompilationResult & compileRs)
+	{
+		RefPtr<PipelineBuilder> pipelineBuilder = hwRenderer->CreatePipelineBuilder();
+
+		pipelineBuilder->FixedFunctionStates = fixedFunctionStates;
+        pipelineBuilder->FixedFunctionStates.PrimitiveTopology = primType;
+
+		// Set vertex layout
+		pipelineBuilder->SetVertexLayout(LoadVertexFormat(*vertFormat));
+
+        RefPtr<PipelineClass> pipelineClass = new PipelineClass();
+        static int pipelineClassId = 0;
+        pipelineClassId++;
+        pipelineClass->Id = pipelineClassId;
 		List<RefPtr<DescriptorSetLayout>> descSetLayouts;
-        ShaderCompilationResult compileRs;
-        Engine::GetShaderCompiler()->CompileShader(compileRs, entryPoints.GetArrayView(), &env);
         auto vsObj = hwRenderer->CreateShader(ShaderType::VertexShader, compileRs.ShaderCode[0].Buffer(), compileRs.ShaderCode[0].Count());
         auto fsObj = hwRenderer->CreateShader(ShaderType::FragmentShader, compileRs.ShaderCode[1].Buffer(), compileRs.ShaderCode[1].Count());
         pipelineClass->shaders.Add(vsObj);
@@ -135,6 +378,17 @@ namespace GameEngine
 		pipelineBuilder->SetBindingLayout(From(descSetLayouts).Select([](auto x) {return x.Ptr(); }).ToList().GetArrayView());
 		pipelineClass->pipeline = pipelineBuilder->ToPipeline(renderTargetLayout);
 		pipelineObjects[shaderKeyBuilder.Key] = pipelineClass;
+		auto & record = pipelineClass->record;
+		record.FragmentShaderFile = fragmentShaderEntryPoint->FileName;
+		record.FragmentShaderFunction = fragmentShaderEntryPoint->FunctionName;
+		for (int i = 0; i < modulePtr; i++)
+		{
+			record.ModuleFiles.Add(modules[i]->typeSymbol->FileName);
+			record.ModuleTypes.Add(modules[i]->typeSymbol->TypeName);
+		}
+		record.VertexFormat = vertFormat->GetTypeId();
+		record.PrimType = primType;
+		record.Culling = fixedFunctionStates.cullMode;
 		return pipelineClass.Ptr();
 	}
 
@@ -153,6 +407,18 @@ namespace GameEngine
 		}
 	}
 
+	DescriptorSet * ModuleInstance::SwitchToNextVersion()
+	{
+		int nextDescriptor = (currentDescriptor + 1) % DynamicBufferLengthMultiplier;
+		if (BufferLength && UniformMemory)
+		{
+			auto buffer = (unsigned char*)UniformMemory->BufferPtr() + BufferOffset;
+			UniformMemory->SetDataAsync(BufferOffset + nextDescriptor * BufferLength, buffer + currentDescriptor * BufferLength, BufferLength);
+		}
+		currentDescriptor = nextDescriptor;
+		return descriptors[currentDescriptor].Ptr();
+	}
+
 	//IMPL_POOL_ALLOCATOR(ModuleInstance, MaxModuleInstances)
 
 	ModuleInstance::~ModuleInstance()
@@ -92,6 +92,9 @@ namespace GameEngine
 		{
 			return currentDescriptor;
 		}
+		// makes the next version of the descriptor set and uniform data current, copying the uniform data of
+		// the current version. Returns the descriptor set of the new version.
+		DescriptorSet * SwitchToNextVersion();
 		operator bool()
 		{
 			return typeSymbol != nullptr;
@@ -100,6 +103,18 @@ namespace GameEngine
 
 	using DescriptorSetBindingArray = CoreLib::Array<DescriptorSet*, 32>;
 
+	// A pipeline created by a PipelineContext, described by names that stay the same across sessions, so that it can
+	// be created again ahead of its first use. The modules are listed in the order they were pushed.
+	struct PipelineRecord
+	{
+		CoreLib::String FragmentShaderFile, FragmentShaderFunction;
+		CoreLib::List<CoreLib::String> ModuleFiles, ModuleTypes;
+		int VertexFormat = 0;
+		PrimitiveType PrimType = PrimitiveType::Triangles;
+		CullMode Culling = CullMode::CullBackFace;
+		CoreLib::String GetKey() const;
+	};
+
 	class PipelineClass
 	{
 	public:
@@ -107,10 +122,55 @@ namespace GameEngine
 		CoreLib::List<CoreLib::RefPtr<Shader>> shaders;
 		CoreLib::RefPtr<Pipeline> pipeline;
 		CoreLib::List<CoreLib::RefPtr<DescriptorSetLayout>> descriptorSetLayouts;
+		// the record of the pipeline, and the level version of the manifest it was last recorded for
+		PipelineRecord record;
+		int recordedLevelVersion = -1;
 	};
 
 	class RenderStat;
 
+	// The pipelines used by each level of a game, kept in a file from one session to the next. Every load of a level
+	// starts a new session of that level, and the records it has not used for MaxUnusedSessions of its sessions are
+	// dropped, so that the manifest follows the content of the level instead of growing forever.
+	class PipelineManifest
+	{
+	public:
+		static const int MaxUnusedSessions = 8;
+	private:
+		struct LevelRecords
+		{
+			int SessionCount = 0;
+			// record key -> the session of the level that last used the record
+			CoreLib::EnumerableDictionary<CoreLib::String, int> LastUsedSessions;
+		};
+		CoreLib::EnumerableDictionary<CoreLib::String, PipelineRecord> records;
+		CoreLib::EnumerableDictionary<CoreLib::String, LevelRecords> levels;
+		LevelRecords * currentLevel = nullptr;
+		int levelVersion = 0;
+		bool modified = false;
+	public:
+		// ignores the file if it is missing or unreadable
+		void LoadFromFile(const CoreLib::String & fileName);
+		void SaveToFile(const CoreLib::String & fileName);
+		// starts a session of a level, records are added to and returned for this level from now on
+		void SetLevel(const CoreLib::String & levelName);
+		// changes every time SetLevel is called
+		int GetLevelVersion()
+		{
+			return levelVersion;
+		}
+		// marks the record as used by the current session of the current level
+		void Add(const PipelineRecord & record);
+		// drops the record from all levels
+		void Remove(const PipelineRecord & record);
+		bool IsModified()
+		{
+			return modified;
+		}
+		// the records of the current level
+		CoreLib::List<PipelineRecord> GetRecords();
+	};
+
 	class PipelineContext
 	{
 	private:
@@ -125,12 +185,20 @@ namespace GameEngine
 		PipelineClass * lastPipeline = nullptr;
 		FixedFunctionPipelineStates fixedFunctionStates;
 		CoreLib::EnumerableDictionary<ShaderKey, CoreLib::RefPtr<PipelineClass>> pipelineObjects;
+		// shaders being compiled for pipelines that are not created yet
+		CoreLib::EnumerableDictionary<ShaderKey, CoreLib::RefPtr<ShaderCompilationRequest>> pendingCompilations;
+		bool asyncShaderCompilation = false;
+		PipelineManifest * manifest = nullptr;
+		// pipelines created while warming up are recorded when they are first drawn
+		bool warmingUp = false;
 		ShaderKeyBuilder shaderKeyBuilder;
 		HardwareRenderer * hwRenderer;
 		RenderStat * renderStats = nullptr;
 		CoreLib::Dictionary<int, VertexFormat> vertexFormats;
 		PipelineClass * GetPipelineInternal(MeshVertexFormat * vertFormat, int vtxId, PrimitiveType primType);
-		PipelineClass* CreatePipeline(MeshVertexFormat * vertFormat, PrimitiveType primType);
+		CoreLib::RefPtr<ShaderCompilationRequest> CompileShaders(MeshVertexFormat * vertFormat);
+		PipelineClass* CreatePipeline(MeshVertexFormat * vertFormat, PrimitiveType primType, ShaderCompilationResult & compileRs);
+		void RecordPipelineUse(PipelineClass * pipeline);
 	public:
 		PipelineContext() = default;
 		void Init(HardwareRenderer * hw, RenderStat * pRenderStats)
@@ -138,6 +206,29 @@ namespace GameEngine
 			hwRenderer = hw;
 			renderStats = pRenderStats;
 		}
+		// When enabled, GetPipeline returns null instead of blocking while the shaders of a pipeline are compiled
+		// on the worker threads of the shader compiler, and the pipeline is created by the first call after they
+		// are ready. Callers skip their draw meanwhile.
+		void SetAsyncShaderCompilation(bool enable)
+		{
+			asyncShaderCompilation = enable;
+		}
+		bool GetAsyncShaderCompilation()
+		{
+			return asyncShaderCompilation;
+		}
+		// records every pipeline drawn from now on into the manifest
+		void SetManifest(PipelineManifest * pManifest)
+		{
+			manifest = pManifest;
+		}
+		// Creates the pipeline of a record, binding the modules and states it was created with. The entry points,
+		// render target layout and fixed function states of its pass must be bound beforehand. Returns false if the
+		// record no longer matches the shaders. With asynchronous compilation, pending is set while the shaders of
+		// the pipeline are compiled, and the pipeline is created by a later call once they are ready.
+		bool WarmUpPipeline(const PipelineRecord & record, bool & pending);
+		// blocks until the shaders of all pipelines being compiled are ready
+		void WaitForPendingCompilations();
 		inline RenderStat * GetRenderStat() 
 		{
 			return renderStats;
@@ -185,6 +276,17 @@ namespace GameEngine
 				    bindings.Add(dset);
             }
 		}
+		// the key of the pipeline of the bound entry point and modules
+		ShaderKey BuildShaderKey(unsigned int vtxId, PrimitiveType primType)
+		{
+			shaderKeyBuilder.Clear();
+			shaderKeyBuilder.Append(fragmentShaderEntryPoint->Id);
+			shaderKeyBuilder.FlipLeadingByte(vtxId);
+			for (int i = 0; i < modulePtr; i++)
+				shaderKeyBuilder.Append(modules[i]->ModuleId);
+			shaderKeyBuilder.Append((unsigned int)primType);
+			return shaderKeyBuilder.Key;
+		}
 		inline PipelineClass* GetPipeline(MeshVertexFormat * vertFormat, PrimitiveType primType)
 		{
 			unsigned int vtxId = (unsigned int)vertFormat->GetTypeId();
@@ -193,6 +295,50 @@ namespace GameEngine
 			return GetPipelineInternal(vertFormat, vtxId, primType);
 		}
 	};
+
+	// The material module below the per-draw modules of a pipeline context while a fixed order draw list is
+	// recorded. The module on the stack and the module whose descriptor set is bound are tracked separately: a
+	// draw whose pipeline is still being compiled is skipped without binding its material, and the next draw
+	// must both look its pipeline up with its own module and bind its material again.
+	class MaterialModuleState
+	{
+	private:
+		PipelineContext * context;
+		ModuleInstance * current, * bound;
+	public:
+		// pushes the module of the first material, whose descriptor set the caller binds
+		MaterialModuleState(PipelineContext & pContext, ModuleInstance * module, CullMode cullMode)
+			: context(&pContext), current(module), bound(module)
+		{
+			context->SetCullMode(cullMode);
+			context->PushModuleInstance(module);
+		}
+		// puts the module of the next draw on the stack, returns true if its descriptor set must be bound
+		bool Select(ModuleInstance * module, CullMode cullMode)
+		{
+			if (module != current)
+			{
+				context->PopModuleInstance();
+				context->PushModuleInstance(module);
+				context->SetCullMode(cullMode);
+				current = module;
+			}
+			return module != bound;
+		}
+		// the draw of the selected module was recorded along with its descriptor set
+		void SetBound()
+		{
+			bound = current;
+		}
+		ModuleInstance * GetBoundModule()
+		{
+			return bound;
+		}
+		void End()
+		{
+			context->PopModuleInstance();
+		}
+	};
 }
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "CoreLib/Basic.h"
 #include "CoreLib/Events.h"
 #include "CoreLib/Tokenizer.h"
+#include "CoreLib/Stream.h"
 #include "CoreLib/VectorMath.h"
 #include <type_traits>
 
@@ -40,6 +41,15 @@ namespace GameEngine
 	public:
 		virtual void ParseValue(CoreLib::Text::TokenReader & parser) = 0;
 		virtual void Serialize(CoreLib::StringBuilder & sb) = 0;
+		// compact form of the value used by binary levels, types without one are stored as text
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer)
+		{
+			writer.Write(GetStringValue());
+		}
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader)
+		{
+			SetStringValue(reader.ReadString());
+		}
 	public:
 		CoreLib::Event<> OnChanged;
 		CoreLib::String GetStringValue()
@@ -241,6 +251,17 @@ namespace GameEngine
 			OnChanging(newValue);
 			value = newValue;
 		}
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer) override
+		{
+			writer.Write(value);
+		}
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader) override
+		{
+			T newValue;
+			reader.Read(newValue);
+			OnChanging(newValue);
+			value = newValue;
+		}
 	public:
 		PUBLIC_METHODS(T)
 	};
@@ -284,6 +305,30 @@ namespace GameEngine
 			value = _Move(newValue);
 			OnChanged();
 		}
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer) override
+		{
+			writer.Write(value.Count());
+			for (auto & val : value)
+			{
+				GenericProperty<T> p;
+				p.WriteValue(val);
+				p.WriteBinary(writer);
+			}
+		}
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader) override
+		{
+			CoreLib::List<T> newValue;
+			int count = reader.ReadInt32();
+			for (int i = 0; i < count; i++)
+			{
+				GenericProperty<T> p;
+				p.ReadBinary(reader);
+				newValue.Add(p.GetValue());
+			}
+			OnChanging(newValue);
+			value = _Move(newValue);
+			OnChanged();
+		}
 	public:
 		PUBLIC_METHODS(CoreLib::List<T>)
 	};
@@ -307,6 +352,18 @@ namespace GameEngine
 		{\
 			type newValue = (type)parser.readerFunc();\
 			OnChanging(newValue); \
+            value = newValue;\
+			OnChanged();\
+		}\
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer) override\
+		{\
+			writer.Write(value);\
+		}\
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader) override\
+		{\
+			type newValue;\
+			reader.Read(newValue);\
+			OnChanging(newValue); \
             value = newValue;\
 			OnChanged();\
 		}\
@@ -339,6 +396,18 @@ namespace GameEngine
 			value = newValue;
 			OnChanged();
 		}
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer) override
+		{
+			writer.Write(value);
+		}
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader) override
+		{
+			bool newValue;
+			reader.Read(newValue);
+			OnChanging(newValue);
+			value = newValue;
+			OnChanged();
+		}
 	public:
 		PUBLIC_METHODS(bool)
 	};
@@ -369,6 +438,18 @@ namespace GameEngine
 				values(newValue, i) = parser.ReadFloat();\
 			parser.Read("]");\
 			OnChanging(newValue);\
+            value = newValue;\
+			OnChanged();\
+		}\
+		virtual void WriteBinary(CoreLib::IO::BinaryWriter & writer) override\
+		{\
+			writer.Write(value);\
+		}\
+		virtual void ReadBinary(CoreLib::IO::BinaryReader & reader) override\
+		{\
+			VectorMath::type newValue;\
+			reader.Read(newValue);\
+			OnChanging(newValue);\
             value = newValue;\
 			OnChanged();\
 		}\
@@ -0,0 +1,168 @@
+#include "RadianceCache.h"
+
+using namespace CoreLib;
+using namespace VectorMath;
+
+namespace GameEngine
+{
+    static const uint64_t EmptySlotKey = ~(uint64_t)0;
+
+    static int GetNormalBucket(Vec3 normal)
+    {
+        int axis = 0;
+        for (int i = 1; i < 3; i++)
+        {
+            if (fabs(normal[i]) > fabs(normal[axis]))
+                axis = i;
+        }
+        return axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+    }
+
+    static uint64_t HashKey(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDull;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    static uint64_t MakeKey(int normalBucket, const int coords[3])
+    {
+        // 20 bits per grid coordinate and 3 bits for the normal bucket
+        uint64_t key = (uint64_t)normalBucket;
+        for (int i = 0; i < 3; i++)
+            key = (key << 20) | (uint64_t)(coords[i] & 0xFFFFF);
+        return key;
+    }
+
+    uint64_t RadianceCache::GetKey(Vec3 position, Vec3 normal) const
+    {
+        int coords[3];
+        for (int i = 0; i < 3; i++)
+            coords[i] = (int)floorf(position[i] * invCellSize);
+        return MakeKey(GetNormalBucket(normal), coords);
+    }
+
+    int RadianceCache::FindSlot(uint64_t key) const
+    {
+        int slot = (int)(HashKey(key) & (uint64_t)tableMask);
+        while (slotKeys[slot] != key && slotKeys[slot] != EmptySlotKey)
+            slot = (slot + 1) & tableMask;
+        return slot;
+    }
+
+    void RadianceCache::Init(float cellSize, int expectedCellCount)
+    {
+        invCellSize = 1.0f / cellSize;
+        int tableSize = 1024;
+        while (tableSize < expectedCellCount * 2)
+            tableSize <<= 1;
+        tableMask = tableSize - 1;
+        slotKeys.SetSize(tableSize);
+        slotCells.SetSize(tableSize);
+        for (auto & key : slotKeys)
+            key = EmptySlotKey;
+        Cells.Clear();
+    }
+
+    void RadianceCache::AddSample(Vec3 position, Vec3 normal)
+    {
+        uint64_t key = GetKey(position, normal);
+        int slot = FindSlot(key);
+        if (slotKeys[slot] == EmptySlotKey)
+        {
+            // keep the load factor of the table below 1/2
+            if ((Cells.Count() + 1) * 2 > tableMask + 1)
+            {
+                List<uint64_t> oldKeys = _Move(slotKeys);
+                List<int> oldCells = _Move(slotCells);
+                int tableSize = (tableMask + 1) * 2;
+                tableMask = tableSize - 1;
+                slotKeys.SetSize(tableSize);
+                slotCells.SetSize(tableSize);
+                for (auto & k : slotKeys)
+                    k = EmptySlotKey;
+                for (int i = 0; i < oldKeys.Count(); i++)
+                {
+                    if (oldKeys[i] == EmptySlotKey)
+                        continue;
+                    int newSlot = FindSlot(oldKeys[i]);
+                    slotKeys[newSlot] = oldKeys[i];
+                    slotCells[newSlot] = oldCells[i];
+                }
+                slot = FindSlot(key);
+            }
+            slotKeys[slot] = key;
+            slotCells[slot] = Cells.Count();
+            RadianceCacheCell cell;
+            cell.Position.SetZero();
+            cell.Normal.SetZero();
+            cell.Irradiance.SetZero();
+            cell.SampleCount = 0;
+            Cells.Add(cell);
+        }
+        auto & cell = Cells[slotCells[slot]];
+        cell.Position += position;
+        cell.Normal += normal;
+        cell.SampleCount++;
+    }
+
+    void RadianceCache::Finalize()
+    {
+        for (auto & cell : Cells)
+        {
+            cell.Position *= 1.0f / cell.SampleCount;
+            float normalLength = cell.Normal.Length();
+            if (normalLength > 1e-6f)
+                cell.Normal *= 1.0f / normalLength;
+        }
+    }
+
+    int RadianceCache::FindCell(Vec3 position, Vec3 normal) const
+    {
+        if (Cells.Count() == 0)
+            return -1;
+        int slot = FindSlot(GetKey(position, normal));
+        return slotKeys[slot] == EmptySlotKey ? -1 : slotCells[slot];
+    }
+
+    bool RadianceCache::Interpolate(Vec3 position, Vec3 normal, int radius, Vec3 & irradiance) const
+    {
+        irradiance.SetZero();
+        if (Cells.Count() == 0)
+            return false;
+        int normalBucket = GetNormalBucket(normal);
+        int center[3];
+        for (int i = 0; i < 3; i++)
+            center[i] = (int)floorf(position[i] * invCellSize);
+        float cellSize = 1.0f / invCellSize;
+        float weightSum = 0.0f;
+        int coords[3];
+        for (int dz = -radius; dz <= radius; dz++)
+            for (int dy = -radius; dy <= radius; dy++)
+                for (int dx = -radius; dx <= radius; dx++)
+                {
+                    coords[0] = center[0] + dx;
+                    coords[1] = center[1] + dy;
+                    coords[2] = center[2] + dz;
+                    uint64_t key = MakeKey(normalBucket, coords);
+                    int slot = FindSlot(key);
+                    if (slotKeys[slot] == EmptySlotKey)
+                        continue;
+                    auto & cell = Cells[slotCells[slot]];
+                    float normalWeight = Vec3::Dot(cell.Normal, normal);
+                    if (normalWeight <= 0.0f)
+                        continue;
+                    float distance = (cell.Position - position).Length();
+                    float weight = normalWeight / (distance + cellSize * 0.1f);
+                    irradiance += cell.Irradiance * weight;
+                    weightSum += weight;
+                }
+        if (weightSum == 0.0f)
+            return false;
+        irradiance *= 1.0f / weightSum;
+        return true;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef GAME_ENGINE_RADIANCE_CACHE_H
+#define GAME_ENGINE_RADIANCE_CACHE_H
+
+#include "CoreLib/Basic.h"
+#include "CoreLib/VectorMath.h"
+
+namespace GameEngine
+{
+    struct RadianceCacheCell
+    {
+        // average position and normal of the surface samples that fall into the cell
+        VectorMath::Vec3 Position, Normal;
+        // indirect irradiance arriving at the cell, in the convention of the baker's indirect lightmaps
+        VectorMath::Vec3 Irradiance;
+        int SampleCount;
+    };
+
+    // World space irradiance cache stored in a hash table of voxels. A voxel is keyed by its grid coordinates and the
+    // dominant axis of the surface normal, so that the two sides of a thin wall or the faces of a corner never share a cell.
+    class RadianceCache
+    {
+    private:
+        float invCellSize = 0.0f;
+        int tableMask = 0;
+        CoreLib::List<uint64_t> slotKeys;
+        CoreLib::List<int> slotCells;
+        uint64_t GetKey(VectorMath::Vec3 position, VectorMath::Vec3 normal) const;
+        int FindSlot(uint64_t key) const;
+    public:
+        CoreLib::List<RadianceCacheCell> Cells;
+        // expectedCellCount is only a hint for the initial size of the hash table
+        void Init(float cellSize, int expectedCellCount);
+        // accumulates a surface sample into its cell, creating the cell if necessary. Call Finalize after adding all samples.
+        void AddSample(VectorMath::Vec3 position, VectorMath::Vec3 normal);
+        // turns the accumulated sums of AddSample into averages
+        void Finalize();
+        // returns the cell containing a surface point, or -1 if no sample fell into it. Safe to call concurrently.
+        int FindCell(VectorMath::Vec3 position, VectorMath::Vec3 normal) const;
+        // Averages the irradiance of the cells with the same normal bucket within radius voxels of a surface point,
+        // weighted by distance and normal agreement. Returns false if there are none. Safe to call concurrently.
+        bool Interpolate(VectorMath::Vec3 position, VectorMath::Vec3 normal, int radius, VectorMath::Vec3 & irradiance) const;
+        bool IsEmpty() const
+        {
+            return Cells.Count() == 0;
+        }
+    };
+}
+
+#endif
@@ -450,6 +450,7 @@ void RasterizeTriangle( TShader& Shader, const FVector2D Points[3], int32 Scisso
         tri.C0 = (abs(tri.A0) + abs(tri.B0)) * dilate;
         tri.C1 = (abs(tri.A1) + abs(tri.B1)) * dilate;
         tri.C2 = (abs(tri.A2) + abs(tri.B2)) * dilate;
+        tri.Dilate = dilate;
 
         int divisor = tri.B2*tri.A0 - tri.A2*tri.B0;
         if (divisor > 0)
@@ -6,6 +6,9 @@
 
 namespace GameEngine
 {
+    // distance in 1/16 pixels by which SetupTriangle moves the edges of a triangle outwards
+    const int DefaultTriangleDilate = 8;
+
     class ProjectedTriangle
     {
     public:
@@ -14,6 +17,7 @@ namespace GameEngine
         int X2, Y2;
         int A0, B0, A1, B1, A2, B2;
         int C0, C1, C2;
+        int Dilate;
     };
     // sets up the triangle based on three post-projection clip space coordinates.
     // it computes the edges equation and perform back-face culling. 
@@ -39,9 +43,38 @@ namespace GameEngine
     class Rasterizer
     {
     public:
-        static bool SetupTriangle(ProjectedTriangle & tri, VectorMath::Vec2 s0, VectorMath::Vec2 s1, VectorMath::Vec2 s2, int width, int height, int dilate = 8);
+        static bool SetupTriangle(ProjectedTriangle & tri, VectorMath::Vec2 s0, VectorMath::Vec2 s1, VectorMath::Vec2 s2, int width, int height, int dilate = DefaultTriangleDilate);
         static int CountOverlap(Canvas& canvas, ProjectedTriangle & tri);
         static void Rasterize(Canvas& canvas, ProjectedTriangle & tri);
+        // calls f(x, y) for every pixel whose center lies inside the (dilated) triangle.
+        // unlike Rasterize, coverage is tested per pixel rather than per 2x2 quad.
+        template<typename PixelFunc>
+        static void ForEachPixel(const ProjectedTriangle & tri, int width, int height, const PixelFunc & f)
+        {
+            // an edge moved by Dilate along both axes moves by up to sqrt(2) * Dilate along its normal
+            int dilate = tri.Dilate * 2;
+            int minX = CoreLib::Math::Max(0, (CoreLib::Math::Min(tri.X0, tri.X1, tri.X2) - dilate) >> 4);
+            int maxX = CoreLib::Math::Min(width - 1, (CoreLib::Math::Max(tri.X0, tri.X1, tri.X2) + dilate) >> 4);
+            int minY = CoreLib::Math::Max(0, (CoreLib::Math::Min(tri.Y0, tri.Y1, tri.Y2) - dilate) >> 4);
+            int maxY = CoreLib::Math::Min(height - 1, (CoreLib::Math::Max(tri.Y0, tri.Y1, tri.Y2) + dilate) >> 4);
+            for (int y = minY; y <= maxY; y++)
+            {
+                long long py = (y << 4) + 8;
+                long long px = (minX << 4) + 8;
+                // edge functions are evaluated in 64 bits since they overflow for large render targets
+                long long e0 = (long long)tri.A0 * (px - tri.X0) + (long long)tri.B0 * (py - tri.Y0) + tri.C0;
+                long long e1 = (long long)tri.A1 * (px - tri.X1) + (long long)tri.B1 * (py - tri.Y1) + tri.C1;
+                long long e2 = (long long)tri.A2 * (px - tri.X2) + (long long)tri.B2 * (py - tri.Y2) + tri.C2;
+                for (int x = minX; x <= maxX; x++)
+                {
+                    if ((e0 | e1 | e2) >= 0)
+                        f(x, y);
+                    e0 += tri.A0 * 16;
+                    e1 += tri.A1 * 16;
+                    e2 += tri.A2 * 16;
+                }
+            }
+        }
     };
 }
 
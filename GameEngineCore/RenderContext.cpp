@@ -33,6 +33,7 @@ namespace GameEngine
 
     void Drawable::UpdateMaterialUniform()
     {
+        scene->GetTextureStreamer()->UpdateMaterialBindings(material);
         if (material->ParameterDirty)
         {
             material->ParameterDirty = false;
@@ -43,7 +44,8 @@ namespace GameEngine
             {
                 if (moduleInstance.BufferLength)
                 {
-                    unsigned char * ptr0 = (unsigned char*)moduleInstance.UniformMemory->BufferPtr() + moduleInstance.BufferOffset;
+                    unsigned char * ptr0 = (unsigned char*)moduleInstance.UniformMemory->BufferPtr() + moduleInstance.BufferOffset +
+                        moduleInstance.GetCurrentVersion() * moduleInstance.BufferLength;
                     auto ptr = ptr0;
                     auto end = ptr + moduleInstance.BufferLength;
                     material->FillInstanceUniformBuffer([](const String&) {},
@@ -233,6 +235,9 @@ namespace GameEngine
 		case CoreLib::Graphics::TextureStorageFormat::BC5:
 			format = StorageFormat::BC5;
 			break;
+		case CoreLib::Graphics::TextureStorageFormat::BC7:
+			format = StorageFormat::RGBA_Compressed;
+			break;
 		default:
 			throw NotImplementedException("unsupported texture format.");
 		}
@@ -240,7 +245,8 @@ namespace GameEngine
 		auto hw = rendererResource->hardwareRenderer.Ptr();
 
 		GameEngine::Texture2D* rs;
-		if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB || format == StorageFormat::BC5 || format == StorageFormat::BC3)
+		if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB || format == StorageFormat::BC5 || format == StorageFormat::BC3 ||
+			format == StorageFormat::RGBA_Compressed)
 		{
 			Array<void*, 32> mipData;
 			for(int level = 0; level < data.GetMipLevels(); level++)
@@ -257,6 +263,8 @@ namespace GameEngine
 		RefPtr<Texture2D> value;
 		if (textures.TryGetValue(filename, value))
 			return value.Ptr();
+		if (auto streamedTexture = textureStreamer->FindTexture(filename))
+			return streamedTexture->GetTexture();
 
 		auto actualFilename = Engine::Instance()->FindFile(Path::ReplaceExt(filename, "texture"), ResourceType::Texture);
 		if (!actualFilename.Length())
@@ -265,24 +273,27 @@ namespace GameEngine
 		{
 			if (actualFilename.ToLower().EndsWith(".texture"))
 			{
+				if (auto streamedTexture = textureStreamer->LoadTexture(filename, actualFilename))
+					return streamedTexture->GetTexture();
 				CoreLib::Graphics::TextureFile file(actualFilename);
 				return LoadTexture2D(filename, file);
 			}
 			else
 			{
-				CoreLib::Imaging::Bitmap bmp(actualFilename);
-				List<unsigned int> pixelsInversed;
-                int *sourcePixels = (int *)bmp.GetPixels();
-                pixelsInversed.SetSize(bmp.GetWidth() * bmp.GetHeight());
-                for (int i = 0; i < bmp.GetHeight(); i++)
-                {
-                    for (int j = 0; j < bmp.GetWidth(); j++)
-                        pixelsInversed[i * bmp.GetWidth() + j] =
-                            sourcePixels[(bmp.GetHeight() - 1 - i) * bmp.GetWidth() + j];
-                }
+				// uncooked content, see AssetCooker.h. The fast encoding is not saved next to the image, where the
+				// cooker would ship it in place of a high quality encoding of the image.
+				MipGenerationOptions mipOptions;
+				try
+				{
+					mipOptions = GetImageMipOptions(actualFilename);
+				}
+				catch (const Exception &)
+				{
+					Print("invalid texture settings '%S'\n", GetImageMipSettingsFileName(actualFilename).ToWString());
+				}
+				mipOptions.Filter = MipFilter::Box;
 				CoreLib::Graphics::TextureFile texFile;
-				TextureCompressor::CompressRGBA_BC1(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight());
-				texFile.SaveToFile(Path::ReplaceExt(actualFilename, "texture"));
+				TextureCompressor::CompressImageFile_BC1(texFile, actualFilename, TextureCompressionQuality::Fast, mipOptions);
 				return LoadTexture2D(filename, texFile);
 			}
 		}
@@ -339,6 +350,10 @@ namespace GameEngine
 			if (isValid)
 			{
 				CreateModuleInstance(result, module, &instanceUniformMemory);
+				// a material registered again, e.g. with the default material after its own failed, replaces the
+				// bindings of its previous module
+				material->StreamedTextures = MaterialTextureBindings();
+				material->PatternVariables.Clear();
 				if (result)
 				{
 					// update all versions of descriptor set with material texture binding
@@ -355,6 +370,16 @@ namespace GameEngine
                                     auto tex = LoadTexture(val.StringValue);
                                     if (tex)
                                         descSet->Update(binding.Value, tex, TextureAspect::Color);
+                                    // streamed textures are rebound when their resident mip levels change
+                                    auto streamedTexture = textureStreamer->FindTexture(val.StringValue);
+                                    if (i == 0 && streamedTexture)
+                                    {
+                                        MaterialTextureBindings::Binding streamedBinding;
+                                        streamedBinding.Location = binding.Value;
+                                        streamedBinding.Texture = streamedTexture;
+                                        streamedBinding.BoundVersion = streamedTexture->GetVersion();
+                                        material->StreamedTextures.Bindings.Add(streamedBinding);
+                                    }
                                 }
                                 else
                                 {
@@ -399,6 +424,7 @@ namespace GameEngine
 		hardwareRenderer = hwRenderer;
 		instanceUniformMemory.Init(hwRenderer, BufferUsage::UniformBuffer, false, 24, hwRenderer->UniformBufferAlignment(), nullptr);
 		transformMemory.Init(hwRenderer, BufferUsage::UniformBuffer, false, 25, hwRenderer->UniformBufferAlignment(), nullptr);
+		textureStreamer = new TextureStreamer(hwRenderer);
 		Clear();
 	}
 	
@@ -407,6 +433,7 @@ namespace GameEngine
 		Destroy();
 		meshes = CoreLib::EnumerableDictionary<CoreLib::String, RefPtr<DrawableMesh>>();
 		textures = EnumerableDictionary<String, RefPtr<Texture2D>>();
+		textureStreamer->Clear();
         deviceLightmapSet = nullptr;
 	}
 
@@ -633,6 +660,7 @@ namespace GameEngine
 		shadowMapResources.Init(hardwareRenderer.Ptr());
         		
 		pipelineManager.Init(hardwareRenderer.Ptr(), &renderStats);
+		pipelineManager.SetAsyncShaderCompilation(Engine::Instance()->GetGraphicsSettings().AsyncShaderCompilation);
 
 		indexBufferMemory.Init(hardwareRenderer.Ptr(), BufferUsage::IndexBuffer, false, 26, 256, nullptr);
 		vertexBufferMemory.Init(hardwareRenderer.Ptr(), BufferUsage::ArrayBuffer, false, 28, 256, nullptr);
@@ -760,10 +788,10 @@ namespace GameEngine
 		if (drawables.Count())
 		{
 			Material* lastMaterial = drawables[0]->GetMaterial();
-			pipelineManager.SetCullMode(lastMaterial->IsDoubleSided ? CullMode::Disabled : CullMode::CullBackFace);
+			MaterialModuleState materialModule(pipelineManager, &lastMaterial->MaterialModule,
+				lastMaterial->IsDoubleSided ? CullMode::Disabled : CullMode::CullBackFace);
 
 			cmdBuf->BindIndexBuffer(drawables[0]->GetMesh()->GetIndexBuffer(), 0);
-			pipelineManager.PushModuleInstance(&lastMaterial->MaterialModule);
 			numMaterials++;
 			BindDescSet(boundSets.Buffer(), cmdBuf, bindings.Count(), lastMaterial->MaterialModule.GetCurrentDescriptorSet());
 			for (auto obj : drawables)
@@ -787,13 +815,10 @@ namespace GameEngine
 					lastMesh = nullptr;
 				}
 				auto newMaterial = obj->GetMaterial();
-				if (newMaterial != lastMaterial)
-				{
-					numMaterials++;
-					pipelineManager.PopModuleInstance();
-					pipelineManager.PushModuleInstance(&newMaterial->MaterialModule);
-					pipelineManager.SetCullMode(newMaterial->IsDoubleSided ? CullMode::Disabled : CullMode::CullBackFace);
-				}
+				// a draw skipped while its pipeline is compiling leaves lastMaterial bound, so the material module
+				// on the stack and the bound material are tracked separately
+				bool materialChanged = materialModule.Select(&newMaterial->MaterialModule,
+					newMaterial->IsDoubleSided ? CullMode::Disabled : CullMode::CullBackFace);
 				pipelineManager.PushModuleInstanceNoShaderChange(obj->GetTransformModule());
 				if (auto pipelineInst = obj->GetPipeline(renderPassId, pipelineManager))
 				{
@@ -804,9 +829,12 @@ namespace GameEngine
 						numShaders++;
 					}
 					auto mesh = obj->GetMesh();
-					if (newMaterial != lastMaterial)
+					if (materialChanged)
 					{
+						numMaterials++;
 						BindDescSet(boundSets.Buffer(), cmdBuf, bindings.Count(), newMaterial->MaterialModule.GetCurrentDescriptorSet());
+						materialModule.SetBound();
+						lastMaterial = newMaterial;
 					}
                     int descOffset = newMaterial->MaterialModule.GetCurrentDescriptorSet() ? 1 : 0;
 					BindDescSet(boundSets.Buffer(), cmdBuf, bindings.Count() + descOffset, obj->GetTransformModule()->GetCurrentDescriptorSet());
@@ -819,12 +847,9 @@ namespace GameEngine
 					auto range = obj->GetElementRange();
 					cmdBuf->DrawIndexed(mesh->indexBufferOffset / sizeof(int) + range.StartIndex, range.Count);
 				}
-				else
-					throw "error";
-				lastMaterial = newMaterial;
 				pipelineManager.PopModuleInstance();
 			}
-			pipelineManager.PopModuleInstance();
+			materialModule.End();
 		}
 		cmdBuf->EndRecording();
 	}
@@ -850,7 +875,8 @@ namespace GameEngine
 				lastMaterial = newMaterial;
 			}
 			pipelineManager.PushModuleInstanceNoShaderChange(obj->GetTransformModule());
-			obj->ReorderKey = (obj->GetPipeline(renderPassId, pipelineManager)->Id << 18) + newMaterial->Id;
+			auto pipeline = obj->GetPipeline(renderPassId, pipelineManager);
+			obj->ReorderKey = ((pipeline ? pipeline->Id : 0) << 18) + newMaterial->Id;
 			pipelineManager.PopModuleInstance();
 
 			reorderBuffer.Add(obj);
@@ -18,6 +18,7 @@
 #include "Renderer.h"
 #include "CoreLib/PerformanceCounter.h"
 #include "DeviceLightmapSet.h"
+#include "TextureStreaming.h"
 
 namespace GameEngine
 {
@@ -178,6 +179,7 @@ namespace GameEngine
 		RendererSharedResource * rendererResource;
 		CoreLib::EnumerableDictionary<CoreLib::String, CoreLib::RefPtr<DrawableMesh>> meshes;
 		CoreLib::EnumerableDictionary<CoreLib::String, CoreLib::RefPtr<Texture2D>> textures;
+		CoreLib::RefPtr<TextureStreamer> textureStreamer;
 		void CreateMaterialModuleInstance(ModuleInstance & mInst, Material* material, const char * moduleName);
 	public:
 		CoreLib::RefPtr<DrawableMesh> LoadDrawableMesh(Mesh * mesh);
@@ -189,6 +191,10 @@ namespace GameEngine
         CoreLib::RefPtr<DeviceLightmapSet> deviceLightmapSet;
 		DeviceMemory instanceUniformMemory, transformMemory;
 		void RegisterMaterial(Material * material);
+		TextureStreamer * GetTextureStreamer()
+		{
+			return textureStreamer.Ptr();
+		}
 		
 	public:
 		SceneResource(RendererSharedResource * resource);
@@ -111,7 +111,10 @@ namespace GameEngine
 		IRenderProcedure* currentRenderProcedure = nullptr;
         IRenderProcedure* lightProbeRenderProcedure = nullptr;
 		EnumerableDictionary<uint32_t, int> worldRenderPassIds;
-		List<RefPtr<WorldRenderPass>> worldRenderPasses;
+		// the first pass registered for each shader, indexed by pass id. The passes are owned by the render procedures.
+		List<WorldRenderPass*> worldRenderPasses;
+		PipelineManifest pipelineManifest;
+		String pipelineManifestFileName;
 		List<RefPtr<PostRenderPass>> postRenderPasses;
         List<String> renderProcedureNames;
         Dictionary<String, RefPtr<IRenderProcedure>> renderProcedures;
@@ -130,6 +133,42 @@ namespace GameEngine
                 currentRenderProcedure = proc;
             proc->Init(this, viewRes);
         }
+		// Creates the pipelines recorded in earlier sessions, so that they are not created when first drawn. Their
+		// shaders are compiled in parallel on the worker threads of the shader compiler, the pipelines are then created
+		// on this thread. Records that no longer match the passes or shaders are dropped from the manifest.
+		void WarmUpPipelines()
+		{
+			pipelineManifest.SetLevel(Path::GetFileName(level->FileName));
+			auto & pipelineManager = sharedRes.pipelineManager;
+			bool asyncShaderCompilation = pipelineManager.GetAsyncShaderCompilation();
+			pipelineManager.SetAsyncShaderCompilation(true);
+			auto bindPass = [&](const PipelineRecord & record)
+			{
+				int passId = -1;
+				auto entryPoint = Engine::GetShaderCompiler()->LoadShaderEntryPoint(record.FragmentShaderFile, record.FragmentShaderFunction);
+				if (!worldRenderPassIds.TryGetValue(entryPoint->Id, passId))
+					return false;
+				worldRenderPasses[passId]->Bind();
+				return true;
+			};
+			List<PipelineRecord> pendingRecords;
+			for (auto & record : pipelineManifest.GetRecords())
+			{
+				bool pending = false;
+				if (!bindPass(record) || !pipelineManager.WarmUpPipeline(record, pending))
+					pipelineManifest.Remove(record);
+				else if (pending)
+					pendingRecords.Add(record);
+			}
+			pipelineManager.WaitForPendingCompilations();
+			for (auto & record : pendingRecords)
+			{
+				bool pending = false;
+				bindPass(record);
+				pipelineManager.WarmUpPipeline(record, pending);
+			}
+			pipelineManager.SetAsyncShaderCompilation(asyncShaderCompilation);
+		}
 		void RunRenderProcedure()
 		{
 			if (!level) return;
@@ -174,6 +213,9 @@ namespace GameEngine
             computeTaskManager = new ComputeTaskManager(hardwareRenderer, Engine::GetShaderCompiler());
 
 			sharedRes.Init(hardwareRenderer);
+			pipelineManifestFileName = Path::Combine(Engine::Instance()->GetDirectory(false, ResourceType::ShaderCache), "pipelines.manifest");
+			pipelineManifest.LoadFromFile(pipelineManifestFileName);
+			sharedRes.pipelineManager.SetManifest(&pipelineManifest);
 
 			mainView = new ViewResource(hardwareRenderer);
 			mainView->Resize(1024, 1024);
@@ -197,6 +239,17 @@ namespace GameEngine
 		~RendererImpl()
 		{
 			Wait();
+			if (pipelineManifest.IsModified())
+			{
+				try
+				{
+					pipelineManifest.SaveToFile(pipelineManifestFileName);
+				}
+				catch (const IOException &)
+				{
+					Print("cannot write pipeline manifest '%s'.\n", pipelineManifestFileName.Buffer());
+				}
+			}
 			for (auto & postPass : postRenderPasses)
 				postPass = nullptr;
 
@@ -226,13 +279,15 @@ namespace GameEngine
             return computeTaskManager.Ptr();
         }
 
-		virtual int RegisterWorldRenderPass(uint32_t shaderId) override
+		virtual int RegisterWorldRenderPass(WorldRenderPass * pass) override
 		{
 			int passId;
+			uint32_t shaderId = pass->GetShaderId();
 			if (worldRenderPassIds.TryGetValue(shaderId, passId))
 				return passId;
 			int newId = worldRenderPassIds.Count();
 			worldRenderPassIds[shaderId] = newId;
+			worldRenderPasses.Add(pass);
 			return newId;
 		}
 
@@ -259,6 +314,9 @@ namespace GameEngine
 		virtual void UpdateLightProbes() override
 		{
 			if (!level) return;
+			// probes are rendered once, so they must not miss the drawables whose shaders are still compiling
+			bool asyncShaderCompilation = sharedRes.pipelineManager.GetAsyncShaderCompilation();
+			sharedRes.pipelineManager.SetAsyncShaderCompilation(false);
 			LightProbeRenderer lpRenderer(this, renderService.Ptr(), lightProbeRenderProcedure, cubemapRenderView.Ptr());
 			int lightProbeCount = 0;
 			for (auto & actor : level->Actors)
@@ -277,6 +335,7 @@ namespace GameEngine
 					defaultEnvMapId = sharedRes.AllocEnvMap();
 				lpRenderer.RenderLightProbe(sharedRes.envMapArray.Ptr(), defaultEnvMapId, level, Vec3::Create(0.0f, 1000.0f, 0.0f));
 			}
+			sharedRes.pipelineManager.SetAsyncShaderCompilation(asyncShaderCompilation);
 		}
         void TryLoadLightmap()
         {
@@ -315,6 +374,7 @@ namespace GameEngine
                 proc.Value->UpdateSharedResourceBinding();
                 proc.Value->UpdateSceneResourceBinding(sceneRes.Ptr());
             }
+			WarmUpPipelines();
 			UpdateLightProbes();
 			RunRenderProcedure();
 			RenderFrame();
@@ -343,6 +403,7 @@ namespace GameEngine
             sharedRes.renderStats.Divisor++;
 			sharedRes.renderStats.NumMaterials = 0;
 			sharedRes.renderStats.NumShaders = 0;
+            sceneRes->GetTextureStreamer()->Update();
             
             RunRenderProcedure();
 		}
@@ -22,7 +22,7 @@ namespace GameEngine
 	class Renderer : public CoreLib::Object
 	{
 	public:
-		virtual int RegisterWorldRenderPass(uint32_t shaderId) = 0;
+		virtual int RegisterWorldRenderPass(WorldRenderPass * pass) = 0;
 		virtual void UpdateLightProbes() = 0;
 		virtual void DestroyContext() = 0;
 		virtual void InitializeLevel(Level * level) = 0;
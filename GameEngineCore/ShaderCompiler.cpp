@@ -2,19 +2,49 @@
 #include "CoreLib/LibIO.h"
 #include "Engine.h"
 #include "ExternalLibs/Slang/slang.h"
-#include "CoreLib/Tokenizer.h"
+#include "CoreLib/Threading.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
 
 namespace GameEngine
 {
 	using namespace CoreLib;
 	using namespace CoreLib::IO;
+	using namespace CoreLib::Threading;
 
+    // Index of the shader cache, mapped into memory when the cache is loaded. The layout is
+    //   header | entries sorted by key hash | key strings
+    // The code and binding layout of each entry are kept in their own files named after ShaderIndex.
+    struct ShaderCacheIndexHeader
+    {
+        char Identifier[8] = { 'S', 'P', 'S', 'H', 'C', 0, 0, 0 };
+        int Version = 1;
+        int EntryCount = 0;
+    };
+
+    struct ShaderCacheIndexEntry
+    {
+        uint64_t KeyHash;
+        int KeyOffset;
+        int KeyLength;
+        int ShaderIndex;
+    };
+
+    // Compiled shaders, accessed from the worker threads of the compiler under a lock.
     class ShaderCache
     {
     private:
         String path;
         TargetShadingLanguage language;
-        EnumerableDictionary<String, int> shaderCodeIndex;
+        std::mutex mutex;
+        RefPtr<MemoryMappedFile> indexFile;
+        ShaderCacheIndexEntry * indexEntries = nullptr;
+        int indexEntryCount = 0;
+        const char * indexKeys = nullptr;
+        // entries added since the index was loaded, entries whose files have gone missing map to -1
+        EnumerableDictionary<String, int> updatedEntries;
+        int nextShaderIndex = 0;
         EnumerableDictionary<int, RefPtr<List<char>>> codeRepo;
         EnumerableDictionary<int, List<DescriptorSetInfo>> bindingLayouts;
         IntSet updatedCodeIndices;
@@ -23,11 +53,11 @@ namespace GameEngine
             switch (language)
             {
             case TargetShadingLanguage::HLSL:
-                return Path::Combine(path, "index_hlsl.txt");
+                return Path::Combine(path, "index_hlsl.bin");
             case TargetShadingLanguage::SPIRV:
-                return Path::Combine(path, "index_spv.txt");
+                return Path::Combine(path, "index_spv.bin");
             default:
-                return Path::Combine(path, "index.txt");
+                return Path::Combine(path, "index.bin");
             }
         }
         String GetShaderCodeFileName(int shaderIndex)
@@ -102,29 +132,122 @@ namespace GameEngine
                 }
             }
         }
+        static uint64_t GetKeyHash(const char * key, int length)
+        {
+            // FNV-1a, the hashes are stored in the index and must not change between runs
+            uint64_t hash = 14695981039346656037ull;
+            for (int i = 0; i < length; i++)
+            {
+                hash ^= (uint64_t)(unsigned char)key[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+        void MapIndex(const String & fileName)
+        {
+            indexFile = new MemoryMappedFile(fileName);
+            auto buffer = indexFile->GetBuffer();
+            auto size = indexFile->GetSize();
+            ShaderCacheIndexHeader header, expectedHeader;
+            if (size < (Int64)sizeof(header))
+                throw IOException("'" + fileName + "' is not a shader cache index.");
+            memcpy(&header, buffer, sizeof(header));
+            if (memcmp(header.Identifier, expectedHeader.Identifier, sizeof(header.Identifier)) != 0 ||
+                header.Version != expectedHeader.Version)
+                throw IOException("'" + fileName + "' is not a shader cache index of this version.");
+            Int64 keysOffset = sizeof(header) + (Int64)header.EntryCount * (Int64)sizeof(ShaderCacheIndexEntry);
+            if (header.EntryCount < 0 || keysOffset > size)
+                throw IOException("'" + fileName + "' is corrupted.");
+            auto entries = (ShaderCacheIndexEntry*)(buffer + sizeof(header));
+            Int64 keysSize = size - keysOffset;
+            for (int i = 0; i < header.EntryCount; i++)
+            {
+                auto & entry = entries[i];
+                if (entry.KeyOffset < 0 || entry.KeyLength < 0 || (Int64)entry.KeyOffset + entry.KeyLength > keysSize ||
+                    entry.ShaderIndex < 0 || (i > 0 && entries[i - 1].KeyHash > entry.KeyHash))
+                    throw IOException("'" + fileName + "' is corrupted.");
+                nextShaderIndex = Math::Max(nextShaderIndex, entry.ShaderIndex + 1);
+            }
+            indexEntries = entries;
+            indexEntryCount = header.EntryCount;
+            indexKeys = (const char*)(buffer + keysOffset);
+        }
+        void UnmapIndex()
+        {
+            indexEntries = nullptr;
+            indexEntryCount = 0;
+            indexKeys = nullptr;
+            indexFile = nullptr;
+        }
+        int FindShaderIndex(const String & key)
+        {
+            if (auto shaderIndex = updatedEntries.TryGetValue(key))
+                return *shaderIndex;
+            auto hash = GetKeyHash(key.Buffer(), key.Length());
+            auto entry = std::lower_bound(indexEntries, indexEntries + indexEntryCount, hash, [](const ShaderCacheIndexEntry & e, uint64_t h)
+            {
+                return e.KeyHash < h;
+            });
+            for (; entry < indexEntries + indexEntryCount && entry->KeyHash == hash; entry++)
+            {
+                if (entry->KeyLength == key.Length() && memcmp(indexKeys + entry->KeyOffset, key.Buffer(), key.Length()) == 0)
+                    return entry->ShaderIndex;
+            }
+            return -1;
+        }
     public:
         void Load(String cachePath, TargetShadingLanguage lang)
         {
             language = lang;
             path = cachePath;
-            if (File::Exists(GetCacheIndexFileName()))
+            auto indexFileName = GetCacheIndexFileName();
+            if (File::Exists(indexFileName))
+            {
+                try
+                {
+                    MapIndex(indexFileName);
+                }
+                catch (const IOException &)
+                {
+                    Print("ignoring shader cache index '%s', all shaders will be recompiled.\n", indexFileName.Buffer());
+                    UnmapIndex();
+                    nextShaderIndex = 0;
+                }
+            }
+        }
+        // copies the layouts without sharing the (not thread safe) reference counts of their names
+        static void CopyBindingLayouts(List<DescriptorSetInfo> & dst, const List<DescriptorSetInfo> & src)
+        {
+            dst.Clear();
+            for (auto & set : src)
             {
-                CoreLib::Text::TokenReader reader(File::ReadAllText(GetCacheIndexFileName()));
-                while (!reader.IsEnd())
+                DescriptorSetInfo copy;
+                copy.BindingPoint = set.BindingPoint;
+                copy.Name = set.Name.Buffer();
+                for (auto & desc : set.Descriptors)
                 {
-                    auto key = reader.ReadStringLiteral();
-                    auto value = reader.ReadInt();
-                    shaderCodeIndex[key] = value;
+                    DescriptorLayout descCopy = desc;
+                    descCopy.Name = desc.Name.Buffer();
+                    copy.Descriptors.Add(descCopy);
                 }
+                dst.Add(_Move(copy));
             }
         }
-        void UpdateEntry(String key, List<char> & code, char* glslSrc, List<DescriptorSetInfo>& layouts)
+        // called from the compile threads. An entry that is already compiled is kept as it is, as the calling
+        // thread may be reading it, and nothing stored here shares a string with the caller.
+        void UpdateEntry(const String & key, const List<char> & code, char* glslSrc, const List<DescriptorSetInfo>& layouts)
         {
-            int value = shaderCodeIndex.Count();
-            shaderCodeIndex.TryGetValue(key, value);
-            shaderCodeIndex[key] = value;
+            std::lock_guard<std::mutex> lock(mutex);
+            int value = FindShaderIndex(key);
+            if (value != -1 && codeRepo.ContainsKey(value) && bindingLayouts.ContainsKey(value))
+                return;
+            if (value == -1)
+                value = nextShaderIndex++;
+            updatedEntries[String(key.Buffer())] = value;
             codeRepo[value] = new List<char>(code);
-            bindingLayouts[value] = layouts;
+            List<DescriptorSetInfo> layoutsCopy;
+            CopyBindingLayouts(layoutsCopy, layouts);
+            bindingLayouts[value] = _Move(layoutsCopy);
             updatedCodeIndices.Add(value);
             if (glslSrc)
             {
@@ -133,8 +256,9 @@ namespace GameEngine
         }
         bool TryGetEntry(String key, List<char> & code, List<DescriptorSetInfo>& layouts)
         {
-            int value = -1;
-            if (shaderCodeIndex.TryGetValue(key, value))
+            std::lock_guard<std::mutex> lock(mutex);
+            int value = FindShaderIndex(key);
+            if (value != -1)
             {
                 RefPtr<List<char>> srcCode;
                 if (!codeRepo.TryGetValue(value, srcCode))
@@ -149,11 +273,15 @@ namespace GameEngine
                     }
                     else
                     {
-                        shaderCodeIndex.Remove(key);
+                        updatedEntries[key] = -1;
                         return false;
                     }
                 }
-                if (!bindingLayouts.TryGetValue(value, layouts))
+                if (auto cachedLayouts = bindingLayouts.TryGetValue(value))
+                {
+                    CopyBindingLayouts(layouts, *cachedLayouts);
+                }
+                else
                 {
                     auto bindingFile = GetBindingLayoutFileName(value);
                     if (File::Exists(bindingFile))
@@ -162,7 +290,7 @@ namespace GameEngine
                     }
                     else
                     {
-                        shaderCodeIndex.Remove(key);
+                        updatedEntries[key] = -1;
                         return false;
                     }
                 }
@@ -173,6 +301,7 @@ namespace GameEngine
         }
         void Save()
         {
+            std::lock_guard<std::mutex> lock(mutex);
             for (auto & code : codeRepo)
             {
                 if (updatedCodeIndices.Contains(code.Key))
@@ -189,14 +318,75 @@ namespace GameEngine
                     WriteBindingLayout(fileName, binding.Value);
                 }
             }
-            StreamWriter writer(GetCacheIndexFileName());
-            for (auto & idx : shaderCodeIndex)
+            if (updatedEntries.Count() == 0)
+                return;
+            // merge the mapped index with the updated entries, then unmap it so that the file can be replaced
+            List<ShaderCacheIndexEntry> entries;
+            List<String> keys;
+            for (int i = 0; i < indexEntryCount; i++)
             {
-                writer << CoreLib::Text::EscapeStringLiteral(idx.Key) << " " << idx.Value << "\n";
+                String key(indexKeys + indexEntries[i].KeyOffset, indexEntries[i].KeyLength);
+                if (!updatedEntries.ContainsKey(key))
+                {
+                    entries.Add(indexEntries[i]);
+                    keys.Add(key);
+                }
             }
+            for (auto & entry : updatedEntries)
+            {
+                if (entry.Value == -1)
+                    continue;
+                ShaderCacheIndexEntry indexEntry;
+                indexEntry.KeyHash = GetKeyHash(entry.Key.Buffer(), entry.Key.Length());
+                indexEntry.ShaderIndex = entry.Value;
+                entries.Add(indexEntry);
+                keys.Add(entry.Key);
+            }
+            UnmapIndex();
+            List<int> order;
+            for (int i = 0; i < entries.Count(); i++)
+                order.Add(i);
+            std::stable_sort(order.begin(), order.end(), [&](int i0, int i1)
+            {
+                return entries[i0].KeyHash < entries[i1].KeyHash;
+            });
+            ShaderCacheIndexHeader header;
+            header.EntryCount = entries.Count();
+            BinaryWriter writer(new FileStream(GetCacheIndexFileName(), FileMode::Create));
+            writer.Write(header);
+            int keyOffset = 0;
+            for (auto i : order)
+            {
+                entries[i].KeyOffset = keyOffset;
+                entries[i].KeyLength = keys[i].Length();
+                keyOffset += keys[i].Length();
+                writer.Write(entries[i]);
+            }
+            for (auto i : order)
+                writer.Write(keys[i].Buffer(), keys[i].Length());
+            writer.Close();
         }
     };
 
+    // The entry points of a request that are not in the shader cache. Everything a worker thread reads is copied
+    // here when the request is queued, as the reference counts of strings are not thread safe.
+    class ShaderCompilationJob : public RefObject
+    {
+    public:
+        struct EntryPoint
+        {
+            // index of the entry point in the result of the request
+            int Index;
+            String Key, FileName, FilePath, FunctionName;
+            StageFlags Stage;
+        };
+        RefPtr<ShaderCompilationRequest> Request;
+        List<EntryPoint> EntryPoints;
+        List<String> SpecializationTypeNames, SpecializationModuleNames;
+        // resolved on the calling thread, the engine is not queried by the compile threads
+        int SlangTarget = 0;
+    };
+
     class SlangShaderCompiler : public IShaderCompiler
     {
     public:
@@ -204,18 +394,40 @@ namespace GameEngine
         EnumerableDictionary<String, SlangCompileRequest*> reflectionCompileRequests;
         EnumerableDictionary<String, RefPtr<ShaderEntryPoint>> shaderEntryPoints;
         EnumerableDictionary<String, RefPtr<ShaderTypeSymbol>> shaderTypeSymbols;
+        // session of the reflection requests, used on the calling thread only
         SlangSession *session = nullptr;
         StringBuilder sb;
         ShaderCache cache;
+        // resolved when the compiler is created, so that worker threads do not query the engine
+        List<String> searchPaths;
+        String shaderLibPath;
+        RefPtr<ThreadPool> compileThreads;
+        ThreadPool::TaskGroup compileTasks;
+        List<RefPtr<ShaderCompilationJob>> runningJobs;
+        // slang sessions are not thread safe, each job takes one of these for the duration of its compilation
+        std::mutex compileSessionMutex;
+        List<SlangSession*> compileSessions;
         SlangShaderCompiler()
         {
-            cache.Load(Engine::Instance()->GetDirectory(false, ResourceType::ShaderCache), Engine::Instance()->GetTargetShadingLanguage());
+            auto engine = Engine::Instance();
+            cache.Load(engine->GetDirectory(false, ResourceType::ShaderCache), engine->GetTargetShadingLanguage());
+            searchPaths.Add(engine->GetDirectory(true, ResourceType::Shader));
+            searchPaths.Add(engine->GetDirectory(false, ResourceType::Shader));
+            searchPaths.Add(engine->GetDirectory(true, ResourceType::Material));
+            searchPaths.Add(engine->GetDirectory(false, ResourceType::Material));
+            shaderLibPath = engine->FindFile("ShaderLib.slang", ResourceType::Shader);
+            // leave a processor to the thread that is rendering
+            compileThreads = new ThreadPool(Math::Max(1, ParallelSystemInfo::GetProcessorCount() - 1));
         }
         ~SlangShaderCompiler()
         {
+            compileThreads->Wait(compileTasks);
+            compileThreads = nullptr;
             cache.Save();
             for (auto cr : reflectionCompileRequests)
                 spDestroyCompileRequest(cr.Value);
+            for (auto compileSession : compileSessions)
+                spDestroySession(compileSession);
             if (session)
                 spDestroySession(session);
         }
@@ -288,174 +500,253 @@ namespace GameEngine
             }
             return false;
         }
-        virtual bool CompileShader(ShaderCompilationResult & src,
-            const CoreLib::ArrayView<ShaderEntryPoint*> entryPoints,
-            const ShaderCompilationEnvironment* env = nullptr) override
+        SlangSession * AcquireCompileSession()
         {
-            StringBuilder sbKey;
-            List<String> keys;
-            src.ShaderCode.SetSize(entryPoints.Count());
-            List<int> entryPointsToCompile;
-            for (int i = 0; i < entryPoints.Count(); i++)
             {
-                auto entryPoint = entryPoints[i];
-                sbKey.Clear();
-                sbKey << entryPoint->FileName << "|" << entryPoint->FunctionName;
-                if (env)
+                std::lock_guard<std::mutex> lock(compileSessionMutex);
+                if (compileSessions.Count())
                 {
-                    for (auto & t : env->SpecializationTypes)
-                    {
-                        sbKey << "|" << t->TypeName;
-                    }
-                }
-                keys.Add(sbKey.ToString());
-                List<char> code;
-                if (!cache.TryGetEntry(keys.Last(), src.ShaderCode[i], src.BindingLayouts))
-                {
-                    entryPointsToCompile.Add(i);
+                    auto compileSession = compileSessions.Last();
+                    compileSessions.RemoveAt(compileSessions.Count() - 1);
+                    return compileSession;
                 }
             }
-            if (entryPointsToCompile.Count())
+            return spCreateSession();
+        }
+        void ReleaseCompileSession(SlangSession * compileSession)
+        {
+            std::lock_guard<std::mutex> lock(compileSessionMutex);
+            compileSessions.Add(compileSession);
+        }
+        // compiles the entry points of a job in a single request, runs on a worker thread
+        bool CompileEntryPoints(SlangSession * compileSession, ShaderCompilationJob * job, ShaderCompilationResult & src)
+        {
+            StageFlags stageFlags = sfNone;
+            auto req = NewCompileRequest(compileSession, job->SlangTarget);
+            Dictionary<String, int> addedTUs;
+            for (auto & ep : job->EntryPoints)
             {
-                StageFlags stageFlags = sfNone;
-                auto req = NewCompileRequest();
-                Dictionary<String, int> addedTUs;
-                for (auto eid : entryPointsToCompile)
+                int unit = 0;
+                if (!addedTUs.TryGetValue(ep.FilePath, unit))
                 {
-                    auto ep = entryPoints[eid];
-                    int unit = 0;
-                    auto path = Engine::Instance()->FindFile(ep->FileName, ResourceType::Shader);
-                    if (path.Length() == 0)
-                        throw IOException(String("Shader file not found: ") + ep->FileName + String("\nDid you forget to specify '-enginedir'?"));
-                    if (!addedTUs.TryGetValue(path, unit))
-                    {
-                        unit = spAddTranslationUnit(req, SLANG_SOURCE_LANGUAGE_SLANG, ep->FileName.Buffer());
-                        spAddTranslationUnitSourceFile(req, unit, path.Buffer());
-                        addedTUs[path] = unit;
-                    }
-                    spAddEntryPoint(req, unit, ep->FunctionName.Buffer(), GetSlangStage(ep->Stage));
-                    stageFlags = StageFlags(stageFlags | ep->Stage);
+                    unit = spAddTranslationUnit(req, SLANG_SOURCE_LANGUAGE_SLANG, ep.FileName.Buffer());
+                    spAddTranslationUnitSourceFile(req, unit, ep.FilePath.Buffer());
+                    addedTUs[ep.FilePath] = unit;
                 }
-                if (env)
-                {
-                    for (int i = 0; i < env->SpecializationTypes.Count(); i++)
-                    {
-                        spAddPreprocessorDefine(req, (String("SPECIALIZATION_TYPE_") + i).Buffer(), env->SpecializationTypes[i]->TypeName.Buffer());
-                        spAddPreprocessorDefine(req, (String("IMPORT_MODULE_") + i).Buffer(), Path::GetFileNameWithoutEXT(env->SpecializationTypes[i]->FileName).Buffer());
-                    }
-                }
-                int anyErrors = spCompile(req);
-                if (anyErrors)
+                spAddEntryPoint(req, unit, ep.FunctionName.Buffer(), GetSlangStage(ep.Stage));
+                stageFlags = StageFlags(stageFlags | ep.Stage);
+            }
+            for (int i = 0; i < job->SpecializationTypeNames.Count(); i++)
+            {
+                spAddPreprocessorDefine(req, (String("SPECIALIZATION_TYPE_") + i).Buffer(), job->SpecializationTypeNames[i].Buffer());
+                spAddPreprocessorDefine(req, (String("IMPORT_MODULE_") + i).Buffer(), job->SpecializationModuleNames[i].Buffer());
+            }
+            int anyErrors = spCompile(req);
+            if (anyErrors)
+            {
+                src.Diagnostics = spGetDiagnosticOutput(req);
+                spDestroyCompileRequest(req);
+                return false;
+            }
+
+            List<char*> glslOutput;
+
+            for (int i = 0; i < job->EntryPoints.Count(); i++)
+            {
+                ISlangBlob* outBlob = nullptr;
+                spGetEntryPointCodeBlob(req, i, 0, &outBlob);
+                int size = (int)outBlob->getBufferSize();
+                auto & code = src.ShaderCode[job->EntryPoints[i].Index];
+                code.SetSize(size);
+                memcpy(code.Buffer(), outBlob->getBufferPointer(), size);
+                if (dumpShaderSource)
                 {
-                    const char *diagMsg = spGetDiagnosticOutput(req);
-                    Print("Error compiling shader.\n%s\n", diagMsg);
-                    spDestroyCompileRequest(req);
-                    src.Diagnostics = diagMsg;
-                    return false;
+                    spGetEntryPointCodeBlob(req, i, 1, &outBlob);
+                    glslOutput.Add((char*)outBlob->getBufferPointer());
                 }
-                
-                List<char*> glslOutput;
+            }
 
-                for (int i = 0; i < entryPointsToCompile.Count(); i++)
+            // extract reflection data
+            slang::ShaderReflection * reflection = slang::ShaderReflection::get(req);
+            int paramCount = (int)reflection->getParameterCount();
+            for (int i = 0; i < paramCount; i++)
+            {
+                auto param = reflection->getParameterByIndex(i);
+                auto paramName = param->getName();
+                if (param->getType()->getKind() == slang::TypeReflection::Kind::ParameterBlock)
                 {
-                    ISlangBlob* outBlob = nullptr;
-                    spGetEntryPointCodeBlob(req, i, 0, &outBlob);
-                    int size = (int)outBlob->getBufferSize();
-                    src.ShaderCode[entryPointsToCompile[i]].SetSize(size);
-                    memcpy(src.ShaderCode[entryPointsToCompile[i]].Buffer(), outBlob->getBufferPointer(), size);
-                    if (dumpShaderSource)
+                    auto layout = param->getTypeLayout();
+                    DescriptorSetInfo set;
+                    set.BindingPoint = src.BindingLayouts.Count();
+                    set.Name = paramName;
+                    auto resType = layout->getElementVarLayout()->getTypeLayout();
+                    bool hasUniform = resType->getSize(slang::Uniform) != 0;
+                    int slotOffset = hasUniform ? 1 : 0;
+                    if (hasUniform)
                     {
-                        spGetEntryPointCodeBlob(req, i, 1, &outBlob);
-                        glslOutput.Add((char*)outBlob->getBufferPointer());
+                        DescriptorLayout desc;
+                        desc.Location = 0;
+                        desc.Type = BindingType::UniformBuffer;
+                        desc.Stages = stageFlags;
+                        desc.Name = set.Name + "_uniforms";
+                        set.Descriptors.Add(desc);
+                        CORELIB_ASSERT(slotOffset != 0);
                     }
-                }
-
-
-                // extract reflection data
-                slang::ShaderReflection * reflection = slang::ShaderReflection::get(req);
-                int paramCount = (int)reflection->getParameterCount();
-                for (int i = 0; i < paramCount; i++)
-                {
-                    auto param = reflection->getParameterByIndex(i);
-                    auto paramName = param->getName();
-                    if (param->getType()->getKind() == slang::TypeReflection::Kind::ParameterBlock)
+                    for (auto f = 0u; f < resType->getFieldCount(); f++)
                     {
-                        auto layout = param->getTypeLayout();
-                        DescriptorSetInfo set;
-                        set.BindingPoint = src.BindingLayouts.Count();
-                        set.Name = paramName;
-                        auto resType = layout->getElementVarLayout()->getTypeLayout();
-                        bool hasUniform = resType->getSize(slang::Uniform) != 0;
-                        int slotOffset = hasUniform ? 1 : 0;
-                        if (hasUniform)
+                        auto field = resType->getFieldByIndex(f);
+                        if (field->getCategory() == slang::Uniform || field->getType()->getKind() == slang::TypeReflection::Kind::Struct)
                         {
-                            DescriptorLayout desc;
-                            desc.Location = 0;
-                            desc.Type = BindingType::UniformBuffer;
-                            desc.Stages = stageFlags;
-                            desc.Name = set.Name + "_uniforms";
-                            set.Descriptors.Add(desc);
-                            CORELIB_ASSERT(slotOffset != 0);
+                            continue;
                         }
-                        for (auto f = 0u; f < resType->getFieldCount(); f++)
+                        DescriptorLayout desc;
+                        desc.Location = field->getBindingIndex() + slotOffset;
+                        desc.Name = field->getName();
+                        if (field->getType()->getKind() == slang::TypeReflection::Kind::Array)
                         {
-                            auto field = resType->getFieldByIndex(f);
-                            if (field->getCategory() == slang::Uniform || field->getType()->getKind() == slang::TypeReflection::Kind::Struct)
-                            {
-                                continue;
-                            }
-                            DescriptorLayout desc;
-                            desc.Location = field->getBindingIndex() + slotOffset;
-                            desc.Name = field->getName();
-                            if (field->getType()->getKind() == slang::TypeReflection::Kind::Array)
-                            {
-                                desc.Type = SlangResourceKindToDescriptorType(field->getType()->getElementType()->getKind(), field->getType()->getResourceShape(), field->getType()->getResourceAccess());
-                                desc.ArraySize = (int)field->getType()->getElementCount();
-                            }
-                            else
-                            {
-                                desc.Type = SlangResourceKindToDescriptorType(field->getType()->getKind(), field->getType()->getResourceShape(), field->getType()->getResourceAccess());
-                            }
-                            desc.Stages = stageFlags;
-                            set.Descriptors.Add(desc);
+                            desc.Type = SlangResourceKindToDescriptorType(field->getType()->getElementType()->getKind(), field->getType()->getResourceShape(), field->getType()->getResourceAccess());
+                            desc.ArraySize = (int)field->getType()->getElementCount();
                         }
-                        src.BindingLayouts.Add(set);
+                        else
+                        {
+                            desc.Type = SlangResourceKindToDescriptorType(field->getType()->getKind(), field->getType()->getResourceShape(), field->getType()->getResourceAccess());
+                        }
+                        desc.Stages = stageFlags;
+                        set.Descriptors.Add(desc);
                     }
+                    src.BindingLayouts.Add(set);
                 }
+            }
 
-                for (int i = 0; i < entryPointsToCompile.Count(); i++)
+            for (int i = 0; i < job->EntryPoints.Count(); i++)
+            {
+                auto & ep = job->EntryPoints[i];
+                char* glsl = nullptr;
+                if (dumpShaderSource)
+                    glsl = glslOutput[i];
+                cache.UpdateEntry(ep.Key, src.ShaderCode[ep.Index], glsl, src.BindingLayouts);
+            }
+
+            spDestroyCompileRequest(req);
+            return true;
+        }
+        void RunCompilationJob(ShaderCompilationJob * job)
+        {
+            auto request = job->Request.Ptr();
+            auto compileSession = AcquireCompileSession();
+            try
+            {
+                request->Succeeded = CompileEntryPoints(compileSession, job, request->Result);
+            }
+            catch (const Exception & e)
+            {
+                request->Result.Diagnostics = e.Message;
+                request->Succeeded = false;
+            }
+            ReleaseCompileSession(compileSession);
+            // the job belongs to the calling thread again from here on
+            request->Completed = true;
+        }
+        virtual RefPtr<ShaderCompilationRequest> CompileShaderAsync(const CoreLib::ArrayView<ShaderEntryPoint*> entryPoints,
+            const ShaderCompilationEnvironment* env = nullptr) override
+        {
+            RefPtr<ShaderCompilationRequest> request = new ShaderCompilationRequest();
+            RefPtr<ShaderCompilationJob> job = new ShaderCompilationJob();
+            job->Request = request;
+            auto & src = request->Result;
+            job->SlangTarget = GetSlangTarget();
+            StringBuilder sbKey;
+            src.ShaderCode.SetSize(entryPoints.Count());
+            for (int i = 0; i < entryPoints.Count(); i++)
+            {
+                auto entryPoint = entryPoints[i];
+                sbKey.Clear();
+                sbKey << entryPoint->FileName << "|" << entryPoint->FunctionName;
+                if (env)
+                {
+                    for (auto & t : env->SpecializationTypes)
+                    {
+                        sbKey << "|" << t->TypeName;
+                    }
+                }
+                auto key = sbKey.ToString();
+                if (!cache.TryGetEntry(key, src.ShaderCode[i], src.BindingLayouts))
                 {
-                    auto eid = entryPointsToCompile[i];
-                    char* glsl = nullptr;
-                    if (dumpShaderSource)
-                        glsl = glslOutput[i];
-                    cache.UpdateEntry(keys[eid], src.ShaderCode[eid], glsl, src.BindingLayouts);
+                    ShaderCompilationJob::EntryPoint ep;
+                    ep.Index = i;
+                    ep.Key = key.Buffer();
+                    ep.FileName = entryPoint->FileName.Buffer();
+                    ep.FilePath = Engine::Instance()->FindFile(entryPoint->FileName, ResourceType::Shader);
+                    if (ep.FilePath.Length() == 0)
+                        throw IOException(String("Shader file not found: ") + entryPoint->FileName + String("\nDid you forget to specify '-enginedir'?"));
+                    ep.FunctionName = entryPoint->FunctionName.Buffer();
+                    ep.Stage = entryPoint->Stage;
+                    job->EntryPoints.Add(ep);
                 }
-
-                spDestroyCompileRequest(req);
             }
-            return true;
+            if (job->EntryPoints.Count() == 0)
+            {
+                request->Succeeded = true;
+                request->Completed = true;
+                return request;
+            }
+            if (env)
+            {
+                for (auto & t : env->SpecializationTypes)
+                {
+                    job->SpecializationTypeNames.Add(t->TypeName.Buffer());
+                    job->SpecializationModuleNames.Add(Path::GetFileNameWithoutEXT(t->FileName));
+                }
+            }
+            List<RefPtr<ShaderCompilationJob>> jobs;
+            for (auto & runningJob : runningJobs)
+            {
+                if (!runningJob->Request->Completed)
+                    jobs.Add(runningJob);
+            }
+            jobs.Add(job);
+            runningJobs = _Move(jobs);
+            auto jobPtr = job.Ptr();
+            compileThreads->Submit(compileTasks, [this, jobPtr]()
+            {
+                RunCompilationJob(jobPtr);
+            });
+            return request;
+        }
+        virtual void WaitForCompilation(ShaderCompilationRequest * request) override
+        {
+            while (!request->Completed)
+            {
+                if (!compileThreads->RunPendingTask())
+                    std::this_thread::yield();
+            }
+        }
+        virtual bool CompileShader(ShaderCompilationResult & src,
+            const CoreLib::ArrayView<ShaderEntryPoint*> entryPoints,
+            const ShaderCompilationEnvironment* env = nullptr) override
+        {
+            auto request = CompileShaderAsync(entryPoints, env);
+            WaitForCompilation(request.Ptr());
+            src = request->Result;
+            if (!request->Succeeded)
+                Print("Error compiling shader.\n%s\n", src.Diagnostics.Buffer());
+            return request->Succeeded;
         }
         virtual ShaderTypeSymbol* LoadSystemTypeSymbol(CoreLib::String TypeName) override
         {
             return LoadTypeSymbol("ShaderLib.slang", TypeName);
         }
-        SlangCompileRequest* NewCompileRequest()
+        SlangCompileRequest* NewCompileRequest(SlangSession * requestSession, int target)
         {
-            if (!session)
-                session = spCreateSession();
-
-            auto compileRequest = spCreateCompileRequest(session);
-            spAddSearchPath(compileRequest, Engine::Instance()->GetDirectory(true, ResourceType::Shader).Buffer());
-            spAddSearchPath(compileRequest, Engine::Instance()->GetDirectory(false, ResourceType::Shader).Buffer());
-            spAddSearchPath(compileRequest, Engine::Instance()->GetDirectory(true, ResourceType::Material).Buffer());
-            spAddSearchPath(compileRequest, Engine::Instance()->GetDirectory(false, ResourceType::Material).Buffer());
+            auto compileRequest = spCreateCompileRequest(requestSession);
+            for (auto & searchPath : searchPaths)
+                spAddSearchPath(compileRequest, searchPath.Buffer());
 
-            spAddCodeGenTarget(compileRequest, GetSlangTarget());
-            spSetTargetProfile(compileRequest, 0, spFindProfile(session, "sm_5_1"));
+            spAddCodeGenTarget(compileRequest, target);
+            spSetTargetProfile(compileRequest, 0, spFindProfile(requestSession, "sm_5_1"));
             if (dumpShaderSource)
             {
-                if (GetSlangTarget() == SLANG_DXBC)
+                if (target == SLANG_DXBC)
                 {
                     spAddCodeGenTarget(compileRequest, SLANG_HLSL);
                     spAddPreprocessorDefine(compileRequest, "__D3D__", "1");
@@ -473,7 +764,6 @@ namespace GameEngine
                 spSetDumpIntermediates(compileRequest, 1);
             #endif
             int shaderLibUnit = spAddTranslationUnit(compileRequest, SLANG_SOURCE_LANGUAGE_SLANG, "ShaderLib");
-            auto shaderLibPath = Engine::Instance()->FindFile("ShaderLib.slang", ResourceType::Shader);
             spAddTranslationUnitSourceFile(compileRequest, shaderLibUnit, shaderLibPath.Buffer());
             return compileRequest;
         }
@@ -492,7 +782,9 @@ namespace GameEngine
             SlangCompileRequest* compileRequest = nullptr;
             if (!reflectionCompileRequests.TryGetValue(fileName, compileRequest))
             {
-                compileRequest = NewCompileRequest();
+                if (!session)
+                    session = spCreateSession();
+                compileRequest = NewCompileRequest(session, GetSlangTarget());
                 if (fileName != "ShaderLib.slang")
                 {
                     auto shaderFile = Engine::Instance()->FindFile(fileName, ResourceType::Shader);
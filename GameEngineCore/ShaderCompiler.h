@@ -3,6 +3,7 @@
 
 #include "CoreLib/Basic.h"
 #include "HardwareRenderer.h"
+#include <atomic>
 
 namespace GameEngine
 {
@@ -68,6 +69,20 @@ namespace GameEngine
 		CoreLib::List<DescriptorSetInfo> BindingLayouts;
     };
 
+    // A compilation queued by IShaderCompiler::CompileShaderAsync. Result and Succeeded are written by a worker
+    // thread and must not be accessed before Completed is set.
+    class ShaderCompilationRequest : public CoreLib::RefObject
+    {
+    public:
+        ShaderCompilationResult Result;
+        bool Succeeded = false;
+        std::atomic<bool> Completed;
+        ShaderCompilationRequest()
+        {
+            Completed = false;
+        }
+    };
+
     class ShaderCompilationEnvironment : public CoreLib::RefObject
     {
     public:
@@ -80,6 +95,12 @@ namespace GameEngine
         virtual bool CompileShader(ShaderCompilationResult & src,
             const CoreLib::ArrayView<ShaderEntryPoint*> entryPoints,
             const ShaderCompilationEnvironment* env = nullptr) = 0;
+        // Queues the compilation of the entry points on the worker threads of the compiler. Entry points found in
+        // the shader cache are loaded right away, the returned request is then already completed.
+        virtual CoreLib::RefPtr<ShaderCompilationRequest> CompileShaderAsync(const CoreLib::ArrayView<ShaderEntryPoint*> entryPoints,
+            const ShaderCompilationEnvironment* env = nullptr) = 0;
+        // blocks until the request has completed, running queued compilations on the calling thread meanwhile
+        virtual void WaitForCompilation(ShaderCompilationRequest * request) = 0;
         virtual ShaderTypeSymbol* LoadSystemTypeSymbol(CoreLib::String typeName) = 0;
         virtual ShaderTypeSymbol* LoadTypeSymbol(CoreLib::String fileName, CoreLib::String typeName) = 0;
         virtual ShaderEntryPoint* LoadShaderEntryPoint(CoreLib::String fileName, CoreLib::String functionName) = 0;
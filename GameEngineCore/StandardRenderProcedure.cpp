@@ -404,6 +404,10 @@ namespace GameEngine
                     ssaoEnabled = true;
                 }
             }
+            // request the texture mip levels needed by the drawables at their current distance
+            auto textureStreamer = params.renderer->GetSceneResource()->GetTextureStreamer();
+            textureStreamer->RequestMips(sink.GetDrawables(false), params.view, h);
+            textureStreamer->RequestMips(sink.GetDrawables(true), params.view, h);
             if (postProcess)
             {
                 eyeAdaptationUniforms.height = h;
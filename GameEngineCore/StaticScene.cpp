@@ -1,5 +1,5 @@
 #include "StaticScene.h"
-#include "Bvh.h"
+#include "Bvh4.h"
 #include "Level.h"
 #include "CoreLib/Graphics/BBox.h"
 #include "StaticMeshActor.h"
@@ -11,14 +11,38 @@ namespace GameEngine
 {
     using namespace VectorMath;
     using namespace CoreLib;
+    // shading attributes of a face, only fetched for the closest hit of a ray. Lightmap UVs are stored as 16-bit
+    // fixed point, and the normal is recomputed from the edges of the hit triangle.
+    struct StaticFaceAttributes
+    {
+        uint16_t uvs[3][2];
+        uint32_t castShadow : 1;
+        int mapId : 31;
+        void SetUV(int i, Vec2 uv)
+        {
+            uvs[i][0] = (uint16_t)(Math::Clamp(uv.x, 0.0f, 1.0f) * 65535.0f + 0.5f);
+            uvs[i][1] = (uint16_t)(Math::Clamp(uv.y, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+        Vec2 GetUV(int i) const
+        {
+            return Vec2::Create(uvs[i][0] * (1.0f / 65535.0f), uvs[i][1] * (1.0f / 65535.0f));
+        }
+    };
+
+    // a face while the BVH is built, its attributes stay in a separate list until the faces are packed into blocks
     struct StaticFace
     {
         Vec3 verts[3];
-        Vec2 uvs[3];
-        Vec3 normal;
-        uint32_t castShadow : 1;
-        int mapId:31;
+        int attributeId;
+    };
 
+    // intersection data of four triangles in SoA layout, stored in the leaves of the 4-wide BVH
+    struct StaticTriangleBlock
+    {
+        float v0[3][4];
+        float e1[3][4];
+        float e2[3][4];
+        int faceId[4];
     };
     
     class MeshBvhEvaluator
@@ -31,81 +55,188 @@ namespace GameEngine
         }
     };
 
-    // Trace Triangle
+    // Packs the faces of a BVH leaf into triangle blocks, and copies their shading attributes to a separate list
+    // in the order of the blocks, so that the attributes of nearby faces are close in memory as well.
+    class StaticTriangleBlockBuilder
+    {
+    public:
+        static const int ElementsPerBlock = 4;
+        const List<StaticFaceAttributes> & sourceAttributes;
+        List<StaticFaceAttributes> & faceAttributes;
+        StaticTriangleBlockBuilder(const List<StaticFaceAttributes> & sourceAttribs, List<StaticFaceAttributes> & attribs)
+            : sourceAttributes(sourceAttribs), faceAttributes(attribs)
+        {}
+        void BuildBlocks(List<StaticTriangleBlock> & blocks, StaticFace * faces, int count)
+        {
+            for (int i = 0; i < count; i += 4)
+            {
+                StaticTriangleBlock block;
+                memset(&block, 0, sizeof(block));
+                for (int j = 0; j < 4; j++)
+                {
+                    if (i + j >= count)
+                    {
+                        // unused lanes have degenerate triangles, which never pass the intersection test
+                        block.faceId[j] = -1;
+                        continue;
+                    }
+                    auto & face = faces[i + j];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        block.v0[k][j] = face.verts[0][k];
+                        block.e1[k][j] = face.verts[1][k] - face.verts[0][k];
+                        block.e2[k][j] = face.verts[2][k] - face.verts[0][k];
+                    }
+                    block.faceId[j] = faceAttributes.Count();
+                    faceAttributes.Add(sourceAttributes[face.attributeId]);
+                }
+                blocks.Add(block);
+            }
+        }
+    };
+
+    // Trace a block of four triangles with SSE (Moller-Trumbore), keeping track of the closest hit
     class MeshTracer
     {
+    private:
+        __m128 origin[3], dir[3];
     public:
-        inline bool Trace(StaticSceneTracingResult & inter, const StaticFace & face, const Ray & ray, float & t) const
+        const StaticTriangleBlock * hitBlock = nullptr;
+        int hitLane = 0;
+        float hitT = FLT_MAX, hitU = 0.0f, hitV = 0.0f;
+        MeshTracer() = default;
+        MeshTracer(const Ray & ray)
         {
-            Vec3 e1 = face.verts[1] - face.verts[0];
-            Vec3 e2 = face.verts[2] - face.verts[0];
-            Vec3 s1 = Vec3::Cross(ray.Dir, e2);
-            float di = Vec3::Dot(s1, e1);
-            float  invd = 1.0f / (di);
-            Vec3 d = ray.Origin - face.verts[0];
-            float  b1 = Vec3::Dot(d, s1) * invd;
-            Vec3 s2 = Vec3::Cross(d, e1);
-            float  b2 = Vec3::Dot(ray.Dir, s2) * invd;
-            float temp = Vec3::Dot(e2, s2) * invd;
-            if (b1 < 0.f || b1 > 1.f || b2 < 0.f || b1 + b2 > 1.f || temp < 1e-5f || temp > ray.tMax)
+            for (int i = 0; i < 3; i++)
             {
-                return false;
+                origin[i] = _mm_set1_ps(ray.Origin[i]);
+                dir[i] = _mm_set1_ps(ray.Dir[i]);
             }
-            else
+        }
+        inline bool Trace(const StaticTriangleBlock & block, float & tMax)
+        {
+            __m128 e1[3], e2[3], d[3];
+            for (int i = 0; i < 3; i++)
+            {
+                e1[i] = _mm_loadu_ps(block.e1[i]);
+                e2[i] = _mm_loadu_ps(block.e2[i]);
+                d[i] = _mm_sub_ps(origin[i], _mm_loadu_ps(block.v0[i]));
+            }
+            // s1 = cross(dir, e2)
+            __m128 s1x = _mm_sub_ps(_mm_mul_ps(dir[1], e2[2]), _mm_mul_ps(dir[2], e2[1]));
+            __m128 s1y = _mm_sub_ps(_mm_mul_ps(dir[2], e2[0]), _mm_mul_ps(dir[0], e2[2]));
+            __m128 s1z = _mm_sub_ps(_mm_mul_ps(dir[0], e2[1]), _mm_mul_ps(dir[1], e2[0]));
+            __m128 di = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s1x, e1[0]), _mm_mul_ps(s1y, e1[1])), _mm_mul_ps(s1z, e1[2]));
+            __m128 invd = _mm_div_ps(_mm_set1_ps(1.0f), di);
+            __m128 b1 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], s1x), _mm_mul_ps(d[1], s1y)), _mm_mul_ps(d[2], s1z)), invd);
+            // s2 = cross(d, e1)
+            __m128 s2x = _mm_sub_ps(_mm_mul_ps(d[1], e1[2]), _mm_mul_ps(d[2], e1[1]));
+            __m128 s2y = _mm_sub_ps(_mm_mul_ps(d[2], e1[0]), _mm_mul_ps(d[0], e1[2]));
+            __m128 s2z = _mm_sub_ps(_mm_mul_ps(d[0], e1[1]), _mm_mul_ps(d[1], e1[0]));
+            __m128 b2 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], s2x), _mm_mul_ps(dir[1], s2y)), _mm_mul_ps(dir[2], s2z)), invd);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], s2x), _mm_mul_ps(e2[1], s2y)), _mm_mul_ps(e2[2], s2z)), invd);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            __m128 mask = _mm_and_ps(_mm_cmpge_ps(b1, zero), _mm_cmple_ps(b1, one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(b2, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(b1, b2), one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(t, _mm_set1_ps(1e-5f)));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(t, _mm_set1_ps(tMax)));
+            int hitMask = _mm_movemask_ps(mask);
+            if (!hitMask)
+                return false;
+            alignas(16) float tValues[4], b1Values[4], b2Values[4];
+            _mm_store_ps(tValues, t);
+            _mm_store_ps(b1Values, b1);
+            _mm_store_ps(b2Values, b2);
+            bool hit = false;
+            for (int i = 0; i < 4; i++)
             {
-                t = inter.T = temp;
-                inter.IsHit = true;
-                inter.MapId = face.mapId;
-                inter.Normal = face.normal;
-                inter.CastShadow = (face.castShadow != 0);
-                inter.UV = face.uvs[0] * (1.0f - b1 - b2) + face.uvs[1] * b1 + face.uvs[2] * b2;
-                return true;
+                if ((hitMask & (1 << i)) && tValues[i] <= tMax)
+                {
+                    tMax = hitT = tValues[i];
+                    hitBlock = &block;
+                    hitLane = i;
+                    hitU = b1Values[i];
+                    hitV = b2Values[i];
+                    hit = true;
+                }
             }
+            return hit;
         }
     };
 
-    Vec3 SafeRcp(Vec3 vin)
-    {
-        Vec3 rs;
-        if (vin.x > 1e-10f || vin.x < -1e-10f) rs.x = 1.0f / vin.x; else rs.x = 0.0f;
-        if (vin.y > 1e-10f || vin.y < -1e-10f) rs.y = 1.0f / vin.y; else rs.y = 0.0f;
-        if (vin.z > 1e-10f || vin.z < -1e-10f) rs.z = 1.0f / vin.z; else rs.z = 0.0f;
-        return rs;
-    }
-
     class StaticSceneImpl : public StaticScene
     {
-    public:
-        Bvh<StaticFace> bvh;
-        virtual StaticSceneTracingResult TraceRay(const Ray & ray) override
+    private:
+        // rays traced together by TraceRays
+        static const int RayPacketSize = 16;
+        StaticSceneTracingResult GetTracingResult(const MeshTracer & tracer)
         {
             StaticSceneTracingResult result;
-            MeshTracer tracer;
-            Vec3 rcpDir = SafeRcp(ray.Dir);
-            TraverseBvh<StaticFace, MeshTracer, StaticSceneTracingResult, false>(tracer, result, bvh, ray, rcpDir);
+            auto & block = *tracer.hitBlock;
+            int lane = tracer.hitLane;
+            auto & face = faceAttributes[block.faceId[lane]];
+            float b1 = tracer.hitU, b2 = tracer.hitV;
+            result.IsHit = true;
+            result.MapId = face.mapId;
+            auto e1 = Vec3::Create(block.e1[0][lane], block.e1[1][lane], block.e1[2][lane]);
+            auto e2 = Vec3::Create(block.e2[0][lane], block.e2[1][lane], block.e2[2][lane]);
+            result.Normal = Vec3::Cross(e1, e2).Normalize();
+            result.CastShadow = (face.castShadow != 0);
+            result.UV = face.GetUV(0) * (1.0f - b1 - b2) + face.GetUV(1) * b1 + face.GetUV(2) * b2;
+            result.T = tracer.hitT;
             return result;
         }
+    public:
+        Bvh4<StaticTriangleBlock> bvh;
+        List<StaticFaceAttributes> faceAttributes;
+        virtual StaticSceneTracingResult TraceRay(const Ray & ray) override
+        {
+            MeshTracer tracer(ray);
+            if (TraverseBvh4<StaticTriangleBlock, MeshTracer, false>(tracer, bvh, ray))
+                return GetTracingResult(tracer);
+            return StaticSceneTracingResult();
+        }
+        virtual void TraceRays(ArrayView<Ray> rays, ArrayView<StaticSceneTracingResult> results) override
+        {
+            // consecutive rays of a sorted stream visit mostly the same nodes, so they are traced as packets
+            MeshTracer tracers[RayPacketSize];
+            for (int first = 0; first < rays.Count(); first += RayPacketSize)
+            {
+                int count = Math::Min(RayPacketSize, rays.Count() - first);
+                for (int i = 0; i < count; i++)
+                    tracers[i] = MeshTracer(rays[first + i]);
+                unsigned int hitRays = TraversePacketBvh4<StaticTriangleBlock, MeshTracer>(tracers, bvh, rays.Buffer() + first, count);
+                for (int i = 0; i < count; i++)
+                    results[first + i] = (hitRays & (1u << i)) ? GetTracingResult(tracers[i]) : StaticSceneTracingResult();
+            }
+        }
     };
 
-    void AddMeshInstance(List<StaticFace>& faces, Mesh * mesh, Matrix4 localTransform, int id, bool castShadow)
+    void AddMeshInstance(List<StaticFace>& faces, List<StaticFaceAttributes>& attributes, Mesh * mesh, Matrix4 localTransform, int id, bool castShadow)
     {
         int uvChannelId = mesh->GetVertexFormat().GetUVChannelCount() - 1;
         for (int i = 0; i < mesh->Indices.Count() / 3; i++)
         {
             StaticFace f;
-            f.mapId = id;
-            f.castShadow = castShadow ? 1 : 0;
+            StaticFaceAttributes attribs;
+            attribs.mapId = id;
+            attribs.castShadow = castShadow ? 1 : 0;
             for (int j = 0; j < 3; j++)
             {
                 int vid = mesh->Indices[i * 3 + j];
-                f.uvs[j] = mesh->GetVertexUV(vid, uvChannelId);
+                attribs.SetUV(j, mesh->GetVertexUV(vid, uvChannelId));
                 f.verts[j] = localTransform.Transform(Vec4::Create(mesh->GetVertexPosition(vid), 1.0f)).xyz();
-                f.normal = Vec3::Cross(f.verts[1] - f.verts[0], f.verts[2] - f.verts[0]).Normalize();
             }
             if ((f.verts[0] - f.verts[1]).Length2() > 1e-6f &&
                 (f.verts[0] - f.verts[2]).Length2() > 1e-6f &&
                 (f.verts[1] - f.verts[2]).Length2() > 1e-6f)
+            {
+                f.attributeId = attributes.Count();
                 faces.Add(f);
+                attributes.Add(attribs);
+            }
         }
     }
 
@@ -160,11 +291,13 @@ namespace GameEngine
         }
     }
 
-    StaticScene* BuildStaticScene(Level* level)
+    StaticScene* BuildStaticScene(Level* level, Threading::ThreadPool & threadPool)
     {
         StaticSceneImpl* scene = new StaticSceneImpl();
         GatherLights(scene, level);
+        scene->lightBvh.Build(scene->lights);
         List<StaticFace> faces;
+        List<StaticFaceAttributes> attributes;
         int id = 0;
         for (auto actor : level->Actors)
         {
@@ -172,25 +305,31 @@ namespace GameEngine
             {
                 if (smActor->IncludeInBaking.GetValue())
                 {
-                    AddMeshInstance(faces, smActor->GetMesh(), smActor->LocalTransform.GetValue(), id, smActor->CastShadow.GetValue());
+                    AddMeshInstance(faces, attributes, smActor->GetMesh(), smActor->LocalTransform.GetValue(), id, smActor->CastShadow.GetValue());
                     id++;
                 }
             }
         }
-        Bvh_Build<StaticFace> bvhBuild;
         MeshBvhEvaluator costEvaluator;
         List<BuildData<StaticFace>> elements;
         elements.SetSize(faces.Count());
-        for (int i = 0; i < faces.Count(); i++)
+        threadPool.ParallelFor(0, faces.Count(), 4096, [&](int i)
         {
             elements[i].Bounds.Init();
             for (int j = 0; j < 3; j++)
                 elements[i].Bounds.Union(faces[i].verts[j]);
             elements[i].Element = faces.Buffer() + i;
             elements[i].Center = (elements[i].Bounds.Min + elements[i].Bounds.Max) * 0.5f;
-        }
-        ConstructBvh(bvhBuild, elements.Buffer(), elements.Count(), costEvaluator);
-        scene->bvh.FromBuild(bvhBuild);
+        });
+        Bvh<StaticFace> binaryBvh;
+        ConstructBvhParallel(binaryBvh, elements.Buffer(), elements.Count(), costEvaluator, threadPool);
+        // the binary BVH holds its own copy of the faces
+        elements = List<BuildData<StaticFace>>();
+        faces = List<StaticFace>();
+        // collapse the binary tree into a 4-wide BVH for SIMD traversal
+        StaticTriangleBlockBuilder blockBuilder(attributes, scene->faceAttributes);
+        scene->faceAttributes.Reserve(attributes.Count());
+        scene->bvh.FromBvh(binaryBvh, blockBuilder);
         return scene;
     }
 }
\ No newline at end of file
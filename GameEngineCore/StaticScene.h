@@ -4,6 +4,8 @@
 #include "CoreLib/Basic.h"
 #include "Ray.h"
 #include "CoreLib/VectorMath.h"
+#include "CoreLib/Threading.h"
+#include "LightBvh.h"
 
 namespace GameEngine
 {
@@ -38,11 +40,17 @@ namespace GameEngine
     {
     public:
         CoreLib::List<StaticLight> lights;
+        // hierarchy over the point and spot lights of lights
+        LightBvh lightBvh;
         VectorMath::Vec3 ambientColor;
         virtual StaticSceneTracingResult TraceRay(const Ray & ray) = 0;
+        // traces a stream of rays in packets that share their BVH traversal, results[i] receives the closest hit of
+        // rays[i]. Callers should sort the stream for coherence (e.g. by direction octant and origin).
+        virtual void TraceRays(CoreLib::ArrayView<Ray> rays, CoreLib::ArrayView<StaticSceneTracingResult> results) = 0;
     };
 
-    StaticScene* BuildStaticScene(Level* level);
+    // builds the acceleration structures of the static meshes in level, parallel work runs on threadPool
+    StaticScene* BuildStaticScene(Level* level, CoreLib::Threading::ThreadPool & threadPool);
 }
 
 #endif
\ No newline at end of file
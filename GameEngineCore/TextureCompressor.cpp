@@ -1,4 +1,7 @@
 #include "TextureCompressor.h"
+#include "CoreLib/Imaging/Bitmap.h"
+#include "CoreLib/Threading.h"
+#include <float.h>
 #define STB_DXT_IMPLEMENTATION
 #include "TextureTool/stb_dxt.h"
 
@@ -7,36 +10,21 @@ namespace GameEngine
 	using namespace CoreLib;
 	using namespace CoreLib::Graphics;
 
-	CoreLib::List<unsigned char> Resample(const CoreLib::List<unsigned char> &rgbaPixels, int w, int h, int & nw, int & nh)
-	{
-		nw = w / 2;
-		nh = h / 2;
-		if (nw < 1)
-			nw = 1;
-		if (nh < 1)
-			nh = 1;
-		CoreLib::List<unsigned char> rs;
-		rs.SetSize(nh * nw * 4);
-		for (int i = 0; i < nh; i++)
-		{
-			int i0 = Math::Clamp(i * 2, 0, h - 1);
-			int i1 = Math::Clamp(i * 2 + 1, 0, h - 1);
-			for (int j = 0; j < nw; j++)
-			{
-				int j0 = Math::Clamp(j * 2, 0, w - 1);
-				int j1 = Math::Clamp(j * 2 + 1, 0, w - 1);
-				for (int k = 0; k < 4; k++)
-					rs[(i * nw + j) * 4 + k] = (rgbaPixels[(i0 * w + j0) * 4 + k] 
-						+ rgbaPixels[(i0 * w + j1) * 4 + k] 
-						+ rgbaPixels[(i1 * w + j0) * 4 + k] 
-						+ rgbaPixels[(i1 * w + j1) * 4 + k]) / 4;
-			}
-		}
-		return rs;
-	}
+    // stb_dxt builds its tables in its first call, which must not run on several threads at once
+    static void InitDXTTables()
+    {
+        static bool initialized = []()
+        {
+            unsigned char block[64] = {}, output[16];
+            stb_compress_dxt_block(output, block, 0, STB_DXT_NORMAL);
+            return true;
+        }();
+        (void)initialized;
+    }
 
     template<typename TBlockCompressFunc>
-    void CompressTexture(TextureFile & result, TextureStorageFormat format, const TBlockCompressFunc & compressFunc, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height)
+    void CompressTexture(TextureFile & result, TextureStorageFormat format, const TBlockCompressFunc & compressFunc, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height,
+        const MipGenerationOptions & mipOptions)
     {
         int blockSize = 0;
         switch (format)
@@ -47,71 +35,1725 @@ namespace GameEngine
         default:
             blockSize = 16;
         }
-        List<unsigned char> input;
-        input.AddRange(rgbaPixels.Buffer(), rgbaPixels.Count());
-        int w = width;
-        int h = height;
-        int level = 0;
+        struct BlockRow
+        {
+            int Level, Y;
+        };
+        // the chain is generated first, so that the blocks of all levels are compressed in one parallel loop
+        // instead of a parallel loop per level, most of which are too small to keep all threads busy
+        MipChain chain;
+        GenerateMipChain(chain, rgbaPixels, width, height, mipOptions);
+        List<BlockRow> blockRows;
+        for (int l = 0; l < chain.Levels.Count(); l++)
+        {
+            for (int i = 0; i < chain.Levels[l].Height; i += 4)
+                blockRows.Add(BlockRow{ l, i });
+        }
         result.Allocate(format, width, height, Math::Max(Math::Log2Ceil(width), Math::Log2Ceil(height)) + 1, 1);
-        while (w >= 1 || h >= 1)
+        List<unsigned char*> levelBuffers;
+        for (int i = 0; i < chain.Levels.Count(); i++)
+            levelBuffers.Add(result.GetBuffer(i).Buffer());
+        InitDXTTables();
+        GetTextureProcessingThreads().ParallelFor(0, blockRows.Count(), 1, [&](int r)
         {
-            auto buffer = result.GetBuffer(level);
+            auto & input = chain.Levels[blockRows[r].Level];
+            auto inputPixels = chain.GetLevelPixels(blockRows[r].Level);
+            auto buffer = levelBuffers[blockRows[r].Level];
+            int w = input.Width, h = input.Height;
+            int i = blockRows[r].Y;
             int blocksPerRow = (w + 3) / 4;
-            #pragma omp parallel for
-            for (int i = 0; i < h; i += 4)
+            for (int j = 0; j < w; j += 4)
             {
-                for (int j = 0; j < w; j += 4)
+                unsigned char block[64];
+                for (int ki = 0; ki < 4; ki++)
                 {
-                    unsigned char block[64], outBlock[16];
-                    for (int ki = 0; ki < 4; ki++)
+                    int ni = Math::Clamp(i + ki, 0, h - 1);
+                    if (j + 4 <= w)
                     {
-                        int ni = Math::Clamp(i + ki, 0, h - 1);
-                        for (int kj = 0; kj < 4; kj++)
-                        {
-                            int nj = Math::Clamp(j + kj, 0, w - 1);
-                            for (int c = 0; c < 4; c++)
-                                block[(ki * 4 + kj) * 4 + c] = input[(ni * w + nj) * 4 + c];
-                        }
+                        memcpy(block + ki * 16, inputPixels + (ni * w + j) * 4, 16);
+                        continue;
+                    }
+                    for (int kj = 0; kj < 4; kj++)
+                    {
+                        int nj = Math::Clamp(j + kj, 0, w - 1);
+                        memcpy(block + (ki * 4 + kj) * 4, inputPixels + (ni * w + nj) * 4, 4);
                     }
-                    compressFunc(outBlock, block);
-                    int ptr = (i/4) * blocksPerRow + (j/4);
-                    memcpy(buffer.Buffer() + ptr * blockSize, outBlock, blockSize);
                 }
+                int ptr = (i / 4) * blocksPerRow + (j / 4);
+                compressFunc(buffer + ptr * blockSize, block);
             }
-
-            if (w == 1 && h == 1) break;
-            int nw, nh;
-            input = Resample(input, w, h, nw, nh);
-            w = nw;
-            h = nh;
-            level++;
-        }
+        });
     }
 
-	void TextureCompressor::CompressRGBA_BC1(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height)
+	// Fast encoding by range fit: the endpoints are the corners of the bounding box of the block, inset to
+	// reduce the error of the extreme texels, and each texel picks the palette entry nearest to its projection
+	// onto the endpoint axis. Texels are kept in SoA layout and processed four at a time with SSE4.1.
+	struct FastBlockTexels
+	{
+		// four groups of four texels for each of the r, g, b and a channels
+		__m128i Channels[4][4];
+	};
+
+	static void LoadFastBlockTexels(FastBlockTexels & texels, const unsigned char * rgbaTexels)
 	{
-        CompressTexture(
-            result, TextureStorageFormat::BC1,
-            [](unsigned char *output, unsigned char *input) {
-                stb_compress_dxt_block(output, input, 0, STB_DXT_HIGHQUAL);
-            },
-            rgbaPixels, width, height);
+		__m128i groups[4];
+		for (int g = 0; g < 4; g++)
+			groups[g] = _mm_loadu_si128((const __m128i*)(rgbaTexels + g * 16));
+		for (int c = 0; c < 4; c++)
+		{
+			__m128i mask = _mm_setr_epi8((char)c, -1, -1, -1, (char)(c + 4), -1, -1, -1, (char)(c + 8), -1, -1, -1, (char)(c + 12), -1, -1, -1);
+			for (int g = 0; g < 4; g++)
+				texels.Channels[c][g] = _mm_shuffle_epi8(groups[g], mask);
+		}
 	}
 
-	void TextureCompressor::CompressRGBA_BC3(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height)
+	static int HorizontalMin(__m128i v)
 	{
-        CompressTexture(result, TextureStorageFormat::BC3, [](unsigned char* output, unsigned char* input) {stb_compress_dxt_block(output, input, 1, STB_DXT_HIGHQUAL); },
-            rgbaPixels, width, height);
+		v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(v);
 	}
 
-	void TextureCompressor::CompressRG_BC5(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height)
+	static int HorizontalMax(__m128i v)
 	{
-        CompressTexture(result, TextureStorageFormat::BC5, [](unsigned char* output, unsigned char* input)
-            {
-                stb__CompressAlphaBlock(output, (unsigned char*)input, 4);
-                stb__CompressAlphaBlock(output + 8, (unsigned char*)input + 1, 4);
-            },
-            rgbaPixels, width, height);
+		v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(v);
+	}
+
+	static int HorizontalSum(__m128i v)
+	{
+		v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(v);
+	}
+
+	static void GetChannelRange(const __m128i * channel, int & minValue, int & maxValue)
+	{
+		minValue = HorizontalMin(_mm_min_epi32(_mm_min_epi32(channel[0], channel[1]), _mm_min_epi32(channel[2], channel[3])));
+		maxValue = HorizontalMax(_mm_max_epi32(_mm_max_epi32(channel[0], channel[1]), _mm_max_epi32(channel[2], channel[3])));
+	}
+
+	static unsigned short PackRGB565(const int * color)
+	{
+		return (unsigned short)((((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) | ((color[2] * 31 + 127) / 255));
+	}
+
+	static void UnpackRGB565(unsigned short packed, int * color)
+	{
+		int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	static void CompressColorBlockFast(unsigned char * block, const FastBlockTexels & texels)
+	{
+		int minColor[3], maxColor[3];
+		for (int c = 0; c < 3; c++)
+		{
+			GetChannelRange(texels.Channels[c], minColor[c], maxColor[c]);
+			int inset = (maxColor[c] - minColor[c]) >> 4;
+			minColor[c] += inset;
+			maxColor[c] -= inset;
+		}
+		// the bounding box has four diagonals, pick the one following the correlation of red and blue to green
+		__m128i covarianceRG = _mm_setzero_si128(), covarianceBG = _mm_setzero_si128();
+		__m128i centerR = _mm_set1_epi32((minColor[0] + maxColor[0]) >> 1);
+		__m128i centerG = _mm_set1_epi32((minColor[1] + maxColor[1]) >> 1);
+		__m128i centerB = _mm_set1_epi32((minColor[2] + maxColor[2]) >> 1);
+		for (int g = 0; g < 4; g++)
+		{
+			__m128i dg = _mm_sub_epi32(texels.Channels[1][g], centerG);
+			covarianceRG = _mm_add_epi32(covarianceRG, _mm_mullo_epi32(_mm_sub_epi32(texels.Channels[0][g], centerR), dg));
+			covarianceBG = _mm_add_epi32(covarianceBG, _mm_mullo_epi32(_mm_sub_epi32(texels.Channels[2][g], centerB), dg));
+		}
+		if (HorizontalSum(covarianceRG) < 0)
+			Swap(minColor[0], maxColor[0]);
+		if (HorizontalSum(covarianceBG) < 0)
+			Swap(minColor[2], maxColor[2]);
+		unsigned short color0 = PackRGB565(maxColor);
+		unsigned short color1 = PackRGB565(minColor);
+		unsigned int indices = 0;
+		if (color0 != color1)
+		{
+			// the four color mode requires color0 > color1
+			if (color0 < color1)
+				Swap(color0, color1);
+			int endpoint0[3], endpoint1[3];
+			UnpackRGB565(color0, endpoint0);
+			UnpackRGB565(color1, endpoint1);
+			int axis[3] = { endpoint1[0] - endpoint0[0], endpoint1[1] - endpoint0[1], endpoint1[2] - endpoint0[2] };
+			__m128 scale = _mm_set1_ps(3.0f / (float)(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]));
+			alignas(16) int steps[16];
+			for (int g = 0; g < 4; g++)
+			{
+				__m128i projection = _mm_add_epi32(_mm_add_epi32(
+					_mm_mullo_epi32(_mm_sub_epi32(texels.Channels[0][g], _mm_set1_epi32(endpoint0[0])), _mm_set1_epi32(axis[0])),
+					_mm_mullo_epi32(_mm_sub_epi32(texels.Channels[1][g], _mm_set1_epi32(endpoint0[1])), _mm_set1_epi32(axis[1]))),
+					_mm_mullo_epi32(_mm_sub_epi32(texels.Channels[2][g], _mm_set1_epi32(endpoint0[2])), _mm_set1_epi32(axis[2])));
+				__m128i step = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(projection), scale));
+				step = _mm_min_epi32(_mm_max_epi32(step, _mm_setzero_si128()), _mm_set1_epi32(3));
+				_mm_store_si128((__m128i*)(steps + g * 4), step);
+			}
+			// palette entries in the order of the projection: color0, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1, color1
+			static const unsigned int paletteIndices[4] = { 0, 2, 3, 1 };
+			for (int i = 0; i < 16; i++)
+				indices |= paletteIndices[steps[i]] << (i * 2);
+		}
+		block[0] = (unsigned char)color0;
+		block[1] = (unsigned char)(color0 >> 8);
+		block[2] = (unsigned char)color1;
+		block[3] = (unsigned char)(color1 >> 8);
+		for (int i = 0; i < 4; i++)
+			block[4 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	// encodes a channel as a BC3 alpha or BC5 block, the range is not inset so that 0 and 255 stay exact
+	static void CompressChannelBlockFast(unsigned char * block, const FastBlockTexels & texels, int channel)
+	{
+		int minValue, maxValue;
+		GetChannelRange(texels.Channels[channel], minValue, maxValue);
+		unsigned long long indices = 0;
+		if (maxValue > minValue)
+		{
+			__m128 scale = _mm_set1_ps(7.0f / (float)(maxValue - minValue));
+			alignas(16) int steps[16];
+			for (int g = 0; g < 4; g++)
+			{
+				__m128i distance = _mm_sub_epi32(_mm_set1_epi32(maxValue), texels.Channels[channel][g]);
+				_mm_store_si128((__m128i*)(steps + g * 4), _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(distance), scale)));
+			}
+			// palette entries from value0 = max to value1 = min in the eight value mode
+			static const unsigned long long paletteIndices[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+			for (int i = 0; i < 16; i++)
+				indices |= paletteIndices[steps[i]] << (i * 3);
+		}
+		block[0] = (unsigned char)maxValue;
+		block[1] = (unsigned char)minValue;
+		for (int i = 0; i < 6; i++)
+			block[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	void TextureCompressor::CompressBC1_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality)
+	{
+		if (quality == TextureCompressionQuality::Fast)
+		{
+			FastBlockTexels texels;
+			LoadFastBlockTexels(texels, rgbaTexels);
+			CompressColorBlockFast(block, texels);
+		}
+		else
+			stb_compress_dxt_block(block, rgbaTexels, 0, STB_DXT_HIGHQUAL);
+	}
+
+	void TextureCompressor::CompressBC3_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality)
+	{
+		if (quality == TextureCompressionQuality::Fast)
+		{
+			FastBlockTexels texels;
+			LoadFastBlockTexels(texels, rgbaTexels);
+			CompressChannelBlockFast(block, texels, 3);
+			CompressColorBlockFast(block + 8, texels);
+		}
+		else
+			stb_compress_dxt_block(block, rgbaTexels, 1, STB_DXT_HIGHQUAL);
+	}
+
+	void TextureCompressor::CompressBC5_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality)
+	{
+		if (quality == TextureCompressionQuality::Fast)
+		{
+			FastBlockTexels texels;
+			LoadFastBlockTexels(texels, rgbaTexels);
+			CompressChannelBlockFast(block, texels, 0);
+			CompressChannelBlockFast(block + 8, texels, 1);
+		}
+		else
+		{
+			stb__CompressAlphaBlock(block, (unsigned char*)rgbaTexels, 4);
+			stb__CompressAlphaBlock(block + 8, (unsigned char*)rgbaTexels + 1, 4);
+		}
+	}
+
+	void TextureCompressor::CompressRGBA_BC1(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality, const MipGenerationOptions & mipOptions)
+	{
+        CompressTexture(result, TextureStorageFormat::BC1, [=](unsigned char * output, unsigned char * input) { CompressBC1_Block(output, input, quality); },
+            rgbaPixels, width, height, mipOptions);
+	}
+
+	// loads the RGBA pixels of an image file with the rows flipped to the bottom-up order of texture files
+	static void LoadImagePixels(const CoreLib::String & fileName, List<unsigned int> & pixelsInversed, int & width, int & height)
+	{
+		CoreLib::Imaging::Bitmap bmp(fileName);
+		int *sourcePixels = (int *)bmp.GetPixels();
+		width = bmp.GetWidth();
+		height = bmp.GetHeight();
+		pixelsInversed.SetSize(width * height);
+		for (int i = 0; i < height; i++)
+		{
+			for (int j = 0; j < width; j++)
+				pixelsInversed[i * width + j] =
+					sourcePixels[(height - 1 - i) * width + j];
+		}
+	}
+
+	void TextureCompressor::CompressImageFile_BC1(TextureFile & result, const CoreLib::String & fileName, TextureCompressionQuality quality, const MipGenerationOptions & mipOptions)
+	{
+		List<unsigned int> pixels;
+		int width, height;
+		LoadImagePixels(fileName, pixels, width, height);
+		CompressRGBA_BC1(result, MakeArrayView((unsigned char*)pixels.Buffer(), pixels.Count() * 4), width, height, quality, mipOptions);
+	}
+
+	void TextureCompressor::CompressRGBA_BC3(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality, const MipGenerationOptions & mipOptions)
+	{
+        CompressTexture(result, TextureStorageFormat::BC3, [=](unsigned char * output, unsigned char * input) { CompressBC3_Block(output, input, quality); },
+            rgbaPixels, width, height, mipOptions);
+	}
+
+	void TextureCompressor::CompressRG_BC5(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality, const MipGenerationOptions & mipOptions)
+	{
+        CompressTexture(result, TextureStorageFormat::BC5, [=](unsigned char * output, unsigned char * input) { CompressBC5_Block(output, input, quality); },
+            rgbaPixels, width, height, mipOptions);
+	}
+
+	// BC6H partition sets for two-region modes, two 16-texel patterns per entry (even pattern in the low bits).
+	static const unsigned int BC6HPartitionTable[16] =
+	{
+		2290666700u, 3972591342u, 4276930688u, 3967876808u, 4293707776u, 3892379264u, 4278255592u, 4026597360u,
+		9369360u, 147747072u, 1930428556u, 2362323200u, 823134348u, 913073766u, 267393000u, 966553998u
+	};
+	static int GetBC6HPartition(int pattern, int texel)
+	{
+		return (BC6HPartitionTable[pattern >> 1] >> ((pattern & 1) * 16 + texel)) & 1;
+	}
+	// the texel of the second region whose index has an implied most significant bit
+	static int GetBC6HFixupTexel(int pattern)
+	{
+		if ((845414400u >> pattern) & 1)
+			return 8;
+		if ((3441033216u >> pattern) & 1)
+			return 2;
+		return 15;
+	}
+
+	// endpoint components: r, g, b of endpoints w (0), x (1), y (2) and z (3)
+	enum BC6HField : unsigned char
+	{
+		R0, G0, B0, R1, G1, B1, R2, G2, B2, R3, G3, B3
+	};
+	// a run of endpoint bits starting at `Bit`, stored least significant bit first,
+	// or most significant bit first when `Count` is negative.
+	struct BC6HBitRun
+	{
+		BC6HField Field;
+		unsigned char Bit;
+		signed char Count;
+	};
+	struct BC6HMode
+	{
+		int EndpointBits;
+		int DeltaBits[3];
+		bool Transformed;
+		int Regions;
+		BC6HBitRun Layout[24];
+	};
+	static const BC6HMode BC6HModes[14] =
+	{
+		{ 10, {5, 5, 5}, true, 2, {{G2,4,1},{B2,4,1},{B3,4,1},{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,5},{G3,4,1},{G2,0,4},{G1,0,5},{B3,0,1},
+			{G3,0,4},{B1,0,5},{B3,1,1},{B2,0,4},{R2,0,5},{B3,2,1},{R3,0,5},{B3,3,1}} },
+		{ 7, {6, 6, 6}, true, 2, {{G2,5,1},{G3,4,1},{G3,5,1},{R0,0,7},{B3,0,1},{B3,1,1},{B2,4,1},{G0,0,7},{B2,5,1},{B3,2,1},{G2,4,1},{B0,0,7},
+			{B3,3,1},{B3,5,1},{B3,4,1},{R1,0,6},{G2,0,4},{G1,0,6},{G3,0,4},{B1,0,6},{B2,0,4},{R2,0,6},{R3,0,6}} },
+		{ 11, {5, 4, 4}, true, 2, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,5},{R0,10,1},{G2,0,4},{G1,0,4},{G0,10,1},{B3,0,1},{G3,0,4},{B1,0,4},
+			{B0,10,1},{B3,1,1},{B2,0,4},{R2,0,5},{B3,2,1},{R3,0,5},{B3,3,1}} },
+		{ 11, {4, 5, 4}, true, 2, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,4},{R0,10,1},{G3,4,1},{G2,0,4},{G1,0,5},{G0,10,1},{G3,0,4},{B1,0,4},
+			{B0,10,1},{B3,1,1},{B2,0,4},{R2,0,4},{B3,0,1},{B3,2,1},{R3,0,4},{G2,4,1},{B3,3,1}} },
+		{ 11, {4, 4, 5}, true, 2, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,4},{R0,10,1},{B2,4,1},{G2,0,4},{G1,0,4},{G0,10,1},{B3,0,1},{G3,0,4},
+			{B1,0,5},{B0,10,1},{B2,0,4},{R2,0,4},{B3,1,1},{B3,2,1},{R3,0,4},{B3,4,1},{B3,3,1}} },
+		{ 9, {5, 5, 5}, true, 2, {{R0,0,9},{B2,4,1},{G0,0,9},{G2,4,1},{B0,0,9},{B3,4,1},{R1,0,5},{G3,4,1},{G2,0,4},{G1,0,5},{B3,0,1},
+			{G3,0,4},{B1,0,5},{B3,1,1},{B2,0,4},{R2,0,5},{B3,2,1},{R3,0,5},{B3,3,1}} },
+		{ 8, {6, 5, 5}, true, 2, {{R0,0,8},{G3,4,1},{B2,4,1},{G0,0,8},{B3,2,1},{G2,4,1},{B0,0,8},{B3,3,1},{B3,4,1},{R1,0,6},{G2,0,4},
+			{G1,0,5},{B3,0,1},{G3,0,4},{B1,0,5},{B3,1,1},{B2,0,4},{R2,0,6},{R3,0,6}} },
+		{ 8, {5, 6, 5}, true, 2, {{R0,0,8},{B3,0,1},{B2,4,1},{G0,0,8},{G2,5,1},{G2,4,1},{B0,0,8},{G3,5,1},{B3,4,1},{R1,0,5},{G3,4,1},
+			{G2,0,4},{G1,0,6},{G3,0,4},{B1,0,5},{B3,1,1},{B2,0,4},{R2,0,5},{B3,2,1},{R3,0,5},{B3,3,1}} },
+		{ 8, {5, 5, 6}, true, 2, {{R0,0,8},{B3,1,1},{B2,4,1},{G0,0,8},{B2,5,1},{G2,4,1},{B0,0,8},{B3,5,1},{B3,4,1},{R1,0,5},{G3,4,1},
+			{G2,0,4},{G1,0,5},{B3,0,1},{G3,0,4},{B1,0,6},{B2,0,4},{R2,0,5},{B3,2,1},{R3,0,5},{B3,3,1}} },
+		{ 6, {6, 6, 6}, false, 2, {{R0,0,6},{G3,4,1},{B3,0,1},{B3,1,1},{B2,4,1},{G0,0,6},{G2,5,1},{B2,5,1},{B3,2,1},{G2,4,1},{B0,0,6},
+			{G3,5,1},{B3,3,1},{B3,5,1},{B3,4,1},{R1,0,6},{G2,0,4},{G1,0,6},{G3,0,4},{B1,0,6},{B2,0,4},{R2,0,6},{R3,0,6}} },
+		{ 10, {10, 10, 10}, false, 1, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,10},{G1,0,10},{B1,0,10}} },
+		{ 11, {9, 9, 9}, true, 1, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,9},{R0,10,1},{G1,0,9},{G0,10,1},{B1,0,9},{B0,10,1}} },
+		{ 12, {8, 8, 8}, true, 1, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,8},{R0,10,-2},{G1,0,8},{G0,10,-2},{B1,0,8},{B0,10,-2}} },
+		{ 16, {4, 4, 4}, true, 1, {{R0,0,10},{G0,0,10},{B0,0,10},{R1,0,4},{R0,10,-6},{G1,0,4},{G0,10,-6},{B1,0,4},{B0,10,-6}} },
+	};
+
+	class BC6HBitReader
+	{
+	private:
+		const unsigned char * data;
+		int position = 0;
+	public:
+		BC6HBitReader(const unsigned char * block)
+			: data(block)
+		{}
+		unsigned int Read(int count)
+		{
+			unsigned int result = 0;
+			for (int i = 0; i < count; i++, position++)
+				result |= ((data[position >> 3] >> (position & 7)) & 1u) << i;
+			return result;
+		}
+	};
+
+	static const int BC6HWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	static const int BC6HWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	static int UnquantizeBC6HEndpoint(int value, int bits)
+	{
+		if (bits >= 15 || value == 0)
+			return value;
+		if (value == (1 << bits) - 1)
+			return 0xFFFF;
+		return ((value << 16) + 0x8000) >> bits;
+	}
+
+	void TextureCompressor::DecompressBC6H_Block(const unsigned char * block, VectorMath::Vec3 * texels)
+	{
+		// mode index for each value of the 5 mode bits, -1 for reserved modes
+		static const int modeIds[32] =
+		{
+			0, 1, 2, 10, 0, 1, 3, 11, 0, 1, 4, 12, 0, 1, 5, 13,
+			0, 1, 6, -1, 0, 1, 7, -1, 0, 1, 8, -1, 0, 1, 9, -1
+		};
+		BC6HBitReader reader(block);
+		int modeBits = (int)reader.Read(2);
+		if (modeBits >= 2)
+			modeBits |= reader.Read(3) << 2;
+		int modeId = modeIds[modeBits];
+		if (modeId == -1)
+		{
+			for (int i = 0; i < 16; i++)
+				texels[i].SetZero();
+			return;
+		}
+		auto & mode = BC6HModes[modeId];
+		int endpoints[12] = {};
+		for (auto & run : mode.Layout)
+		{
+			if (run.Count == 0)
+				break;
+			if (run.Count > 0)
+				endpoints[run.Field] |= reader.Read(run.Count) << run.Bit;
+			else
+			{
+				for (int i = -run.Count - 1; i >= 0; i--)
+					endpoints[run.Field] |= reader.Read(1) << (run.Bit + i);
+			}
+		}
+		int componentCount = mode.Regions * 6;
+		if (mode.Transformed)
+		{
+			// all endpoints but the first are stored as signed deltas to the first one
+			int endpointMask = (1 << mode.EndpointBits) - 1;
+			for (int i = 3; i < componentCount; i++)
+			{
+				int deltaBits = mode.DeltaBits[i % 3];
+				int delta = endpoints[i];
+				if (delta & (1 << (deltaBits - 1)))
+					delta -= 1 << deltaBits;
+				endpoints[i] = (endpoints[i % 3] + delta) & endpointMask;
+			}
+		}
+		for (int i = 0; i < componentCount; i++)
+			endpoints[i] = UnquantizeBC6HEndpoint(endpoints[i], mode.EndpointBits);
+
+		int pattern = 0;
+		int fixupTexel = 0;
+		if (mode.Regions == 2)
+		{
+			pattern = (int)reader.Read(5);
+			fixupTexel = GetBC6HFixupTexel(pattern);
+		}
+		int indexBits = mode.Regions == 2 ? 3 : 4;
+		for (int i = 0; i < 16; i++)
+		{
+			int region = mode.Regions == 2 ? GetBC6HPartition(pattern, i) : 0;
+			bool isAnchor = (i == 0) || (region == 1 && i == fixupTexel);
+			int index = (int)reader.Read(isAnchor ? indexBits - 1 : indexBits);
+			int weight = indexBits == 3 ? BC6HWeights3[index] : BC6HWeights4[index];
+			int * e0 = endpoints + region * 6;
+			int * e1 = e0 + 3;
+			for (int c = 0; c < 3; c++)
+			{
+				int value = (e0[c] * (64 - weight) + e1[c] * weight + 32) >> 6;
+				// rescale the interpolated value to the bits of a half float
+				texels[i][c] = HalfToFloat((unsigned short)((value * 31) >> 6));
+			}
+		}
+	}
+
+	// BC6H encoder. Texels are encoded in half float bit space, where interpolation of the format is linear
+	// and squared differences approximate the error in log space.
+
+	// code of each mode in the first 2 or 5 bits of a block
+	static const int BC6HModeCodes[14] = { 0, 1, 2, 6, 10, 14, 18, 22, 26, 30, 3, 7, 11, 15 };
+
+	class BC6HBitWriter
+	{
+	private:
+		unsigned char * data;
+		int position = 0;
+	public:
+		BC6HBitWriter(unsigned char * block)
+			: data(block)
+		{
+			memset(block, 0, 16);
+		}
+		void Write(unsigned int value, int count)
+		{
+			for (int i = 0; i < count; i++, position++)
+				data[position >> 3] |= (unsigned char)(((value >> i) & 1u) << (position & 7));
+		}
+	};
+
+	// texels of a block as half float bits in SoA layout
+	struct BC6HBlockTexels
+	{
+		alignas(16) float Values[3][16];
+	};
+
+	// per-region endpoints in half float bit space before quantization
+	struct BC6HRegionEndpoints
+	{
+		float Endpoints[2][2][3];
+	};
+
+	static int QuantizeBC6HEndpoint(float halfValue, int bits)
+	{
+		// inverse of UnquantizeBC6HEndpoint followed by the (x * 31) >> 6 rescale of the decoder
+		float unquantized = halfValue * (64.0f / 31.0f);
+		int maxValue = (1 << bits) - 1;
+		if (bits >= 15)
+			return Math::Clamp((int)(unquantized + 0.5f), 0, maxValue);
+		return Math::Clamp((int)(unquantized * (float)(1 << bits) * (1.0f / 65536.0f)), 0, maxValue);
+	}
+
+	// Fits a line segment through the texels in regionMask along their principal axis.
+	static void FitBC6HEndpoints(const BC6HBlockTexels & texels, unsigned int regionMask, float endpoints[2][3])
+	{
+		float mean[3] = {};
+		int count = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(regionMask & (1 << i)))
+				continue;
+			for (int c = 0; c < 3; c++)
+				mean[c] += texels.Values[c][i];
+			count++;
+		}
+		for (int c = 0; c < 3; c++)
+			mean[c] /= (float)count;
+		float covariance[6] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(regionMask & (1 << i)))
+				continue;
+			float d[3] = { texels.Values[0][i] - mean[0], texels.Values[1][i] - mean[1], texels.Values[2][i] - mean[2] };
+			covariance[0] += d[0] * d[0];
+			covariance[1] += d[0] * d[1];
+			covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1];
+			covariance[4] += d[1] * d[2];
+			covariance[5] += d[2] * d[2];
+		}
+		// power iteration for the principal axis
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[3] =
+			{
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+			};
+			float length = Math::Max(Math::Max(fabs(next[0]), fabs(next[1])), fabs(next[2]));
+			if (length < 1e-20f)
+				break;
+			for (int c = 0; c < 3; c++)
+				axis[c] = next[c] / length;
+		}
+		float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(regionMask & (1 << i)))
+				continue;
+			float t = ((texels.Values[0][i] - mean[0]) * axis[0] + (texels.Values[1][i] - mean[1]) * axis[1] +
+				(texels.Values[2][i] - mean[2]) * axis[2]) / axisLength2;
+			minT = Math::Min(minT, t);
+			maxT = Math::Max(maxT, t);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			endpoints[0][c] = Math::Clamp(mean[c] + axis[c] * minT, 0.0f, (float)0x7BFF);
+			endpoints[1][c] = Math::Clamp(mean[c] + axis[c] * maxT, 0.0f, (float)0x7BFF);
+		}
+	}
+
+	// Picks the nearest palette entry for every texel in regionMask with SSE, four texels at a time.
+	// Returns the sum of squared errors of these texels.
+	static float FindBC6HIndices(const BC6HBlockTexels & texels, const float palette[16][3], int entryCount, unsigned int regionMask, int * indices)
+	{
+		float error = 0.0f;
+		for (int group = 0; group < 16; group += 4)
+		{
+			unsigned int groupMask = (regionMask >> group) & 0xF;
+			if (!groupMask)
+				continue;
+			__m128 r = _mm_load_ps(texels.Values[0] + group);
+			__m128 g = _mm_load_ps(texels.Values[1] + group);
+			__m128 b = _mm_load_ps(texels.Values[2] + group);
+			__m128 bestDistance = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int e = 0; e < entryCount; e++)
+			{
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[e][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[e][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[e][2]));
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, bestDistance));
+				bestDistance = _mm_min_ps(distance, bestDistance);
+				bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(e)));
+			}
+			alignas(16) float distances[4];
+			alignas(16) int groupIndices[4];
+			_mm_store_ps(distances, bestDistance);
+			_mm_store_si128((__m128i*)groupIndices, bestIndex);
+			for (int i = 0; i < 4; i++)
+			{
+				if (groupMask & (1 << i))
+				{
+					error += distances[i];
+					indices[group + i] = groupIndices[i];
+				}
+			}
+		}
+		return error;
+	}
+
+	// Least squares fit of the endpoints of a region to the texels given their interpolation weights.
+	static void RefineBC6HEndpoints(const BC6HBlockTexels & texels, unsigned int regionMask, const int * indices, const int * weights, float endpoints[2][3])
+	{
+		float a00 = 0.0f, a01 = 0.0f, a11 = 0.0f;
+		float b0[3] = {}, b1[3] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(regionMask & (1 << i)))
+				continue;
+			float w = weights[indices[i]] * (1.0f / 64.0f);
+			float iw = 1.0f - w;
+			a00 += iw * iw;
+			a01 += iw * w;
+			a11 += w * w;
+			for (int c = 0; c < 3; c++)
+			{
+				b0[c] += iw * texels.Values[c][i];
+				b1[c] += w * texels.Values[c][i];
+			}
+		}
+		float det = a00 * a11 - a01 * a01;
+		if (fabs(det) < 1e-6f)
+			return;
+		float invDet = 1.0f / det;
+		for (int c = 0; c < 3; c++)
+		{
+			endpoints[0][c] = Math::Clamp((a11 * b0[c] - a01 * b1[c]) * invDet, 0.0f, (float)0x7BFF);
+			endpoints[1][c] = Math::Clamp((a00 * b1[c] - a01 * b0[c]) * invDet, 0.0f, (float)0x7BFF);
+		}
 	}
-}
 
+	struct BC6HEncoding
+	{
+		int Mode;
+		int Pattern;
+		int Endpoints[12];
+		int Indices[16];
+		float Error;
+	};
+
+	// Encodes the block with the given mode and partition, starting from unquantized endpoints.
+	// Returns false if the endpoints cannot be represented in the mode.
+	static bool EncodeBC6HMode(const BC6HBlockTexels & texels, int modeId, int pattern, const BC6HRegionEndpoints & regionEndpoints, BC6HEncoding & result)
+	{
+		auto & mode = BC6HModes[modeId];
+		int indexCount = mode.Regions == 2 ? 8 : 16;
+		const int * weights = mode.Regions == 2 ? BC6HWeights3 : BC6HWeights4;
+		unsigned int regionMasks[2] = { 0xFFFF, 0 };
+		if (mode.Regions == 2)
+		{
+			regionMasks[0] = regionMasks[1] = 0;
+			for (int i = 0; i < 16; i++)
+				regionMasks[GetBC6HPartition(pattern, i)] |= 1 << i;
+		}
+		result.Mode = modeId;
+		result.Pattern = pattern;
+		result.Error = 0.0f;
+		for (int r = 0; r < mode.Regions; r++)
+		{
+			int * quantized = result.Endpoints + r * 6;
+			float palette[16][3];
+			for (int e = 0; e < 2; e++)
+				for (int c = 0; c < 3; c++)
+					quantized[e * 3 + c] = QuantizeBC6HEndpoint(regionEndpoints.Endpoints[r][e][c], mode.EndpointBits);
+			for (int c = 0; c < 3; c++)
+			{
+				int e0 = UnquantizeBC6HEndpoint(quantized[c], mode.EndpointBits);
+				int e1 = UnquantizeBC6HEndpoint(quantized[3 + c], mode.EndpointBits);
+				for (int i = 0; i < indexCount; i++)
+					palette[i][c] = (float)((((e0 * (64 - weights[i]) + e1 * weights[i] + 32) >> 6) * 31) >> 6);
+			}
+			result.Error += FindBC6HIndices(texels, palette, indexCount, regionMasks[r], result.Indices);
+			// the anchor index of a region has an implied zero MSB, swap the endpoints if it is set.
+			// Interpolation weights are symmetric, so this does not change the decoded texels.
+			int anchor = r == 0 ? 0 : GetBC6HFixupTexel(pattern);
+			if (result.Indices[anchor] >= indexCount / 2)
+			{
+				for (int c = 0; c < 3; c++)
+					Swap(quantized[c], quantized[3 + c]);
+				for (int i = 0; i < 16; i++)
+					if (regionMasks[r] & (1 << i))
+						result.Indices[i] = indexCount - 1 - result.Indices[i];
+			}
+		}
+		if (mode.Transformed)
+		{
+			// store all endpoints but the first as deltas, which may wrap around the endpoint precision
+			int wrap = 1 << mode.EndpointBits;
+			for (int i = 3; i < mode.Regions * 6; i++)
+			{
+				int deltaBits = mode.DeltaBits[i % 3];
+				int minDelta = -(1 << (deltaBits - 1));
+				int maxDelta = (1 << (deltaBits - 1)) - 1;
+				int delta = result.Endpoints[i] - result.Endpoints[i % 3];
+				if (delta < minDelta)
+					delta += wrap;
+				else if (delta > maxDelta)
+					delta -= wrap;
+				if (delta < minDelta || delta > maxDelta)
+					return false;
+				result.Endpoints[i] = delta & ((1 << deltaBits) - 1);
+			}
+		}
+		return true;
+	}
+
+	static void WriteBC6HBlock(unsigned char * block, const BC6HEncoding & encoding)
+	{
+		auto & mode = BC6HModes[encoding.Mode];
+		BC6HBitWriter writer(block);
+		int modeCode = BC6HModeCodes[encoding.Mode];
+		writer.Write(modeCode, encoding.Mode < 2 ? 2 : 5);
+		for (auto & run : mode.Layout)
+		{
+			if (run.Count == 0)
+				break;
+			if (run.Count > 0)
+				writer.Write(encoding.Endpoints[run.Field] >> run.Bit, run.Count);
+			else
+			{
+				for (int i = -run.Count - 1; i >= 0; i--)
+					writer.Write(encoding.Endpoints[run.Field] >> (run.Bit + i), 1);
+			}
+		}
+		int fixupTexel = 0;
+		if (mode.Regions == 2)
+		{
+			writer.Write(encoding.Pattern, 5);
+			fixupTexel = GetBC6HFixupTexel(encoding.Pattern);
+		}
+		int indexBits = mode.Regions == 2 ? 3 : 4;
+		for (int i = 0; i < 16; i++)
+		{
+			bool isAnchor = (i == 0) || (mode.Regions == 2 && i == fixupTexel);
+			writer.Write(encoding.Indices[i], isAnchor ? indexBits - 1 : indexBits);
+		}
+	}
+
+	// error of a two-region partition with unquantized endpoints, used to select partitions worth encoding
+	static float EstimateBC6HPartitionError(const BC6HBlockTexels & texels, int pattern, BC6HRegionEndpoints & endpoints)
+	{
+		float error = 0.0f;
+		unsigned int regionMasks[2] = {};
+		for (int i = 0; i < 16; i++)
+			regionMasks[GetBC6HPartition(pattern, i)] |= 1 << i;
+		for (int r = 0; r < 2; r++)
+		{
+			FitBC6HEndpoints(texels, regionMasks[r], endpoints.Endpoints[r]);
+			float palette[16][3];
+			for (int i = 0; i < 8; i++)
+				for (int c = 0; c < 3; c++)
+					palette[i][c] = (endpoints.Endpoints[r][0][c] * (64 - BC6HWeights3[i]) + endpoints.Endpoints[r][1][c] * BC6HWeights3[i]) * (1.0f / 64.0f);
+			int indices[16];
+			error += FindBC6HIndices(texels, palette, 8, regionMasks[r], indices);
+		}
+		return error;
+	}
+
+	static void TryBC6HMode(const BC6HBlockTexels & texels, int modeId, int pattern, BC6HRegionEndpoints endpoints, bool refine, BC6HEncoding & best)
+	{
+		BC6HEncoding encoding;
+		bool valid = EncodeBC6HMode(texels, modeId, pattern, endpoints, encoding);
+		if (valid && encoding.Error < best.Error)
+			best = encoding;
+		if (!valid || !refine)
+			return;
+		auto & mode = BC6HModes[modeId];
+		const int * weights = mode.Regions == 2 ? BC6HWeights3 : BC6HWeights4;
+		for (int iteration = 0; iteration < 2; iteration++)
+		{
+			// refit the endpoints to the chosen indices, the nearest indices are then searched again
+			for (int r = 0; r < mode.Regions; r++)
+			{
+				unsigned int regionMask = 0;
+				for (int i = 0; i < 16; i++)
+					if (mode.Regions == 1 || GetBC6HPartition(pattern, i) == r)
+						regionMask |= 1 << i;
+				RefineBC6HEndpoints(texels, regionMask, encoding.Indices, weights, endpoints.Endpoints[r]);
+			}
+			valid = EncodeBC6HMode(texels, modeId, pattern, endpoints, encoding);
+			if (!valid)
+				break;
+			if (encoding.Error < best.Error)
+				best = encoding;
+		}
+	}
+
+	void TextureCompressor::CompressBC6H_Block(unsigned char * block, const VectorMath::Vec3 * texels, BC6HQuality quality)
+	{
+		BC6HBlockTexels halfTexels;
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				// unsigned BC6H only stores finite non-negative values
+				float value = texels[i][c];
+				value = value > 0.0f ? Math::Min(value, 65504.0f) : 0.0f;
+				halfTexels.Values[c][i] = (float)FloatToHalf(value);
+			}
+		}
+		bool refine = quality == BC6HQuality::High;
+		BC6HEncoding best;
+		best.Error = FLT_MAX;
+		BC6HRegionEndpoints endpoints;
+		FitBC6HEndpoints(halfTexels, 0xFFFF, endpoints.Endpoints[0]);
+		// one region modes, from the highest endpoint precision to the most precise deltas
+		for (int modeId = 10; modeId < 14; modeId++)
+			TryBC6HMode(halfTexels, modeId, 0, endpoints, refine, best);
+		if (quality != BC6HQuality::Fast && best.Error > 0.0f)
+		{
+			// two region modes are only tried for the partitions that fit the block best
+			const int maxCandidates = 32;
+			int candidateCount = quality == BC6HQuality::High ? 32 : 4;
+			float candidateErrors[maxCandidates];
+			int candidates[maxCandidates];
+			BC6HRegionEndpoints partitionEndpoints[32];
+			int count = 0;
+			for (int pattern = 0; pattern < 32; pattern++)
+			{
+				float error = EstimateBC6HPartitionError(halfTexels, pattern, partitionEndpoints[pattern]);
+				int pos = Math::Min(count, candidateCount - 1);
+				if (count == candidateCount && error >= candidateErrors[pos])
+					continue;
+				while (pos > 0 && candidateErrors[pos - 1] > error)
+				{
+					candidateErrors[pos] = candidateErrors[pos - 1];
+					candidates[pos] = candidates[pos - 1];
+					pos--;
+				}
+				candidateErrors[pos] = error;
+				candidates[pos] = pattern;
+				count = Math::Min(count + 1, candidateCount);
+			}
+			for (int i = 0; i < count; i++)
+				for (int modeId = 0; modeId < 10; modeId++)
+					TryBC6HMode(halfTexels, modeId, candidates[i], partitionEndpoints[candidates[i]], refine, best);
+		}
+		WriteBC6HBlock(block, best);
+	}
+
+	void TextureCompressor::CompressBC6H_BlockRow(unsigned char * output, const float * rgbPixels, int width, int height, int blockY, BC6HQuality quality)
+	{
+		int blocksPerRow = (width + 3) / 4;
+		for (int blockX = 0; blockX < blocksPerRow; blockX++)
+		{
+			VectorMath::Vec3 texels[16];
+			for (int ki = 0; ki < 4; ki++)
+			{
+				int y = Math::Min(blockY * 4 + ki, height - 1);
+				for (int kj = 0; kj < 4; kj++)
+				{
+					int x = Math::Min(blockX * 4 + kj, width - 1);
+					auto pixel = rgbPixels + (y * width + x) * 3;
+					texels[ki * 4 + kj] = VectorMath::Vec3::Create(pixel[0], pixel[1], pixel[2]);
+				}
+			}
+			CompressBC6H_Block(output + (blockY * blocksPerRow + blockX) * 16, texels, quality);
+		}
+	}
+
+	void TextureCompressor::CompressBC6H(unsigned char * output, const float * rgbPixels, int width, int height, BC6HQuality quality)
+	{
+		int blockRows = (height + 3) / 4;
+		GetTextureProcessingThreads().ParallelFor(0, blockRows, 1, [&](int blockY)
+		{
+			CompressBC6H_BlockRow(output, rgbPixels, width, height, blockY, quality);
+		});
+	}
+
+	void TextureCompressor::CompressRGB_BC6H(TextureFile & result, const CoreLib::ArrayView<float> & rgbPixels, int width, int height, BC6HQuality quality)
+	{
+		List<float> input;
+		input.AddRange(rgbPixels.Buffer(), rgbPixels.Count());
+		int w = width;
+		int h = height;
+		int level = 0;
+		result.Allocate(TextureStorageFormat::BC6H, width, height, Math::Max(Math::Log2Ceil(width), Math::Log2Ceil(height)) + 1, 1);
+		while (true)
+		{
+			CompressBC6H(result.GetBuffer(level).Buffer(), input.Buffer(), w, h, quality);
+			if (w == 1 && h == 1)
+				break;
+			// box filter the next mip level
+			int nw = Math::Max(w / 2, 1);
+			int nh = Math::Max(h / 2, 1);
+			List<float> next;
+			next.SetSize(nw * nh * 3);
+			for (int i = 0; i < nh; i++)
+			{
+				int i0 = Math::Min(i * 2, h - 1);
+				int i1 = Math::Min(i * 2 + 1, h - 1);
+				for (int j = 0; j < nw; j++)
+				{
+					int j0 = Math::Min(j * 2, w - 1);
+					int j1 = Math::Min(j * 2 + 1, w - 1);
+					for (int c = 0; c < 3; c++)
+						next[(i * nw + j) * 3 + c] = (input[(i0 * w + j0) * 3 + c] + input[(i0 * w + j1) * 3 + c] +
+							input[(i1 * w + j0) * 3 + c] + input[(i1 * w + j1) * 3 + c]) * 0.25f;
+				}
+			}
+			input = _Move(next);
+			w = nw;
+			h = nh;
+			level++;
+		}
+	}
+
+	// BC7 encoder. The single subset RGBA mode is tried for every block, the modes with a separate alpha index
+	// and the multi-subset modes are added depending on the quality. Multi-subset modes are only encoded for
+	// the partitions with the lowest error when fitted with unquantized endpoints.
+
+	struct BC7ModeInfo
+	{
+		int Subsets;
+		int PartitionBits;
+		int RotationBits;
+		int IndexSelectionBits;
+		int ColorBits;
+		int AlphaBits;
+		// a p-bit for each endpoint, or one shared by both endpoints of a subset
+		int EndpointPBits;
+		int SharedPBits;
+		int IndexBits;
+		// index bits of the alpha channel in the modes with a separate alpha index
+		int SecondaryIndexBits;
+	};
+	static const BC7ModeInfo BC7Modes[8] =
+	{
+		{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+		{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+		{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+		{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+		{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+		{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+		{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+		{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+	};
+
+	// subset of each texel for the two subset partitions, one bit per texel
+	static const unsigned short BC7Partitions2[64] =
+	{
+		0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+		0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+		0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+		0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+	};
+	// subset of each texel for the three subset partitions, two bits per texel
+	static const unsigned int BC7Partitions3[64] =
+	{
+		0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+		0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+		0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+		0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+		0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+		0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+		0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+		0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+	};
+	// texels whose index has an implied zero most significant bit, besides texel 0 of the first subset
+	static const unsigned char BC7Anchors2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+	};
+	static const unsigned char BC7Anchors3[2][64] =
+	{
+		{
+			3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+			3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+			8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+			3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+		},
+		{
+			15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+			15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+			15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+			15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+		}
+	};
+	static const int BC7Weights2[4] = { 0, 21, 43, 64 };
+
+	static int GetBC7Subset(int subsets, int partition, int texel)
+	{
+		if (subsets == 2)
+			return (BC7Partitions2[partition] >> texel) & 1;
+		if (subsets == 3)
+			return (BC7Partitions3[partition] >> (texel * 2)) & 3;
+		return 0;
+	}
+
+	static int GetBC7Anchor(int subsets, int partition, int subset)
+	{
+		if (subset == 0)
+			return 0;
+		if (subsets == 2)
+			return BC7Anchors2[partition];
+		return BC7Anchors3[subset - 1][partition];
+	}
+
+	static const int * GetBC7Weights(int indexBits)
+	{
+		return indexBits == 2 ? BC7Weights2 : indexBits == 3 ? BC6HWeights3 : BC6HWeights4;
+	}
+
+	static int UnquantizeBC7(int value, int bits)
+	{
+		value <<= 8 - bits;
+		return value | (value >> bits);
+	}
+
+	static int InterpolateBC7(int e0, int e1, int weight)
+	{
+		return (e0 * (64 - weight) + e1 * weight + 32) >> 6;
+	}
+
+	// texels of a block in SoA layout, r, g, b and a from 0 to 255
+	struct BC7BlockTexels
+	{
+		float Values[4][16];
+	};
+
+	// unquantized endpoints of each subset
+	struct BC7SubsetEndpoints
+	{
+		float Endpoints[3][2][4];
+	};
+
+	struct BC7Encoding
+	{
+		int Mode;
+		int Partition;
+		int Rotation;
+		int IndexSelection;
+		// quantized endpoints without p-bits
+		int Endpoints[3][2][4];
+		int PBits[3][2];
+		int ColorIndices[16];
+		// used by the modes with a separate alpha index only
+		int AlphaIndices[16];
+		float Error;
+	};
+
+	// Fits a line segment through the first channelCount channels of the texels in subsetMask along their principal axis.
+	// Returns the sum of squared distances of the texels to the line.
+	static float FitBC7Endpoints(const BC7BlockTexels & texels, unsigned int subsetMask, int channelCount, float endpoints[2][4])
+	{
+		float mean[4] = {};
+		int count = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(subsetMask & (1 << i)))
+				continue;
+			for (int c = 0; c < channelCount; c++)
+				mean[c] += texels.Values[c][i];
+			count++;
+		}
+		for (int c = 0; c < channelCount; c++)
+			mean[c] /= (float)count;
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(subsetMask & (1 << i)))
+				continue;
+			for (int c0 = 0; c0 < channelCount; c0++)
+				for (int c1 = c0; c1 < channelCount; c1++)
+					covariance[c0][c1] += (texels.Values[c0][i] - mean[c0]) * (texels.Values[c1][i] - mean[c1]);
+		}
+		for (int c0 = 0; c0 < channelCount; c0++)
+			for (int c1 = 0; c1 < c0; c1++)
+				covariance[c0][c1] = covariance[c1][c0];
+		// power iteration for the principal axis
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int c0 = 0; c0 < channelCount; c0++)
+			{
+				for (int c1 = 0; c1 < channelCount; c1++)
+					next[c0] += covariance[c0][c1] * axis[c1];
+				length = Math::Max(length, fabs(next[c0]));
+			}
+			if (length < 1e-20f)
+				break;
+			for (int c = 0; c < channelCount; c++)
+				axis[c] = next[c] / length;
+		}
+		float axisLength2 = 0.0f, variance = 0.0f, axisVariance = 0.0f;
+		for (int c0 = 0; c0 < channelCount; c0++)
+		{
+			axisLength2 += axis[c0] * axis[c0];
+			variance += covariance[c0][c0];
+			for (int c1 = 0; c1 < channelCount; c1++)
+				axisVariance += axis[c0] * covariance[c0][c1] * axis[c1];
+		}
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(subsetMask & (1 << i)))
+				continue;
+			float t = 0.0f;
+			for (int c = 0; c < channelCount; c++)
+				t += (texels.Values[c][i] - mean[c]) * axis[c];
+			t /= axisLength2;
+			minT = Math::Min(minT, t);
+			maxT = Math::Max(maxT, t);
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			if (c < channelCount)
+			{
+				endpoints[0][c] = Math::Clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+				endpoints[1][c] = Math::Clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+			}
+			else
+				endpoints[0][c] = endpoints[1][c] = 255.0f;
+		}
+		return Math::Max(variance - axisVariance / axisLength2, 0.0f);
+	}
+
+	// fits the alpha channel of the modes with a separate alpha index to its range
+	static void FitBC7AlphaEndpoints(const BC7BlockTexels & texels, float endpoints[2][4])
+	{
+		endpoints[0][3] = 255.0f;
+		endpoints[1][3] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			endpoints[0][3] = Math::Min(endpoints[0][3], texels.Values[3][i]);
+			endpoints[1][3] = Math::Max(endpoints[1][3], texels.Values[3][i]);
+		}
+	}
+
+	// Least squares fit of channels [firstChannel, endChannel) of the endpoints of a subset to the texels given their interpolation weights.
+	static void RefineBC7Endpoints(const BC7BlockTexels & texels, unsigned int subsetMask, const int * indices, const int * weights,
+		int firstChannel, int endChannel, float endpoints[2][4])
+	{
+		float a00 = 0.0f, a01 = 0.0f, a11 = 0.0f;
+		float b0[4] = {}, b1[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			if (!(subsetMask & (1 << i)))
+				continue;
+			float w = weights[indices[i]] * (1.0f / 64.0f);
+			float iw = 1.0f - w;
+			a00 += iw * iw;
+			a01 += iw * w;
+			a11 += w * w;
+			for (int c = firstChannel; c < endChannel; c++)
+			{
+				b0[c] += iw * texels.Values[c][i];
+				b1[c] += w * texels.Values[c][i];
+			}
+		}
+		float det = a00 * a11 - a01 * a01;
+		if (fabs(det) < 1e-6f)
+			return;
+		float invDet = 1.0f / det;
+		for (int c = firstChannel; c < endChannel; c++)
+		{
+			endpoints[0][c] = Math::Clamp((a11 * b0[c] - a01 * b1[c]) * invDet, 0.0f, 255.0f);
+			endpoints[1][c] = Math::Clamp((a00 * b1[c] - a01 * b0[c]) * invDet, 0.0f, 255.0f);
+		}
+	}
+
+	// quantizes an endpoint component to `bits` bits, followed by pBit unless it is negative. Returns the decoded value.
+	static int QuantizeBC7Component(float value, int bits, int pBit, int & quantized)
+	{
+		int maxValue = (1 << bits) - 1;
+		if (pBit < 0)
+		{
+			quantized = Math::Clamp((int)(value * maxValue * (1.0f / 255.0f) + 0.5f), 0, maxValue);
+			return UnquantizeBC7(quantized, bits);
+		}
+		float code = value * ((2 << bits) - 1) * (1.0f / 255.0f);
+		quantized = Math::Clamp((int)((code - pBit) * 0.5f + 0.5f), 0, maxValue);
+		return UnquantizeBC7((quantized << 1) | pBit, bits + 1);
+	}
+
+	// quantizes the endpoints of a subset and picks their p-bits, decoded receives the decoded endpoints
+	static void QuantizeBC7Endpoints(const BC7ModeInfo & mode, const float endpoints[2][4], int quantized[2][4], int pBits[2], int decoded[2][4])
+	{
+		int channelCount = mode.AlphaBits ? 4 : 3;
+		auto quantizeEndpoint = [&](int e, int pBit, int * q, int * d)
+		{
+			float error = 0.0f;
+			for (int c = 0; c < channelCount; c++)
+			{
+				d[c] = QuantizeBC7Component(endpoints[e][c], c < 3 ? mode.ColorBits : mode.AlphaBits, pBit, q[c]);
+				float diff = d[c] - endpoints[e][c];
+				error += diff * diff;
+			}
+			if (channelCount == 3)
+			{
+				q[3] = 0;
+				d[3] = 255;
+			}
+			return error;
+		};
+		if (!mode.EndpointPBits && !mode.SharedPBits)
+		{
+			for (int e = 0; e < 2; e++)
+			{
+				quantizeEndpoint(e, -1, quantized[e], decoded[e]);
+				pBits[e] = 0;
+			}
+			return;
+		}
+		int candidates[2][2][4], candidateDecoded[2][2][4];
+		float errors[2][2];
+		for (int e = 0; e < 2; e++)
+			for (int p = 0; p < 2; p++)
+				errors[e][p] = quantizeEndpoint(e, p, candidates[e][p], candidateDecoded[e][p]);
+		for (int e = 0; e < 2; e++)
+		{
+			int p;
+			if (mode.EndpointPBits)
+				p = errors[e][1] < errors[e][0] ? 1 : 0;
+			else
+				p = errors[0][1] + errors[1][1] < errors[0][0] + errors[1][0] ? 1 : 0;
+			pBits[e] = p;
+			memcpy(quantized[e], candidates[e][p], sizeof(int) * 4);
+			memcpy(decoded[e], candidateDecoded[e][p], sizeof(int) * 4);
+		}
+	}
+
+	// Picks the nearest palette entry for every texel in subsetMask, comparing channels [firstChannel, endChannel).
+	// Returns the sum of squared errors of these channels.
+	static float FindBC7Indices(const BC7BlockTexels & texels, const int decoded[2][4], int indexBits, int firstChannel, int endChannel,
+		unsigned int subsetMask, int * indices)
+	{
+		auto weights = GetBC7Weights(indexBits);
+		int entryCount = 1 << indexBits;
+		float palette[16][4];
+		for (int i = 0; i < entryCount; i++)
+			for (int c = firstChannel; c < endChannel; c++)
+				palette[i][c] = (float)InterpolateBC7(decoded[0][c], decoded[1][c], weights[i]);
+		float error = 0.0f;
+		for (int t = 0; t < 16; t++)
+		{
+			if (!(subsetMask & (1 << t)))
+				continue;
+			float bestError = FLT_MAX;
+			for (int i = 0; i < entryCount; i++)
+			{
+				float e = 0.0f;
+				for (int c = firstChannel; c < endChannel; c++)
+				{
+					float diff = palette[i][c] - texels.Values[c][t];
+					e += diff * diff;
+				}
+				if (e < bestError)
+				{
+					bestError = e;
+					indices[t] = i;
+				}
+			}
+			error += bestError;
+		}
+		return error;
+	}
+
+	static unsigned int GetBC7SubsetMask(int subsets, int partition, int subset)
+	{
+		unsigned int mask = 0;
+		for (int i = 0; i < 16; i++)
+			if (GetBC7Subset(subsets, partition, i) == subset)
+				mask |= 1 << i;
+		return mask;
+	}
+
+	// encodes texels, already rotated for the modes with a rotation, with the given mode and unquantized endpoints
+	static void EncodeBC7Mode(const BC7BlockTexels & texels, int modeId, int partition, int rotation, int indexSelection,
+		const BC7SubsetEndpoints & endpoints, BC7Encoding & result)
+	{
+		auto & mode = BC7Modes[modeId];
+		bool separateAlpha = mode.SecondaryIndexBits != 0;
+		int colorIndexBits = separateAlpha && indexSelection ? mode.SecondaryIndexBits : mode.IndexBits;
+		int alphaIndexBits = indexSelection ? mode.IndexBits : mode.SecondaryIndexBits;
+		int colorChannels = separateAlpha || !mode.AlphaBits ? 3 : 4;
+		result.Mode = modeId;
+		result.Partition = partition;
+		result.Rotation = rotation;
+		result.IndexSelection = indexSelection;
+		result.Error = 0.0f;
+		for (int s = 0; s < mode.Subsets; s++)
+		{
+			unsigned int subsetMask = GetBC7SubsetMask(mode.Subsets, partition, s);
+			int decoded[2][4];
+			QuantizeBC7Endpoints(mode, endpoints.Endpoints[s], result.Endpoints[s], result.PBits[s], decoded);
+			result.Error += FindBC7Indices(texels, decoded, colorIndexBits, 0, colorChannels, subsetMask, result.ColorIndices);
+			if (separateAlpha)
+				result.Error += FindBC7Indices(texels, decoded, alphaIndexBits, 3, 4, subsetMask, result.AlphaIndices);
+			else if (!mode.AlphaBits)
+			{
+				// alpha is decoded as 255
+				for (int i = 0; i < 16; i++)
+					if (subsetMask & (1 << i))
+						result.Error += (255.0f - texels.Values[3][i]) * (255.0f - texels.Values[3][i]);
+			}
+			// the anchor index of a subset has an implied zero MSB, swap the endpoints if it is set.
+			// Interpolation weights are symmetric, so this does not change the decoded texels.
+			int anchor = GetBC7Anchor(mode.Subsets, partition, s);
+			int colorIndexCount = 1 << colorIndexBits;
+			if (result.ColorIndices[anchor] >= colorIndexCount / 2)
+			{
+				for (int c = 0; c < colorChannels; c++)
+					Swap(result.Endpoints[s][0][c], result.Endpoints[s][1][c]);
+				if (mode.EndpointPBits)
+					Swap(result.PBits[s][0], result.PBits[s][1]);
+				for (int i = 0; i < 16; i++)
+					if (subsetMask & (1 << i))
+						result.ColorIndices[i] = colorIndexCount - 1 - result.ColorIndices[i];
+			}
+			int alphaIndexCount = 1 << alphaIndexBits;
+			if (separateAlpha && result.AlphaIndices[0] >= alphaIndexCount / 2)
+			{
+				Swap(result.Endpoints[s][0][3], result.Endpoints[s][1][3]);
+				for (int i = 0; i < 16; i++)
+					result.AlphaIndices[i] = alphaIndexCount - 1 - result.AlphaIndices[i];
+			}
+		}
+	}
+
+	static void TryBC7Mode(const BC7BlockTexels & texels, int modeId, int partition, int rotation, int indexSelection,
+		BC7SubsetEndpoints endpoints, bool refine, BC7Encoding & best)
+	{
+		BC7Encoding encoding;
+		EncodeBC7Mode(texels, modeId, partition, rotation, indexSelection, endpoints, encoding);
+		if (encoding.Error < best.Error)
+			best = encoding;
+		if (!refine)
+			return;
+		auto & mode = BC7Modes[modeId];
+		bool separateAlpha = mode.SecondaryIndexBits != 0;
+		auto colorWeights = GetBC7Weights(separateAlpha && indexSelection ? mode.SecondaryIndexBits : mode.IndexBits);
+		auto alphaWeights = GetBC7Weights(indexSelection ? mode.IndexBits : mode.SecondaryIndexBits);
+		int colorChannels = separateAlpha || !mode.AlphaBits ? 3 : 4;
+		for (int iteration = 0; iteration < 2; iteration++)
+		{
+			// refit the endpoints to the chosen indices, the nearest indices are then searched again
+			for (int s = 0; s < mode.Subsets; s++)
+			{
+				unsigned int subsetMask = GetBC7SubsetMask(mode.Subsets, partition, s);
+				RefineBC7Endpoints(texels, subsetMask, encoding.ColorIndices, colorWeights, 0, colorChannels, endpoints.Endpoints[s]);
+				if (separateAlpha)
+					RefineBC7Endpoints(texels, subsetMask, encoding.AlphaIndices, alphaWeights, 3, 4, endpoints.Endpoints[s]);
+			}
+			EncodeBC7Mode(texels, modeId, partition, rotation, indexSelection, endpoints, encoding);
+			if (encoding.Error < best.Error)
+				best = encoding;
+		}
+	}
+
+	// error of a partition with unquantized endpoints and continuous interpolation, used to select partitions worth encoding
+	static float EstimateBC7PartitionError(const BC7BlockTexels & texels, int subsets, int partition, int channelCount, BC7SubsetEndpoints & endpoints)
+	{
+		float error = 0.0f;
+		for (int s = 0; s < subsets; s++)
+			error += FitBC7Endpoints(texels, GetBC7SubsetMask(subsets, partition, s), channelCount, endpoints.Endpoints[s]);
+		return error;
+	}
+
+	// returns up to candidateCount partitions with the lowest estimated error, sorted by error
+	static int FindBC7PartitionCandidates(const BC7BlockTexels & texels, int subsets, int channelCount, int candidateCount,
+		int * candidates, BC7SubsetEndpoints * partitionEndpoints)
+	{
+		float candidateErrors[64];
+		int count = 0;
+		for (int partition = 0; partition < 64; partition++)
+		{
+			float error = EstimateBC7PartitionError(texels, subsets, partition, channelCount, partitionEndpoints[partition]);
+			int pos = Math::Min(count, candidateCount - 1);
+			if (count == candidateCount && error >= candidateErrors[pos])
+				continue;
+			while (pos > 0 && candidateErrors[pos - 1] > error)
+			{
+				candidateErrors[pos] = candidateErrors[pos - 1];
+				candidates[pos] = candidates[pos - 1];
+				pos--;
+			}
+			candidateErrors[pos] = error;
+			candidates[pos] = partition;
+			count = Math::Min(count + 1, candidateCount);
+		}
+		return count;
+	}
+
+	static void WriteBC7Block(unsigned char * block, const BC7Encoding & encoding)
+	{
+		auto & mode = BC7Modes[encoding.Mode];
+		BC6HBitWriter writer(block);
+		writer.Write(1u << encoding.Mode, encoding.Mode + 1);
+		writer.Write(encoding.Partition, mode.PartitionBits);
+		writer.Write(encoding.Rotation, mode.RotationBits);
+		writer.Write(encoding.IndexSelection, mode.IndexSelectionBits);
+		for (int c = 0; c < 4; c++)
+		{
+			int bits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+			for (int s = 0; s < mode.Subsets; s++)
+				for (int e = 0; e < 2; e++)
+					writer.Write(encoding.Endpoints[s][e][c], bits);
+		}
+		for (int s = 0; s < mode.Subsets; s++)
+		{
+			if (mode.EndpointPBits)
+			{
+				writer.Write(encoding.PBits[s][0], 1);
+				writer.Write(encoding.PBits[s][1], 1);
+			}
+			else if (mode.SharedPBits)
+				writer.Write(encoding.PBits[s][0], 1);
+		}
+		// with index selection the color indices are stored in the secondary index bits
+		const int * primaryIndices = encoding.IndexSelection ? encoding.AlphaIndices : encoding.ColorIndices;
+		for (int i = 0; i < 16; i++)
+		{
+			bool isAnchor = false;
+			for (int s = 0; s < mode.Subsets; s++)
+				isAnchor |= GetBC7Anchor(mode.Subsets, encoding.Partition, s) == i;
+			writer.Write(primaryIndices[i], isAnchor ? mode.IndexBits - 1 : mode.IndexBits);
+		}
+		if (mode.SecondaryIndexBits)
+		{
+			const int * secondaryIndices = encoding.IndexSelection ? encoding.ColorIndices : encoding.AlphaIndices;
+			for (int i = 0; i < 16; i++)
+				writer.Write(secondaryIndices[i], i == 0 ? mode.SecondaryIndexBits - 1 : mode.SecondaryIndexBits);
+		}
+	}
+
+	void TextureCompressor::DecompressBC7_Block(const unsigned char * block, unsigned char * rgbaTexels)
+	{
+		BC6HBitReader reader(block);
+		int modeId = 0;
+		while (modeId < 8 && !reader.Read(1))
+			modeId++;
+		if (modeId == 8)
+		{
+			// reserved mode
+			memset(rgbaTexels, 0, 64);
+			return;
+		}
+		auto & mode = BC7Modes[modeId];
+		int partition = (int)reader.Read(mode.PartitionBits);
+		int rotation = (int)reader.Read(mode.RotationBits);
+		int indexSelection = (int)reader.Read(mode.IndexSelectionBits);
+		int endpoints[3][2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			int bits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+			for (int s = 0; s < mode.Subsets; s++)
+				for (int e = 0; e < 2; e++)
+					endpoints[s][e][c] = (int)reader.Read(bits);
+		}
+		for (int s = 0; s < mode.Subsets; s++)
+		{
+			int pBits[2] = { -1, -1 };
+			if (mode.EndpointPBits)
+			{
+				pBits[0] = (int)reader.Read(1);
+				pBits[1] = (int)reader.Read(1);
+			}
+			else if (mode.SharedPBits)
+				pBits[0] = pBits[1] = (int)reader.Read(1);
+			for (int e = 0; e < 2; e++)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					int bits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+					if (!bits)
+						endpoints[s][e][c] = 255;
+					else if (pBits[e] >= 0)
+						endpoints[s][e][c] = UnquantizeBC7((endpoints[s][e][c] << 1) | pBits[e], bits + 1);
+					else
+						endpoints[s][e][c] = UnquantizeBC7(endpoints[s][e][c], bits);
+				}
+			}
+		}
+		int primaryIndices[16], secondaryIndices[16];
+		for (int i = 0; i < 16; i++)
+		{
+			bool isAnchor = false;
+			for (int s = 0; s < mode.Subsets; s++)
+				isAnchor |= GetBC7Anchor(mode.Subsets, partition, s) == i;
+			primaryIndices[i] = (int)reader.Read(isAnchor ? mode.IndexBits - 1 : mode.IndexBits);
+		}
+		if (mode.SecondaryIndexBits)
+		{
+			for (int i = 0; i < 16; i++)
+				secondaryIndices[i] = (int)reader.Read(i == 0 ? mode.SecondaryIndexBits - 1 : mode.SecondaryIndexBits);
+		}
+		auto primaryWeights = GetBC7Weights(mode.IndexBits);
+		auto secondaryWeights = GetBC7Weights(mode.SecondaryIndexBits);
+		for (int i = 0; i < 16; i++)
+		{
+			int s = GetBC7Subset(mode.Subsets, partition, i);
+			int colorWeight = primaryWeights[primaryIndices[i]];
+			int alphaWeight = colorWeight;
+			if (mode.SecondaryIndexBits)
+			{
+				alphaWeight = secondaryWeights[secondaryIndices[i]];
+				if (indexSelection)
+					Swap(colorWeight, alphaWeight);
+			}
+			auto texel = rgbaTexels + i * 4;
+			for (int c = 0; c < 4; c++)
+				texel[c] = (unsigned char)InterpolateBC7(endpoints[s][0][c], endpoints[s][1][c], c < 3 ? colorWeight : alphaWeight);
+			if (rotation)
+				Swap(texel[rotation - 1], texel[3]);
+		}
+	}
+
+	static void DecompressColorBlock(const unsigned char * block, unsigned char * rgbaTexels, bool allowThreeColorMode)
+	{
+		int packed[2] = { block[0] | (block[1] << 8), block[2] | (block[3] << 8) };
+		int palette[4][4];
+		for (int i = 0; i < 2; i++)
+		{
+			int r = (packed[i] >> 11) & 31, g = (packed[i] >> 5) & 63, b = packed[i] & 31;
+			palette[i][0] = (r << 3) | (r >> 2);
+			palette[i][1] = (g << 2) | (g >> 4);
+			palette[i][2] = (b << 3) | (b >> 2);
+			palette[i][3] = 255;
+		}
+		bool threeColorMode = allowThreeColorMode && packed[0] <= packed[1];
+		for (int c = 0; c < 3; c++)
+		{
+			if (threeColorMode)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] * 2 + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + palette[1][c] * 2) / 3;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = threeColorMode ? 0 : 255;
+		unsigned int indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+		for (int i = 0; i < 16; i++)
+		{
+			auto color = palette[(indices >> (i * 2)) & 3];
+			for (int c = 0; c < 4; c++)
+				rgbaTexels[i * 4 + c] = (unsigned char)color[c];
+		}
+	}
+
+	void TextureCompressor::DecompressBC1_Block(const unsigned char * block, unsigned char * rgbaTexels)
+	{
+		DecompressColorBlock(block, rgbaTexels, true);
+	}
+
+	void TextureCompressor::DecompressBC3_Block(const unsigned char * block, unsigned char * rgbaTexels)
+	{
+		DecompressColorBlock(block + 8, rgbaTexels, false);
+		int alpha[8] = { block[0], block[1] };
+		for (int i = 2; i < 8; i++)
+		{
+			if (alpha[0] > alpha[1])
+				alpha[i] = (alpha[0] * (8 - i) + alpha[1] * (i - 1)) / 7;
+			else if (i < 6)
+				alpha[i] = (alpha[0] * (6 - i) + alpha[1] * (i - 1)) / 5;
+			else
+				alpha[i] = i == 6 ? 0 : 255;
+		}
+		unsigned long long indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= (unsigned long long)block[2 + i] << (i * 8);
+		for (int i = 0; i < 16; i++)
+			rgbaTexels[i * 4 + 3] = (unsigned char)alpha[(indices >> (i * 3)) & 7];
+	}
+
+	void TextureCompressor::DecompressRGBA(List<unsigned int> & rgbaPixels, TextureFile & texture, int level)
+	{
+		int width = Math::Max(1, texture.GetWidth() >> level);
+		int height = Math::Max(1, texture.GetHeight() >> level);
+		auto data = texture.GetBuffer(level).Buffer();
+		rgbaPixels.SetSize(width * height);
+		auto format = texture.GetFormat();
+		if (format == TextureStorageFormat::BC1 || format == TextureStorageFormat::BC3 || format == TextureStorageFormat::BC7)
+		{
+			int blockSize = format == TextureStorageFormat::BC1 ? 8 : 16;
+			int blocksX = (width + 3) / 4;
+			int blocksY = (height + 3) / 4;
+			for (int by = 0; by < blocksY; by++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					unsigned int texels[16];
+					auto block = data + (by * blocksX + bx) * blockSize;
+					if (format == TextureStorageFormat::BC1)
+						DecompressBC1_Block(block, (unsigned char*)texels);
+					else if (format == TextureStorageFormat::BC3)
+						DecompressBC3_Block(block, (unsigned char*)texels);
+					else
+						DecompressBC7_Block(block, (unsigned char*)texels);
+					for (int y = 0; y < 4 && by * 4 + y < height; y++)
+						for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+							rgbaPixels[(by * 4 + y) * width + bx * 4 + x] = texels[y * 4 + x];
+				}
+			}
+			return;
+		}
+		int channels = 0;
+		switch (format)
+		{
+		case TextureStorageFormat::R8:
+			channels = 1;
+			break;
+		case TextureStorageFormat::RG8:
+			channels = 2;
+			break;
+		case TextureStorageFormat::RGB8:
+			channels = 3;
+			break;
+		case TextureStorageFormat::RGBA8:
+			channels = 4;
+			break;
+		default:
+			throw NotImplementedException("DecompressRGBA: unsupported texture format.");
+		}
+		for (int i = 0; i < width * height; i++)
+		{
+			unsigned char texel[4] = { 0, 0, 0, 255 };
+			for (int c = 0; c < channels; c++)
+				texel[c] = data[i * channels + c];
+			rgbaPixels[i] = texel[0] | (texel[1] << 8) | (texel[2] << 16) | ((unsigned int)texel[3] << 24);
+		}
+	}
+
+	void TextureCompressor::LoadImageFile_RGBA(List<unsigned int> & rgbaPixels, int & width, int & height, const CoreLib::String & fileName)
+	{
+		LoadImagePixels(fileName, rgbaPixels, width, height);
+	}
+
+	void TextureCompressor::CompressBC7_Block(unsigned char * block, const unsigned char * rgbaTexels, BC7Quality quality)
+	{
+		BC7BlockTexels texels;
+		bool opaque = true;
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+				texels.Values[c][i] = rgbaTexels[i * 4 + c];
+			opaque &= rgbaTexels[i * 4 + 3] == 255;
+		}
+		bool refine = quality == BC7Quality::High;
+		BC7Encoding best;
+		best.Error = FLT_MAX;
+		BC7SubsetEndpoints endpoints;
+		FitBC7Endpoints(texels, 0xFFFF, 4, endpoints.Endpoints[0]);
+		TryBC7Mode(texels, 6, 0, 0, 0, endpoints, refine, best);
+		if (quality == BC7Quality::Fast || best.Error == 0.0f)
+		{
+			WriteBC7Block(block, best);
+			return;
+		}
+		// modes with a separate alpha index, where the rotation swaps alpha with a color channel
+		for (int rotation = 0; rotation < (quality == BC7Quality::High ? 4 : 1); rotation++)
+		{
+			BC7BlockTexels rotatedTexels = texels;
+			if (rotation)
+			{
+				for (int i = 0; i < 16; i++)
+					Swap(rotatedTexels.Values[rotation - 1][i], rotatedTexels.Values[3][i]);
+			}
+			FitBC7Endpoints(rotatedTexels, 0xFFFF, 3, endpoints.Endpoints[0]);
+			FitBC7AlphaEndpoints(rotatedTexels, endpoints.Endpoints[0]);
+			TryBC7Mode(rotatedTexels, 5, 0, rotation, 0, endpoints, refine, best);
+			TryBC7Mode(rotatedTexels, 4, 0, rotation, 0, endpoints, refine, best);
+			TryBC7Mode(rotatedTexels, 4, 0, rotation, 1, endpoints, refine, best);
+		}
+		// multi-subset modes only store alpha in mode 7
+		int candidates[64];
+		BC7SubsetEndpoints partitionEndpoints[64];
+		int count = FindBC7PartitionCandidates(texels, 2, opaque ? 3 : 4, quality == BC7Quality::High ? 16 : 4, candidates, partitionEndpoints);
+		for (int i = 0; i < count; i++)
+		{
+			if (opaque)
+			{
+				TryBC7Mode(texels, 1, candidates[i], 0, 0, partitionEndpoints[candidates[i]], refine, best);
+				TryBC7Mode(texels, 3, candidates[i], 0, 0, partitionEndpoints[candidates[i]], refine, best);
+			}
+			else
+				TryBC7Mode(texels, 7, candidates[i], 0, 0, partitionEndpoints[candidates[i]], refine, best);
+		}
+		if (opaque)
+		{
+			count = FindBC7PartitionCandidates(texels, 3, 3, quality == BC7Quality::High ? 16 : 2, candidates, partitionEndpoints);
+			for (int i = 0; i < count; i++)
+			{
+				TryBC7Mode(texels, 2, candidates[i], 0, 0, partitionEndpoints[candidates[i]], refine, best);
+				// mode 0 has 4 partition bits
+				if (candidates[i] < 16)
+					TryBC7Mode(texels, 0, candidates[i], 0, 0, partitionEndpoints[candidates[i]], refine, best);
+			}
+		}
+		WriteBC7Block(block, best);
+	}
+
+	void TextureCompressor::CompressRGBA_BC7(TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, BC7Quality quality, const MipGenerationOptions & mipOptions)
+	{
+        CompressTexture(result, TextureStorageFormat::BC7, [=](unsigned char * output, unsigned char * input) { CompressBC7_Block(output, input, quality); },
+            rgbaPixels, width, height, mipOptions);
+	}
+
+	void TextureCompressor::CompressImageFile_BC7(TextureFile & result, const CoreLib::String & fileName, BC7Quality quality, const MipGenerationOptions & mipOptions)
+	{
+		List<unsigned int> pixels;
+		int width, height;
+		LoadImagePixels(fileName, pixels, width, height);
+		CompressRGBA_BC7(result, MakeArrayView((unsigned char*)pixels.Buffer(), pixels.Count() * 4), width, height, quality, mipOptions);
+	}
+}
@@ -3,15 +3,78 @@
 
 #include "CoreLib/Basic.h"
 #include "CoreLib/Graphics/TextureFile.h"
+#include "CoreLib/VectorMath.h"
+#include "MipGenerator.h"
 
 namespace GameEngine
 {
+	enum class BC6HQuality
+	{
+		// single region modes only
+		Fast,
+		// two region modes for the best fitting partitions
+		Normal,
+		// all partitions, with least squares endpoint refinement
+		High
+	};
+
+	enum class BC7Quality
+	{
+		// single subset RGBA mode only
+		Fast,
+		// adds the separate alpha modes and the best fitting partitions of the multi-subset modes
+		Normal,
+		// all alpha rotations and more partitions, with least squares endpoint refinement
+		High
+	};
+
+	enum class TextureCompressionQuality
+	{
+		// SIMD range fit of the block bounding box, for textures compressed at load time and during iteration
+		Fast,
+		// stb_dxt with refined endpoints, for cooked and shipped textures
+		High
+	};
+
 	class TextureCompressor
 	{
 	public:
-		static void CompressRGBA_BC1(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height);
-		static void CompressRGBA_BC3(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height);
-		static void CompressRG_BC5(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height);
+		// the mip chain is generated first and the blocks of all levels are compressed in a single parallel loop on
+		// GetTextureProcessingThreads().
+		// Mips are filtered as sRGB color by default, BC5 mips as linear data.
+		static void CompressRGBA_BC1(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality = TextureCompressionQuality::High, const MipGenerationOptions & mipOptions = MipGenerationOptions());
+		static void CompressRGBA_BC3(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality = TextureCompressionQuality::High, const MipGenerationOptions & mipOptions = MipGenerationOptions());
+		static void CompressRG_BC5(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, TextureCompressionQuality quality = TextureCompressionQuality::High, const MipGenerationOptions & mipOptions = MipGenerationOptions(MipContent::Linear));
+		// loads an image file and compresses it to BC1. Rows are flipped to the bottom-up order of texture files.
+		static void CompressImageFile_BC1(CoreLib::Graphics::TextureFile & result, const CoreLib::String & fileName, TextureCompressionQuality quality = TextureCompressionQuality::High, const MipGenerationOptions & mipOptions = MipGenerationOptions());
+		// encode 4x4 RGBA texels stored in row major order into a block.
+		static void CompressBC1_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality);
+		static void CompressBC3_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality);
+		static void CompressBC5_Block(unsigned char * block, const unsigned char * rgbaTexels, TextureCompressionQuality quality);
+		// decodes a 16-byte unsigned BC6H block into 4x4 texels stored in row major order.
+		static void DecompressBC6H_Block(const unsigned char * block, VectorMath::Vec3 * texels);
+		// encodes 4x4 texels stored in row major order into a 16-byte unsigned BC6H block.
+		static void CompressBC6H_Block(unsigned char * block, const VectorMath::Vec3 * texels, BC6HQuality quality);
+		// encodes a row of 4x4 blocks of an RGB float image into unsigned BC6H blocks, for callers that schedule the rows
+		// on their own threads. Edge blocks are padded by clamping.
+		static void CompressBC6H_BlockRow(unsigned char * output, const float * rgbPixels, int width, int height, int blockY, BC6HQuality quality);
+		// encodes an RGB float image into unsigned BC6H blocks stored in row major order, edge blocks are padded by clamping.
+		static void CompressBC6H(unsigned char * output, const float * rgbPixels, int width, int height, BC6HQuality quality);
+		static void CompressRGB_BC6H(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<float> & rgbPixels, int width, int height, BC6HQuality quality = BC6HQuality::Normal);
+		// decodes a 16-byte BC7 block into 4x4 RGBA texels stored in row major order.
+		static void DecompressBC7_Block(const unsigned char * block, unsigned char * rgbaTexels);
+		// decode an 8-byte BC1 or 16-byte BC3 block into 4x4 RGBA texels stored in row major order.
+		static void DecompressBC1_Block(const unsigned char * block, unsigned char * rgbaTexels);
+		static void DecompressBC3_Block(const unsigned char * block, unsigned char * rgbaTexels);
+		// decodes a mip level of an 8-bit, BC1, BC3 or BC7 texture into RGBA texels, keeping the row order of the file.
+		static void DecompressRGBA(CoreLib::List<unsigned int> & rgbaPixels, CoreLib::Graphics::TextureFile & texture, int level);
+		// loads an image file into RGBA texels, rows are flipped to the bottom-up order of texture files.
+		static void LoadImageFile_RGBA(CoreLib::List<unsigned int> & rgbaPixels, int & width, int & height, const CoreLib::String & fileName);
+		// encodes 4x4 RGBA texels stored in row major order into a 16-byte BC7 block.
+		static void CompressBC7_Block(unsigned char * block, const unsigned char * rgbaTexels, BC7Quality quality);
+		static void CompressRGBA_BC7(CoreLib::Graphics::TextureFile & result, const CoreLib::ArrayView<unsigned char> & rgbaPixels, int width, int height, BC7Quality quality = BC7Quality::Normal, const MipGenerationOptions & mipOptions = MipGenerationOptions());
+		// loads an image file and compresses it to BC7, see CompressImageFile_BC1.
+		static void CompressImageFile_BC7(CoreLib::Graphics::TextureFile & result, const CoreLib::String & fileName, BC7Quality quality = BC7Quality::Normal, const MipGenerationOptions & mipOptions = MipGenerationOptions());
 	};
 }
 
@@ -0,0 +1,399 @@
+#include "TextureStreaming.h"
+#include "Drawable.h"
+#include "Engine.h"
+#include "EngineLimits.h"
+#include "Material.h"
+#include "CoreLib/LibIO.h"
+#include "CoreLib/Graphics/TextureFile.h"
+#include <algorithm>
+#include <float.h>
+
+namespace GameEngine
+{
+    using namespace CoreLib;
+    using namespace CoreLib::IO;
+    using namespace CoreLib::Graphics;
+    using namespace CoreLib::Threading;
+
+    // levels up to this size are loaded with the texture and never evicted
+    static const int MinResidentTextureSize = 64;
+    static const int TextureStreamingIOThreadCount = 2;
+    static const int MaxPendingMipLoads = 16;
+    static const int MaxMipLevels = 32;
+
+    void MipLoadRequest::Run()
+    {
+        try
+        {
+            auto & offsets = Texture->mipOffsets;
+            if (Mip < EndMip)
+            {
+                FileStream stream(Texture->fileName);
+                stream.Seek(SeekOrigin::Start, offsets[Mip]);
+                Data.SetSize((int)(offsets[EndMip] - offsets[Mip]));
+                if (stream.Read(Data.Buffer(), Data.Count()) != Data.Count())
+                    Failed = true;
+            }
+            // each level is preceded by its size
+            for (int level = Mip; level < EndMip; level++)
+                LevelOffsets.Add((int)(offsets[level] - offsets[Mip]) + (int)sizeof(int));
+        }
+        catch (const IOException &)
+        {
+            Failed = true;
+        }
+        Completed = true;
+    }
+
+    Int64 StreamedTexture::GetSize(int mip)
+    {
+        Int64 size = 0;
+        for (int level = mip; level < mipLevels; level++)
+            size += mipSizes[level];
+        return size;
+    }
+
+    TextureStreamer::TextureStreamer(HardwareRenderer * hw)
+        : hardwareRenderer(hw)
+    {
+        ioThreads = new ThreadPool(TextureStreamingIOThreadCount);
+    }
+
+    TextureStreamer::~TextureStreamer()
+    {
+        ioThreads->Wait(ioTasks);
+    }
+
+    StreamedTexture * TextureStreamer::LoadTexture(const String & name, const String & fileName)
+    {
+        RefPtr<StreamedTexture> result = new StreamedTexture();
+        result->name = name;
+        result->fileName = fileName;
+        {
+            BinaryReader reader(new FileStream(fileName));
+            TextureFileHeader header;
+            int headerSize = reader.ReadInt32();
+            if (headerSize != sizeof(header))
+                return nullptr;
+            reader.Read((unsigned char*)&header, headerSize);
+            if (header.Type != TextureType::Texture2D)
+                return nullptr;
+            switch (header.Format)
+            {
+            case TextureStorageFormat::BC1:
+                result->format = StorageFormat::BC1;
+                break;
+            case TextureStorageFormat::BC3:
+                result->format = StorageFormat::BC3;
+                break;
+            case TextureStorageFormat::BC5:
+                result->format = StorageFormat::BC5;
+                break;
+            case TextureStorageFormat::BC7:
+                result->format = StorageFormat::RGBA_Compressed;
+                break;
+            default:
+                return nullptr;
+            }
+            result->width = header.Width;
+            result->height = header.Height;
+            result->mipLevels = reader.ReadInt32();
+            if (result->mipLevels < 2 || result->mipLevels > MaxMipLevels || Math::Max(header.Width, header.Height) <= MinResidentTextureSize)
+                return nullptr;
+            // record where each level is, the levels themselves are read when they are needed
+            Int64 offset = sizeof(int) + headerSize + sizeof(int);
+            for (int level = 0; level < result->mipLevels; level++)
+            {
+                int size = reader.ReadInt32();
+                if (size != (int)GetTextureDataSize(header.Format, Math::Max(1, header.Width >> level), Math::Max(1, header.Height >> level)))
+                    return nullptr;
+                result->mipOffsets.Add(offset);
+                result->mipSizes.Add(size);
+                offset += sizeof(int) + size;
+                if (level + 1 < result->mipLevels)
+                    reader.GetStream()->Seek(SeekOrigin::Current, size);
+            }
+            result->mipOffsets.Add(offset);
+        }
+        result->tailMip = result->mipLevels - 1;
+        for (int level = 0; level < result->mipLevels; level++)
+        {
+            if (Math::Max(result->width >> level, result->height >> level) <= MinResidentTextureSize)
+            {
+                result->tailMip = level;
+                break;
+            }
+        }
+        MipLoadRequest tailLoad;
+        tailLoad.Texture = result.Ptr();
+        tailLoad.Mip = result->tailMip;
+        tailLoad.EndMip = result->mipLevels;
+        tailLoad.Run();
+        if (tailLoad.Failed)
+            return nullptr;
+        result->tailData = _Move(tailLoad.Data);
+        result->tailLevelOffsets = _Move(tailLoad.LevelOffsets);
+        result->residentMip = result->tailMip;
+        SwapTexture(result.Ptr(), result->tailMip, nullptr, Engine::Instance()->GetFrameId());
+        result->requestedMip = result->targetMip = result->tailMip;
+        textures[name] = result;
+        return result.Ptr();
+    }
+
+    StreamedTexture * TextureStreamer::FindTexture(const String & name)
+    {
+        RefPtr<StreamedTexture> result;
+        if (textures.TryGetValue(name, result))
+            return result.Ptr();
+        return nullptr;
+    }
+
+    void TextureStreamer::RequestMips(ArrayView<Drawable*> drawables, const View & view, int screenHeight)
+    {
+        int frame = Engine::Instance()->GetFrameId();
+        float tanHalfFov = tanf(view.FOV * (Math::Pi / 360.0f));
+        for (auto drawable : drawables)
+        {
+            auto material = drawable->GetMaterial();
+            if (!material || material->StreamedTextures.Bindings.Count() == 0)
+                continue;
+            // size of the bounding sphere on screen, assuming that a texture covers the drawable once
+            float projectedSize = FLT_MAX;
+            auto & bounds = drawable->Bounds;
+            if (bounds.Min.x <= bounds.Max.x)
+            {
+                auto center = (bounds.Min + bounds.Max) * 0.5f;
+                float radius = (bounds.Max - bounds.Min).Length() * 0.5f;
+                float distance = (center - view.Position).Length() - radius;
+                if (distance > 0.0f)
+                    projectedSize = radius * screenHeight / (distance * tanHalfFov);
+            }
+            for (auto & binding : material->StreamedTextures.Bindings)
+            {
+                auto texture = binding.Texture.Ptr();
+                float textureSize = (float)Math::Max(texture->width, texture->height);
+                int mip = 0;
+                if (projectedSize < textureSize)
+                    mip = Math::Min(texture->tailMip, (int)Math::Log2Floor((unsigned int)(textureSize / Math::Max(projectedSize, 1.0f))));
+                if (texture->lastRequestFrame != frame)
+                {
+                    texture->lastRequestFrame = frame;
+                    texture->requestedMip = mip;
+                }
+                else
+                    texture->requestedMip = Math::Min(texture->requestedMip, mip);
+            }
+        }
+    }
+
+    void TextureStreamer::UpdateMaterialBindings(Material * material)
+    {
+        auto & streamedTextures = material->StreamedTextures;
+        int frame = Engine::Instance()->GetFrameId();
+        if (streamedTextures.LastUpdateFrame == frame)
+            return;
+        bool changed = false;
+        for (auto & binding : streamedTextures.Bindings)
+            changed |= binding.BoundVersion != binding.Texture->version;
+        if (!changed)
+            return;
+        // switching descriptor set versions at most once per frame ensures that the next version is no longer
+        // used by the frames in flight
+        streamedTextures.LastUpdateFrame = frame;
+        auto descSet = material->MaterialModule.SwitchToNextVersion();
+        descSet->BeginUpdate();
+        for (auto & binding : streamedTextures.Bindings)
+        {
+            descSet->Update(binding.Location, binding.Texture->GetTexture(), TextureAspect::Color);
+            binding.BoundVersion = binding.Texture->version;
+        }
+        descSet->EndUpdate();
+    }
+
+    void TextureStreamer::SwapTexture(StreamedTexture * texture, int mip, MipLoadRequest * request, int frame)
+    {
+        // the streamed data is the file range of the levels [residentMip, tailMip), loaded levels go in front of
+        // it and evicted levels are cut from its start
+        auto & offsets = texture->mipOffsets;
+        int streamedMip = Math::Min(mip, texture->tailMip);
+        if (request)
+        {
+            request->Data.AddRange(texture->streamedData);
+            texture->streamedData = _Move(request->Data);
+        }
+        else if (mip > texture->residentMip)
+        {
+            int start = (int)(offsets[streamedMip] - offsets[texture->residentMip]);
+            List<unsigned char> data;
+            data.AddRange(texture->streamedData.Buffer() + start, texture->streamedData.Count() - start);
+            texture->streamedData = _Move(data);
+        }
+        Array<void*, MaxMipLevels> mipData;
+        for (int level = mip; level < texture->tailMip; level++)
+            mipData.Add(texture->streamedData.Buffer() + (int)(offsets[level] - offsets[mip]) + sizeof(int));
+        for (int level = Math::Max(mip, texture->tailMip); level < texture->mipLevels; level++)
+            mipData.Add(texture->tailData.Buffer() + texture->tailLevelOffsets[level - texture->tailMip]);
+        RefPtr<Texture2D> newTexture = hardwareRenderer->CreateTexture2D(texture->name, TextureUsage::Sampled,
+            Math::Max(1, texture->width >> mip), Math::Max(1, texture->height >> mip),
+            texture->mipLevels - mip, texture->format, DataType::Byte4, mipData.GetArrayView());
+        if (texture->texture)
+        {
+            RetiredTexture retired;
+            retired.Texture = texture->texture;
+            retired.Frame = frame;
+            retiredTextures.Add(retired);
+            residentSize -= texture->GetSize(texture->residentMip);
+        }
+        texture->texture = newTexture;
+        texture->residentMip = mip;
+        texture->version++;
+        residentSize += texture->GetSize(texture->residentMip);
+    }
+
+    void TextureStreamer::UpdateTargetMips(int frame)
+    {
+        Int64 budget = (Int64)Engine::Instance()->GetGraphicsSettings().TextureStreamingBudget << 20;
+        Int64 targetSize = 0;
+        List<StreamedTexture*> usedTextures, unusedTextures;
+        for (auto & entry : textures)
+        {
+            auto texture = entry.Value.Ptr();
+            int currentMip = texture->pendingLoad ? texture->pendingLoad->Mip : texture->residentMip;
+            // levels finer than needed are kept as long as they fit in the budget
+            if (texture->loadFailed)
+                texture->targetMip = texture->residentMip;
+            else if (texture->lastRequestFrame >= frame - 1)
+            {
+                texture->targetMip = Math::Min(texture->requestedMip, currentMip);
+                usedTextures.Add(texture);
+            }
+            else
+            {
+                texture->targetMip = currentMip;
+                unusedTextures.Add(texture);
+            }
+            targetSize += texture->GetSize(texture->targetMip);
+        }
+        if (targetSize <= budget)
+            return;
+        auto evict = [&](StreamedTexture * texture, int maxMip)
+        {
+            while (targetSize > budget && texture->targetMip < maxMip)
+            {
+                targetSize -= texture->mipSizes[texture->targetMip];
+                texture->targetMip++;
+            }
+        };
+        // evict the least recently used textures first, then the levels finer than needed by the drawables in view
+        std::sort(unusedTextures.begin(), unusedTextures.end(), [](StreamedTexture * t0, StreamedTexture * t1)
+        {
+            return t0->lastRequestFrame < t1->lastRequestFrame;
+        });
+        for (auto texture : unusedTextures)
+            evict(texture, texture->tailMip);
+        for (auto texture : usedTextures)
+            evict(texture, Math::Max(texture->targetMip, texture->requestedMip));
+        // if that is not enough, lower the resolution of the textures in view evenly, largest levels first
+        std::sort(usedTextures.begin(), usedTextures.end(), [](StreamedTexture * t0, StreamedTexture * t1)
+        {
+            return t0->mipSizes[t0->targetMip] > t1->mipSizes[t1->targetMip];
+        });
+        bool evicted = true;
+        while (targetSize > budget && evicted)
+        {
+            evicted = false;
+            for (auto texture : usedTextures)
+            {
+                if (targetSize <= budget)
+                    break;
+                if (texture->targetMip < texture->tailMip)
+                {
+                    targetSize -= texture->mipSizes[texture->targetMip];
+                    texture->targetMip++;
+                    evicted = true;
+                }
+            }
+        }
+    }
+
+    void TextureStreamer::Update()
+    {
+        int frame = Engine::Instance()->GetFrameId();
+        // List does not destroy removed elements, so references are released before removing them
+        for (int i = 0; i < retiredTextures.Count();)
+        {
+            if (frame - retiredTextures[i].Frame >= DynamicBufferLengthMultiplier)
+            {
+                retiredTextures[i].Texture = nullptr;
+                retiredTextures.FastRemoveAt(i);
+            }
+            else
+                i++;
+        }
+        for (int i = 0; i < pendingLoads.Count();)
+        {
+            auto request = pendingLoads[i].Ptr();
+            if (request->Completed)
+            {
+                auto texture = request->Texture;
+                texture->pendingLoad = nullptr;
+                if (request->Failed)
+                {
+                    Print("cannot stream texture '%S'\n", texture->fileName.ToWString());
+                    texture->loadFailed = true;
+                }
+                else
+                    SwapTexture(texture, request->Mip, request, frame);
+                pendingLoads[i] = nullptr;
+                pendingLoads.FastRemoveAt(i);
+            }
+            else
+                i++;
+        }
+
+        UpdateTargetMips(frame);
+
+        // evictions are built from the resident data right away, the loads of the textures missing the most levels
+        // are issued first
+        List<StreamedTexture*> loads;
+        for (auto & entry : textures)
+        {
+            auto texture = entry.Value.Ptr();
+            if (texture->pendingLoad)
+                continue;
+            if (texture->targetMip > texture->residentMip)
+                SwapTexture(texture, texture->targetMip, nullptr, frame);
+            else if (texture->targetMip < texture->residentMip)
+                loads.Add(texture);
+        }
+        std::sort(loads.begin(), loads.end(), [&](StreamedTexture * t0, StreamedTexture * t1)
+        {
+            return t0->residentMip - t0->targetMip > t1->residentMip - t1->targetMip;
+        });
+        for (auto texture : loads)
+        {
+            if (pendingLoads.Count() >= MaxPendingMipLoads)
+                break;
+            RefPtr<MipLoadRequest> request = new MipLoadRequest();
+            request->Texture = texture;
+            request->Mip = texture->targetMip;
+            request->EndMip = texture->residentMip;
+            texture->pendingLoad = request;
+            pendingLoads.Add(request);
+            auto requestPtr = request.Ptr();
+            ioThreads->Submit(ioTasks, [requestPtr]()
+            {
+                requestPtr->Run();
+            });
+        }
+    }
+
+    void TextureStreamer::Clear()
+    {
+        ioThreads->Wait(ioTasks);
+        pendingLoads = List<RefPtr<MipLoadRequest>>();
+        retiredTextures = List<RetiredTexture>();
+        textures = EnumerableDictionary<String, RefPtr<StreamedTexture>>();
+        residentSize = 0;
+    }
+}
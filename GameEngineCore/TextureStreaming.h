@@ -0,0 +1,143 @@
+#ifndef GAME_ENGINE_TEXTURE_STREAMING_H
+#define GAME_ENGINE_TEXTURE_STREAMING_H
+
+#include "CoreLib/Basic.h"
+#include "CoreLib/Threading.h"
+#include "HardwareRenderer.h"
+#include "View.h"
+#include <atomic>
+
+namespace GameEngine
+{
+    class Drawable;
+    class Material;
+    class StreamedTexture;
+
+    // reads the mip levels [Mip, EndMip) of a streamed texture on an I/O thread, the levels finer than those
+    // already resident
+    class MipLoadRequest : public CoreLib::RefObject
+    {
+    public:
+        StreamedTexture * Texture = nullptr;
+        int Mip = 0, EndMip = 0;
+        // data of the levels in the order they are stored in the file, finest first
+        CoreLib::List<unsigned char> Data;
+        CoreLib::List<int> LevelOffsets;
+        bool Failed = false;
+        std::atomic<bool> Completed;
+        MipLoadRequest()
+        {
+            Completed = false;
+        }
+        void Run();
+    };
+
+    // A block compressed texture whose fine mip levels are loaded on demand. The hardware texture holds the
+    // resident levels [ResidentMip, MipLevels) and is replaced whenever the resident levels change, so users
+    // of the texture must rebind it when GetVersion() changes. The resident levels are also kept in memory, so
+    // that only loads of finer levels read the file and evictions build the smaller texture from memory.
+    class StreamedTexture : public CoreLib::RefObject
+    {
+        friend class TextureStreamer;
+        friend class MipLoadRequest;
+    private:
+        CoreLib::String name, fileName;
+        StorageFormat format;
+        int width = 0, height = 0, mipLevels = 0;
+        // file offset of the size prefix of each level, followed by the end offset of the last level
+        CoreLib::List<CoreLib::Int64> mipOffsets;
+        CoreLib::List<int> mipSizes;
+        CoreLib::RefPtr<Texture2D> texture;
+        // the levels [tailMip, mipLevels), loaded with the texture
+        CoreLib::List<unsigned char> tailData;
+        CoreLib::List<int> tailLevelOffsets;
+        // the file data of the streamed levels [residentMip, tailMip), each level preceded by its size
+        CoreLib::List<unsigned char> streamedData;
+        int version = 0;
+        int residentMip = 0, tailMip = 0;
+        // finest level needed by the drawables of lastRequestFrame, and the level the streamer aims at
+        int requestedMip = 0, targetMip = 0;
+        int lastRequestFrame = -1;
+        // set when a load fails, e.g. because the file has changed, the resident levels are then kept
+        bool loadFailed = false;
+        CoreLib::RefPtr<MipLoadRequest> pendingLoad;
+        CoreLib::Int64 GetSize(int mip);
+    public:
+        Texture2D * GetTexture()
+        {
+            return texture.Ptr();
+        }
+        int GetVersion()
+        {
+            return version;
+        }
+        int GetResidentMip()
+        {
+            return residentMip;
+        }
+        int GetMipLevels()
+        {
+            return mipLevels;
+        }
+    };
+
+    // streamed textures bound to the descriptor sets of a material
+    class MaterialTextureBindings
+    {
+    public:
+        struct Binding
+        {
+            int Location;
+            CoreLib::RefPtr<StreamedTexture> Texture;
+            int BoundVersion;
+        };
+        CoreLib::List<Binding> Bindings;
+        int LastUpdateFrame = -1;
+    };
+
+    // Loads the coarse mip levels of textures immediately, and streams the finer levels in and out on I/O
+    // threads depending on the projected size of the drawables using them. The resident levels of all
+    // streamed textures are kept within GraphicsSettings::TextureStreamingBudget, evicting the levels of
+    // the least recently used textures first.
+    class TextureStreamer
+    {
+    private:
+        struct RetiredTexture
+        {
+            CoreLib::RefPtr<Texture2D> Texture;
+            int Frame;
+        };
+        HardwareRenderer * hardwareRenderer;
+        CoreLib::RefPtr<CoreLib::Threading::ThreadPool> ioThreads;
+        CoreLib::Threading::ThreadPool::TaskGroup ioTasks;
+        CoreLib::EnumerableDictionary<CoreLib::String, CoreLib::RefPtr<StreamedTexture>> textures;
+        CoreLib::List<CoreLib::RefPtr<MipLoadRequest>> pendingLoads;
+        // textures replaced by a new residency, kept until the frames using them have completed
+        CoreLib::List<RetiredTexture> retiredTextures;
+        CoreLib::Int64 residentSize = 0;
+        // replaces the hardware texture by one holding the levels [mip, mipLevels). A request holds the levels
+        // [mip, residentMip) when the new levels are finer, coarser levels are taken from the resident data.
+        void SwapTexture(StreamedTexture * texture, int mip, MipLoadRequest * request, int frame);
+        void UpdateTargetMips(int frame);
+    public:
+        TextureStreamer(HardwareRenderer * hw);
+        ~TextureStreamer();
+        // loads the coarse levels of a .texture file. Returns null if the file cannot be streamed, it is then
+        // loaded as a whole by the caller.
+        StreamedTexture * LoadTexture(const CoreLib::String & name, const CoreLib::String & fileName);
+        StreamedTexture * FindTexture(const CoreLib::String & name);
+        // records the mip levels the textures of the drawables need when rendered to a view of screenHeight pixels
+        void RequestMips(CoreLib::ArrayView<Drawable*> drawables, const View & view, int screenHeight);
+        // rebinds the streamed textures of a material whose resident levels have changed
+        void UpdateMaterialBindings(Material * material);
+        // swaps in the completed loads, evicts levels and issues new loads, called once per frame before rendering
+        void Update();
+        void Clear();
+        CoreLib::Int64 GetResidentSize()
+        {
+            return residentSize;
+        }
+    };
+}
+
+#endif
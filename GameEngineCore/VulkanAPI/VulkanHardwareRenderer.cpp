@@ -1509,7 +1509,7 @@ namespace VK
 			
 			// Set up staging buffer and copy data to new image
 			int bufferSize = pwidth * pheight * pdepth * layerCount * dataTypeSize;
-			if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB|| format == StorageFormat::BC5 || format == StorageFormat::BC3 || format == StorageFormat::BC6H)
+			if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB|| format == StorageFormat::BC5 || format == StorageFormat::BC3 || format == StorageFormat::BC6H || format == StorageFormat::RGBA_Compressed)
 			{
 				int blocks = (int)(ceil(pwidth / 4.0f) * ceil(pheight / 4.0f));
 				bufferSize = (format == StorageFormat::BC1||format == StorageFormat::BC1_SRGB) ? blocks * 8 : blocks * 16;
@@ -1665,7 +1665,7 @@ namespace VK
 			CORELIB_UNUSED(bufSize);
 			// Set up staging buffer and copy data to new image
 			int bufferSize = 0;
-			if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB || format == StorageFormat::BC5 || format == StorageFormat::BC3)
+			if (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB || format == StorageFormat::BC5 || format == StorageFormat::BC3 || format == StorageFormat::RGBA_Compressed)
 			{
 				int blocks = (int)(ceil(width / 4.0f) * ceil(height / 4.0f));
 				bufferSize = (format == StorageFormat::BC1 || format == StorageFormat::BC1_SRGB) ? blocks * 8 : blocks * 16;
@@ -4785,6 +4785,11 @@ namespace VK
 			return RendererState::PhysicalDevice().getProperties().deviceName;
 		}
 
+        virtual bool HasDevice() override
+        {
+            return true;
+        }
+
         virtual bool IsImageSpaceYAxisInverted() override
         {
             return true;
@@ -66,6 +66,24 @@ namespace GameEngine
     {
         CoreLib::Diagnostics::Debug::Write(buffer);
     }
+    bool OsApplication::StartProcess(const CoreLib::String & commandLine)
+    {
+        STARTUPINFOW startupInfo;
+        PROCESS_INFORMATION processInfo;
+        ZeroMemory(&startupInfo, sizeof(startupInfo));
+        startupInfo.cb = sizeof(startupInfo);
+        ZeroMemory(&processInfo, sizeof(processInfo));
+        // CreateProcessW may modify the command line buffer
+        int length = 0;
+        auto wcommandLine = commandLine.ToWString(&length);
+        CoreLib::List<wchar_t> cmdLine;
+        cmdLine.AddRange(wcommandLine, length + 1);
+        if (!CreateProcessW(NULL, cmdLine.Buffer(), NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo))
+            return false;
+        CloseHandle(processInfo.hProcess);
+        CloseHandle(processInfo.hThread);
+        return true;
+    }
     GameEngine::DialogResult OsApplication::ShowMessage(CoreLib::String msg, CoreLib::String title, MessageBoxFlags flags)
     {
         return GetWin32MsgBoxResult(MessageBoxW(NULL, msg.ToWString(), title.ToWString(), GetWin32MsgBoxFlags(flags)));
@@ -47,7 +47,7 @@ namespace GameEngine
         vertShader = Engine::GetShaderCompiler()->LoadShaderEntryPoint(GetShaderFileName(), "vs_main");
         fragShader = Engine::GetShaderCompiler()->LoadShaderEntryPoint(GetShaderFileName(), "ps_main");
         SetPipelineStates(fixedFunctionStates);
-		renderPassId = renderer->RegisterWorldRenderPass(GetShaderId());
+		renderPassId = renderer->RegisterWorldRenderPass(this);
 	}
 	WorldRenderPass::~WorldRenderPass()
 	{
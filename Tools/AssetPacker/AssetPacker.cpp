@@ -0,0 +1,98 @@
+#include "CoreLib/Basic.h"
+#include "CoreLib/LibIO.h"
+#include "CoreLib/Archive.h"
+
+using namespace CoreLib;
+using namespace CoreLib::IO;
+
+struct PackerOptions
+{
+	String InputDirectory;
+	String OutputFileName;
+	// extensions of files that are stored uncompressed, e.g. to keep them mappable in place
+	List<String> StoredExtensions;
+};
+
+// Files in a mounted archive take priority over loose files, so files that must stay loose are not packed:
+// the directories the engine writes at runtime (shader and pipeline caches, settings), the cook cache, and
+// shader sources, which the shader compiler reads and imports from the file system itself.
+bool IsLooseFile(const String & relativeDir, const DirectoryEntry & entry)
+{
+	auto name = entry.name.ToLower();
+	if (entry.type == DirectoryEntryType::Directory)
+		return relativeDir.Length() == 0 && (name == "cache" || name == "settings");
+	auto ext = Path::GetFileExt(name);
+	return ext == "pak" || ext == "slang" || (relativeDir.Length() == 0 && name == "cook.cache");
+}
+
+void CollectFiles(const String & dir, const String & relativeDir, List<String> & files)
+{
+	List<DirectoryEntry> entries;
+	for (auto entry : DirectoryIterator(dir))
+		entries.Add(entry);
+	entries.Sort([](const DirectoryEntry & e0, const DirectoryEntry & e1) { return e0.name < e1.name; });
+	for (auto & entry : entries)
+	{
+		if (IsLooseFile(relativeDir, entry))
+			continue;
+		auto relativePath = relativeDir.Length() ? relativeDir + "/" + entry.name : entry.name;
+		if (entry.type == DirectoryEntryType::Directory)
+			CollectFiles(entry.fullPath, relativePath, files);
+		else if (entry.type == DirectoryEntryType::File)
+			files.Add(relativePath);
+	}
+}
+
+int Pack(const PackerOptions & options)
+{
+	List<String> files;
+	CollectFiles(options.InputDirectory, "", files);
+	AssetArchiveWriter writer(options.OutputFileName);
+	Int64 totalSize = 0;
+	for (auto & file : files)
+	{
+		auto data = File::ReadAllBytes(Path::Combine(options.InputDirectory, file));
+		bool allowCompression = options.StoredExtensions.IndexOf(Path::GetFileExt(file).ToLower()) == -1;
+		writer.AddFile(file, data.GetArrayView(), allowCompression);
+		totalSize += data.Count();
+	}
+	writer.Close();
+	RefPtr<FileStream> output = new FileStream(options.OutputFileName);
+	output->Seek(SeekOrigin::End, 0);
+	printf("packed %d files (%.1f MB) into '%s' (%.1f MB).\n", files.Count(), totalSize / 1048576.0,
+		options.OutputFileName.Buffer(), output->GetPosition() / 1048576.0);
+	return 0;
+}
+
+int wmain(int argc, const wchar_t ** argv)
+{
+	if (argc < 2)
+	{
+		printf("Command Format: AssetPacker directory [-o output.pak] [-store ext]...\n");
+		printf("Packs all files in the directory into an archive, which is mounted at the directory of the archive.\n");
+		printf("Shader sources, the cook cache and the Cache and Settings directories are left out, as they must stay loose.\n");
+		printf("  -o      output file name, defaults to directory/content.pak\n");
+		printf("  -store  stores files with the extension uncompressed\n");
+		return 1;
+	}
+	PackerOptions options;
+	options.InputDirectory = String::FromWString(argv[1]);
+	options.OutputFileName = Path::Combine(options.InputDirectory, "content.pak");
+	for (int i = 2; i < argc; i++)
+	{
+		auto arg = String::FromWString(argv[i]);
+		if (arg == "-o" && i + 1 < argc)
+			options.OutputFileName = String::FromWString(argv[++i]);
+		else if (arg == "-store" && i + 1 < argc)
+			options.StoredExtensions.Add(String::FromWString(argv[++i]).ToLower());
+	}
+	try
+	{
+		return Pack(options);
+	}
+	catch (const Exception & e)
+	{
+		printf("error: %s\n", e.Message.Buffer());
+		return 1;
+	}
+}
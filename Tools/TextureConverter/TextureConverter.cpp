@@ -13,9 +13,9 @@ using namespace CoreLib::Imaging;
 using namespace CoreLib::IO;
 using namespace GameEngine;
 
-void ConvertTexture(const String & fileName, TextureStorageFormat format)
+void ConvertTexture(const String & fileName, TextureStorageFormat format, TextureCompressionQuality quality, const MipGenerationOptions & mipOptions)
 {
-	if (format == TextureStorageFormat::BC1 || format == TextureStorageFormat::BC5 || format == TextureStorageFormat::BC3)
+	if (format == TextureStorageFormat::BC1 || format == TextureStorageFormat::BC5 || format == TextureStorageFormat::BC3 || format == TextureStorageFormat::BC7)
 	{
 		Bitmap bmp(fileName);
 		List<unsigned int> pixelsInversed;
@@ -28,11 +28,33 @@ void ConvertTexture(const String & fileName, TextureStorageFormat format)
 		}
 		CoreLib::Graphics::TextureFile texFile;
 		if (format == TextureStorageFormat::BC1)
-			TextureCompressor::CompressRGBA_BC1(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight());
+			TextureCompressor::CompressRGBA_BC1(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight(), quality, mipOptions);
+		else if (format == TextureStorageFormat::BC7)
+			TextureCompressor::CompressRGBA_BC7(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight(),
+				quality == TextureCompressionQuality::Fast ? BC7Quality::Fast : BC7Quality::High, mipOptions);
 		else if (format == TextureStorageFormat::BC3)
-			TextureCompressor::CompressRGBA_BC3(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight());
+			TextureCompressor::CompressRGBA_BC3(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight(), quality, mipOptions);
 		else
-			TextureCompressor::CompressRG_BC5(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight());
+			TextureCompressor::CompressRG_BC5(texFile, MakeArrayView((unsigned char*)pixelsInversed.Buffer(), pixelsInversed.Count() * 4), bmp.GetWidth(), bmp.GetHeight(), quality, mipOptions);
+		texFile.SaveToFile(Path::ReplaceExt(fileName, "texture"));
+	}
+	else if (format == TextureStorageFormat::BC6H)
+	{
+		BitmapF bmp(fileName);
+		List<float> pixelsInversed;
+		auto sourcePixels = bmp.GetPixels();
+		pixelsInversed.SetSize(bmp.GetWidth() * bmp.GetHeight() * 3);
+		for (int i = 0; i < bmp.GetHeight(); i++)
+		{
+			for (int j = 0; j < bmp.GetWidth(); j++)
+			{
+				auto pixel = sourcePixels[(bmp.GetHeight() - 1 - i)*bmp.GetWidth() + j];
+				for (int c = 0; c < 3; c++)
+					pixelsInversed[(i*bmp.GetWidth() + j) * 3 + c] = pixel[c];
+			}
+		}
+		CoreLib::Graphics::TextureFile texFile;
+		TextureCompressor::CompressRGB_BC6H(texFile, pixelsInversed.GetArrayView(), bmp.GetWidth(), bmp.GetHeight(), BC6HQuality::High);
 		texFile.SaveToFile(Path::ReplaceExt(fileName, "texture"));
 	}
 	else
@@ -80,6 +102,9 @@ int wmain(int argc, const wchar_t ** argv)
 		TextureStorageFormat format = TextureStorageFormat::BC1;
 		String fileName = String::FromWString(argv[1]);
 		bool colorLookup = false;
+		TextureCompressionQuality quality = TextureCompressionQuality::High;
+		MipGenerationOptions mipOptions;
+		bool linear = false, normalMap = false;
 		for (int i = 0; i < argc; i++)
 		{
 			if (String::FromWString(argv[i]) == "-bc1")
@@ -88,6 +113,10 @@ int wmain(int argc, const wchar_t ** argv)
 				format = TextureStorageFormat::BC5;
 			if (String::FromWString(argv[i]) == "-bc3")
 				format = TextureStorageFormat::BC3;
+			if (String::FromWString(argv[i]) == "-bc7")
+				format = TextureStorageFormat::BC7;
+			if (String::FromWString(argv[i]) == "-bc6h")
+				format = TextureStorageFormat::BC6H;
 			if (String::FromWString(argv[i]) == "-r8")
 				format = TextureStorageFormat::R8;
 			if (String::FromWString(argv[i]) == "-rg8")
@@ -100,16 +129,38 @@ int wmain(int argc, const wchar_t ** argv)
 				format = TextureStorageFormat::RGBA_F32;
 			if (String::FromWString(argv[i]) == "-colorlu")
 				colorLookup = true;
+			if (String::FromWString(argv[i]) == "-fast")
+				quality = TextureCompressionQuality::Fast;
+			if (String::FromWString(argv[i]) == "-box")
+				mipOptions.Filter = MipFilter::Box;
+			if (String::FromWString(argv[i]) == "-lanczos")
+				mipOptions.Filter = MipFilter::Lanczos;
+			if (String::FromWString(argv[i]) == "-linear")
+				linear = true;
+			if (String::FromWString(argv[i]) == "-normalmap")
+				normalMap = true;
+			if (String::FromWString(argv[i]) == "-cutout")
+				mipOptions.PreserveAlphaCoverage = true;
 		}
+		if (normalMap)
+			mipOptions.Content = MipContent::NormalMap;
+		else if (linear || format == TextureStorageFormat::BC5)
+			mipOptions.Content = MipContent::Linear;
 		if (colorLookup)
 			CreateColorLookupTexture(fileName);
 		else
-			ConvertTexture(fileName, format);
+			ConvertTexture(fileName, format, quality, mipOptions);
 	}
 	else
 	{
 		printf("Command Format: TextureConverter file_name -format\n");
-		printf("Supported formats: bc1, bc5, r8, rg8, rgb8, rgba8, rgba32f, colorlu (require %d x %d image)\n", colorLookupImageSize*colorLookupImageSize, colorLookupImageSize);
+		printf("Supported formats: bc1, bc3, bc5, bc6h, bc7, r8, rg8, rgb8, rgba8, rgba32f, colorlu (require %d x %d image)\n", colorLookupImageSize*colorLookupImageSize, colorLookupImageSize);
+		printf("Option -fast uses a faster, lower quality encoder for bc1, bc3, bc5 and bc7.\n");
+		printf("Mips of block compressed formats are filtered in linear space with a Kaiser filter, options:\n");
+		printf("  -box, -lanczos: use a box or Lanczos filter instead\n");
+		printf("  -linear: the image holds linear data instead of sRGB colors, the default for bc5\n");
+		printf("  -normalmap: the image holds normals, which are renormalized in every level\n");
+		printf("  -cutout: preserves the alpha test coverage of the image in every level\n");
 	}
     return 0;
 }
@@ -3,6 +3,7 @@
 #include "Mesh.h"
 #include "CoreLib/Imaging/Bitmap.h"
 #include "CoreLib/LibIO.h"
+#include "CoreLib/Threading.h"
 
 using namespace CoreLib;
 using namespace GameEngine;
@@ -107,7 +108,8 @@ int main(int argc, const char ** argv)
     Mesh mIn;
     Mesh mOut;
     mIn.LoadFromFile(argv[1]);
-    GenerateLightmapUV(&mOut, &mIn, 1024, 4);
+    CoreLib::Threading::ThreadPool threadPool;
+    GenerateLightmapUV(&mOut, &mIn, 1024, 4, &threadPool);
     mOut.SaveToFile(CoreLib::IO::Path::ReplaceExt(argv[1], ".out.mesh"));
     VisualizeUV(mOut, 1, String(argv[1]) + ".out.bmp");
     return 0;
@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../CoreLib/Basic.h"
+#include "CoreLib/LibIO.h"
+#include "CoreLib/Archive.h"
+#include "CoreLib/Compression.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace CoreLib;
+using namespace CoreLib::IO;
+
+namespace UnitTest
+{
+    TEST_CLASS(ArchiveTest)
+    {
+    public:
+        TEST_METHOD(CompressionRoundTrip)
+        {
+            List<unsigned char> data;
+            for (int i = 0; i < 100000; i++)
+                data.Add((unsigned char)((i % 1000) < 500 ? i % 7 : (i * 2654435761u) >> 24));
+            auto compressed = CompressBlock(data.GetArrayView());
+            Assert::IsTrue(compressed.Count() < data.Count());
+            List<unsigned char> decompressed;
+            decompressed.SetSize(data.Count());
+            DecompressBlock(compressed.GetArrayView(), decompressed.GetArrayView());
+            Assert::IsTrue(memcmp(data.Buffer(), decompressed.Buffer(), data.Count()) == 0);
+            decompressed.SetSize(data.Count() - 1);
+            bool thrown = false;
+            try
+            {
+                DecompressBlock(compressed.GetArrayView(), decompressed.GetArrayView());
+            }
+            catch (const IOException &)
+            {
+                thrown = true;
+            }
+            Assert::IsTrue(thrown);
+            // an empty block round trips, and a length that runs past the output is rejected
+            auto emptyCompressed = CompressBlock(ArrayView<unsigned char>());
+            DecompressBlock(emptyCompressed.GetArrayView(), ArrayView<unsigned char>());
+            List<unsigned char> corrupted;
+            corrupted.Add(0xF0);
+            for (int i = 0; i < 100000; i++)
+                corrupted.Add(255);
+            thrown = false;
+            try
+            {
+                DecompressBlock(corrupted.GetArrayView(), decompressed.GetArrayView());
+            }
+            catch (const IOException &)
+            {
+                thrown = true;
+            }
+            Assert::IsTrue(thrown);
+        }
+
+        TEST_METHOD(ReadFromMountedArchive)
+        {
+            String text = "mounted archives are searched before the file system";
+            List<unsigned char> zeros;
+            zeros.SetSize(4096);
+            for (auto & b : zeros)
+                b = 0;
+            {
+                AssetArchiveWriter writer("ArchiveTest.pak");
+                writer.AddFile("Settings/test.txt", MakeArrayView((unsigned char*)text.Buffer(), text.Length()));
+                writer.AddFile("Meshes/zeros.bin", zeros.GetArrayView());
+                writer.Close();
+            }
+            AssetArchive::Mount(new AssetArchive("ArchiveTest.pak", "ArchiveRoot"));
+            Assert::IsTrue(File::Exists("ArchiveRoot/Settings/test.txt"));
+            Assert::IsTrue(File::Exists("ArchiveRoot/Meshes/../Settings/./test.txt"));
+            Assert::IsFalse(File::Exists("ArchiveRoot/Settings/missing.txt"));
+            Assert::IsTrue(File::ReadAllText("ArchiveRoot/Settings/test.txt") == text);
+            auto bytes = File::ReadAllBytes("ArchiveRoot/Meshes/zeros.bin");
+            Assert::IsTrue(bytes.Count() == zeros.Count() && memcmp(bytes.Buffer(), zeros.Buffer(), zeros.Count()) == 0);
+            AssetArchive::UnmountAll();
+            Assert::IsFalse(File::Exists("ArchiveRoot/Settings/test.txt"));
+        }
+    };
+}
@@ -0,0 +1,113 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../CoreLib/Basic.h"
+#include "../CoreLib/LibIO.h"
+#include "../GameEngineCore/PipelineContext.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace CoreLib;
+using namespace GameEngine;
+
+namespace UnitTest
+{
+    TEST_CLASS(PipelineContextTest)
+    {
+    public:
+        TEST_METHOD(MaterialModuleWithPendingPipelines)
+        {
+            ShaderEntryPoint vs, fs;
+            vs.Id = 1;
+            fs.Id = 2;
+            FixedFunctionPipelineStates states;
+            ModuleInstance materialX, materialY, transform;
+            materialX.ModuleId = 10;
+            materialY.ModuleId = 11;
+            transform.ModuleId = 20;
+            auto expectedKey = [&](ModuleInstance * material)
+            {
+                PipelineContext context;
+                context.BindEntryPoint(&vs, &fs, nullptr, &states);
+                context.PushModuleInstance(material);
+                context.PushModuleInstanceNoShaderChange(&transform);
+                return context.BuildShaderKey(0, PrimitiveType::Triangles);
+            };
+            PipelineContext context;
+            context.BindEntryPoint(&vs, &fs, nullptr, &states);
+            // draws in recording order, with whether their pipeline is ready
+            struct Draw
+            {
+                ModuleInstance * Material;
+                bool Ready;
+            } draws[] = {
+                { &materialX, false },
+                { &materialY, false },
+                { &materialX, true },
+                { &materialY, false },
+                { &materialY, true },
+                { &materialY, true },
+                { &materialX, false },
+                { &materialY, true },
+            };
+            MaterialModuleState materialModule(context, &materialX, CullMode::CullBackFace);
+            ModuleInstance * bound = &materialX;
+            for (auto & draw : draws)
+            {
+                bool changed = materialModule.Select(draw.Material, CullMode::CullBackFace);
+                Assert::AreEqual(draw.Material != bound, changed);
+                context.PushModuleInstanceNoShaderChange(&transform);
+                Assert::IsTrue(context.BuildShaderKey(0, PrimitiveType::Triangles) == expectedKey(draw.Material));
+                if (draw.Ready)
+                {
+                    if (changed)
+                        materialModule.SetBound();
+                    bound = draw.Material;
+                }
+                Assert::IsTrue(materialModule.GetBoundModule() == bound);
+                context.PopModuleInstance();
+            }
+            materialModule.End();
+        }
+        TEST_METHOD(PipelineManifestPerLevel)
+        {
+            auto makeRecord = [](const char * function)
+            {
+                PipelineRecord record;
+                record.FragmentShaderFile = "Forward.slang";
+                record.FragmentShaderFunction = function;
+                record.ModuleFiles.Add("Material.slang");
+                record.ModuleTypes.Add("Material");
+                return record;
+            };
+            String fileName = "PipelineManifestTest.manifest";
+            PipelineManifest manifest;
+            manifest.LoadFromFile(fileName);
+            manifest.SetLevel("a.level");
+            manifest.Add(makeRecord("fsA"));
+            manifest.Add(makeRecord("fsShared"));
+            manifest.SetLevel("b.level");
+            manifest.Add(makeRecord("fsB"));
+            manifest.Add(makeRecord("fsShared"));
+            manifest.SaveToFile(fileName);
+
+            PipelineManifest loaded;
+            loaded.LoadFromFile(fileName);
+            loaded.SetLevel("a.level");
+            auto records = loaded.GetRecords();
+            Assert::AreEqual(2, records.Count());
+            Assert::IsTrue(records[0].GetKey() == makeRecord("fsA").GetKey() || records[1].GetKey() == makeRecord("fsA").GetKey());
+            // records not used for MaxUnusedSessions sessions of a level are dropped
+            loaded.Add(makeRecord("fsShared"));
+            for (int i = 0; i < PipelineManifest::MaxUnusedSessions; i++)
+            {
+                loaded.SetLevel("a.level");
+                loaded.Add(makeRecord("fsShared"));
+            }
+            records = loaded.GetRecords();
+            Assert::AreEqual(1, records.Count());
+            Assert::IsTrue(records[0].GetKey() == makeRecord("fsShared").GetKey());
+            // other levels keep their records
+            loaded.SetLevel("b.level");
+            Assert::AreEqual(2, loaded.GetRecords().Count());
+            IO::File::Delete(fileName);
+        }
+    };
+}
@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../CoreLib/Basic.h"
+#include "CoreLib/Threading.h"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace CoreLib;
+using namespace CoreLib::Threading;
+
+namespace UnitTest
+{
+    TEST_CLASS(ThreadPoolTest)
+    {
+    public:
+        TEST_METHOD(ParallelForSum)
+        {
+            ThreadPool pool(4);
+            List<int> values;
+            values.SetSize(100000);
+            pool.ParallelFor(0, values.Count(), 1000, [&](int i)
+            {
+                values[i] = i;
+            });
+            long long sum = 0;
+            for (auto v : values)
+                sum += v;
+            Assert::IsTrue(sum == (long long)values.Count() * (values.Count() - 1) / 2);
+        }
+
+        TEST_METHOD(NestedTasks)
+        {
+            ThreadPool pool(4);
+            std::atomic<int> leafCount;
+            leafCount = 0;
+            Func<void, int> spawn;
+            spawn = [&](int depth)
+            {
+                if (depth == 0)
+                {
+                    leafCount++;
+                    return;
+                }
+                ThreadPool::TaskGroup group;
+                pool.Submit(group, [&, depth]() { spawn(depth - 1); });
+                pool.Submit(group, [&, depth]() { spawn(depth - 1); });
+                pool.Wait(group);
+            };
+            ThreadPool::TaskGroup root;
+            pool.Submit(root, [&]() { spawn(10); });
+            pool.Wait(root);
+            Assert::AreEqual(1024, leafCount.load());
+        }
+
+        TEST_METHOD(TaskException)
+        {
+            ThreadPool pool(4);
+            std::atomic<int> completedCount;
+            completedCount = 0;
+            bool caught = false;
+            try
+            {
+                pool.ParallelFor(0, 1000, 1, [&](int i)
+                {
+                    if (i == 500)
+                        throw InvalidOperationException("task failed");
+                    completedCount++;
+                });
+            }
+            catch (const InvalidOperationException &)
+            {
+                caught = true;
+            }
+            Assert::IsTrue(caught);
+            // the pool is still usable after a task has thrown
+            ThreadPool::TaskGroup group;
+            pool.Submit(group, [&]() { completedCount++; });
+            pool.Wait(group);
+            Assert::IsTrue(completedCount.load() >= 1);
+        }
+    };
+}